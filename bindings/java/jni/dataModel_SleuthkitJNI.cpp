@@ -45,6 +45,9 @@ typedef struct {
 //stack-allocated buffer size for read method
 #define FIXED_BUF_SIZE (16 * 1024)
 
+//number of metadata structures to cache per open file system
+#define TSK_JNI_META_CACHE_SIZE 1024
+
 /**
 * Sets flag to throw an TskCoreException back up to the Java code with a specific message.
 * Note: exception is thrown to Java code after the native function returns
@@ -1401,6 +1404,13 @@ JNIEXPORT jlong JNICALL Java_org_sleuthkit_datamodel_SleuthkitJNI_openFsNat
         TSK_FS_TYPE_DETECT);
     if (fs_info == NULL) {
         setThrowTskCoreError(env, tsk_error_get());
+        return 0;
+    }
+
+    // The same files get opened by address over and over again by
+    // openFileNat, so keep their metadata around.
+    if (tsk_fs_meta_cache_set_size(fs_info, TSK_JNI_META_CACHE_SIZE)) {
+        tsk_error_reset();
     }
     return (jlong) fs_info;
 }
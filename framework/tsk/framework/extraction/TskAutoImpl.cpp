@@ -402,6 +402,14 @@ TSK_RETVAL_ENUM TSKAutoImpl::processAttribute(TSK_FS_FILE * a_fsFile,
     {
         TSK_FS_ATTR_RUN *run;
         int count = 0;
+
+        // the file system may not have loaded all of the runs yet
+        if (tsk_fs_attr_resolve(a_fsAttr))
+        {
+            registerError();
+            return TSK_OK;
+        }
+
         for (run = a_fsAttr->nrd.run; run != NULL; run = run->next)
         {
             // ignore sparse blocks
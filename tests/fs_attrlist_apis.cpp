@@ -303,6 +303,108 @@ test_ntfs_fe()
     return 0;
 }
 
+/* State of the tsk_fs_meta_walk_content() test */
+typedef struct {
+    int resident;               // number of files that had resident content
+    int failed;
+} RESIDENT_TEST;
+
+/* Compare the resident content from the walk with what
+ * tsk_fs_file_read() returns for the same file */
+static TSK_WALK_RET_ENUM
+test_resident_act(TSK_FS_FILE * a_fs_file, const TSK_FS_ATTR * a_fs_attr,
+    const char *a_buf, size_t a_len, void *a_ptr)
+{
+    RESIDENT_TEST *test = (RESIDENT_TEST *) a_ptr;
+    TSK_FS_FILE *fs_file;
+    char buf[4096];
+    ssize_t cnt;
+
+    if (a_buf == NULL)
+        return TSK_WALK_CONT;
+
+    if ((a_fs_attr == NULL) || ((a_fs_attr->flags & TSK_FS_ATTR_RES) == 0)
+        || ((TSK_OFF_T) a_len != a_fs_attr->size)) {
+        fprintf(stderr,
+            "Resident content of %" PRIuINUM
+            " does not match its attribute\n", a_fs_file->meta->addr);
+        test->failed = 1;
+        return TSK_WALK_STOP;
+    }
+
+    fs_file = tsk_fs_file_open_meta(a_fs_file->fs_info, NULL,
+        a_fs_file->meta->addr);
+    if (!fs_file) {
+        fprintf(stderr, "Error opening file %" PRIuINUM " via meta\n",
+            a_fs_file->meta->addr);
+        tsk_error_print(stderr);
+        test->failed = 1;
+        return TSK_WALK_STOP;
+    }
+
+    cnt = tsk_fs_file_read(fs_file, 0, buf, sizeof(buf),
+        TSK_FS_FILE_READ_FLAG_NONE);
+    if ((cnt < 0) || ((size_t) cnt != a_len)
+        || (memcmp(buf, a_buf, a_len))) {
+        fprintf(stderr,
+            "Resident content of %" PRIuINUM
+            " differs from tsk_fs_file_read (%d vs %d bytes)\n",
+            a_fs_file->meta->addr, (int) a_len, (int) cnt);
+        test->failed = 1;
+        tsk_fs_file_close(fs_file);
+        return TSK_WALK_STOP;
+    }
+
+    tsk_fs_file_close(fs_file);
+    test->resident++;
+    return TSK_WALK_CONT;
+}
+
+/* Verify that tsk_fs_meta_walk_content() gives the content of small
+ * NTFS files */
+static int
+test_ntfs_resident()
+{
+    TSK_FS_INFO *fs;
+    TSK_IMG_INFO *img;
+    const char *tname = "fe_test_1-NTFS-resident";
+    char fname[512];
+    RESIDENT_TEST test;
+
+    snprintf(fname, 512, "%s/fe_test_1.img", s_root);
+    if ((img = tsk_img_open_sing((const TSK_TCHAR *)fname, (TSK_IMG_TYPE_ENUM) 0, 0)) == NULL) {
+        fprintf(stderr, "Error opening %s image\n", tname);
+        tsk_error_print(stderr);
+        return 1;
+    }
+
+    if ((fs = tsk_fs_open_img(img, 32256, (TSK_FS_TYPE_ENUM) 0)) == NULL) {
+        fprintf(stderr, "Error opening %s image\n", tname);
+        tsk_error_print(stderr);
+        return 1;
+    }
+
+    memset(&test, 0, sizeof(test));
+    if (tsk_fs_meta_walk_content(fs, fs->first_inum, fs->last_inum,
+            TSK_FS_META_FLAG_ALLOC, test_resident_act, &test)) {
+        fprintf(stderr, "Error walking %s\n", tname);
+        tsk_error_print(stderr);
+        return 1;
+    }
+    if (test.failed) {
+        fprintf(stderr, "%s failure\n", tname);
+        return 1;
+    }
+    if (test.resident == 0) {
+        fprintf(stderr, "%s failure: no resident files found\n", tname);
+        return 1;
+    }
+
+    tsk_fs_close(fs);
+    tsk_img_close(img);
+    return 0;
+}
+
 
 
 int
@@ -318,6 +420,8 @@ main(int argc, char **argv)
         return 1;
     if (test_ntfs_fe())
         return 1;
+    if (test_ntfs_resident())
+        return 1;
 
     printf("Tests Passed\n");
     return 0;
@@ -22,8 +22,10 @@ usage()
 {
     TFPRINTF(stderr,
         _TSK_T
-        ("usage: %s [-tvV] [-f fstype] [-i imgtype] [-b dev_sector_size] [-o imgoffset] image\n"),
+        ("usage: %s [-ctvV] [-f fstype] [-i imgtype] [-b dev_sector_size] [-o imgoffset] image\n"),
         progname);
+    tsk_fprintf(stderr,
+        "\t-c: verify the file system metadata checksums (ext4)\n");
     tsk_fprintf(stderr, "\t-t: display type only\n");
     tsk_fprintf(stderr,
         "\t-i imgtype: The format of the image file (use '-i list' for supported types)\n");
@@ -52,6 +54,7 @@ main(int argc, char **argv1)
 
     int ch;
     uint8_t type = 0;
+    uint8_t check = 0;
     TSK_TCHAR **argv;
     unsigned int ssize = 0;
     TSK_TCHAR *cp;
@@ -70,7 +73,7 @@ main(int argc, char **argv1)
     progname = argv[0];
     setlocale(LC_ALL, "");
 
-    while ((ch = GETOPT(argc, argv, _TSK_T("b:f:i:o:tvV"))) > 0) {
+    while ((ch = GETOPT(argc, argv, _TSK_T("b:cf:i:o:tvV"))) > 0) {
         switch (ch) {
         case _TSK_T('?'):
         default:
@@ -120,6 +123,9 @@ main(int argc, char **argv1)
             }
             break;
 
+        case _TSK_T('c'):
+            check = 1;
+            break;
         case _TSK_T('t'):
             type = 1;
             break;
@@ -164,6 +170,14 @@ main(int argc, char **argv1)
     if (type) {
         tsk_printf("%s\n", tsk_fs_type_toname(fs->ftype));
     }
+    else if (check) {
+        if (fs->fscheck(fs, stdout)) {
+            tsk_error_print(stderr);
+            fs->close(fs);
+            img->close(img);
+            exit(1);
+        }
+    }
     else {
         if (fs->fsstat(fs, stdout)) {
             tsk_error_print(stderr);
@@ -20,7 +20,7 @@ usage()
 {
     TFPRINTF(stderr,
         _TSK_T
-        ("usage: %s [-f fstype] [-i imgtype] [-b dev_sector_size] [-o imgoffset] [-vV] image [inode]\n"),
+        ("usage: %s [-f fstype] [-i imgtype] [-b dev_sector_size] [-o imgoffset] [-B fs_blk] [-vV] image [inode]\n"),
         progname);
     tsk_fprintf(stderr,
         "\t-i imgtype: The format of the image file (use '-i list' for supported types)\n");
@@ -30,12 +30,27 @@ usage()
         "\t-f fstype: File system type (use '-f list' for supported types)\n");
     tsk_fprintf(stderr,
         "\t-o imgoffset: The offset of the file system in the image (in sectors)\n");
+    tsk_fprintf(stderr,
+        "\t-B fs_blk: Only list the journal copies of the file system block (can be given more than once)\n");
     tsk_fprintf(stderr, "\t-v: verbose output to stderr\n");
     tsk_fprintf(stderr, "\t-V: print version\n");
     exit(1);
 }
 
 
+/* Print one journal copy of a file system block */
+static TSK_WALK_RET_ENUM
+print_jentry_act(TSK_FS_INFO * fs, TSK_FS_JENTRY * a_jentry, int a_num,
+    void *a_ptr)
+{
+    tsk_printf("%" PRIuDADDR ":\t%sFS Block %" PRIuDADDR " (seq: %"
+        PRIu64 ")\n", a_jentry->jblk,
+        (a_jentry->flags & TSK_FS_JENTRY_FLAG_UNALLOC) ? "Unallocated " :
+        "Allocated ", a_jentry->fsblk, a_jentry->seq);
+    return TSK_WALK_CONT;
+}
+
+
 int
 main(int argc, char **argv1)
 {
@@ -51,6 +66,9 @@ main(int argc, char **argv1)
     TSK_TCHAR **argv;
     unsigned int ssize = 0;
     TSK_TCHAR *cp;
+    TSK_DADDR_T *fsblks = NULL;
+    size_t fsblk_cnt = 0;
+    size_t i;
 
 #ifdef TSK_WIN32
     // On Windows, get the wide arguments (mingw doesn't support wmain)
@@ -66,7 +84,7 @@ main(int argc, char **argv1)
     progname = argv[0];
     setlocale(LC_ALL, "");
 
-    while ((ch = GETOPT(argc, argv, _TSK_T("b:f:i:o:vV"))) > 0) {
+    while ((ch = GETOPT(argc, argv, _TSK_T("b:B:f:i:o:vV"))) > 0) {
         switch (ch) {
         case _TSK_T('?'):
         default:
@@ -83,6 +101,27 @@ main(int argc, char **argv1)
                 usage();
             }
             break;
+        case _TSK_T('B'):
+            {
+                TSK_DADDR_T addr = TSTRTOULL(OPTARG, &cp, 0);
+                TSK_DADDR_T *tmp;
+
+                if (*cp || *cp == *OPTARG) {
+                    TFPRINTF(stderr,
+                        _TSK_T("invalid argument: FS block: %s\n"),
+                        OPTARG);
+                    usage();
+                }
+                if ((tmp = (TSK_DADDR_T *) tsk_realloc(fsblks,
+                            (fsblk_cnt + 1) * sizeof(TSK_DADDR_T))) ==
+                    NULL) {
+                    tsk_error_print(stderr);
+                    exit(1);
+                }
+                fsblks = tmp;
+                fsblks[fsblk_cnt++] = addr;
+            }
+            break;
         case _TSK_T('f'):
             if (TSTRCMP(OPTARG, _TSK_T("list")) == 0) {
                 tsk_fs_type_print(stderr);
@@ -140,12 +179,14 @@ main(int argc, char **argv1)
                 tsk_img_open(argc - OPTIND, &argv[OPTIND],
                     imgtype, ssize)) == NULL) {
             tsk_error_print(stderr);
+            free(fsblks);
             exit(1);
         }
         if ((imgaddr * img->sector_size) >= img->size) {
             tsk_fprintf(stderr,
                 "Sector offset supplied is larger than disk image (maximum: %"
                 PRIu64 ")\n", img->size / img->sector_size);
+            free(fsblks);
             exit(1);
         }
 
@@ -154,6 +195,7 @@ main(int argc, char **argv1)
             if (tsk_error_get_errno() == TSK_ERR_FS_UNSUPTYPE)
                 tsk_fs_type_print(stderr);
             img->close(img);
+            free(fsblks);
             exit(1);
         }
         inum = fs->journ_inum;
@@ -163,6 +205,7 @@ main(int argc, char **argv1)
                 tsk_img_open(argc - OPTIND - 1, &argv[OPTIND],
                     imgtype, ssize)) == NULL) {
             tsk_error_print(stderr);
+            free(fsblks);
             exit(1);
         }
         if ((fs = tsk_fs_open_img(img, imgaddr * img->sector_size, fstype)) == NULL) {
@@ -170,6 +213,7 @@ main(int argc, char **argv1)
             if (tsk_error_get_errno() == TSK_ERR_FS_UNSUPTYPE)
                 tsk_fs_type_print(stderr);
             img->close(img);
+            free(fsblks);
             exit(1);
         }
     }
@@ -179,6 +223,7 @@ main(int argc, char **argv1)
             "Journal support does not exist for this file system\n");
         fs->close(fs);
         img->close(img);
+        free(fsblks);
         exit(1);
     }
 
@@ -188,6 +233,7 @@ main(int argc, char **argv1)
             fs->last_inum);
         fs->close(fs);
         img->close(img);
+        free(fsblks);
         exit(1);
     }
 
@@ -198,6 +244,7 @@ main(int argc, char **argv1)
             fs->first_inum);
         fs->close(fs);
         img->close(img);
+        free(fsblks);
         exit(1);
     }
 
@@ -205,15 +252,40 @@ main(int argc, char **argv1)
         tsk_error_print(stderr);
         fs->close(fs);
         img->close(img);
+        free(fsblks);
         exit(1);
     }
-    if (fs->jentry_walk(fs, 0, 0, NULL)) {
+
+    if (fsblk_cnt) {
+        if (fs->jentry_find == NULL) {
+            tsk_fprintf(stderr,
+                "Searching the journal by block is not supported for this file system\n");
+            fs->close(fs);
+            img->close(img);
+            free(fsblks);
+            exit(1);
+        }
+
+        tsk_printf("JBlk\tDescription\n");
+        for (i = 0; i < fsblk_cnt; i++) {
+            if (fs->jentry_find(fs, fsblks[i], print_jentry_act, NULL)) {
+                tsk_error_print(stderr);
+                fs->close(fs);
+                img->close(img);
+                free(fsblks);
+                exit(1);
+            }
+        }
+    }
+    else if (fs->jentry_walk(fs, 0, 0, NULL)) {
         tsk_error_print(stderr);
         fs->close(fs);
         img->close(img);
+        free(fsblks);
         exit(1);
     }
 
+    free(fsblks);
     fs->close(fs);
     img->close(img);
     exit(0);
@@ -76,6 +76,7 @@ void
     TskAuto::closeImage();
     m_NSRLDb = NULL;
     m_knownBadDb = NULL;
+    m_residentMd5.clear();
 }
 
 
@@ -319,6 +320,9 @@ TskAutoDb::filterFs(TSK_FS_INFO * fs_info)
     }
 
 
+    if (m_fileHashFlag)
+        md5HashResident(fs_info);
+
     // We won't hit the root directory on the walk, so open it now 
     if ((file_root = tsk_fs_file_open(fs_info, NULL, "/")) != NULL) {
         processFile(file_root, "");
@@ -749,7 +753,18 @@ TskAutoDb::processAttribute(TSK_FS_FILE * fs_file,
         TSK_DB_FILES_KNOWN_ENUM file_known = TSK_DB_FILES_KNOWN_UNKNOWN;
 
         if (m_fileHashFlag && isFile(fs_file)) {
-            if (md5HashAttr(hash, fs_attr)) {
+            std::map<TSK_INUM_T, RESIDENT_MD5>::iterator it =
+                m_residentMd5.end();
+
+            // resident files were hashed by md5HashResident()
+            if ((fs_attr->flags & TSK_FS_ATTR_RES) && (fs_file->meta))
+                it = m_residentMd5.find(fs_file->meta->addr);
+
+            if ((it != m_residentMd5.end())
+                && (it->second.attrId == fs_attr->id)) {
+                memcpy(hash, it->second.md5, 16);
+            }
+            else if (md5HashAttr(hash, fs_attr)) {
                 // error was registered
                 return TSK_OK;
             }
@@ -792,6 +807,12 @@ TskAutoDb::processAttribute(TSK_FS_FILE * fs_file,
             TSK_FS_ATTR_RUN *run;
             int sequence = 0;
 
+            // the file system may not have loaded all of the runs yet
+            if (tsk_fs_attr_resolve(fs_attr)) {
+                registerError();
+                return TSK_OK;
+            }
+
             for (run = fs_attr->nrd.run; run != NULL; run = run->next) {
                 unsigned int block_size = fs_file->fs_info->block_size;
 
@@ -845,6 +866,18 @@ TskAutoDb::md5HashAttr(unsigned char md5Hash[16], const TSK_FS_ATTR * fs_attr)
 
     TSK_MD5_Init(&md);
 
+    // resident content is already in memory; hash it in place
+    if ((fs_attr->flags & TSK_FS_ATTR_RES)
+        && ((fs_attr->flags & TSK_FS_ATTR_COMP) == 0)
+        && (fs_attr->rd.buf != NULL)
+        && ((size_t) fs_attr->size <= fs_attr->rd.buf_size)) {
+        if (fs_attr->size > 0)
+            TSK_MD5_Update(&md, fs_attr->rd.buf,
+                (unsigned int) fs_attr->size);
+        TSK_MD5_Final(md5Hash, &md);
+        return 0;
+    }
+
     if (tsk_fs_attr_walk(fs_attr, TSK_FS_FILE_WALK_FLAG_NONE,
             md5HashCallback, (void *) &md)) {
         registerError();
@@ -856,10 +889,63 @@ TskAutoDb::md5HashAttr(unsigned char md5Hash[16], const TSK_FS_ATTR * fs_attr)
 }
 
 /**
-* Callback invoked per every unallocated block in the filesystem
+ * Helper for md5HashResident
+ */
+TSK_WALK_RET_ENUM
+TskAutoDb::md5ResidentCallback(TSK_FS_FILE * fs_file,
+    const TSK_FS_ATTR * fs_attr, const char *buf, size_t len, void *ptr)
+{
+    TskAutoDb *tskAutoDb = (TskAutoDb *) ptr;
+    TSK_MD5_CTX md;
+
+    if (tskAutoDb->m_stopped)
+        return TSK_WALK_STOP;
+
+    // non-resident files are hashed when the directories are walked
+    if (buf == NULL)
+        return TSK_WALK_CONT;
+
+    RESIDENT_MD5 & entry = tskAutoDb->m_residentMd5[fs_file->meta->addr];
+    entry.attrId = fs_attr->id;
+    TSK_MD5_Init(&md);
+    if (len > 0)
+        TSK_MD5_Update(&md, (unsigned char *) buf, (unsigned int) len);
+    TSK_MD5_Final(entry.md5, &md);
+
+    return TSK_WALK_CONT;
+}
+
+/**
+ * Hash the files of a file system whose content is stored in their
+ * metadata (small NTFS files) with one pass over the metadata.  The
+ * hashes are used by processAttribute() so that these files do not each
+ * have to be read as the directories are walked.  Errors are registered
+ * and the files are then hashed as they are found.
+ * @param fs_info File system to hash the resident files of
+ */
+void
+TskAutoDb::md5HashResident(TSK_FS_INFO * fs_info)
+{
+    m_residentMd5.clear();
+
+    // only NTFS stores file content in the metadata
+    if (TSK_FS_TYPE_ISNTFS(fs_info->ftype) == 0)
+        return;
+
+    if (tsk_fs_meta_walk_content(fs_info, fs_info->first_inum,
+            fs_info->last_inum, (TSK_FS_META_FLAG_ENUM)
+            (TSK_FS_META_FLAG_ALLOC | TSK_FS_META_FLAG_UNALLOC),
+            md5ResidentCallback, this)) {
+        registerError();
+        m_residentMd5.clear();
+    }
+}
+
+/**
+* Callback invoked per every run of unallocated blocks in the filesystem
 * Creates file ranges and file entries 
 * A single file entry per consecutive range of blocks
-* @param a_block block being walked
+* @param a_block run of blocks being walked (a_block->len blocks from a_block->addr)
 * @param a_ptr a pointer to an UNALLOC_BLOCK_WLK_TRACK struct
 * @returns TSK_WALK_CONT if continue, otherwise TSK_WALK_STOP if stop processing requested
 */
@@ -873,15 +959,15 @@ TSK_WALK_RET_ENUM TskAutoDb::fsWalkUnallocBlocksCb(const TSK_FS_BLOCK *a_block,
     if (unallocBlockWlkTrack->isStart) {
         unallocBlockWlkTrack->isStart = false;
         unallocBlockWlkTrack->curRangeStart = a_block->addr;
-        unallocBlockWlkTrack->prevBlock = a_block->addr;
+        unallocBlockWlkTrack->prevBlock = a_block->addr + a_block->len - 1;
         unallocBlockWlkTrack->size = 0;
         unallocBlockWlkTrack->nextSequenceNo = 0;
         return TSK_WALK_CONT;
     }
 
-    // if this block is consecutive with the previous one, update prevBlock and return
+    // if this run is consecutive with the previous one, update prevBlock and return
     if (a_block->addr == unallocBlockWlkTrack->prevBlock + 1) {
-        unallocBlockWlkTrack->prevBlock = a_block->addr;
+        unallocBlockWlkTrack->prevBlock = a_block->addr + a_block->len - 1;
         return TSK_WALK_CONT;
     }
 
@@ -895,7 +981,7 @@ TSK_WALK_RET_ENUM TskAutoDb::fsWalkUnallocBlocksCb(const TSK_FS_BLOCK *a_block,
     // bookkeeping for the next range object
     unallocBlockWlkTrack->size += rangeSizeBytes;
     unallocBlockWlkTrack->curRangeStart = a_block->addr;
-    unallocBlockWlkTrack->prevBlock = a_block->addr;
+    unallocBlockWlkTrack->prevBlock = a_block->addr + a_block->len - 1;
 
     // Here we just return if we are a) collecting all unallocated data
     // for the given volumen (chunkSize == 0) or b) collecting all unallocated
@@ -952,7 +1038,7 @@ TSK_RETVAL_ENUM TskAutoDb::addFsInfoUnalloc(const TSK_DB_FS_INFO & dbFsInfo) {
     //walk unalloc blocks on the fs and process them
     //initialize the unalloc block walk tracking 
     UNALLOC_BLOCK_WLK_TRACK unallocBlockWlkTrack(*this, *fsInfo, dbFsInfo.objId, m_chunkSize);
-    uint8_t block_walk_ret = tsk_fs_block_walk(fsInfo, fsInfo->first_block, fsInfo->last_block, (TSK_FS_BLOCK_WALK_FLAG_ENUM)(TSK_FS_BLOCK_WALK_FLAG_UNALLOC | TSK_FS_BLOCK_WALK_FLAG_AONLY), 
+    uint8_t block_walk_ret = tsk_fs_block_walk(fsInfo, fsInfo->first_block, fsInfo->last_block, (TSK_FS_BLOCK_WALK_FLAG_ENUM)(TSK_FS_BLOCK_WALK_FLAG_UNALLOC | TSK_FS_BLOCK_WALK_FLAG_AONLY | TSK_FS_BLOCK_WALK_FLAG_RUNS), 
         fsWalkUnallocBlocksCb, &unallocBlockWlkTrack);
 
     if (block_walk_ret == 1) {
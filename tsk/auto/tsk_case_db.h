@@ -18,6 +18,7 @@
 #define _TSK_AUTO_CASE_H
 
 #include <string>
+#include <map>
 using std::string;
 
 #include "tsk_auto_i.h"
@@ -137,6 +138,13 @@ class TskAutoDb:public TskAuto {
     bool m_foundStructure;  ///< Set to true when we find either a volume or file system
     bool m_attributeAdded; ///< Set to true when an attribute was added by processAttributes
 
+    // MD5 of a default attribute whose content is resident
+    typedef struct {
+        uint16_t attrId;        ///< ID of the default attribute
+        unsigned char md5[16];
+    } RESIDENT_MD5;
+    std::map<TSK_INUM_T, RESIDENT_MD5> m_residentMd5; ///< Hashes of resident files in the current file system, by metadata address
+
     // prevent copying until we add proper logic to handle it
     TskAutoDb(const TskAutoDb&);
     TskAutoDb & operator=(const TskAutoDb&);
@@ -168,6 +176,10 @@ class TskAutoDb:public TskAuto {
         TSK_OFF_T offset, TSK_DADDR_T addr, char *buf, size_t size,
         TSK_FS_BLOCK_FLAG_ENUM a_flags, void *ptr);
     int md5HashAttr(unsigned char md5Hash[16], const TSK_FS_ATTR * fs_attr);
+    static TSK_WALK_RET_ENUM md5ResidentCallback(TSK_FS_FILE * fs_file,
+        const TSK_FS_ATTR * fs_attr, const char *buf, size_t len,
+        void *ptr);
+    void md5HashResident(TSK_FS_INFO * fs_info);
 
     static TSK_WALK_RET_ENUM fsWalkUnallocBlocksCb(const TSK_FS_BLOCK *a_block, void *a_ptr);
     TSK_RETVAL_ENUM addFsInfoUnalloc(const TSK_DB_FS_INFO & dbFsInfo);
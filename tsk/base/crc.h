@@ -166,6 +166,16 @@ ulong cm_tab P_((p_cm_t p_cm,int index));
 
 void crc16(p_cm_t crc_context, unsigned char const *buff, unsigned int size);
 
+#include <stddef.h>
+#ifdef _MSC_VER
+#include "tsk_os.h"
+#else
+#include <stdint.h>
+#endif
+
+uint32_t tsk_crc32c(uint32_t crc, const void *buf, size_t len);
+uint32_t tsk_crc32c_sw(uint32_t crc, const void *buf, size_t len);
+
 #endif
 
 /******************************************************************************/
@@ -78,16 +78,16 @@ print_list(const TSK_FS_BLOCK * fs_block, void *ptr)
 
 
 
-/* print_block - write data block to stdout */
+/* print_block - write a run of data blocks to stdout */
 static TSK_WALK_RET_ENUM
 print_block(const TSK_FS_BLOCK * fs_block, void *ptr)
 {
     if (tsk_verbose)
-        tsk_fprintf(stderr, "write block %" PRIuDADDR "\n",
-            fs_block->addr);
+        tsk_fprintf(stderr, "write block %" PRIuDADDR " (%" PRIuDADDR
+            " blocks)\n", fs_block->addr, fs_block->len);
 
-    if (fwrite(fs_block->buf, fs_block->fs_info->block_size, 1,
-            stdout) != 1) {
+    if (fwrite(fs_block->buf, fs_block->fs_info->block_size,
+            (size_t) fs_block->len, stdout) != fs_block->len) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_WRITE);
         tsk_error_set_errstr("blkls_lib: error writing to stdout: %s",
@@ -242,6 +242,7 @@ tsk_fs_blkls(TSK_FS_INFO * fs, TSK_FS_BLKLS_FLAG_ENUM a_blklsflags,
             return 1;
         }
 #endif
+        a_block_flags |= TSK_FS_BLOCK_WALK_FLAG_RUNS;
         if (tsk_fs_block_walk(fs, bstart, blast, a_block_flags,
                 print_block, &data))
             return 1;
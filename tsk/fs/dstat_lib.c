@@ -40,12 +40,15 @@ blkstat_act(const TSK_FS_BLOCK * fs_block, void *ptr)
 
     if (TSK_FS_TYPE_ISFFS(fs_block->fs_info->ftype)) {
         FFS_INFO *ffs = (FFS_INFO *) fs_block->fs_info;
-        tsk_printf("Group: %" PRI_FFSGRP "\n", ffs->grp_num);
+        tsk_printf("Group: %" PRI_FFSGRP "\n",
+            dtog_lcl(fs_block->fs_info, ffs->fs.sb1, fs_block->addr));
     }
     else if (TSK_FS_TYPE_ISEXT(fs_block->fs_info->ftype)) {
         EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) fs_block->fs_info;
         if (fs_block->addr >= ext2fs->first_data_block)
-            tsk_printf("Group: %" PRI_EXT2GRP "\n", ext2fs->grp_num);
+            tsk_printf("Group: %" PRI_EXT2GRP "\n",
+                ext2_dtog_lcl(fs_block->fs_info, ext2fs->fs,
+                    fs_block->addr));
     }
     else if (TSK_FS_TYPE_ISFAT(fs_block->fs_info->ftype)) {
         FATFS_INFO *fatfs = (FATFS_INFO *) fs_block->fs_info;
@@ -413,18 +413,15 @@ exfatfs_setup_fs_layout_model(FATFS_INFO *a_fatfs)
 static void 
 exfatfs_init_fat_cache(FATFS_INFO *a_fatfs)
 {
-    uint32_t i = 0;
-
     assert(a_fatfs != NULL);
 
-    for (i = 0; i < FATFS_FAT_CACHE_N; i++) {
-        a_fatfs->fatc_addr[i] = 0;
-        a_fatfs->fatc_ttl[i] = 0;
-    }
+    fatfs_fat_chunks_free(a_fatfs);
 
     tsk_init_lock(&a_fatfs->cache_lock);
     tsk_init_lock(&a_fatfs->dir_lock);
     a_fatfs->inum2par = NULL;
+    tsk_init_lock(&a_fatfs->dir_sectors_lock);
+    a_fatfs->dir_sectors = NULL;
 }
 
 /**
@@ -469,9 +466,12 @@ exfatfs_set_func_ptrs(FATFS_INFO *a_fatfs)
     /* Content category functions. */
     fs->block_walk = fatfs_block_walk;
     fs->block_getflags = fatfs_block_getflags;
+    fs->block_getflags_run = fatfs_block_getflags_run;
 
     /* Meta data category functions. */
     fs->inode_walk = fatfs_inode_walk;
+    // the FAT and directory sector caches are locked
+    fs->flags |= TSK_FS_INFO_FLAG_PAR_INODE_WALK;
     fs->istat = fatfs_istat;
     fs->file_add_meta = fatfs_inode_lookup;
     fs->get_default_attr_type = fatfs_get_default_attr_type;
@@ -32,7 +32,6 @@
 #include "tsk/base/crc.h"
 #include <stddef.h>
 //#define Ext4_DBG 1
-//#define EXT4_CHECKSUMS 1
 
 
 #ifdef Ext4_DBG
@@ -97,207 +96,258 @@ ext2fs_bg_has_super(uint32_t feature_ro_compat, uint32_t group_block)
 
 
 
-/* ext2fs_group_load - load 32-bit or 64-bit block group descriptor into cache
+/* ext2fs_group_table_load - read the group descriptor table into memory
  *
- * Note: This routine assumes &ext2fs->lock is locked by the caller.
+ * The table is read once when the file system is opened and is then only
+ * read, so the descriptors can be used without taking ext2fs->lock.  Only
+ * the part of the table that is in the image is kept; descriptors after
+ * that cause an error when they are asked for, as does a descriptor with
+ * bad block locations.
  *
- * return 1 on error and 0 on success.  On success one of either ext2fs->grp_buf or ext2fs->ext4_grp_buf will
- * be non-null and contain the valid data. Because Ext4 can have 32-bit group descriptors, check which buffer is 
- * non-null to determine what to read instead of duplicating the logic everywhere.
+ * return 1 on error and 0 on success.
+ * */
+static uint8_t
+ext2fs_group_table_load(EXT2FS_INFO * ext2fs)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) ext2fs;
+    size_t gd_size = tsk_getu16(fs->endian, ext2fs->fs->s_desc_size);
+    TSK_OFF_T avail;
+    EXT2_GRPNUM_T cnt_max;
+    size_t len;
+    ssize_t cnt;
+
+    // 64-bit version.
+    if ((fs->ftype == TSK_FS_TYPE_EXT4)
+        && (EXT2FS_HAS_INCOMPAT_FEATURE(fs, ext2fs->fs,
+                EXT2FS_FEATURE_INCOMPAT_64BIT)
+            && (gd_size >= 64))) {
+        ext2fs->grp_64bit = 1;
+    }
+    else {
+        ext2fs->grp_64bit = 0;
+        if (!gd_size)
+            gd_size = sizeof(ext2fs_gd);
+    }
+    ext2fs->grp_desc_size = gd_size;
+
+    /* do not allocate more than the image can hold (the group count in a
+     * corrupt super block can be huge) */
+    avail = fs->img_info->size - fs->offset - ext2fs->groups_offset;
+    if (avail < 0)
+        avail = 0;
+    cnt_max = ext2fs->groups_count;
+    if ((TSK_OFF_T) cnt_max * (TSK_OFF_T) gd_size > avail)
+        cnt_max = (EXT2_GRPNUM_T) (avail / gd_size);
+
+    /* the buffer is padded so that a short descriptor can still be
+     * accessed through the ext2fs_gd and ext4fs_gd structures */
+    len = (size_t) cnt_max * gd_size;
+    if ((ext2fs->grp_tbl =
+            (uint8_t *) tsk_malloc(len + sizeof(ext4fs_gd))) == NULL)
+        return 1;
+
+    ext2fs->grp_tbl_cnt = 0;
+    if (len) {
+        cnt = tsk_fs_read(fs, ext2fs->groups_offset,
+            (char *) ext2fs->grp_tbl, len);
+        if (cnt > 0)
+            ext2fs->grp_tbl_cnt = (EXT2_GRPNUM_T) (cnt / gd_size);
+        tsk_error_reset();
+    }
+
+    if (tsk_verbose && (ext2fs->grp_64bit == 0)) {
+        EXT2_GRPNUM_T i;
+        for (i = 0; i < ext2fs->grp_tbl_cnt; i++) {
+            ext2fs_gd *gd = (ext2fs_gd *) & ext2fs->grp_tbl[i * gd_size];
+            tsk_fprintf(stderr,
+                "\tgroup %" PRI_EXT2GRP ": %" PRIu16 "/%" PRIu16
+                " free blocks/inodes\n", i, tsk_getu16(fs->endian,
+                    gd->bg_free_blocks_count),
+                tsk_getu16(fs->endian, gd->bg_free_inodes_count));
+        }
+    }
+    return 0;
+}
+
+/* ext2fs_group_get - get a 32-bit or 64-bit block group descriptor from
+ * the in-memory table.  Does not need ext2fs->lock.
+ *
+ * @param ext2fs File system
+ * @param grp_num Group to get
+ * @param a_gd [out] Set to the descriptor on ext2, ext3 and 32-bit ext4 (else NULL)
+ * @param a_ext4_gd [out] Set to the descriptor on 64-bit ext4 (else NULL)
  *
+ * return 1 on error and 0 on success.  On success one of either *a_gd or
+ * *a_ext4_gd will be non-null and point to the valid data. Because Ext4
+ * can have 32-bit group descriptors, check which one is non-null to
+ * determine what to read instead of duplicating the logic everywhere.
  * */
 static uint8_t
-    ext2fs_group_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
+ext2fs_group_get(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num,
+    ext2fs_gd ** a_gd, ext4fs_gd ** a_ext4_gd)
 {
     TSK_FS_INFO *fs = (TSK_FS_INFO *) ext2fs;
-    int gd_size = tsk_getu16(fs->endian, ext2fs->fs->s_desc_size);
+    TSK_OFF_T offs;
+    uint8_t *desc;
+
+    *a_gd = NULL;
+    *a_ext4_gd = NULL;
 
     /*
     * Sanity check
     */
-    if (grp_num < 0 || grp_num >= ext2fs->groups_count) {
+    if (grp_num >= ext2fs->groups_count) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_ARG);
         tsk_error_set_errstr
-            ("ext2fs_group_load: invalid cylinder group number: %"
+            ("ext2fs_group_get: invalid cylinder group number: %"
             PRI_EXT2GRP "", grp_num);
         return 1;
     }
-    // already loaded
-    else if (ext2fs->grp_num == grp_num) {
-        return 0;
-    }
-
-    // 64-bit version.  
-    if (((fs->ftype == TSK_FS_TYPE_EXT4)) && (EXT2FS_HAS_INCOMPAT_FEATURE(fs, ext2fs->fs,
-        EXT2FS_FEATURE_INCOMPAT_64BIT)
-        && (tsk_getu16(fs->endian, ext2fs->fs->s_desc_size) >= 64))) {
-            TSK_OFF_T offs;
-            ssize_t cnt;
 
-            if (!gd_size)
-                gd_size = sizeof(ext4fs_gd);
-
-            if (ext2fs->ext4_grp_buf == NULL) {
-                if ((ext2fs->ext4_grp_buf = (ext4fs_gd *) tsk_malloc(gd_size)) == NULL) 
-                    return 1;
-            }
-            offs = ext2fs->groups_offset + grp_num * gd_size;
+    offs = ext2fs->groups_offset +
+        (TSK_OFF_T) grp_num * ext2fs->grp_desc_size;
+    if (grp_num >= ext2fs->grp_tbl_cnt) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_READ);
+        tsk_error_set_errstr("ext2fs_group_get: Group descriptor %"
+            PRI_EXT2GRP " at %" PRIuOFF, grp_num, offs);
+        return 1;
+    }
+    desc = &ext2fs->grp_tbl[(size_t) grp_num * ext2fs->grp_desc_size];
 
-            cnt = tsk_fs_read(&ext2fs->fs_info, offs, (char *) ext2fs->ext4_grp_buf, gd_size);
+    // 64-bit version.
+    if (ext2fs->grp_64bit) {
+        ext4fs_gd *gd = (ext4fs_gd *) desc;
 
 #ifdef Ext4_DBG
-            debug_print_buf((char *) ext2fs->ext4_grp_buf, gd_size);
+        debug_print_buf((char *) gd, ext2fs->grp_desc_size);
 #endif
-            if (cnt != gd_size) {
-                if (cnt >= 0) {
-                    tsk_error_reset();
-                    tsk_error_set_errno(TSK_ERR_FS_READ);
-                }
-                tsk_error_set_errstr2("ext2fs_group_load: Group descriptor %"
-                    PRI_EXT2GRP " at %" PRIuOFF, grp_num, offs);
-                return 1;
-            }
-
-            // sanity checks
-            if ((ext4_getu64(fs->endian,
-                ext2fs->ext4_grp_buf->bg_block_bitmap_hi,
-                ext2fs->ext4_grp_buf->bg_block_bitmap_lo) > fs->last_block) ||
-                (ext4_getu64(fs->endian,
-                ext2fs->ext4_grp_buf->bg_inode_bitmap_hi,
-                ext2fs->ext4_grp_buf->bg_inode_bitmap_lo) > fs->last_block) ||
-                (ext4_getu64(fs->endian,
-                ext2fs->ext4_grp_buf->bg_inode_table_hi,
-                ext2fs->ext4_grp_buf->bg_inode_table_lo) > fs->last_block)) {
-                    tsk_error_reset();
-                    tsk_error_set_errno(TSK_ERR_FS_CORRUPT);
-                    tsk_error_set_errstr("extXfs_group_load: Ext4 Group %" PRI_EXT2GRP
-                        " descriptor block locations too large at byte offset %"
-                        PRIuDADDR, grp_num, offs);
-                    return 1;
-            }
-    }
-    else {
-        TSK_OFF_T offs;
-        ssize_t cnt;
-        if (!gd_size)
-            gd_size = sizeof(ext2fs_gd);
-
-        if (ext2fs->grp_buf == NULL) {
-            if ((ext2fs->grp_buf = (ext2fs_gd *) tsk_malloc(gd_size)) == NULL) 
-                return 1;
-        }
-        offs = ext2fs->groups_offset + grp_num * gd_size;
-
-        cnt = tsk_fs_read(&ext2fs->fs_info, offs, (char *) ext2fs->grp_buf, gd_size);
-
-        if (cnt != gd_size) {
-            if (cnt >= 0) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_READ);
-            }
-            tsk_error_set_errstr2("ext2fs_group_load: Group descriptor %"
-                PRI_EXT2GRP " at %" PRIuOFF, grp_num, offs);
+        // sanity checks
+        if ((ext4_getu64(fs->endian,
+                    gd->bg_block_bitmap_hi,
+                    gd->bg_block_bitmap_lo) > fs->last_block) ||
+            (ext4_getu64(fs->endian,
+                    gd->bg_inode_bitmap_hi,
+                    gd->bg_inode_bitmap_lo) > fs->last_block) ||
+            (ext4_getu64(fs->endian,
+                    gd->bg_inode_table_hi,
+                    gd->bg_inode_table_lo) > fs->last_block)) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_CORRUPT);
+            tsk_error_set_errstr("extXfs_group_load: Ext4 Group %"
+                PRI_EXT2GRP
+                " descriptor block locations too large at byte offset %"
+                PRIuDADDR, grp_num, offs);
             return 1;
         }
+        *a_ext4_gd = gd;
+    }
+    else {
+        ext2fs_gd *gd = (ext2fs_gd *) desc;
 
         // sanity checks
         if ((tsk_getu32(fs->endian,
-            ext2fs->grp_buf->bg_block_bitmap) > fs->last_block) ||
+                    gd->bg_block_bitmap) > fs->last_block) ||
             (tsk_getu32(fs->endian,
-            ext2fs->grp_buf->bg_inode_bitmap) > fs->last_block) ||
+                    gd->bg_inode_bitmap) > fs->last_block) ||
             (tsk_getu32(fs->endian,
-            ext2fs->grp_buf->bg_inode_table) > fs->last_block)) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_CORRUPT);
-                tsk_error_set_errstr("extXfs_group_load: Group %" PRI_EXT2GRP
-                    " descriptor block locations too large at byte offset %"
-                    PRIuDADDR, grp_num, offs);
-                return 1;
-        }
-
-        if (tsk_verbose) {
-            TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
-            tsk_fprintf(stderr,
-                "\tgroup %" PRI_EXT2GRP ": %" PRIu16 "/%" PRIu16
-                " free blocks/inodes\n", grp_num, tsk_getu16(fs->endian,
-                ext2fs->grp_buf->bg_free_blocks_count),
-                tsk_getu16(fs->endian, ext2fs->grp_buf->bg_free_inodes_count));
+                    gd->bg_inode_table) > fs->last_block)) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_CORRUPT);
+            tsk_error_set_errstr("extXfs_group_load: Group %" PRI_EXT2GRP
+                " descriptor block locations too large at byte offset %"
+                PRIuDADDR, grp_num, offs);
+            return 1;
         }
+        *a_gd = gd;
     }
-    ext2fs->grp_num = grp_num;
 
     return 0;
 }
 
-#ifdef EXT4_CHECKSUMS
+/* ext2fs_put_le32 - store a value in little endian order, which is the
+ * order that the values in the checksums are in */
+static void
+ext2fs_put_le32(uint8_t * a_buf, uint32_t a_val)
+{
+    a_buf[0] = (uint8_t) (a_val & 0xff);
+    a_buf[1] = (uint8_t) ((a_val >> 8) & 0xff);
+    a_buf[2] = (uint8_t) ((a_val >> 16) & 0xff);
+    a_buf[3] = (uint8_t) ((a_val >> 24) & 0xff);
+}
+
+/* ext2fs_csum_seed - the seed of the metadata_csum checksums.  It is the
+ * crc32c of the UUID, or the value that was saved in the super block
+ * when the UUID was changed (CSUM_SEED).
+ */
+static uint32_t
+ext2fs_csum_seed(EXT2FS_INFO * ext2fs)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) ext2fs;
+
+    if (EXT2FS_HAS_INCOMPAT_FEATURE(fs, ext2fs->fs,
+            EXT4FS_FEATURE_INCOMPAT_CSUM_SEED))
+        return tsk_getu32(fs->endian, ext2fs->fs->s_checksum_seed);
+    return tsk_crc32c(~0U, ext2fs->fs->s_uuid,
+        sizeof(ext2fs->fs->s_uuid));
+}
+
 /**
- * ext4_group_desc_csum - Calculates the checksum of a group descriptor
- * Ported from linux/fs/ext4/super.c
- * @ext4_sb:       pointer to ext2 super block structure
+ * ext2fs_group_desc_csum - Calculates the checksum of a group descriptor
+ * Ported from linux/fs/ext4/super.c.  With metadata_csum, it is the low
+ * 16 bits of a crc32c.  With only GDT_CSUM, it is a crc16.
+ * @ext2fs:        file system
+ * @a_seed:        seed from ext2fs_csum_seed() (metadata_csum only)
  * @block_group:   group descriptor number
- * @gdp:           pointer to group descriptor to calculate checksum for
+ * @a_desc:        group descriptor to calculate checksum for
  * returns the checksum value
  */
-
-//Temporarily removing CRC16 code until non-GPL version implemented
-//static uint16_t
-//ext4_group_desc_csum(ext2fs_sb *ext4_sb, uint32_t block_group,
-//                          struct ext4fs_gd *gdp)
-//{
-//      uint16_t crc = 0;
-//      if (*ext4_sb->s_feature_ro_compat & EXT2FS_FEATURE_RO_COMPAT_GDT_CSUM)
-//      {
-//              int offset = offsetof(struct ext4fs_gd, bg_checksum);
-//              uint32_t le_group = tsk_getu32(TSK_LIT_ENDIAN, &block_group);
-//              crc = crc16(~0, ext4_sb->s_uuid, sizeof(ext4_sb->s_uuid));
-//              crc = crc16(crc, (uint8_t *)&le_group, sizeof(le_group));
-//              crc = crc16(crc, (uint8_t *)gdp, offset);
-//              offset += sizeof(gdp->bg_checksum); /* skip checksum */
-//              /* for checksum of struct ext4_group_desc do the rest...*/
-//              if ((*ext4_sb->s_feature_incompat &
-//                   EXT2FS_FEATURE_INCOMPAT_64BIT) &&
-//                  offset < *ext4_sb->s_desc_size)
-//        {
-//                      crc = crc16(crc, (uint8_t *)gdp + offset, *ext4_sb->s_desc_size - offset);
-//        }
-//      }
-//
-//      return crc;
-//}
-
-static cm_t CRC16_CTX;
-
 static uint16_t
-ext4_group_desc_csum(ext2fs_sb * ext4_sb, uint32_t block_group,
-    struct ext4fs_gd *gdp)
+ext2fs_group_desc_csum(EXT2FS_INFO * ext2fs, uint32_t a_seed,
+    EXT2_GRPNUM_T block_group, const uint8_t * a_desc)
 {
-    CRC16_CTX.cm_width = 16;
-    CRC16_CTX.cm_poly = 0x8005L;
-    CRC16_CTX.cm_init = 0xFFFFL;
-    CRC16_CTX.cm_refin = TRUE;
-    CRC16_CTX.cm_refot = TRUE;
-    CRC16_CTX.cm_xorot = 0x0000L;
-    cm_ini(&CRC16_CTX);
-    if (*ext4_sb->s_feature_ro_compat & EXT2FS_FEATURE_RO_COMPAT_GDT_CSUM) {
-        int offset = offsetof(struct ext4fs_gd, bg_checksum);
-        uint32_t le_group = tsk_getu32(TSK_LIT_ENDIAN, &block_group);
-        crc16(&CRC16_CTX, ext4_sb->s_uuid, sizeof(ext4_sb->s_uuid));
-        crc16(&CRC16_CTX, (uint8_t *) & le_group, sizeof(le_group));
-        crc16(&CRC16_CTX, (uint8_t *) gdp, offset);
-        offset += sizeof(gdp->bg_checksum);     /* skip checksum */
-        /* for checksum of struct ext4_group_desc do the rest... */
-        if ((*ext4_sb->s_feature_incompat &
-                EXT2FS_FEATURE_INCOMPAT_64BIT) &&
-            offset < *ext4_sb->s_desc_size) {
-            crc16(&CRC16_CTX, (uint8_t *) gdp + offset,
-                *ext4_sb->s_desc_size - offset);
-        }
-    }
-
-    return cm_crc(&CRC16_CTX);
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) ext2fs;
+    size_t offset = offsetof(ext4fs_gd, bg_checksum);
+    size_t size = ext2fs->grp_desc_size;
+    uint8_t le_group[4];
+    cm_t crc16_ctx;
+
+    ext2fs_put_le32(le_group, block_group);
+
+    if (EXT2FS_HAS_RO_COMPAT_FEATURE(fs, ext2fs->fs,
+            EXT4FS_FEATURE_RO_COMPAT_METADATA_CSUM)) {
+        static const uint8_t dummy_csum[2] = { 0, 0 };
+        uint32_t crc;
+
+        crc = tsk_crc32c(a_seed, le_group, sizeof(le_group));
+        crc = tsk_crc32c(crc, a_desc, offset);
+        crc = tsk_crc32c(crc, dummy_csum, sizeof(dummy_csum));
+        offset += sizeof(dummy_csum);
+        if (offset < size)
+            crc = tsk_crc32c(crc, a_desc + offset, size - offset);
+        return (uint16_t) (crc & 0xffff);
+    }
+
+    crc16_ctx.cm_width = 16;
+    crc16_ctx.cm_poly = 0x8005L;
+    crc16_ctx.cm_init = 0xFFFFL;
+    crc16_ctx.cm_refin = TRUE;
+    crc16_ctx.cm_refot = TRUE;
+    crc16_ctx.cm_xorot = 0x0000L;
+    cm_ini(&crc16_ctx);
+    crc16(&crc16_ctx, ext2fs->fs->s_uuid, sizeof(ext2fs->fs->s_uuid));
+    crc16(&crc16_ctx, le_group, sizeof(le_group));
+    crc16(&crc16_ctx, a_desc, (unsigned int) offset);
+    offset += 2;                /* skip checksum */
+    /* for checksum of struct ext4_group_desc do the rest... */
+    if ((EXT2FS_HAS_INCOMPAT_FEATURE(fs, ext2fs->fs,
+                EXT2FS_FEATURE_INCOMPAT_64BIT)) && (offset < size)) {
+        crc16(&crc16_ctx, a_desc + offset, (unsigned int) (size - offset));
+    }
+
+    return (uint16_t) cm_crc(&crc16_ctx);
 }
-#endif
 
 
 /* ext2fs_print_map - print a bitmap */
@@ -319,144 +369,318 @@ ext2fs_print_map(uint8_t * map, int len)
     ((tsk_getu32(ext2fs->fs_info.endian, ext2fs->fs->s_inodes_per_group) * ext2fs->inode_size - 1) \
            / ext2fs->fs_info.block_size + 1)
 
-/* ext2fs_bmap_load - look up block bitmap & load into cache
- *
- * Note: This routine assumes &ext2fs->lock is locked by the caller.
+/* Maximum number of block and inode bitmaps in EXT2FS_INFO.map_head */
+#define EXT2FS_BITMAP_CACHE_MAX 128
+
+/* Maximum number of bitmaps that are read with one call to tsk_fs_read.
+ * With flex_bg, the bitmaps of consecutive groups are stored next to each
+ * other and are read together. */
+#define EXT2FS_BITMAP_BULK 16
+
+/* ext2fs_bitmap_addr - get the address of the block or inode bitmap
+ * of a group.
  *
  * return 1 on error and 0 on success
  * */
 static uint8_t
-ext2fs_bmap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
+ext2fs_bitmap_addr(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num,
+    uint8_t is_imap, TSK_DADDR_T * a_addr)
 {
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
-    ssize_t cnt;
-    TSK_DADDR_T addr;
+    ext2fs_gd *grp_buf;
+    ext4fs_gd *ext4_grp_buf;
 
     /*
-     * Look up the group descriptor info.  The load will do the sanity check.
+     * Look up the group descriptor info.  The get will do the sanity check.
      */
-    if (ext2fs_group_load(ext2fs, grp_num)) {
+    if (ext2fs_group_get(ext2fs, grp_num, &grp_buf, &ext4_grp_buf)) {
         return 1;
     }
 
-    if (ext2fs->bmap_buf == NULL) {
-        if ((ext2fs->bmap_buf =
-                (uint8_t *) tsk_malloc(fs->block_size)) == NULL) {
-            return 1;
-        }
+    if (ext4_grp_buf != NULL) {
+        *a_addr = is_imap ?
+            ext4_getu64(fs->endian, ext4_grp_buf->bg_inode_bitmap_hi,
+            ext4_grp_buf->bg_inode_bitmap_lo) :
+            ext4_getu64(fs->endian, ext4_grp_buf->bg_block_bitmap_hi,
+            ext4_grp_buf->bg_block_bitmap_lo);
     }
-    else if (ext2fs->bmap_grp_num == grp_num) {
-        return 0;
+    else {
+        *a_addr = (TSK_DADDR_T) (is_imap ?
+            tsk_getu32(fs->endian, grp_buf->bg_inode_bitmap) :
+            tsk_getu32(fs->endian, grp_buf->bg_block_bitmap));
     }
-    
-    if (ext2fs->ext4_grp_buf != NULL) { 
-        addr = ext4_getu64(fs->endian,
-            ext2fs->ext4_grp_buf->bg_block_bitmap_hi,
-            ext2fs->ext4_grp_buf->bg_block_bitmap_lo);
+    return 0;
+}
+
+/* Find a bitmap in the cache.  Must hold lock. */
+static EXT2FS_BITMAP_ENTRY *
+ext2fs_bitmap_find(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num,
+    uint8_t is_imap)
+{
+    EXT2FS_BITMAP_ENTRY *entry;
+
+    for (entry = ext2fs->map_head; entry != NULL; entry = entry->next) {
+        if ((entry->grp_num == grp_num) && (entry->is_imap == is_imap))
+            return entry;
     }
-    else {
-        addr = (TSK_DADDR_T) tsk_getu32(fs->endian, ext2fs->grp_buf->bg_block_bitmap);
+    return NULL;
+}
+
+/* Unlink a bitmap from the cache list.  Must hold lock. */
+static void
+ext2fs_bitmap_unlink(EXT2FS_INFO * ext2fs, EXT2FS_BITMAP_ENTRY * entry)
+{
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        ext2fs->map_head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        ext2fs->map_tail = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+/* Add a bitmap to the front of the cache list.  Must hold lock. */
+static void
+ext2fs_bitmap_push(EXT2FS_INFO * ext2fs, EXT2FS_BITMAP_ENTRY * entry)
+{
+    entry->prev = NULL;
+    entry->next = ext2fs->map_head;
+    if (ext2fs->map_head)
+        ext2fs->map_head->prev = entry;
+    else
+        ext2fs->map_tail = entry;
+    ext2fs->map_head = entry;
+}
+
+/* ext2fs_bitmap_load - look up a block or inode bitmap and load it
+ * into the cache.  If the bitmaps of the following groups are stored
+ * right after it (flex_bg), they are read and cached at the same time.
+ *
+ * Note: This routine assumes &ext2fs->lock is locked by the caller.
+ * The returned buffer is valid until the lock is released.
+ *
+ * return the bitmap (block_size bytes) or NULL on error
+ * */
+static uint8_t *
+ext2fs_bitmap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num,
+    uint8_t is_imap)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
+    EXT2FS_BITMAP_ENTRY *entry;
+    ssize_t cnt;
+    TSK_DADDR_T addr, next_addr;
+    EXT2_GRPNUM_T n, i;
+    char *buf;
+    const char *myname = is_imap ? "ext2fs_imap_load" : "ext2fs_bmap_load";
+
+    if ((entry = ext2fs_bitmap_find(ext2fs, grp_num, is_imap)) != NULL) {
+        if (entry != ext2fs->map_head) {
+            ext2fs_bitmap_unlink(ext2fs, entry);
+            ext2fs_bitmap_push(ext2fs, entry);
+        }
+        return entry->buf;
     }
 
+    if (ext2fs_bitmap_addr(ext2fs, grp_num, is_imap, &addr))
+        return NULL;
+
     if (addr > fs->last_block) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
         tsk_error_set_errstr
-            ("ext2fs_bmap_load: Block too large for image: %" PRIu64, addr);
-        return 1;
+            ("%s: Block too large for image: %" PRIu64, myname, addr);
+        return NULL;
     }
 
-    cnt = tsk_fs_read(fs, addr * fs->block_size, 
-        (char *) ext2fs->bmap_buf, ext2fs->fs_info.block_size);
+    /* see how many of the following bitmaps are stored next to this one */
+    for (n = 1; n < EXT2FS_BITMAP_BULK; n++) {
+        if ((grp_num + n >= ext2fs->groups_count)
+            || (addr + n > fs->last_block)
+            || (ext2fs_bitmap_addr(ext2fs, grp_num + n, is_imap,
+                    &next_addr))) {
+            tsk_error_reset();
+            break;
+        }
+        if ((next_addr != addr + n)
+            || (ext2fs_bitmap_find(ext2fs, grp_num + n, is_imap) != NULL))
+            break;
+    }
+
+    if ((buf = (char *) tsk_malloc((size_t) n * fs->block_size)) == NULL)
+        return NULL;
 
-    if (cnt != ext2fs->fs_info.block_size) {
+    cnt = tsk_fs_read(fs, addr * fs->block_size, buf,
+        (size_t) n * fs->block_size);
+    if ((cnt != (ssize_t) n * fs->block_size) && (n > 1)) {
+        /* only the first one is needed */
+        n = 1;
+        cnt = tsk_fs_read(fs, addr * fs->block_size, buf, fs->block_size);
+    }
+    if (cnt != (ssize_t) n * fs->block_size) {
         if (cnt >= 0) {
             tsk_error_reset();
             tsk_error_set_errno(TSK_ERR_FS_READ);
         }
-        tsk_error_set_errstr2("ext2fs_bmap_load: block bitmap %"
-            PRI_EXT2GRP " at %" PRIu64, grp_num, addr);
-        return 1;
+        tsk_error_set_errstr2("%s: %s bitmap %" PRI_EXT2GRP " at %"
+            PRIu64, myname, is_imap ? "Inode" : "block", grp_num, addr);
+        free(buf);
+        return NULL;
     }
 
-    ext2fs->bmap_grp_num = grp_num;
+    /* add them in reverse order so that grp_num ends up in front */
+    for (i = n; i > 0; i--) {
+        if ((entry = (EXT2FS_BITMAP_ENTRY *) tsk_malloc(sizeof(*entry) +
+                    fs->block_size)) == NULL) {
+            free(buf);
+            return NULL;
+        }
+        entry->grp_num = grp_num + i - 1;
+        entry->is_imap = is_imap;
+        entry->buf = (uint8_t *) & entry[1];
+        memcpy(entry->buf, &buf[(size_t) (i - 1) * fs->block_size],
+            fs->block_size);
+        ext2fs_bitmap_push(ext2fs, entry);
+
+        /* remove the least recently used bitmap if the cache is full */
+        if (++ext2fs->map_cnt > EXT2FS_BITMAP_CACHE_MAX) {
+            EXT2FS_BITMAP_ENTRY *old = ext2fs->map_tail;
+            ext2fs_bitmap_unlink(ext2fs, old);
+            ext2fs->map_cnt--;
+            free(old);
+        }
+    }
+    free(buf);
+
     if (tsk_verbose > 1)
-        ext2fs_print_map(ext2fs->bmap_buf,
-            tsk_getu32(fs->endian, ext2fs->fs->s_blocks_per_group));    
-    return 0;
+        ext2fs_print_map(entry->buf, is_imap ?
+            tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group) :
+            tsk_getu32(fs->endian, ext2fs->fs->s_blocks_per_group));
+    return entry->buf;
 }
 
+/* ext2fs_bmap_load - look up block bitmap & load into cache
+ *
+ * Note: This routine assumes &ext2fs->lock is locked by the caller.
+ *
+ * return the bitmap or NULL on error
+ * */
+static uint8_t *
+ext2fs_bmap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
+{
+    return ext2fs_bitmap_load(ext2fs, grp_num, 0);
+}
 
 /* ext2fs_imap_load - look up inode bitmap & load into cache
  *
  * Note: This routine assumes &ext2fs->lock is locked by the caller.
  *
- * return 0 on success and 1 on error
+ * return the bitmap or NULL on error
  * */
+static uint8_t *
+ext2fs_imap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
+{
+    return ext2fs_bitmap_load(ext2fs, grp_num, 1);
+}
+
+/* Free all of the bitmaps in the cache */
+static void
+ext2fs_bitmap_cache_free(EXT2FS_INFO * ext2fs)
+{
+    while (ext2fs->map_head) {
+        EXT2FS_BITMAP_ENTRY *entry = ext2fs->map_head;
+        ext2fs->map_head = entry->next;
+        free(entry);
+    }
+    ext2fs->map_tail = NULL;
+    ext2fs->map_cnt = 0;
+}
+
+/* ext2fs_group_itable - get the location of the inode table of a group
+ * and how many inodes at its start have been initialized.  Inodes after
+ * that are in a table area that the group descriptor marks as never used
+ * (EXT4_BG_INODE_UNINIT or bg_itable_unused, which are only maintained
+ * when group descriptor checksums are enabled).
+ *
+ * @param ext2fs File system
+ * @param grp_num Group
+ * @param a_addr [out] Block address of the inode table
+ * @param a_init [out] Number of initialized inodes (can be NULL)
+ *
+ * return 1 on error and 0 on success
+ */
 static uint8_t
-    ext2fs_imap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
+ext2fs_group_itable(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num,
+    TSK_DADDR_T * a_addr, TSK_INUM_T * a_init)
 {
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
-    ssize_t cnt;
-    TSK_DADDR_T addr;
+    uint32_t ipg = tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group);
+    ext2fs_gd *grp_buf;
+    ext4fs_gd *ext4_grp_buf;
+    ext4fs_gd *gd;
+    uint32_t unused;
 
-    /*
-    * Look up the group descriptor info.
-    */
-    if (ext2fs_group_load(ext2fs, grp_num)) {
+    if (ext2fs_group_get(ext2fs, grp_num, &grp_buf, &ext4_grp_buf))
         return 1;
-    }
-
-    /* Allocate the cache buffer and exit if map is already loaded */
-    if (ext2fs->imap_buf == NULL) {
-        if ((ext2fs->imap_buf =
-            (uint8_t *) tsk_malloc(fs->block_size)) == NULL) {
-                return 1;
-        }
-    }
-    else if (ext2fs->imap_grp_num == grp_num) {
-        return 0;
-    }
 
-    /*
-    * Look up the inode allocation bitmap.
-    */
-    if (ext2fs->ext4_grp_buf != NULL) { 
-        addr = ext4_getu64(fs->endian,
-            ext2fs->ext4_grp_buf->bg_inode_bitmap_hi,
-            ext2fs->ext4_grp_buf->bg_inode_bitmap_lo);
+    if (ext4_grp_buf != NULL) {
+        gd = ext4_grp_buf;
+        *a_addr = ext4_getu64(fs->endian, gd->bg_inode_table_hi,
+            gd->bg_inode_table_lo);
+        unused = tsk_getu16(fs->endian, gd->bg_itable_unused_lo) |
+            ((uint32_t) tsk_getu16(fs->endian,
+                gd->bg_itable_unused_hi) << 16);
     }
     else {
-        addr = (TSK_DADDR_T) tsk_getu32(fs->endian, ext2fs->grp_buf->bg_inode_bitmap);
-    }
-
-    if (addr > fs->last_block) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
-        tsk_error_set_errstr
-            ("ext2fs_imap_load: Block too large for image: %" PRIu64, addr);
-        return 1;
-    }
-
-    cnt = tsk_fs_read(fs, addr * fs->block_size, 
-        (char *) ext2fs->imap_buf, ext2fs->fs_info.block_size);
-
-    if (cnt != ext2fs->fs_info.block_size) {
-        if (cnt >= 0) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_READ);
-        }
-        tsk_error_set_errstr2("ext2fs_imap_load: Inode bitmap %"
-            PRI_EXT2GRP " at %" PRIu64, grp_num, addr);
-        return 1;
+        // the 32-bit descriptors share the layout of the first half
+        gd = (ext4fs_gd *) grp_buf;
+        *a_addr = (TSK_DADDR_T) tsk_getu32(fs->endian,
+            grp_buf->bg_inode_table);
+        unused = tsk_getu16(fs->endian, gd->bg_itable_unused_lo);
+    }
+
+    if (a_init) {
+        if ((EXT2FS_HAS_RO_COMPAT_FEATURE(fs, ext2fs->fs,
+                    EXT2FS_FEATURE_RO_COMPAT_GDT_CSUM) == 0)
+            && (EXT2FS_HAS_RO_COMPAT_FEATURE(fs, ext2fs->fs,
+                    EXT4FS_FEATURE_RO_COMPAT_METADATA_CSUM) == 0))
+            *a_init = ipg;
+        else if (EXT4BG_HAS_FLAG(fs, gd, EXT4_BG_INODE_UNINIT))
+            *a_init = 0;
+        else if (unused > ipg)
+            *a_init = 0;
+        else
+            *a_init = ipg - unused;
     }
+    return 0;
+}
 
-    ext2fs->imap_grp_num = grp_num;
-    if (tsk_verbose > 1)
-        ext2fs_print_map(ext2fs->imap_buf,
-        tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group));
+/* ext2fs_dinode_print - print the verbose summary of a disk inode */
+static void
+ext2fs_dinode_print(EXT2FS_INFO * ext2fs, TSK_INUM_T dino_inum,
+    ext2fs_inode * dino_buf)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
 
-    return 0;
+    tsk_fprintf(stderr,
+        "%" PRIuINUM " m/l/s=%o/%d/%" PRIuOFF
+        " u/g=%d/%d macd=%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32
+        "\n", dino_inum, tsk_getu16(fs->endian, dino_buf->i_mode),
+        tsk_getu16(fs->endian, dino_buf->i_nlink),
+        (tsk_getu32(fs->endian,
+                dino_buf->i_size) + (tsk_getu16(fs->endian,
+                    dino_buf->i_mode) & EXT2_IN_REG) ? (uint64_t)
+            tsk_getu32(fs->endian, dino_buf->i_size_high) << 32 : 0),
+        tsk_getu16(fs->endian,
+            dino_buf->i_uid) + (tsk_getu16(fs->endian,
+                dino_buf->i_uid_high) << 16), tsk_getu16(fs->endian,
+            dino_buf->i_gid) + (tsk_getu16(fs->endian,
+                dino_buf->i_gid_high) << 16), tsk_getu32(fs->endian,
+            dino_buf->i_mtime), tsk_getu32(fs->endian,
+            dino_buf->i_atime), tsk_getu32(fs->endian,
+            dino_buf->i_ctime), tsk_getu32(fs->endian,
+            dino_buf->i_dtime));
 }
 
 /* ext2fs_dinode_load - look up disk inode & load into ext2fs_inode structure
@@ -467,7 +691,7 @@ static uint8_t
  * return 1 on error and 0 on success
  * */
 
-static uint8_t
+uint8_t
 ext2fs_dinode_load(EXT2FS_INFO * ext2fs, TSK_INUM_T dino_inum,
     ext2fs_inode * dino_buf)
 {
@@ -475,6 +699,7 @@ ext2fs_dinode_load(EXT2FS_INFO * ext2fs, TSK_INUM_T dino_inum,
     TSK_OFF_T addr;
     ssize_t cnt;
     TSK_INUM_T rel_inum;
+    TSK_DADDR_T itbl;
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
 
     /*
@@ -502,11 +727,7 @@ ext2fs_dinode_load(EXT2FS_INFO * ext2fs, TSK_INUM_T dino_inum,
     grp_num = (EXT2_GRPNUM_T) ((dino_inum - fs->first_inum) /
         tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group));
 
-    /* lock access to grp_buf */
-    tsk_take_lock(&ext2fs->lock);
-
-    if (ext2fs_group_load(ext2fs, grp_num)) {
-        tsk_release_lock(&ext2fs->lock);
+    if (ext2fs_group_itable(ext2fs, grp_num, &itbl, NULL)) {
         return 1;
     }
 
@@ -516,25 +737,14 @@ ext2fs_dinode_load(EXT2FS_INFO * ext2fs, TSK_INUM_T dino_inum,
     rel_inum =
         (dino_inum - 1) - tsk_getu32(fs->endian,
         ext2fs->fs->s_inodes_per_group) * grp_num;
-    if (ext2fs->ext4_grp_buf != NULL) {
 #ifdef Ext4_DBG
+    if (ext2fs->grp_64bit)
         printf("DEBUG: d_inode_load 64bit gd_size=%d\n",
             tsk_getu16(fs->endian, ext2fs->fs->s_desc_size));
 #endif
-        addr =
-            (TSK_OFF_T) ext4_getu64(fs->endian,
-            ext2fs->ext4_grp_buf->bg_inode_table_hi,
-            ext2fs->ext4_grp_buf->bg_inode_table_lo)
-            * (TSK_OFF_T) fs->block_size +
-            rel_inum * (TSK_OFF_T) ext2fs->inode_size;
-    }
-    else {
-        addr =
-            (TSK_OFF_T) tsk_getu32(fs->endian,
-            ext2fs->grp_buf->bg_inode_table) * (TSK_OFF_T) fs->block_size +
-            rel_inum * (TSK_OFF_T) ext2fs->inode_size;
-    }
-    tsk_release_lock(&ext2fs->lock);
+    addr =
+        (TSK_OFF_T) itbl * (TSK_OFF_T) fs->block_size +
+        rel_inum * (TSK_OFF_T) ext2fs->inode_size;
 
     cnt = tsk_fs_read(fs, addr, (char *) dino_buf, ext2fs->inode_size);
 
@@ -550,30 +760,74 @@ ext2fs_dinode_load(EXT2FS_INFO * ext2fs, TSK_INUM_T dino_inum,
 //DEBUG    printf("Inode Size: %d, %d, %d, %d\n", sizeof(ext2fs_inode), *ext2fs->fs->s_inode_size, ext2fs->inode_size, *ext2fs->fs->s_want_extra_isize);
 //DEBUG    debug_print_buf((char *)dino_buf, ext2fs->inode_size);
 
-    if (tsk_verbose) {
-        tsk_fprintf(stderr,
-            "%" PRIuINUM " m/l/s=%o/%d/%" PRIuOFF
-            " u/g=%d/%d macd=%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32
-            "\n", dino_inum, tsk_getu16(fs->endian, dino_buf->i_mode),
-            tsk_getu16(fs->endian, dino_buf->i_nlink),
-            (tsk_getu32(fs->endian,
-                    dino_buf->i_size) + (tsk_getu16(fs->endian,
-                        dino_buf->i_mode) & EXT2_IN_REG) ? (uint64_t)
-                tsk_getu32(fs->endian, dino_buf->i_size_high) << 32 : 0),
-            tsk_getu16(fs->endian,
-                dino_buf->i_uid) + (tsk_getu16(fs->endian,
-                    dino_buf->i_uid_high) << 16), tsk_getu16(fs->endian,
-                dino_buf->i_gid) + (tsk_getu16(fs->endian,
-                    dino_buf->i_gid_high) << 16), tsk_getu32(fs->endian,
-                dino_buf->i_mtime), tsk_getu32(fs->endian,
-                dino_buf->i_atime), tsk_getu32(fs->endian,
-                dino_buf->i_ctime), tsk_getu32(fs->endian,
-                dino_buf->i_dtime));
-    }
+    if (tsk_verbose)
+        ext2fs_dinode_print(ext2fs, dino_inum, dino_buf);
 
     return 0;
 }
 
+/**
+ * \internal
+ * Find the value of the "system.data" extended attribute in the space
+ * after an inode.  It holds the inline data that does not fit in i_block.
+ *
+ * @param ext2fs File system
+ * @param dino_buf Inode (must be ext2fs->inode_size bytes)
+ * @param [out] a_len Length of the value
+ * @returns Pointer to the value in dino_buf or NULL if not found
+ */
+static const uint8_t *
+ext4_inline_data_xattr(EXT2FS_INFO * ext2fs, const ext2fs_inode * dino_buf,
+    uint32_t * a_len)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
+    const uint8_t *base = (const uint8_t *) dino_buf;
+    size_t first, off;
+
+    *a_len = 0;
+
+    if (ext2fs->inode_size <= EXT2_GOOD_OLD_INODE_SIZE)
+        return NULL;
+
+    off = EXT2_GOOD_OLD_INODE_SIZE + tsk_getu16(fs->endian,
+        dino_buf->i_extra_isize);
+    if ((off % 4) || (off + 4 > ext2fs->inode_size)
+        || (tsk_getu32(fs->endian, &base[off]) != EXT2_EA_MAGIC))
+        return NULL;
+
+    first = off + 4;
+    for (off = first; off + 4 <= ext2fs->inode_size;) {
+        const ext2fs_ea_entry *ea_entry =
+            (const ext2fs_ea_entry *) &base[off];
+        uint16_t val_off;
+        uint32_t val_size;
+
+        /* The list ends with four NULL bytes */
+        if (tsk_getu32(fs->endian, &base[off]) == 0)
+            break;
+
+        if (off + EXT2_EA_LEN(ea_entry->nlen) > ext2fs->inode_size)
+            break;
+
+        if ((ea_entry->nidx != EXT2_EA_IDX_SYSTEM) || (ea_entry->nlen != 4)
+            || (memcmp(&ea_entry->name, "data", 4) != 0)) {
+            off += EXT2_EA_LEN(ea_entry->nlen);
+            continue;
+        }
+
+        /* Values in other inodes are not used for inline data */
+        val_off = tsk_getu16(fs->endian, ea_entry->val_off);
+        val_size = tsk_getu32(fs->endian, ea_entry->val_size);
+        if ((tsk_getu32(fs->endian, ea_entry->val_blk) != 0)
+            || (first + val_off + val_size > ext2fs->inode_size))
+            return NULL;
+
+        *a_len = val_size;
+        return &base[first + val_off];
+    }
+    return NULL;
+}
+
 /* ext2fs_dinode_copy - copy cached disk inode into generic inode
  *
  * returns 1 on error and 0 on success
@@ -587,6 +841,7 @@ ext2fs_dinode_copy(EXT2FS_INFO * ext2fs, TSK_FS_META * fs_meta,
     ext2fs_sb *sb = ext2fs->fs;
     EXT2_GRPNUM_T grp_num;
     TSK_INUM_T ibase = 0;
+    uint8_t *imap;
 
 
     if (dino_buf == NULL) {
@@ -670,11 +925,15 @@ ext2fs_dinode_copy(EXT2FS_INFO * ext2fs, TSK_FS_META * fs_meta,
      * hold the upper 32-bits
      *
      * The RO_COMPAT_LARGE_FILE flag in the super block will identify
-     * if there are any large files in the file system
+     * if there are any large files in the file system.  With the
+     * INCOMPAT_LARGEDIR flag, directories also use the upper 32-bits.
      */
-    if ((fs_meta->type == TSK_FS_META_TYPE_REG) &&
-        (tsk_getu32(fs->endian, sb->s_feature_ro_compat) &
-            EXT2FS_FEATURE_RO_COMPAT_LARGE_FILE)) {
+    if (((fs_meta->type == TSK_FS_META_TYPE_REG) &&
+            (tsk_getu32(fs->endian, sb->s_feature_ro_compat) &
+                EXT2FS_FEATURE_RO_COMPAT_LARGE_FILE))
+        || ((fs_meta->type == TSK_FS_META_TYPE_DIR) &&
+            (EXT2FS_HAS_INCOMPAT_FEATURE(fs, sb,
+                    EXT4FS_FEATURE_INCOMPAT_LARGEDIR)))) {
         fs_meta->size +=
             ((uint64_t) tsk_getu32(fs->endian,
                 dino_buf->i_size_high) << 32);
@@ -720,8 +979,51 @@ ext2fs_dinode_copy(EXT2FS_INFO * ext2fs, TSK_FS_META * fs_meta,
             return 1;
         }
     }
-
-    if (tsk_getu32(fs->endian, dino_buf->i_flags) & EXT2_IN_EXTENTS) {
+
+    /* Inline data is copied so that it can be read without going back
+     * to the inode */
+    if (tsk_getu32(fs->endian, dino_buf->i_flags) & EXT2_IN_INLINE_DATA) {
+        const uint8_t *ea_val;
+        uint32_t ea_len;
+        size_t inline_len;
+
+        fs_meta->content_type = TSK_FS_META_CONTENT_TYPE_EXT4_INLINE;
+
+        ea_val = ext4_inline_data_xattr(ext2fs, dino_buf, &ea_len);
+        inline_len = EXT4_MIN_INLINE_DATA_SIZE + ea_len;
+        if (inline_len > fs_meta->content_len) {
+            if ((fs_meta =
+                    tsk_fs_meta_realloc(fs_meta, inline_len)) == NULL) {
+                return 1;
+            }
+        }
+        memset(fs_meta->content_ptr, 0, fs_meta->content_len);
+        memcpy(fs_meta->content_ptr, dino_buf->i_block,
+            EXT4_MIN_INLINE_DATA_SIZE);
+        if (ea_len)
+            memcpy((char *) fs_meta->content_ptr +
+                EXT4_MIN_INLINE_DATA_SIZE, ea_val, ea_len);
+
+        if ((fs_meta->type == TSK_FS_META_TYPE_LNK)
+            && (fs_meta->size < EXT2FS_MAXPATHLEN) && (fs_meta->size >= 0)) {
+            size_t link_len = (size_t) fs_meta->size < inline_len ?
+                (size_t) fs_meta->size : inline_len;
+
+            if ((fs_meta->link =
+                    tsk_malloc((size_t) (fs_meta->size + 1))) == NULL)
+                return 1;
+
+            memcpy(fs_meta->link, fs_meta->content_ptr, link_len);
+            fs_meta->link[link_len] = '\0';
+
+            /* Clean up name */
+            for (i = 0; fs_meta->link[i] != '\0'; i++) {
+                if (TSK_IS_CNTRL(fs_meta->link[i]))
+                    fs_meta->link[i] = '^';
+            }
+        }
+    }
+    else if (tsk_getu32(fs->endian, dino_buf->i_flags) & EXT2_IN_EXTENTS) {
         uint32_t *addr_ptr;
         fs_meta->content_type = TSK_FS_META_CONTENT_TYPE_EXT4_EXTENTS;
         /* NOTE TSK_DADDR_T != uint32_t, so lets make sure we use uint32_t */
@@ -732,6 +1034,7 @@ ext2fs_dinode_copy(EXT2FS_INFO * ext2fs, TSK_FS_META * fs_meta,
     }
     else {
         TSK_DADDR_T *addr_ptr;
+        fs_meta->content_type = TSK_FS_META_CONTENT_TYPE_DEFAULT;
         addr_ptr = (TSK_DADDR_T *) fs_meta->content_ptr;
         for (i = 0; i < EXT2FS_NDADDR + EXT2FS_NIADDR; i++)
             addr_ptr[i] = tsk_gets32(fs->endian, dino_buf->i_block[i]);
@@ -830,7 +1133,7 @@ ext2fs_dinode_copy(EXT2FS_INFO * ext2fs, TSK_FS_META * fs_meta,
 
     tsk_take_lock(&ext2fs->lock);
 
-    if (ext2fs_imap_load(ext2fs, grp_num)) {
+    if ((imap = ext2fs_imap_load(ext2fs, grp_num)) == NULL) {
         tsk_release_lock(&ext2fs->lock);
         return 1;
     }
@@ -842,7 +1145,7 @@ ext2fs_dinode_copy(EXT2FS_INFO * ext2fs, TSK_FS_META * fs_meta,
     /*
      * Apply the allocated/unallocated restriction.
      */
-    fs_meta->flags = (isset(ext2fs->imap_buf, inum - ibase) ?
+    fs_meta->flags = (isset(imap, inum - ibase) ?
         TSK_FS_META_FLAG_ALLOC : TSK_FS_META_FLAG_UNALLOC);
 
     tsk_release_lock(&ext2fs->lock);
@@ -920,6 +1223,10 @@ ext2fs_inode_lookup(TSK_FS_INFO * fs, TSK_FS_FILE * a_fs_file,
 
 
 
+/* Maximum number of bytes of an inode table that ext2fs_inode_walk()
+ * reads at a time */
+#define EXT2FS_ITABLE_CHUNK (1024 * 1024)
+
 /* ext2fs_inode_walk - inode iterator
  *
  * flags used: TSK_FS_META_FLAG_USED, TSK_FS_META_FLAG_UNUSED,
@@ -943,6 +1250,13 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     int myflags;
     ext2fs_inode *dino_buf = NULL;
     unsigned int size = 0;
+    uint8_t *imap = NULL;
+    EXT2_GRPNUM_T imap_grp_num = 0xffffffff;
+    uint8_t *itbl = NULL;
+    TSK_INUM_T itbl_first = 0, itbl_cnt = 0, itbl_max;
+    TSK_DADDR_T itbl_addr = 0;
+    TSK_INUM_T ino_init = 0;
+    uint32_t ipg;
 
     // clean up any error messages that are lying around
     tsk_error_reset();
@@ -1027,8 +1341,30 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         return 1;
     }
 
+    /* Keep our own copy of the inode bitmap for the current group so
+     * that walks in other threads do not make us reload it for each inode */
+    if ((imap = (uint8_t *) tsk_malloc(fs->block_size)) == NULL) {
+        free(dino_buf);
+        return 1;
+    }
+
+    /* The inode table of the current group is read in chunks of up to
+     * EXT2FS_ITABLE_CHUNK bytes and the inodes are used from there */
+    ipg = tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group);
+    itbl_max = EXT2FS_ITABLE_CHUNK / ext2fs->inode_size;
+    if (itbl_max > end_inum_tmp - start_inum + 1)
+        itbl_max = end_inum_tmp - start_inum + 1;
+    if ((itbl =
+            (uint8_t *) tsk_malloc((size_t) itbl_max *
+                ext2fs->inode_size)) == NULL) {
+        free(imap);
+        free(dino_buf);
+        return 1;
+    }
+
     for (inum = start_inum; inum <= end_inum_tmp; inum++) {
         int retval;
+        ext2fs_inode *dino;
 
         /*
          * Be sure to use the proper group descriptor data. XXX Linux inodes
@@ -1038,40 +1374,103 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
             (EXT2_GRPNUM_T) ((inum - 1) / tsk_getu32(fs->endian,
                 ext2fs->fs->s_inodes_per_group));
 
-        /* lock access to imap_buf */
-        tsk_take_lock(&ext2fs->lock);
+        if (grp_num != imap_grp_num) {
+            uint8_t *cached;
+
+            /* lock access to the bitmap cache */
+            tsk_take_lock(&ext2fs->lock);
 
-        if (ext2fs_imap_load(ext2fs, grp_num)) {
+            if ((cached = ext2fs_imap_load(ext2fs, grp_num)) == NULL) {
+                tsk_release_lock(&ext2fs->lock);
+                free(itbl);
+                free(imap);
+                free(dino_buf);
+                return 1;
+            }
+            memcpy(imap, cached, fs->block_size);
             tsk_release_lock(&ext2fs->lock);
-            free(dino_buf);
-            return 1;
+
+            if (ext2fs_group_itable(ext2fs, grp_num, &itbl_addr,
+                    &ino_init)) {
+                free(itbl);
+                free(imap);
+                free(dino_buf);
+                return 1;
+            }
+            imap_grp_num = grp_num;
+            itbl_cnt = 0;
         }
-        ibase =
-            grp_num * tsk_getu32(fs->endian,
-            ext2fs->fs->s_inodes_per_group) + 1;
+        ibase = grp_num * ipg + 1;
 
         /*
          * Apply the allocated/unallocated restriction.
          */
-        myflags = (isset(ext2fs->imap_buf, inum - ibase) ?
+        myflags = (isset(imap, inum - ibase) ?
             TSK_FS_META_FLAG_ALLOC : TSK_FS_META_FLAG_UNALLOC);
 
-        tsk_release_lock(&ext2fs->lock);
-
         if ((flags & myflags) != myflags)
             continue;
 
-        if (ext2fs_dinode_load(ext2fs, inum, dino_buf)) {
-            tsk_fs_file_close(fs_file);
-            free(dino_buf);
-            return 1;
+        /* Read the next chunk of the inode table if this inode is not in
+         * the buffer.  The part of the table that the group descriptor
+         * says was never used is only read if unallocated inodes are
+         * wanted, because e2fsck also marks groups whose inodes were all
+         * deleted that way.  The chunk stops at the end of the group. */
+        if ((inum < itbl_first) || (inum >= itbl_first + itbl_cnt)) {
+            TSK_INUM_T rel_inum = inum - ibase;
+            TSK_INUM_T lim =
+                (flags & TSK_FS_META_FLAG_UNALLOC) ? ipg : ino_init;
+
+            itbl_cnt = 0;
+            if (rel_inum < lim) {
+                TSK_INUM_T n = lim - rel_inum;
+                ssize_t cnt;
+
+                if (n > itbl_max)
+                    n = itbl_max;
+                if (n > end_inum_tmp - inum + 1)
+                    n = end_inum_tmp - inum + 1;
+                cnt = tsk_fs_read(fs,
+                    (TSK_OFF_T) itbl_addr * fs->block_size +
+                    (TSK_OFF_T) rel_inum * ext2fs->inode_size,
+                    (char *) itbl, (size_t) n * ext2fs->inode_size);
+                itbl_first = inum;
+                if (cnt > 0)
+                    itbl_cnt = (TSK_INUM_T) cnt / ext2fs->inode_size;
+                tsk_error_reset();
+            }
+        }
+
+        if ((inum >= itbl_first) && (inum < itbl_first + itbl_cnt)) {
+            uint8_t *raw = &itbl[(inum - itbl_first) * ext2fs->inode_size];
+
+            if (ext2fs->inode_size >= sizeof(ext2fs_inode)) {
+                dino = (ext2fs_inode *) raw;
+            }
+            else {
+                memcpy(dino_buf, raw, ext2fs->inode_size);
+                dino = dino_buf;
+            }
+            if (tsk_verbose)
+                ext2fs_dinode_print(ext2fs, inum, dino);
+        }
+        // not in the buffer (never used or could not be read)
+        else {
+            if (ext2fs_dinode_load(ext2fs, inum, dino_buf)) {
+                tsk_fs_file_close(fs_file);
+                free(itbl);
+                free(imap);
+                free(dino_buf);
+                return 1;
+            }
+            dino = dino_buf;
         }
 
 
         /*
          * Apply the used/unused restriction.
          */
-        myflags |= (tsk_getu32(fs->endian, dino_buf->i_ctime) ?
+        myflags |= (tsk_getu32(fs->endian, dino->i_ctime) ?
             TSK_FS_META_FLAG_USED : TSK_FS_META_FLAG_UNUSED);
 
         if ((flags & myflags) != myflags)
@@ -1091,8 +1490,10 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
          * Fill in a file system-independent inode structure and pass control
          * to the application.
          */
-        if (ext2fs_dinode_copy(ext2fs, fs_file->meta, inum, dino_buf)) {
+        if (ext2fs_dinode_copy(ext2fs, fs_file->meta, inum, dino)) {
             tsk_fs_meta_close(fs_file->meta);
+            free(itbl);
+            free(imap);
             free(dino_buf);
             return 1;
         }
@@ -1100,11 +1501,15 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         retval = a_action(fs_file, a_ptr);
         if (retval == TSK_WALK_STOP) {
             tsk_fs_file_close(fs_file);
+            free(itbl);
+            free(imap);
             free(dino_buf);
             return 0;
         }
         else if (retval == TSK_WALK_ERROR) {
             tsk_fs_file_close(fs_file);
+            free(itbl);
+            free(imap);
             free(dino_buf);
             return 1;
         }
@@ -1118,6 +1523,8 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
 
         if (tsk_fs_dir_make_orphan_dir_meta(fs, fs_file->meta)) {
             tsk_fs_file_close(fs_file);
+            free(itbl);
+            free(imap);
             free(dino_buf);
             return 1;
         }
@@ -1125,11 +1532,15 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         retval = a_action(fs_file, a_ptr);
         if (retval == TSK_WALK_STOP) {
             tsk_fs_file_close(fs_file);
+            free(itbl);
+            free(imap);
             free(dino_buf);
             return 0;
         }
         else if (retval == TSK_WALK_ERROR) {
             tsk_fs_file_close(fs_file);
+            free(itbl);
+            free(imap);
             free(dino_buf);
             return 1;
         }
@@ -1139,6 +1550,8 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
      * Cleanup.
      */
     tsk_fs_file_close(fs_file);
+    free(itbl);
+    free(imap);
     if (dino_buf != NULL)
         free((char *) dino_buf);
 
@@ -1153,8 +1566,11 @@ ext2fs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
     EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) a_fs;
     int flags;
     EXT2_GRPNUM_T grp_num;
+    uint8_t *bmap;
     TSK_DADDR_T dbase = 0;      /* first block number in group */
     TSK_DADDR_T dmin = 0;       /* first block after inodes */
+    ext2fs_gd *grp_buf;
+    ext4fs_gd *ext4_grp_buf;
 
     // these blocks are not described in the group descriptors
     // sparse
@@ -1165,11 +1581,15 @@ ext2fs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
 
     grp_num = ext2_dtog_lcl(a_fs, ext2fs->fs, a_addr);
 
-    /* lock access to bmap_buf */
+    /* lock access to the bitmap cache */
     tsk_take_lock(&ext2fs->lock);
 
     /* Lookup bitmap if not loaded */
-    if (ext2fs_bmap_load(ext2fs, grp_num)) {
+    if ((bmap = ext2fs_bmap_load(ext2fs, grp_num)) == NULL) {
+        tsk_release_lock(&ext2fs->lock);
+        return 0;
+    }
+    if (ext2fs_group_get(ext2fs, grp_num, &grp_buf, &ext4_grp_buf)) {
         tsk_release_lock(&ext2fs->lock);
         return 0;
     }
@@ -1183,7 +1603,7 @@ ext2fs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
      * s_first_data_block field.
      */
     dbase = ext2_cgbase_lcl(a_fs, ext2fs->fs, grp_num);
-    flags = (isset(ext2fs->bmap_buf, a_addr - dbase) ?
+    flags = (isset(bmap, a_addr - dbase) ?
         TSK_FS_BLOCK_FLAG_ALLOC : TSK_FS_BLOCK_FLAG_UNALLOC);
     
     /*
@@ -1204,23 +1624,23 @@ ext2fs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
      * They just happen to be reserved for something else :-)
      */
 
-    if (ext2fs->ext4_grp_buf != NULL) {
-        dmin = ext4_getu64(a_fs->endian, ext2fs->ext4_grp_buf->bg_inode_table_hi,
-                    ext2fs->ext4_grp_buf->bg_inode_table_lo) + + INODE_TABLE_SIZE(ext2fs);
+    if (ext4_grp_buf != NULL) {
+        dmin = ext4_getu64(a_fs->endian, ext4_grp_buf->bg_inode_table_hi,
+                    ext4_grp_buf->bg_inode_table_lo) + + INODE_TABLE_SIZE(ext2fs);
 
         if ((a_addr >= dbase
                 && a_addr < ext4_getu64(a_fs->endian, 
-                ext2fs->ext4_grp_buf->bg_block_bitmap_hi,
-                ext2fs->ext4_grp_buf->bg_block_bitmap_lo))
+                ext4_grp_buf->bg_block_bitmap_hi,
+                ext4_grp_buf->bg_block_bitmap_lo))
             || (a_addr == ext4_getu64(a_fs->endian, 
-                ext2fs->ext4_grp_buf->bg_block_bitmap_hi,
-                ext2fs->ext4_grp_buf->bg_block_bitmap_lo))
+                ext4_grp_buf->bg_block_bitmap_hi,
+                ext4_grp_buf->bg_block_bitmap_lo))
             || (a_addr == ext4_getu64(a_fs->endian, 
-                ext2fs->ext4_grp_buf->bg_inode_bitmap_hi,
-                ext2fs->ext4_grp_buf->bg_inode_bitmap_lo))
+                ext4_grp_buf->bg_inode_bitmap_hi,
+                ext4_grp_buf->bg_inode_bitmap_lo))
             || (a_addr >= ext4_getu64(a_fs->endian, 
-                ext2fs->ext4_grp_buf->bg_inode_table_hi,
-                ext2fs->ext4_grp_buf->bg_inode_table_lo)
+                ext4_grp_buf->bg_inode_table_hi,
+                ext4_grp_buf->bg_inode_table_lo)
                 && a_addr < dmin))
             flags |= TSK_FS_BLOCK_FLAG_META;
         else
@@ -1230,17 +1650,17 @@ ext2fs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
     else {
         dmin =
             tsk_getu32(a_fs->endian,
-            ext2fs->grp_buf->bg_inode_table) + INODE_TABLE_SIZE(ext2fs);
+            grp_buf->bg_inode_table) + INODE_TABLE_SIZE(ext2fs);
 
         if ((a_addr >= dbase
                 && a_addr < tsk_getu32(a_fs->endian,
-                    ext2fs->grp_buf->bg_block_bitmap))
+                    grp_buf->bg_block_bitmap))
             || (a_addr == tsk_getu32(a_fs->endian,
-                    ext2fs->grp_buf->bg_block_bitmap))
+                    grp_buf->bg_block_bitmap))
             || (a_addr == tsk_getu32(a_fs->endian,
-                    ext2fs->grp_buf->bg_inode_bitmap))
+                    grp_buf->bg_inode_bitmap))
             || (a_addr >= tsk_getu32(a_fs->endian,
-                    ext2fs->grp_buf->bg_inode_table)
+                    grp_buf->bg_inode_table)
                 && a_addr < dmin))
             flags |= TSK_FS_BLOCK_FLAG_META;
         else
@@ -1252,6 +1672,88 @@ ext2fs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
 }
 
 
+/* ext2fs_block_getflags_run - get the flags of a block and the number of
+ * blocks that follow it (up to a_end) that have the same flags.  The run
+ * is found by scanning the block bitmap of the group and stops at the
+ * end of the group and where the group's metadata starts or ends.
+ *
+ * Return the number of blocks in the run or 0 on error
+ */
+static TSK_DADDR_T
+ext2fs_block_getflags_run(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr,
+    TSK_DADDR_T a_end, TSK_FS_BLOCK_FLAG_ENUM * a_flags)
+{
+    EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) a_fs;
+    EXT2_GRPNUM_T grp_num;
+    uint8_t *bmap;
+    TSK_DADDR_T dbase, last, bounds[6];
+    size_t len;
+    int i;
+    ext2fs_gd *grp_buf;
+    ext4fs_gd *ext4_grp_buf;
+
+    *a_flags = ext2fs_block_getflags(a_fs, a_addr);
+    if (*a_flags == 0)
+        return 0;
+
+    // block 0 and the blocks before the first group
+    if ((a_addr == 0) || (a_addr < ext2fs->first_data_block))
+        return 1;
+
+    grp_num = ext2_dtog_lcl(a_fs, ext2fs->fs, a_addr);
+    dbase = ext2_cgbase_lcl(a_fs, ext2fs->fs, grp_num);
+    last = dbase + tsk_getu32(a_fs->endian,
+        ext2fs->fs->s_blocks_per_group) - 1;
+    if (last - dbase >= (TSK_DADDR_T) a_fs->block_size * 8)
+        last = dbase + (TSK_DADDR_T) a_fs->block_size * 8 - 1;
+    if (last > a_end)
+        last = a_end;
+
+    /* lock access to the bitmap cache */
+    tsk_take_lock(&ext2fs->lock);
+
+    if (((bmap = ext2fs_bmap_load(ext2fs, grp_num)) == NULL)
+        || (ext2fs_group_get(ext2fs, grp_num, &grp_buf, &ext4_grp_buf))) {
+        tsk_release_lock(&ext2fs->lock);
+        return 0;
+    }
+
+    // places where the META / CONT status changes (see ext2fs_block_getflags)
+    if (ext4_grp_buf != NULL) {
+        bounds[0] = ext4_getu64(a_fs->endian,
+            ext4_grp_buf->bg_block_bitmap_hi,
+            ext4_grp_buf->bg_block_bitmap_lo);
+        bounds[2] = ext4_getu64(a_fs->endian,
+            ext4_grp_buf->bg_inode_bitmap_hi,
+            ext4_grp_buf->bg_inode_bitmap_lo);
+        bounds[4] = ext4_getu64(a_fs->endian,
+            ext4_grp_buf->bg_inode_table_hi,
+            ext4_grp_buf->bg_inode_table_lo);
+    }
+    else {
+        bounds[0] = tsk_getu32(a_fs->endian,
+            grp_buf->bg_block_bitmap);
+        bounds[2] = tsk_getu32(a_fs->endian,
+            grp_buf->bg_inode_bitmap);
+        bounds[4] = tsk_getu32(a_fs->endian,
+            grp_buf->bg_inode_table);
+    }
+    bounds[1] = bounds[0] + 1;
+    bounds[3] = bounds[2] + 1;
+    bounds[5] = bounds[4] + INODE_TABLE_SIZE(ext2fs);
+    for (i = 0; i < 6; i++) {
+        if ((bounds[i] > a_addr) && (bounds[i] - 1 < last))
+            last = bounds[i] - 1;
+    }
+
+    len = tsk_fs_bitmap_run(bmap, (size_t) (a_addr - dbase),
+        (size_t) (last - dbase + 1), 0);
+
+    tsk_release_lock(&ext2fs->lock);
+    return len;
+}
+
+
 /* ext2fs_block_walk - block iterator
  *
  * flags: TSK_FS_BLOCK_FLAG_ALLOC, TSK_FS_BLOCK_FLAG_UNALLOC, TSK_FS_BLOCK_FLAG_CONT,
@@ -1361,122 +1863,305 @@ ext2fs_block_walk(TSK_FS_INFO * a_fs, TSK_DADDR_T a_start_blk,
     return 0;
 }
 
-static uint8_t
-ext2fs_fscheck(TSK_FS_INFO * fs, FILE * hFile)
+/* Maximum number of blocks in the extent tree block cache
+ * (EXT2FS_INFO.ext_head) */
+#define EXT2FS_EXTENT_CACHE_MAX 256
+
+/* Maximum depth of an extent tree (the kernel allows 5 levels) */
+#define EXT2FS_EXTENT_MAX_DEPTH 5
+
+/* Unlink a block from the extent tree block cache.  Must hold lock. */
+static void
+ext2fs_extent_cache_unlink(EXT2FS_INFO * ext2fs,
+    EXT2FS_EXTENT_BLOCK * entry)
 {
-    tsk_error_reset();
-    tsk_error_set_errno(TSK_ERR_FS_UNSUPFUNC);
-    tsk_error_set_errstr("fscheck not implemented yet for Ext3");
-    return 1;
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        ext2fs->ext_head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        ext2fs->ext_tail = entry->prev;
+    entry->prev = entry->next = NULL;
 }
 
-/** \internal
- * Add a single extent -- that is, a single data ran -- to the file data attribute.
- * @return 0 on success, 1 on error.
- */
-static TSK_OFF_T
-ext2fs_make_data_run_extent(TSK_FS_INFO * fs_info, TSK_FS_ATTR * fs_attr,
-    ext2fs_extent * extent)
+/* Add a block to the front of the extent tree block cache.  Must hold
+ * lock. */
+static void
+ext2fs_extent_cache_push(EXT2FS_INFO * ext2fs, EXT2FS_EXTENT_BLOCK * entry)
 {
-    TSK_FS_ATTR_RUN *data_run;
-    data_run = tsk_fs_attr_run_alloc();
-    if (data_run == NULL) {
-        return 1;
-    }
-
-    data_run->offset = tsk_getu32(fs_info->endian, extent->ee_block);
-    data_run->addr =
-        (((uint32_t) tsk_getu16(fs_info->endian,
-                extent->ee_start_hi)) << 16) | tsk_getu32(fs_info->endian,
-        extent->ee_start_lo);
-    data_run->len = tsk_getu16(fs_info->endian, extent->ee_len);
+    entry->prev = NULL;
+    entry->next = ext2fs->ext_head;
+    if (ext2fs->ext_head)
+        ext2fs->ext_head->prev = entry;
+    else
+        ext2fs->ext_tail = entry;
+    ext2fs->ext_head = entry;
+}
 
-    // save the run
-    if (tsk_fs_attr_add_run(fs_info, fs_attr, data_run)) {
-        return 1;
+/* Free all of the blocks in the extent tree block cache */
+static void
+ext2fs_extent_cache_free(EXT2FS_INFO * ext2fs)
+{
+    while (ext2fs->ext_head) {
+        EXT2FS_EXTENT_BLOCK *entry = ext2fs->ext_head;
+        ext2fs->ext_head = entry->next;
+        free(entry);
     }
-
-    return 0;
+    ext2fs->ext_tail = NULL;
+    ext2fs->ext_cnt = 0;
 }
 
-
 /** \internal
- * Given a block that contains an extent node (which starts with extent_header),
- * walk it, and add everything encountered to the appropriate attributes.
+ * Read a block of an extent tree.  The blocks are kept in a cache that is
+ * shared by all of the files in the file system.
+ *
+ * @param ext2fs File system
+ * @param a_addr Address of the block
+ * @param a_buf Buffer to copy the block to (block_size bytes)
  * @return 0 on success, 1 on error.
  */
-static TSK_OFF_T
-ext2fs_make_data_run_extent_index(TSK_FS_INFO * fs_info,
-    TSK_FS_ATTR * fs_attr, TSK_FS_ATTR * fs_attr_extent,
-    TSK_DADDR_T idx_block)
+static uint8_t
+ext2fs_extent_block_read(EXT2FS_INFO * ext2fs, TSK_DADDR_T a_addr,
+    uint8_t * a_buf)
 {
-    ext2fs_extent_header *header;
-    TSK_FS_ATTR_RUN *data_run;
-    uint8_t *buf;
+    TSK_FS_INFO *fs_info = &ext2fs->fs_info;
+    EXT2FS_EXTENT_BLOCK *entry;
     ssize_t cnt;
-    unsigned int i;
 
-    /* first, read the block specified by the parameter */
-    int fs_blocksize = fs_info->block_size;
-    if ((buf = (uint8_t *) tsk_malloc(fs_blocksize)) == NULL) {
-        return 1;
+    tsk_take_lock(&ext2fs->lock);
+    for (entry = ext2fs->ext_head; entry != NULL; entry = entry->next) {
+        if (entry->addr == a_addr) {
+            memcpy(a_buf, entry->buf, fs_info->block_size);
+            if (entry != ext2fs->ext_head) {
+                ext2fs_extent_cache_unlink(ext2fs, entry);
+                ext2fs_extent_cache_push(ext2fs, entry);
+            }
+            tsk_release_lock(&ext2fs->lock);
+            return 0;
+        }
     }
+    tsk_release_lock(&ext2fs->lock);
 
-    cnt =
-        tsk_fs_read_block(fs_info, idx_block, (char *) buf, fs_blocksize);
-    if (cnt != fs_blocksize) {
+    cnt = tsk_fs_read_block(fs_info, a_addr, (char *) a_buf,
+        fs_info->block_size);
+    if (cnt != fs_info->block_size) {
         if (cnt >= 0) {
             tsk_error_reset();
             tsk_error_set_errno(TSK_ERR_FS_READ);
         }
-        tsk_error_set_errstr("ext2fs_make_data_run_extent_index: Block %"
-            PRIuDADDR, idx_block);
+        tsk_error_set_errstr2("ext2fs_extent_block_read: Block %"
+            PRIuDADDR, a_addr);
         return 1;
     }
-    header = (ext2fs_extent_header *) buf;
 
-    /* add it to the extent attribute */
+    /* Add it to the cache.  Errors are ignored because the cache is only
+     * an optimization.  If another thread added the same block in the
+     * meantime, the older copy is never found again and ages out. */
+    if ((entry = (EXT2FS_EXTENT_BLOCK *) malloc(sizeof(*entry) +
+                fs_info->block_size)) == NULL)
+        return 0;
+    entry->addr = a_addr;
+    entry->buf = (uint8_t *) & entry[1];
+    memcpy(entry->buf, a_buf, fs_info->block_size);
+
+    tsk_take_lock(&ext2fs->lock);
+    ext2fs_extent_cache_push(ext2fs, entry);
+    if (++ext2fs->ext_cnt > EXT2FS_EXTENT_CACHE_MAX) {
+        EXT2FS_EXTENT_BLOCK *old = ext2fs->ext_tail;
+        ext2fs_extent_cache_unlink(ext2fs, old);
+        ext2fs->ext_cnt--;
+        free(old);
+    }
+    tsk_release_lock(&ext2fs->lock);
+    return 0;
+}
+
+/** \internal
+ * Check the header of an extent tree node that was read from a block.
+ *
+ * @param fs_info File system
+ * @param header Header of the node
+ * @param a_depth Depth that the node must have
+ * @return 0 if it is valid, 1 if not.
+ */
+static uint8_t
+ext2fs_extent_header_check(TSK_FS_INFO * fs_info,
+    const ext2fs_extent_header * header, uint16_t a_depth)
+{
     if (tsk_getu16(fs_info->endian, header->eh_magic) != 0xF30A) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("ext2fs_load_attrs: extent header magic valid incorrect!");
+        return 1;
+    }
+    if (tsk_getu16(fs_info->endian, header->eh_depth) != a_depth) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("ext2fs_load_attrs: extent tree node has depth %d (expected %d)",
+            tsk_getu16(fs_info->endian, header->eh_depth), a_depth);
+        return 1;
+    }
+    /* leaf and index entries have the same size */
+    if (tsk_getu16(fs_info->endian, header->eh_entries) >
+        (fs_info->block_size - sizeof(ext2fs_extent_header)) /
+        sizeof(ext2fs_extent)) {
+        tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
         tsk_error_set_errstr
-            ("ext2fs_make_data_run_extent_index: extent header magic valid incorrect!");
+            ("ext2fs_load_attrs: extent tree node reports too many entries");
         return 1;
     }
+    return 0;
+}
 
+/** \internal
+ * Make a data run for a single extent.
+ * @return the run or NULL on error.
+ */
+static TSK_FS_ATTR_RUN *
+ext2fs_extent_to_run(TSK_FS_INFO * fs_info, const ext2fs_extent * extent)
+{
+    TSK_FS_ATTR_RUN *data_run;
     data_run = tsk_fs_attr_run_alloc();
     if (data_run == NULL) {
+        return NULL;
+    }
+
+    data_run->offset = tsk_getu32(fs_info->endian, extent->ee_block);
+    data_run->addr =
+        (((TSK_DADDR_T) tsk_getu16(fs_info->endian,
+                extent->ee_start_hi)) << 32) | tsk_getu32(fs_info->endian,
+        extent->ee_start_lo);
+    data_run->len = tsk_getu16(fs_info->endian, extent->ee_len);
+    return data_run;
+}
+
+/** \internal
+ * Add a single extent -- that is, a single data ran -- to the file data attribute.
+ * @return 0 on success, 1 on error.
+ */
+static TSK_OFF_T
+ext2fs_make_data_run_extent(TSK_FS_INFO * fs_info, TSK_FS_ATTR * fs_attr,
+    ext2fs_extent * extent)
+{
+    TSK_FS_ATTR_RUN *data_run;
+    if ((data_run = ext2fs_extent_to_run(fs_info, extent)) == NULL) {
         return 1;
     }
-    data_run->addr = idx_block;
-    data_run->len = fs_blocksize;
 
-    if (tsk_fs_attr_add_run(fs_info, fs_attr_extent, data_run)) {
+    // save the run
+    if (tsk_fs_attr_add_run(fs_info, fs_attr, data_run)) {
         return 1;
     }
 
-    /* process leaf nodes */
-    if (tsk_getu16(fs_info->endian, header->eh_depth) == 0) {
-        ext2fs_extent *extents = (ext2fs_extent *) (header + 1);
-        for (i = 0; i < tsk_getu16(fs_info->endian, header->eh_entries);
-            i++) {
-            ext2fs_extent extent = extents[i];
-            if (ext2fs_make_data_run_extent(fs_info, fs_attr, &extent)) {
+    return 0;
+}
+
+/* A leaf node of an extent tree */
+typedef struct {
+    TSK_DADDR_T addr;           /* block that stores the leaf */
+    TSK_DADDR_T offset;         /* first file block that the leaf maps */
+} EXT4_EXTENT_LEAF;
+
+/* State while the index nodes of an extent tree are loaded */
+typedef struct {
+    TSK_FS_ATTR_RUN *tree_head; /* runs for the blocks of the tree */
+    TSK_FS_ATTR_RUN *tree_tail; /* last entry in tree_head */
+    TSK_DADDR_T tree_cnt;       /* number of blocks in tree_head */
+    EXT4_EXTENT_LEAF *leaves;   /* leaves of the tree in file order */
+    size_t leaf_cnt;            /* number of entries in leaves */
+    size_t leaf_max;            /* number of entries allocated in leaves */
+} EXT4_EXTENT_LOAD;
+
+/** \internal
+ * Walk the index nodes below an index node of an extent tree.  Every
+ * block of the tree gets a run (for the extent attribute) and the leaves
+ * are collected, but the leaves themselves are not read.
+ *
+ * @param ext2fs File system
+ * @param a_load State of the load
+ * @param header Index node
+ * @param a_depth Depth of the index node (1 if its entries point to leaves)
+ * @return 0 on success, 1 on error.
+ */
+static uint8_t
+ext4_extent_index_load(EXT2FS_INFO * ext2fs, EXT4_EXTENT_LOAD * a_load,
+    const ext2fs_extent_header * header, uint16_t a_depth)
+{
+    TSK_FS_INFO *fs_info = &ext2fs->fs_info;
+    const ext2fs_extent_idx *indices =
+        (const ext2fs_extent_idx *) (header + 1);
+    uint16_t num_entries = tsk_getu16(fs_info->endian, header->eh_entries);
+    uint8_t *buf = NULL;
+    int i;
+
+    for (i = 0; i < num_entries; i++) {
+        const ext2fs_extent_idx *index = &indices[i];
+        TSK_DADDR_T child_block =
+            (((TSK_DADDR_T) tsk_getu16(fs_info->endian,
+                    index->ei_leaf_hi)) << 32) | tsk_getu32(fs_info->endian,
+            index->ei_leaf_lo);
+        TSK_FS_ATTR_RUN *data_run;
+
+        // the blocks of the tree are listed in the order they are visited
+        if ((data_run = tsk_fs_attr_run_alloc()) == NULL) {
+            free(buf);
+            return 1;
+        }
+        data_run->offset = a_load->tree_cnt++;
+        data_run->addr = child_block;
+        data_run->len = 1;
+        if (a_load->tree_tail)
+            a_load->tree_tail->next = data_run;
+        else
+            a_load->tree_head = data_run;
+        a_load->tree_tail = data_run;
+
+        if (a_depth == 1) {
+            TSK_DADDR_T offset =
+                tsk_getu32(fs_info->endian, index->ei_block);
+
+            if ((a_load->leaf_cnt > 0)
+                && (offset <= a_load->leaves[a_load->leaf_cnt - 1].offset)) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+                tsk_error_set_errstr
+                    ("ext4_extent_index_load: extent index entries are out of order");
+                free(buf);
                 return 1;
             }
+            if (a_load->leaf_cnt == a_load->leaf_max) {
+                size_t max = a_load->leaf_max ? a_load->leaf_max * 2 : 16;
+                EXT4_EXTENT_LEAF *leaves;
+
+                if ((leaves = (EXT4_EXTENT_LEAF *)
+                        tsk_realloc(a_load->leaves,
+                            max * sizeof(EXT4_EXTENT_LEAF))) == NULL) {
+                    free(buf);
+                    return 1;
+                }
+                a_load->leaves = leaves;
+                a_load->leaf_max = max;
+            }
+            a_load->leaves[a_load->leaf_cnt].addr = child_block;
+            a_load->leaves[a_load->leaf_cnt].offset = offset;
+            a_load->leaf_cnt++;
         }
-    }
-    /* recurse on interior nodes */
-    else {
-        ext2fs_extent_idx *indices = (ext2fs_extent_idx *) (header + 1);
-        for (i = 0; i < tsk_getu16(fs_info->endian, header->eh_entries);
-            i++) {
-            ext2fs_extent_idx *index = &indices[i];
-            TSK_DADDR_T child_block =
-                (((uint32_t) tsk_getu16(fs_info->endian,
-                        index->ei_leaf_hi)) << 16) | tsk_getu32(fs_info->
-                endian, index->ei_leaf_lo);
-            if (ext2fs_make_data_run_extent_index(fs_info, fs_attr,
-                    fs_attr_extent, child_block)) {
+        else {
+            if ((buf == NULL) && ((buf = (uint8_t *)
+                        tsk_malloc(fs_info->block_size)) == NULL)) {
+                return 1;
+            }
+            if ((ext2fs_extent_block_read(ext2fs, child_block, buf))
+                || (ext2fs_extent_header_check(fs_info,
+                        (ext2fs_extent_header *) buf, a_depth - 1))
+                || (ext4_extent_index_load(ext2fs, a_load,
+                        (ext2fs_extent_header *) buf, a_depth - 1))) {
+                free(buf);
                 return 1;
             }
         }
@@ -1487,74 +2172,118 @@ ext2fs_make_data_run_extent_index(TSK_FS_INFO * fs_info,
 }
 
 /** \internal
- * Get the number of extent blocks rooted at the given extent_header.
- * The count does not include the extent header passed as a parameter.
+ * Load the extents of a leaf node of an extent tree.  This is the
+ * file system's attr_resolve_run function: the data attribute of a file
+ * with an extent tree gets an UNRESOLVED run for each leaf, which covers
+ * the file blocks from the start of the leaf to the start of the next
+ * one, and the leaf is read only when those blocks are needed.
  *
- * @return the number of extent blocks, or -1 on error.
+ * @param a_fs_attr Attribute that the run is in
+ * @param a_run UNRESOLVED run (addr is the block of the leaf)
+ * @param a_runs [out] Runs of the extents in the leaf
+ * @return 0 on success, 1 on error.
  */
-static int32_t
-ext2fs_extent_tree_index_count(TSK_FS_INFO * fs_info,
-    TSK_FS_META * fs_meta, ext2fs_extent_header * header)
+static uint8_t
+ext4_attr_resolve_run(TSK_FS_ATTR * a_fs_attr,
+    const TSK_FS_ATTR_RUN * a_run, TSK_FS_ATTR_RUN ** a_runs)
 {
-    int fs_blocksize = fs_info->block_size;
-    ext2fs_extent_idx *indices;
-    int count = 0;
+    TSK_FS_INFO *fs_info = a_fs_attr->fs_file->fs_info;
+    EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) fs_info;
+    TSK_FS_ATTR_RUN *head = NULL, *tail = NULL, *data_run;
+    TSK_DADDR_T cur = a_run->offset;
+    TSK_DADDR_T end = a_run->offset + a_run->len;
+    ext2fs_extent_header *header;
+    ext2fs_extent *extents;
+    uint16_t num_entries;
     uint8_t *buf;
     int i;
 
-    if (tsk_getu16(fs_info->endian, header->eh_magic) != 0xF30A) {
-        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-        tsk_error_set_errstr
-            ("ext2fs_load_attrs: extent header magic valid incorrect!");
-        return -1;
-    }
+    *a_runs = NULL;
 
-    if (tsk_getu16(fs_info->endian, header->eh_depth) == 0) {
-        return 0;
+    if ((buf = (uint8_t *) tsk_malloc(fs_info->block_size)) == NULL) {
+        return 1;
     }
-
-    if ((buf = (uint8_t *) tsk_malloc(fs_blocksize)) == NULL) {
-        return -1;
+    if ((ext2fs_extent_block_read(ext2fs, a_run->addr, buf))
+        || (ext2fs_extent_header_check(fs_info,
+                (ext2fs_extent_header *) buf, 0))) {
+        free(buf);
+        return 1;
     }
+    header = (ext2fs_extent_header *) buf;
+    num_entries = tsk_getu16(fs_info->endian, header->eh_entries);
+    extents = (ext2fs_extent *) (header + 1);
 
-    indices = (ext2fs_extent_idx *) (header + 1);
-    for (i = 0; i < tsk_getu16(fs_info->endian, header->eh_entries); i++) {
-        ext2fs_extent_idx *index = &indices[i];
-        TSK_DADDR_T block =
-            (((uint32_t) tsk_getu16(fs_info->endian,
-                    index->ei_leaf_hi)) << 16) | tsk_getu32(fs_info->
-            endian, index->ei_leaf_lo);
-        ssize_t cnt =
-            tsk_fs_read_block(fs_info, block, (char *) buf, fs_blocksize);
-        int ret;
+    for (i = 0; i < num_entries; i++) {
+        if ((data_run = ext2fs_extent_to_run(fs_info, &extents[i])) == NULL)
+            goto on_error;
 
-        if (cnt != fs_blocksize) {
-            if (cnt >= 0) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_READ);
+        /* The leaf must map only blocks in its part of the file (the last
+         * one can also map blocks past the end of the file) */
+        if ((data_run->offset < cur) || ((a_run->next != NULL)
+                && (data_run->offset + data_run->len > end))) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+            tsk_error_set_errstr
+                ("ext4_attr_resolve_run: extent at %" PRIuDADDR
+                " is outside of its index range (%" PRIuINUM ")",
+                data_run->offset, a_fs_attr->fs_file->meta->addr);
+            tsk_fs_attr_run_free(data_run);
+            goto on_error;
+        }
+
+        // holes between the extents
+        if (data_run->offset > cur) {
+            TSK_FS_ATTR_RUN *fill_run;
+            if ((fill_run = tsk_fs_attr_run_alloc()) == NULL) {
+                tsk_fs_attr_run_free(data_run);
+                goto on_error;
             }
-            tsk_error_set_errstr2("ext2fs_extent_tree_index_count: Block %"
-                PRIuDADDR, block);
-            return -1;
+            fill_run->offset = cur;
+            fill_run->len = data_run->offset - cur;
+            fill_run->flags = TSK_FS_ATTR_RUN_FLAG_FILLER;
+            fill_run->next = data_run;
+            data_run = fill_run;
         }
 
-        if ((ret =
-                ext2fs_extent_tree_index_count(fs_info, fs_meta,
-                    (ext2fs_extent_header *) buf)) < 0) {
-            return -1;
+        if (tail)
+            tail->next = data_run;
+        else
+            head = data_run;
+        for (tail = data_run; tail->next; tail = tail->next) {
         }
-        count += ret;
-        count++;
+        cur = tail->offset + tail->len;
+    }
+
+    // hole at the end of the leaf's part of the file
+    if ((a_run->next != NULL) && (cur < end)) {
+        if ((data_run = tsk_fs_attr_run_alloc()) == NULL)
+            goto on_error;
+        data_run->offset = cur;
+        data_run->len = end - cur;
+        data_run->flags = TSK_FS_ATTR_RUN_FLAG_FILLER;
+        if (tail)
+            tail->next = data_run;
+        else
+            head = data_run;
     }
 
     free(buf);
-    return count;
+    *a_runs = head;
+    return 0;
+
+  on_error:
+    if (head)
+        tsk_fs_attr_run_free(head);
+    free(buf);
+    return 1;
 }
 
 
 /**
  * \internal
- * Loads attribute for Ext4 Extents-based storage method.
+ * Loads attribute for Ext4 Extents-based storage method.  The index nodes
+ * of an extent tree are read here, but its leaves are read only when the
+ * data in them is needed (see ext4_attr_resolve_run).
  * @param fs_file File system to analyze
  * @returns 0 on success, 1 otherwise
  */
@@ -1567,7 +2296,6 @@ ext4_load_attrs_extents(TSK_FS_FILE *fs_file)
     TSK_FS_ATTR *fs_attr;
     int i;
     ext2fs_extent *extents = NULL;
-    ext2fs_extent_idx *indices = NULL;
     
     ext2fs_extent_header *header = (ext2fs_extent_header *) fs_meta->content_ptr;
     uint16_t num_entries = tsk_getu16(fs_info->endian, header->eh_entries);
@@ -1642,7 +2370,10 @@ ext4_load_attrs_extents(TSK_FS_FILE *fs_file)
     }
     else {                  /* interior node */
         TSK_FS_ATTR *fs_attr_extent;
-        int32_t extent_index_size;
+        EXT4_EXTENT_LOAD load;
+        TSK_OFF_T extent_index_size;
+        TSK_DADDR_T blocks = (TSK_DADDR_T) (length / fs_info->block_size);
+        size_t j;
         
         if (num_entries >
             (fs_info->block_size -
@@ -1653,6 +2384,13 @@ ext4_load_attrs_extents(TSK_FS_FILE *fs_file)
             ("ext2fs_load_attr: Inode reports too many extent indices");
             return 1;
         }
+        if (depth > EXT2FS_EXTENT_MAX_DEPTH) {
+            tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+            tsk_error_set_errstr
+            ("ext2fs_load_attr: Inode reports extent tree depth of %d",
+             depth);
+            return 1;
+        }
         
         if ((fs_attr_extent =
              tsk_fs_attrlist_getnew(fs_meta->attr,
@@ -1660,37 +2398,104 @@ ext4_load_attrs_extents(TSK_FS_FILE *fs_file)
              return 1;
          }
         
-        extent_index_size =
-        ext2fs_extent_tree_index_count(fs_info, fs_meta, header);
-        if (extent_index_size < 0) {
+        memset(&load, 0, sizeof(load));
+        if (ext4_extent_index_load((EXT2FS_INFO *) fs_info, &load, header,
+                depth)) {
+            if (load.tree_head)
+                tsk_fs_attr_run_free(load.tree_head);
+            free(load.leaves);
             return 1;
         }
         
-        if (tsk_fs_attr_set_run(fs_file, fs_attr_extent, NULL, NULL,
+        extent_index_size = (TSK_OFF_T) load.tree_cnt * fs_info->block_size;
+        if (tsk_fs_attr_set_run(fs_file, fs_attr_extent, load.tree_head, NULL,
                                 TSK_FS_ATTR_TYPE_UNIX_EXTENT, TSK_FS_ATTR_ID_DEFAULT,
-                                fs_info->block_size * extent_index_size,
-                                fs_info->block_size * extent_index_size,
-                                fs_info->block_size * extent_index_size, 0, 0)) {
+                                extent_index_size, extent_index_size,
+                                extent_index_size, 0, 0)) {
+            tsk_fs_attr_run_free(load.tree_head);
+            free(load.leaves);
             return 1;
         }
         
-        indices = (ext2fs_extent_idx *) (header + 1);
-        for (i = 0; i < num_entries; i++) {
-            ext2fs_extent_idx *index = &indices[i];
-            TSK_DADDR_T child_block =
-            (((uint32_t) tsk_getu16(fs_info->endian,
-                                    index->
-                                    ei_leaf_hi)) << 16) | tsk_getu32(fs_info->
-                                                                     endian, index->ei_leaf_lo);
-            if (ext2fs_make_data_run_extent_index(fs_info, fs_attr,
-                                                  fs_attr_extent, child_block)) {
+        /* one UNRESOLVED run for each leaf */
+        for (j = 0; j < load.leaf_cnt; j++) {
+            TSK_FS_ATTR_RUN *data_run;
+            
+            if ((data_run = tsk_fs_attr_run_alloc()) == NULL) {
+                free(load.leaves);
+                return 1;
+            }
+            data_run->offset = load.leaves[j].offset;
+            data_run->addr = load.leaves[j].addr;
+            data_run->flags = TSK_FS_ATTR_RUN_FLAG_UNRESOLVED;
+            if (j + 1 < load.leaf_cnt)
+                data_run->len = load.leaves[j + 1].offset - data_run->offset;
+            else if (blocks > data_run->offset)
+                data_run->len = blocks - data_run->offset;
+            else
+                data_run->len = 1;
+            
+            if (tsk_fs_attr_add_run(fs_info, fs_attr, data_run)) {
+                free(load.leaves);
                 return 1;
             }
         }
+        free(load.leaves);
+    }
+    
+    fs_meta->attr_state = TSK_FS_META_ATTR_STUDIED;
+    
+    return 0;
+}
+
+/**
+ * \internal
+ * Load the data of a file with inline data into a resident attribute.
+ * The data was copied from the inode by ext2fs_dinode_copy(), so no
+ * blocks are read.
+ *
+ * @param fs_file File to load attributes for
+ * @returns 0 on success, 1 otherwise
+ */
+static uint8_t
+ext4_load_attrs_inline(TSK_FS_FILE * fs_file)
+{
+    TSK_FS_META *fs_meta = fs_file->meta;
+    TSK_FS_ATTR *fs_attr;
+    size_t len;
+
+    if ((fs_meta->attr != NULL)
+        && (fs_meta->attr_state == TSK_FS_META_ATTR_STUDIED)) {
+        return 0;
     }
-    
+    else if (fs_meta->attr_state == TSK_FS_META_ATTR_ERROR) {
+        return 1;
+    }
+    else if (fs_meta->attr != NULL) {
+        tsk_fs_attrlist_markunused(fs_meta->attr);
+    }
+    else if ((fs_meta->attr = tsk_fs_attrlist_alloc()) == NULL) {
+        return 1;
+    }
+
+    /* The size should never be larger than the inline data */
+    len = (fs_meta->size < (TSK_OFF_T) fs_meta->content_len) ?
+        (size_t) fs_meta->size : fs_meta->content_len;
+
+    if ((fs_attr =
+            tsk_fs_attrlist_getnew(fs_meta->attr,
+                TSK_FS_ATTR_RES)) == NULL) {
+        return 1;
+    }
+
+    if (tsk_fs_attr_set_str(fs_file, fs_attr, NULL,
+            TSK_FS_ATTR_TYPE_DEFAULT, TSK_FS_ATTR_ID_DEFAULT,
+            fs_meta->content_ptr, len)) {
+        fs_meta->attr_state = TSK_FS_META_ATTR_ERROR;
+        return 1;
+    }
+
     fs_meta->attr_state = TSK_FS_META_ATTR_STUDIED;
-    
     return 0;
 }
 
@@ -1708,6 +2513,10 @@ ext2fs_load_attrs(TSK_FS_FILE * fs_file)
     if (fs_file->meta->content_type == TSK_FS_META_CONTENT_TYPE_EXT4_EXTENTS) {
         return ext4_load_attrs_extents(fs_file);
     }
+    else if (fs_file->meta->content_type ==
+        TSK_FS_META_CONTENT_TYPE_EXT4_INLINE) {
+        return ext4_load_attrs_inline(fs_file);
+    }
     else {
         return tsk_fs_unix_make_data_run(fs_file);
     }
@@ -1716,7 +2525,8 @@ ext2fs_load_attrs(TSK_FS_FILE * fs_file)
 
 static void
 ext4_fsstat_datablock_helper(TSK_FS_INFO * fs, FILE * hFile,
-    unsigned int i, TSK_DADDR_T cg_base, int gd_size)
+    unsigned int i, TSK_DADDR_T cg_base, int gd_size,
+    ext4fs_gd * ext4_grp_buf)
 {
     EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) fs;
     ext2fs_sb *sb = ext2fs->fs;
@@ -1724,7 +2534,7 @@ ext4_fsstat_datablock_helper(TSK_FS_INFO * fs, FILE * hFile,
     unsigned int ibpg, gd_blocks;
     unsigned int num_flex_bg, curr_flex_bg;
     uint64_t last_block;
-    ext4fs_gd *ext4_gd = ext2fs->ext4_grp_buf;
+    ext4fs_gd *ext4_gd = ext4_grp_buf;
     uint64_t db_offset = 0;
     unsigned int num_groups = 0, left_over = 0;
 
@@ -1781,26 +2591,26 @@ ext4_fsstat_datablock_helper(TSK_FS_INFO * fs, FILE * hFile,
             tsk_fprintf(hFile, "    Uninit Data Bitmaps: ");
             tsk_fprintf(hFile, "%" PRIu64 " - %" PRIu64 "\n",
                 ext4_getu64(fs->endian, ext4_gd->bg_block_bitmap_hi,
-                    ext2fs->ext4_grp_buf->bg_block_bitmap_lo)
+                    ext4_grp_buf->bg_block_bitmap_lo)
                 + (left_over), ext4_getu64(fs->endian,
                     ext4_gd->bg_block_bitmap_hi,
-                    ext2fs->ext4_grp_buf->bg_block_bitmap_lo)
+                    ext4_grp_buf->bg_block_bitmap_lo)
                 + gpfbg - 1);
             tsk_fprintf(hFile, "    Uninit Inode Bitmaps: ");
             tsk_fprintf(hFile, "%" PRIu64 " - %" PRIu64 "\n",
                 ext4_getu64(fs->endian, ext4_gd->bg_inode_bitmap_hi,
-                    ext2fs->ext4_grp_buf->bg_inode_bitmap_lo)
+                    ext4_grp_buf->bg_inode_bitmap_lo)
                 + (left_over), ext4_getu64(fs->endian,
                     ext4_gd->bg_inode_bitmap_hi,
-                    ext2fs->ext4_grp_buf->bg_inode_bitmap_lo)
+                    ext4_grp_buf->bg_inode_bitmap_lo)
                 + gpfbg - 1);
             tsk_fprintf(hFile, "    Uninit Inode Table: ");
             tsk_fprintf(hFile, "%" PRIu64 " - %" PRIu64 "\n",
                 ext4_getu64(fs->endian, ext4_gd->bg_inode_table_hi,
-                    ext2fs->ext4_grp_buf->bg_inode_table_lo)
+                    ext4_grp_buf->bg_inode_table_lo)
                 + ((left_over) * ibpg), ext4_getu64(fs->endian,
                     ext4_gd->bg_inode_table_hi,
-                    ext2fs->ext4_grp_buf->bg_inode_table_lo)
+                    ext4_grp_buf->bg_inode_table_lo)
                 + (gpfbg * ibpg) - 1);
             
         }
@@ -1858,6 +2668,8 @@ ext2fs_fsstat(TSK_FS_INFO * fs, FILE * hFile)
     time_t tmptime;
     char timeBuf[128];
     const char *tmptypename;
+    ext2fs_gd *grp_buf;
+    ext4fs_gd *ext4_grp_buf;
 
 
     // clean up any error messages that are lying around
@@ -2157,23 +2969,19 @@ ext2fs_fsstat(TSK_FS_INFO * fs, FILE * hFile)
         TSK_DADDR_T cg_base;
         TSK_INUM_T inum;
 
-        /* lock access to grp_buf */
-        tsk_take_lock(&ext2fs->lock);
-
-        if (ext2fs_group_load(ext2fs, i)) {
-            tsk_release_lock(&ext2fs->lock);
+        if (ext2fs_group_get(ext2fs, i, &grp_buf, &ext4_grp_buf)) {
             return 1;
         }
         tsk_fprintf(hFile, "\nGroup: %d:\n", i);
-        if (ext2fs->ext4_grp_buf != NULL) {
+        if (ext4_grp_buf != NULL) {
             tsk_fprintf(hFile, "  Block Group Flags: [");
-            if (EXT4BG_HAS_FLAG(fs, ext2fs->ext4_grp_buf,
+            if (EXT4BG_HAS_FLAG(fs, ext4_grp_buf,
                 EXT4_BG_INODE_UNINIT))
                 tsk_fprintf(hFile, "INODE_UNINIT, ");
-            if (EXT4BG_HAS_FLAG(fs, ext2fs->ext4_grp_buf,
+            if (EXT4BG_HAS_FLAG(fs, ext4_grp_buf,
                 EXT4_BG_BLOCK_UNINIT))
                 tsk_fprintf(hFile, "BLOCK_UNINIT, ");
-            if (EXT4BG_HAS_FLAG(fs, ext2fs->ext4_grp_buf,
+            if (EXT4BG_HAS_FLAG(fs, ext4_grp_buf,
                 EXT4_BG_INODE_ZEROED))
                 tsk_fprintf(hFile, "INODE_ZEROED, ");
             tsk_fprintf(hFile, "\b\b]\n");
@@ -2252,7 +3060,7 @@ ext2fs_fsstat(TSK_FS_INFO * fs, FILE * hFile)
         /*        if (((tsk_getu32(fs->endian, ext2fs->fs->s_feature_ro_compat) &
         EXT2FS_FEATURE_RO_COMPAT_SPARSE_SUPER) &&
         (cg_base != tsk_getu32(fs->endian,
-        ext2fs->grp_buf->bg_block_bitmap)))
+        grp_buf->bg_block_bitmap)))
         || ((tsk_getu32(fs->endian,
         ext2fs->fs->s_feature_ro_compat) &
         EXT2FS_FEATURE_RO_COMPAT_SPARSE_SUPER) == 0)) {
@@ -2299,61 +3107,62 @@ ext2fs_fsstat(TSK_FS_INFO * fs, FILE * hFile)
         }
 
 
-        if (ext2fs->ext4_grp_buf != NULL) {
+        if (ext4_grp_buf != NULL) {
             /* The block bitmap is a full block */
             tsk_fprintf(hFile,
                 "    Data bitmap: %" PRIu64 " - %" PRIu64 "\n",
                 ext4_getu64(fs->endian,
-                ext2fs->ext4_grp_buf->bg_block_bitmap_hi,
-                ext2fs->ext4_grp_buf->bg_block_bitmap_lo),
+                ext4_grp_buf->bg_block_bitmap_hi,
+                ext4_grp_buf->bg_block_bitmap_lo),
                 ext4_getu64(fs->endian,
-                ext2fs->ext4_grp_buf->bg_block_bitmap_hi,
-                ext2fs->ext4_grp_buf->bg_block_bitmap_lo));
+                ext4_grp_buf->bg_block_bitmap_hi,
+                ext4_grp_buf->bg_block_bitmap_lo));
 
 
             /* The inode bitmap is a full block */
             tsk_fprintf(hFile,
                 "    Inode bitmap: %" PRIu64 " - %" PRIu64 "\n",
                 ext4_getu64(fs->endian,
-                ext2fs->ext4_grp_buf->bg_inode_bitmap_hi,
-                ext2fs->ext4_grp_buf->bg_inode_bitmap_lo),
+                ext4_grp_buf->bg_inode_bitmap_hi,
+                ext4_grp_buf->bg_inode_bitmap_lo),
                 ext4_getu64(fs->endian,
-                ext2fs->ext4_grp_buf->bg_inode_bitmap_hi,
-                ext2fs->ext4_grp_buf->bg_inode_bitmap_lo));
+                ext4_grp_buf->bg_inode_bitmap_hi,
+                ext4_grp_buf->bg_inode_bitmap_lo));
 
 
             tsk_fprintf(hFile,
                 "    Inode Table: %" PRIu64 " - %" PRIu64 "\n",
                 ext4_getu64(fs->endian,
-                ext2fs->ext4_grp_buf->bg_inode_table_hi,
-                ext2fs->ext4_grp_buf->bg_inode_table_lo),
+                ext4_grp_buf->bg_inode_table_hi,
+                ext4_grp_buf->bg_inode_table_lo),
                 ext4_getu64(fs->endian,
-                ext2fs->ext4_grp_buf->bg_inode_table_hi,
-                ext2fs->ext4_grp_buf->bg_inode_table_lo)
+                ext4_grp_buf->bg_inode_table_hi,
+                ext4_grp_buf->bg_inode_table_lo)
                 + ibpg - 1);
 
-            ext4_fsstat_datablock_helper(fs, hFile, i, cg_base, gd_size);
+            ext4_fsstat_datablock_helper(fs, hFile, i, cg_base, gd_size,
+                ext4_grp_buf);
         }
         else {
             /* The block bitmap is a full block */
             tsk_fprintf(hFile,
                 "    Data bitmap: %" PRIu32 " - %" PRIu32 "\n",
-                tsk_getu32(fs->endian, ext2fs->grp_buf->bg_block_bitmap),
-                tsk_getu32(fs->endian, ext2fs->grp_buf->bg_block_bitmap));
+                tsk_getu32(fs->endian, grp_buf->bg_block_bitmap),
+                tsk_getu32(fs->endian, grp_buf->bg_block_bitmap));
 
 
             /* The inode bitmap is a full block */
             tsk_fprintf(hFile,
                 "    Inode bitmap: %" PRIu32 " - %" PRIu32 "\n",
-                tsk_getu32(fs->endian, ext2fs->grp_buf->bg_inode_bitmap),
-                tsk_getu32(fs->endian, ext2fs->grp_buf->bg_inode_bitmap));
+                tsk_getu32(fs->endian, grp_buf->bg_inode_bitmap),
+                tsk_getu32(fs->endian, grp_buf->bg_inode_bitmap));
 
 
             tsk_fprintf(hFile,
                 "    Inode Table: %" PRIu32 " - %" PRIu32 "\n",
-                tsk_getu32(fs->endian, ext2fs->grp_buf->bg_inode_table),
+                tsk_getu32(fs->endian, grp_buf->bg_inode_table),
                 tsk_getu32(fs->endian,
-                ext2fs->grp_buf->bg_inode_table) + ibpg - 1);
+                grp_buf->bg_inode_table) + ibpg - 1);
         
             tsk_fprintf(hFile, "    Data Blocks: ");
             // BC: Commented out from Ext4 commit because it produced
@@ -2363,7 +3172,7 @@ ext2fs_fsstat(TSK_FS_INFO * fs, FILE * hFile)
             if ((tsk_getu32(fs->endian, ext2fs->fs->s_feature_ro_compat) &
                 EXT2FS_FEATURE_RO_COMPAT_SPARSE_SUPER) &&
                 (cg_base == tsk_getu32(fs->endian,
-                ext2fs->grp_buf->bg_block_bitmap))) {
+                grp_buf->bg_block_bitmap))) {
 
                     /* it goes from the end of the inode bitmap to before the
                     * table
@@ -2373,14 +3182,14 @@ ext2fs_fsstat(TSK_FS_INFO * fs, FILE * hFile)
 
                     tsk_fprintf(hFile, "%" PRIu32 " - %" PRIu32 ", ",
                         tsk_getu32(fs->endian,
-                        ext2fs->grp_buf->bg_inode_bitmap) + 1,
+                        grp_buf->bg_inode_bitmap) + 1,
                         tsk_getu32(fs->endian,
-                        ext2fs->grp_buf->bg_inode_table) - 1);
+                        grp_buf->bg_inode_table) - 1);
             }
 
             tsk_fprintf(hFile, "%" PRIu32 " - %" PRIu32 "\n",
                 (uint64_t) tsk_getu32(fs->endian,
-                ext2fs->grp_buf->bg_inode_table) + ibpg,
+                grp_buf->bg_inode_table) + ibpg,
                 ((ext2_cgbase_lcl(fs, sb, i + 1) - 1) <
                 fs->last_block) ? (ext2_cgbase_lcl(fs, sb,
                 i + 1) - 1) : fs->last_block);
@@ -2392,13 +3201,13 @@ ext2fs_fsstat(TSK_FS_INFO * fs, FILE * hFile)
         if (i != (ext2fs->groups_count - 1)) {
             uint64_t tmpInt;
 
-            if (ext2fs->ext4_grp_buf != NULL) 
+            if (ext4_grp_buf != NULL) 
                 // @@@ Should be 32-bit
                 tmpInt = tsk_getu16(fs->endian,
-                    ext2fs->ext4_grp_buf->bg_free_inodes_count_lo);
+                    ext4_grp_buf->bg_free_inodes_count_lo);
             else
                 tmpInt = tsk_getu16(fs->endian,
-                    ext2fs->grp_buf->bg_free_inodes_count);
+                    grp_buf->bg_free_inodes_count);
             
             tsk_fprintf(hFile,
                 "  Free Inodes: %" PRIu32 " (%" PRIu32 "%%)\n",
@@ -2406,13 +3215,13 @@ ext2fs_fsstat(TSK_FS_INFO * fs, FILE * hFile)
                 tsk_getu32(fs->endian, sb->s_inodes_per_group));
 
 
-            if (ext2fs->ext4_grp_buf != NULL) 
+            if (ext4_grp_buf != NULL) 
                 // @@@ Should be 32-bit
                 tmpInt = tsk_getu16(fs->endian,
-                    ext2fs->ext4_grp_buf->bg_free_blocks_count_lo);
+                    ext4_grp_buf->bg_free_blocks_count_lo);
             else
                 tmpInt = tsk_getu16(fs->endian,
-                    ext2fs->grp_buf->bg_free_blocks_count);
+                    grp_buf->bg_free_blocks_count);
 
             tsk_fprintf(hFile,
                 "  Free Blocks: %" PRIu32 " (%" PRIu32 "%%)\n",
@@ -2432,13 +3241,13 @@ ext2fs_fsstat(TSK_FS_INFO * fs, FILE * hFile)
             if (inum_left == 0)
                 inum_left = tsk_getu32(fs->endian, sb->s_inodes_per_group);
 
-            if (ext2fs->ext4_grp_buf != NULL) 
+            if (ext4_grp_buf != NULL) 
                 // @@@ Should be 32-bit
                 tmpInt = tsk_getu16(fs->endian,
-                    ext2fs->ext4_grp_buf->bg_free_inodes_count_lo);
+                    ext4_grp_buf->bg_free_inodes_count_lo);
             else
                 tmpInt = tsk_getu16(fs->endian,
-                    ext2fs->grp_buf->bg_free_inodes_count);
+                    grp_buf->bg_free_inodes_count);
             
             tsk_fprintf(hFile, "  Free Inodes: %" PRIu32 " (%d%%)\n",
                 tmpInt, 100 * tmpInt / inum_left); 
@@ -2450,40 +3259,660 @@ ext2fs_fsstat(TSK_FS_INFO * fs, FILE * hFile)
             if (blk_left == 0)
                 blk_left = tsk_getu32(fs->endian, sb->s_blocks_per_group);
 
-            if (ext2fs->ext4_grp_buf != NULL) 
+            if (ext4_grp_buf != NULL) 
                 // @@@ Should be 32-bit
                 tmpInt = tsk_getu16(fs->endian,
-                    ext2fs->ext4_grp_buf->bg_free_blocks_count_lo);
+                    ext4_grp_buf->bg_free_blocks_count_lo);
             else
                 tmpInt = tsk_getu16(fs->endian,
-                    ext2fs->grp_buf->bg_free_blocks_count);
+                    grp_buf->bg_free_blocks_count);
 
             tsk_fprintf(hFile, "  Free Blocks: %" PRIu32 " (%d%%)\n",
                 tmpInt, 100 * tmpInt / blk_left);
         }
 
 
-        if (ext2fs->ext4_grp_buf != NULL) {
+        if (ext4_grp_buf != NULL) {
             // @@@@ Sould be 32-bit
             tsk_fprintf(hFile, "  Total Directories: %" PRIu16 "\n",
-                tsk_getu16(fs->endian, ext2fs->ext4_grp_buf->bg_used_dirs_count_lo));
+                tsk_getu16(fs->endian, ext4_grp_buf->bg_used_dirs_count_lo));
 
             tsk_fprintf(hFile, "  Stored Checksum: 0x%04" PRIX16 "\n",
-                tsk_getu16(fs->endian, ext2fs->ext4_grp_buf->bg_checksum));
-#ifdef EXT4_CHECKSUMS
-            //Need Non-GPL CRC16
-            tsk_fprintf(hFile, "  Calculated Checksum: 0x%04" PRIX16 "\n",
-                ext4_group_desc_csum(ext2fs->fs, i, ext2fs->ext4_grp_buf));
-#endif
+                tsk_getu16(fs->endian, ext4_grp_buf->bg_checksum));
+            if (EXT2FS_HAS_RO_COMPAT_FEATURE(fs, sb,
+                    EXT2FS_FEATURE_RO_COMPAT_GDT_CSUM |
+                    EXT4FS_FEATURE_RO_COMPAT_METADATA_CSUM))
+                tsk_fprintf(hFile,
+                    "  Calculated Checksum: 0x%04" PRIX16 "\n",
+                    ext2fs_group_desc_csum(ext2fs,
+                        ext2fs_csum_seed(ext2fs), i,
+                        (uint8_t *) ext4_grp_buf));
         }
         else {
             tsk_fprintf(hFile, "  Total Directories: %" PRIu16 "\n",
-               tsk_getu16(fs->endian, ext2fs->grp_buf->bg_used_dirs_count));
+               tsk_getu16(fs->endian, grp_buf->bg_used_dirs_count));
         }
+    }
 
-        tsk_release_lock(&ext2fs->lock);
+    return 0;
+}
+
+
+/************************* fscheck *******************************/
+
+/* Number of inode checksum errors that are listed for each group.  The
+ * others are only counted. */
+#define EXT2FS_FSCHECK_LIST_MAX 8
+
+/* Bitmap checksum states */
+#define EXT2FS_FSCHECK_OK       0
+#define EXT2FS_FSCHECK_BAD      1
+#define EXT2FS_FSCHECK_UNINIT   2       /* not checked, not initialized */
+#define EXT2FS_FSCHECK_NA       3       /* not checked */
+
+/* An inode or extent block with a bad checksum */
+typedef struct {
+    TSK_INUM_T inum;
+    TSK_DADDR_T blk;            /* extent block or 0 for the inode itself */
+    uint8_t bad_hdr;            /* extent block does not have a valid header */
+    uint32_t stored;
+    uint32_t calc;
+} EXT2FS_FSCHECK_ERR;
+
+/* Results of checking one group */
+typedef struct {
+    uint8_t gd_bad;
+    uint16_t gd_stored;
+    uint16_t gd_calc;
+    uint8_t bmap_state;
+    uint32_t bmap_stored;
+    uint32_t bmap_calc;
+    uint8_t imap_state;
+    uint32_t imap_stored;
+    uint32_t imap_calc;
+    uint32_t ino_cnt;           /* inodes checked */
+    uint32_t ino_bad;
+    uint32_t ext_cnt;           /* extent blocks checked */
+    uint32_t ext_bad;
+    size_t err_cnt;             /* errors in err */
+    EXT2FS_FSCHECK_ERR err[EXT2FS_FSCHECK_LIST_MAX];
+    uint8_t failed;             /* group could not be (fully) checked */
+    char errstr[TSK_ERROR_STRING_MAX_LENGTH + 1];
+} EXT2FS_FSCHECK_GRP;
+
+typedef struct {
+    EXT2FS_INFO *ext2fs;
+    uint32_t seed;
+    uint8_t metadata_csum;
+    uint8_t check_inodes;
+    EXT2FS_FSCHECK_GRP *grps;
+} EXT2FS_FSCHECK;
+
+/* Save the current error in the group results.  Errors are per thread,
+ * so they have to be printed by the caller. */
+static void
+ext2fs_fscheck_fail(EXT2FS_FSCHECK_GRP * a_grp)
+{
+    const char *errstr = tsk_error_get();
+
+    a_grp->failed = 1;
+    // tsk_error_get() returns NULL if the check did not set an error
+    strncpy(a_grp->errstr, errstr ? errstr : "unknown error",
+        TSK_ERROR_STRING_MAX_LENGTH);
+    tsk_error_reset();
+}
+
+static void
+ext2fs_fscheck_add_err(EXT2FS_FSCHECK_GRP * a_grp, TSK_INUM_T a_inum,
+    TSK_DADDR_T a_blk, uint8_t a_bad_hdr, uint32_t a_stored,
+    uint32_t a_calc)
+{
+    EXT2FS_FSCHECK_ERR *err;
+
+    if (a_grp->err_cnt >= EXT2FS_FSCHECK_LIST_MAX)
+        return;
+    err = &a_grp->err[a_grp->err_cnt++];
+    err->inum = a_inum;
+    err->blk = a_blk;
+    err->bad_hdr = a_bad_hdr;
+    err->stored = a_stored;
+    err->calc = a_calc;
+}
+
+/* Calculate the checksum of a raw inode (ext4_inode_csum() in Linux) */
+static uint32_t
+ext2fs_inode_csum(EXT2FS_INFO * ext2fs, uint32_t a_seed,
+    const uint8_t * a_raw, uint8_t a_has_hi)
+{
+    static const uint8_t dummy_csum[2] = { 0, 0 };
+    size_t offset = offsetof(ext2fs_inode, i_checksum_lo);
+    uint32_t crc;
+
+    crc = tsk_crc32c(a_seed, a_raw, offset);
+    crc = tsk_crc32c(crc, dummy_csum, sizeof(dummy_csum));
+    offset += sizeof(dummy_csum);
+    crc = tsk_crc32c(crc, a_raw + offset,
+        EXT2_GOOD_OLD_INODE_SIZE - offset);
+
+    if (ext2fs->inode_size > EXT2_GOOD_OLD_INODE_SIZE) {
+        offset = offsetof(ext2fs_inode, i_checksum_hi);
+        crc = tsk_crc32c(crc, a_raw + EXT2_GOOD_OLD_INODE_SIZE,
+            offset - EXT2_GOOD_OLD_INODE_SIZE);
+        if (a_has_hi) {
+            crc = tsk_crc32c(crc, dummy_csum, sizeof(dummy_csum));
+            offset += sizeof(dummy_csum);
+        }
+        crc = tsk_crc32c(crc, a_raw + offset, ext2fs->inode_size - offset);
+    }
+    return crc;
+}
+
+/* Verify the extent tree blocks below an index node.  a_bufs has room
+ * for one block per level.
+ *
+ * Return 1 if a block could not be read and 0 otherwise */
+static uint8_t
+ext2fs_fscheck_extents(EXT2FS_INFO * ext2fs, EXT2FS_FSCHECK_GRP * a_grp,
+    TSK_INUM_T a_inum, uint32_t a_seed, const ext2fs_extent_header * a_hdr,
+    uint16_t a_depth, uint8_t * a_bufs)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) ext2fs;
+    const ext2fs_extent_idx *idx = (const ext2fs_extent_idx *) (a_hdr + 1);
+    uint16_t num = tsk_getu16(fs->endian, a_hdr->eh_entries);
+    uint16_t i;
+
+    for (i = 0; i < num; i++) {
+        ext2fs_extent_header *hdr = (ext2fs_extent_header *) a_bufs;
+        TSK_DADDR_T blk;
+        size_t tail;
+        uint32_t stored, calc;
+        ssize_t cnt;
+
+        blk = (((TSK_DADDR_T) tsk_getu16(fs->endian,
+                    idx[i].ei_leaf_hi)) << 32) | tsk_getu32(fs->endian,
+            idx[i].ei_leaf_lo);
+        if (blk > fs->last_block) {
+            a_grp->ext_bad++;
+            ext2fs_fscheck_add_err(a_grp, a_inum, blk, 1, 0, 0);
+            continue;
+        }
+
+        cnt = tsk_fs_read(fs, (TSK_OFF_T) blk * fs->block_size,
+            (char *) a_bufs, fs->block_size);
+        if (cnt != (ssize_t) fs->block_size) {
+            if (cnt >= 0) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_READ);
+            }
+            tsk_error_set_errstr2("ext2fs_fscheck: extent block %"
+                PRIuDADDR " of inode %" PRIuINUM, blk, a_inum);
+            return 1;
+        }
+        a_grp->ext_cnt++;
+
+        tail = sizeof(ext2fs_extent_header) +
+            (size_t) tsk_getu16(fs->endian, hdr->eh_max) *
+            sizeof(ext2fs_extent);
+        if ((tsk_getu16(fs->endian, hdr->eh_magic) != EXT2_EXTENT_MAGIC)
+            || (tsk_getu16(fs->endian, hdr->eh_depth) != a_depth - 1)
+            || (tsk_getu16(fs->endian, hdr->eh_entries) >
+                tsk_getu16(fs->endian, hdr->eh_max))
+            || (tail + sizeof(ext2fs_extent_tail) > fs->block_size)) {
+            a_grp->ext_bad++;
+            ext2fs_fscheck_add_err(a_grp, a_inum, blk, 1, 0, 0);
+            continue;
+        }
+
+        calc = tsk_crc32c(a_seed, a_bufs, tail);
+        stored = tsk_getu32(fs->endian,
+            ((ext2fs_extent_tail *) & a_bufs[tail])->et_checksum);
+        if (calc != stored) {
+            a_grp->ext_bad++;
+            ext2fs_fscheck_add_err(a_grp, a_inum, blk, 0, stored, calc);
+        }
+
+        if ((a_depth > 1)
+            && (ext2fs_fscheck_extents(ext2fs, a_grp, a_inum, a_seed, hdr,
+                    a_depth - 1, a_bufs + fs->block_size)))
+            return 1;
+    }
+    return 0;
+}
+
+/* Verify the checksums of the allocated inodes in a group and of their
+ * extent tree blocks.
+ *
+ * Return 1 on error and 0 on success */
+static uint8_t
+ext2fs_fscheck_inodes(EXT2FS_FSCHECK * a_chk, EXT2_GRPNUM_T a_grp_num,
+    const uint8_t * a_imap, EXT2FS_FSCHECK_GRP * a_grp)
+{
+    EXT2FS_INFO *ext2fs = a_chk->ext2fs;
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) ext2fs;
+    uint32_t ipg = tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group);
+    TSK_DADDR_T itbl;
+    TSK_INUM_T init, i;
+    uint8_t *tbl, *bufs;
+    size_t len;
+    ssize_t cnt;
+
+    if (ext2fs_group_itable(ext2fs, a_grp_num, &itbl, &init))
+        return 1;
+    if (init == 0)
+        return 0;
+
+    len = (size_t) init *ext2fs->inode_size;
+    if ((tbl = (uint8_t *) tsk_malloc(len)) == NULL)
+        return 1;
+    if ((bufs = (uint8_t *) tsk_malloc(EXT2FS_EXTENT_MAX_DEPTH *
+                fs->block_size)) == NULL) {
+        free(tbl);
+        return 1;
+    }
+
+    cnt = tsk_fs_read(fs, (TSK_OFF_T) itbl * fs->block_size, (char *) tbl,
+        len);
+    if (cnt != (ssize_t) len) {
+        if (cnt >= 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_READ);
+        }
+        tsk_error_set_errstr2("ext2fs_fscheck: inode table of group %"
+            PRI_EXT2GRP " at %" PRIuDADDR, a_grp_num, itbl);
+        free(tbl);
+        free(bufs);
+        return 1;
+    }
+
+    for (i = 0; i < init; i++) {
+        const uint8_t *raw = &tbl[(size_t) i * ext2fs->inode_size];
+        const ext2fs_inode *dino = (const ext2fs_inode *) raw;
+        TSK_INUM_T inum = (TSK_INUM_T) a_grp_num * ipg + i + 1;
+        uint8_t le_inum[4];
+        uint8_t has_hi = 0;
+        uint32_t seed, stored, calc;
+        const ext2fs_extent_header *hdr;
+
+        if (!isset(a_imap, i))
+            continue;
+        a_grp->ino_cnt++;
+
+        ext2fs_put_le32(le_inum, (uint32_t) inum);
+        seed = tsk_crc32c(a_chk->seed, le_inum, sizeof(le_inum));
+        seed = tsk_crc32c(seed, dino->i_generation,
+            sizeof(dino->i_generation));
+
+        if ((ext2fs->inode_size > EXT2_GOOD_OLD_INODE_SIZE)
+            && ((size_t) tsk_getu16(fs->endian, dino->i_extra_isize) +
+                EXT2_GOOD_OLD_INODE_SIZE >=
+                offsetof(ext2fs_inode, i_checksum_hi) + 2))
+            has_hi = 1;
+
+        stored = tsk_getu16(fs->endian, dino->i_checksum_lo);
+        calc = ext2fs_inode_csum(ext2fs, seed, raw, has_hi);
+        if (has_hi)
+            stored |= (uint32_t) tsk_getu16(fs->endian,
+                dino->i_checksum_hi) << 16;
+        else
+            calc &= 0xffff;
+
+        if (stored != calc) {
+            size_t j;
+
+            /* an inode that is all zeros is considered valid (as in
+             * e2fsprogs) */
+            for (j = 0; j < EXT2_GOOD_OLD_INODE_SIZE; j++) {
+                if (raw[j])
+                    break;
+            }
+            if (j < EXT2_GOOD_OLD_INODE_SIZE) {
+                a_grp->ino_bad++;
+                ext2fs_fscheck_add_err(a_grp, inum, 0, 0, stored, calc);
+            }
+        }
+
+        /* the blocks below the root of an extent tree */
+        if (((tsk_getu32(fs->endian, dino->i_flags) & EXT2_IN_EXTENTS) == 0)
+            || (tsk_getu32(fs->endian, dino->i_flags) &
+                EXT2_IN_INLINE_DATA))
+            continue;
+        hdr = (const ext2fs_extent_header *) dino->i_block;
+        if ((tsk_getu16(fs->endian, hdr->eh_magic) != EXT2_EXTENT_MAGIC)
+            || (tsk_getu16(fs->endian, hdr->eh_depth) == 0)
+            || (tsk_getu16(fs->endian, hdr->eh_depth) >
+                EXT2FS_EXTENT_MAX_DEPTH)
+            || (tsk_getu16(fs->endian, hdr->eh_entries) > 4))
+            continue;
+
+        if (ext2fs_fscheck_extents(ext2fs, a_grp, inum, seed, hdr,
+                tsk_getu16(fs->endian, hdr->eh_depth), bufs)) {
+            free(tbl);
+            free(bufs);
+            return 1;
+        }
+    }
+
+    free(tbl);
+    free(bufs);
+    return 0;
+}
+
+/* Verify a block or inode bitmap (metadata_csum only)
+ *
+ * Return 1 on error and 0 on success */
+static uint8_t
+ext2fs_fscheck_bitmap(EXT2FS_FSCHECK * a_chk, EXT2_GRPNUM_T a_grp_num,
+    const ext4fs_gd * a_gd, uint8_t a_is_imap, uint8_t * a_buf,
+    uint8_t * a_state, uint32_t * a_stored, uint32_t * a_calc)
+{
+    EXT2FS_INFO *ext2fs = a_chk->ext2fs;
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) ext2fs;
+    TSK_DADDR_T addr;
+    size_t len;
+    ssize_t cnt;
+
+    if (a_is_imap) {
+        len = tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group) / 8;
+    }
+    else if (EXT2FS_HAS_RO_COMPAT_FEATURE(fs, ext2fs->fs,
+            EXT4FS_FEATURE_RO_COMPAT_BIGALLOC)) {
+        /* s_frags_per_group is s_clusters_per_group with bigalloc */
+        len = tsk_getu32(fs->endian, ext2fs->fs->s_frags_per_group) / 8;
+    }
+    else {
+        len = tsk_getu32(fs->endian, ext2fs->fs->s_blocks_per_group) / 8;
+    }
+    if (len > fs->block_size)
+        len = fs->block_size;
+
+    if (ext2fs_bitmap_addr(ext2fs, a_grp_num, a_is_imap, &addr))
+        return 1;
+
+    cnt = tsk_fs_read(fs, (TSK_OFF_T) addr * fs->block_size,
+        (char *) a_buf, fs->block_size);
+    if (cnt != (ssize_t) fs->block_size) {
+        if (cnt >= 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_READ);
+        }
+        tsk_error_set_errstr2("ext2fs_fscheck: %s bitmap of group %"
+            PRI_EXT2GRP " at %" PRIuDADDR, a_is_imap ? "inode" : "block",
+            a_grp_num, addr);
+        return 1;
+    }
+
+    *a_calc = tsk_crc32c(a_chk->seed, a_buf, len);
+    if (a_is_imap) {
+        *a_stored = tsk_getu16(fs->endian, a_gd->bg_inode_bitmap_csum_lo);
+        if (ext2fs->grp_desc_size >=
+            offsetof(ext4fs_gd, bg_inode_bitmap_csum_hi) + 2)
+            *a_stored |= (uint32_t) tsk_getu16(fs->endian,
+                a_gd->bg_inode_bitmap_csum_hi) << 16;
+        else
+            *a_calc &= 0xffff;
+    }
+    else {
+        *a_stored = tsk_getu16(fs->endian, a_gd->bg_block_bitmap_csum_lo);
+        if (ext2fs->grp_desc_size >=
+            offsetof(ext4fs_gd, bg_block_bitmap_csum_hi) + 2)
+            *a_stored |= (uint32_t) tsk_getu16(fs->endian,
+                a_gd->bg_block_bitmap_csum_hi) << 16;
+        else
+            *a_calc &= 0xffff;
+    }
+    *a_state = (*a_calc == *a_stored) ? EXT2FS_FSCHECK_OK :
+        EXT2FS_FSCHECK_BAD;
+    return 0;
+}
+
+/* tsk_fs_par_for() callback that checks one group */
+static void
+ext2fs_fscheck_group(void *a_ptr, size_t a_idx)
+{
+    EXT2FS_FSCHECK *chk = (EXT2FS_FSCHECK *) a_ptr;
+    EXT2FS_INFO *ext2fs = chk->ext2fs;
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) ext2fs;
+    EXT2_GRPNUM_T grp_num = (EXT2_GRPNUM_T) a_idx;
+    EXT2FS_FSCHECK_GRP *grp = &chk->grps[a_idx];
+    ext2fs_gd *gd32;
+    ext4fs_gd *gd64;
+    const ext4fs_gd *gd;
+    uint8_t *buf;
+
+    grp->bmap_state = EXT2FS_FSCHECK_NA;
+    grp->imap_state = EXT2FS_FSCHECK_NA;
+
+    if (ext2fs_group_get(ext2fs, grp_num, &gd32, &gd64)) {
+        ext2fs_fscheck_fail(grp);
+        return;
+    }
+    // the 32-bit descriptors share the layout of the first half
+    gd = (gd64 != NULL) ? gd64 : (const ext4fs_gd *) gd32;
+
+    grp->gd_stored = tsk_getu16(fs->endian, gd->bg_checksum);
+    grp->gd_calc = ext2fs_group_desc_csum(ext2fs, chk->seed, grp_num,
+        (const uint8_t *) gd);
+    grp->gd_bad = (grp->gd_stored != grp->gd_calc);
+
+    if (chk->metadata_csum == 0)
+        return;
+
+    if ((buf = (uint8_t *) tsk_malloc(fs->block_size)) == NULL) {
+        ext2fs_fscheck_fail(grp);
+        return;
+    }
+
+    if (EXT4BG_HAS_FLAG(fs, gd, EXT4_BG_BLOCK_UNINIT))
+        grp->bmap_state = EXT2FS_FSCHECK_UNINIT;
+    else if (ext2fs_fscheck_bitmap(chk, grp_num, gd, 0, buf,
+            &grp->bmap_state, &grp->bmap_stored, &grp->bmap_calc)) {
+        ext2fs_fscheck_fail(grp);
+        free(buf);
+        return;
+    }
+
+    if (EXT4BG_HAS_FLAG(fs, gd, EXT4_BG_INODE_UNINIT)) {
+        grp->imap_state = EXT2FS_FSCHECK_UNINIT;
+    }
+    else if (ext2fs_fscheck_bitmap(chk, grp_num, gd, 1, buf,
+            &grp->imap_state, &grp->imap_stored, &grp->imap_calc)) {
+        ext2fs_fscheck_fail(grp);
+    }
+    else if ((chk->check_inodes)
+        && (ext2fs_fscheck_inodes(chk, grp_num, buf, grp))) {
+        ext2fs_fscheck_fail(grp);
+    }
+    free(buf);
+}
+
+/**
+ * Verify the metadata checksums of an ext4 file system and print a
+ * report.  The super block is checked and the groups are checked in
+ * parallel: with metadata_csum, the group descriptors, block and inode
+ * bitmaps, allocated inodes and the extent tree blocks of those inodes.
+ * With only GDT_CSUM (uninit_bg), just the group descriptors.
+ *
+ * @param fs File system to check
+ * @param hFile File handle to print the report to
+ * @returns 1 on error and 0 on success (checksum errors are not errors)
+ */
+static uint8_t
+ext2fs_fscheck(TSK_FS_INFO * fs, FILE * hFile)
+{
+    EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) fs;
+    ext2fs_sb *sb = ext2fs->fs;
+    EXT2FS_FSCHECK chk;
+    EXT2_GRPNUM_T i;
+    uint64_t gd_bad = 0, bmap_cnt = 0, bmap_bad = 0, bmap_uninit = 0;
+    uint64_t imap_cnt = 0, imap_bad = 0, imap_uninit = 0;
+    uint64_t ino_cnt = 0, ino_bad = 0, ext_cnt = 0, ext_bad = 0;
+    uint64_t failed = 0, total;
+    uint8_t sb_bad = 0;
+
+    // clean up any error messages that are lying around
+    tsk_error_reset();
+
+    memset(&chk, 0, sizeof(chk));
+    chk.ext2fs = ext2fs;
+    chk.metadata_csum = EXT2FS_HAS_RO_COMPAT_FEATURE(fs, sb,
+        EXT4FS_FEATURE_RO_COMPAT_METADATA_CSUM);
+
+    if ((chk.metadata_csum == 0)
+        && (EXT2FS_HAS_RO_COMPAT_FEATURE(fs, sb,
+                EXT2FS_FEATURE_RO_COMPAT_GDT_CSUM) == 0)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_UNSUPFUNC);
+        tsk_error_set_errstr
+            ("ext2fs_fscheck: file system does not have metadata checksums");
+        return 1;
+    }
+    if ((chk.metadata_csum)
+        && (sb->s_checksum_type != EXT4FS_CRC32C_CHKSUM)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_UNSUPFUNC);
+        tsk_error_set_errstr
+            ("ext2fs_fscheck: unsupported checksum type: %d",
+            sb->s_checksum_type);
+        return 1;
+    }
+
+    if (chk.metadata_csum) {
+        chk.seed = ext2fs_csum_seed(ext2fs);
+        /* Linux only uses inode checksums when it created the fs */
+        chk.check_inodes = (tsk_getu32(fs->endian,
+                sb->s_creator_os) == EXT2FS_OS_LINUX);
+    }
+
+    if ((chk.grps = (EXT2FS_FSCHECK_GRP *)
+            tsk_malloc((size_t) ext2fs->groups_count *
+                sizeof(EXT2FS_FSCHECK_GRP))) == NULL)
+        return 1;
+
+    tsk_fs_par_for(0, ext2fs->groups_count, ext2fs_fscheck_group, &chk);
+
+    tsk_fprintf(hFile, "METADATA CHECKSUM INFORMATION\n");
+    tsk_fprintf(hFile, "--------------------------------------------\n");
+    if (chk.metadata_csum) {
+        uint32_t sb_stored = tsk_getu32(fs->endian, sb->s_checksum);
+        uint32_t sb_calc = tsk_crc32c(~0U, sb,
+            offsetof(ext2fs_sb, s_checksum));
+
+        tsk_fprintf(hFile, "Checksum Type: crc32c (metadata_csum)\n");
+        tsk_fprintf(hFile, "Checksum Seed: 0x%08" PRIX32 "\n", chk.seed);
+        if (sb_stored == sb_calc) {
+            tsk_fprintf(hFile, "Super Block Checksum: 0x%08" PRIX32
+                " (OK)\n", sb_stored);
+        }
+        else {
+            sb_bad = 1;
+            tsk_fprintf(hFile, "Super Block Checksum: 0x%08" PRIX32
+                " (MISMATCH, calculated: 0x%08" PRIX32 ")\n", sb_stored,
+                sb_calc);
+        }
+    }
+    else {
+        tsk_fprintf(hFile,
+            "Checksum Type: crc16 (uninit_bg, group descriptors only)\n");
+    }
+    tsk_fprintf(hFile, "\n");
+
+    for (i = 0; i < ext2fs->groups_count; i++) {
+        EXT2FS_FSCHECK_GRP *grp = &chk.grps[i];
+        size_t j;
+
+        if (grp->gd_bad) {
+            gd_bad++;
+            tsk_fprintf(hFile, "Group %" PRI_EXT2GRP
+                ": Group Descriptor Checksum Mismatch (stored: 0x%04"
+                PRIX16 ", calculated: 0x%04" PRIX16 ")\n", i,
+                grp->gd_stored, grp->gd_calc);
+        }
+
+        if (grp->bmap_state == EXT2FS_FSCHECK_UNINIT)
+            bmap_uninit++;
+        else if (grp->bmap_state != EXT2FS_FSCHECK_NA)
+            bmap_cnt++;
+        if (grp->bmap_state == EXT2FS_FSCHECK_BAD) {
+            bmap_bad++;
+            tsk_fprintf(hFile, "Group %" PRI_EXT2GRP
+                ": Block Bitmap Checksum Mismatch (stored: 0x%08" PRIX32
+                ", calculated: 0x%08" PRIX32 ")\n", i, grp->bmap_stored,
+                grp->bmap_calc);
+        }
+
+        if (grp->imap_state == EXT2FS_FSCHECK_UNINIT)
+            imap_uninit++;
+        else if (grp->imap_state != EXT2FS_FSCHECK_NA)
+            imap_cnt++;
+        if (grp->imap_state == EXT2FS_FSCHECK_BAD) {
+            imap_bad++;
+            tsk_fprintf(hFile, "Group %" PRI_EXT2GRP
+                ": Inode Bitmap Checksum Mismatch (stored: 0x%08" PRIX32
+                ", calculated: 0x%08" PRIX32 ")\n", i, grp->imap_stored,
+                grp->imap_calc);
+        }
+
+        for (j = 0; j < grp->err_cnt; j++) {
+            EXT2FS_FSCHECK_ERR *err = &grp->err[j];
+
+            if (err->blk == 0)
+                tsk_fprintf(hFile, "Group %" PRI_EXT2GRP ": Inode %"
+                    PRIuINUM " Checksum Mismatch (stored: 0x%08" PRIX32
+                    ", calculated: 0x%08" PRIX32 ")\n", i, err->inum,
+                    err->stored, err->calc);
+            else if (err->bad_hdr)
+                tsk_fprintf(hFile, "Group %" PRI_EXT2GRP ": Inode %"
+                    PRIuINUM " Extent Block %" PRIuDADDR
+                    " Has An Invalid Header\n", i, err->inum, err->blk);
+            else
+                tsk_fprintf(hFile, "Group %" PRI_EXT2GRP ": Inode %"
+                    PRIuINUM " Extent Block %" PRIuDADDR
+                    " Checksum Mismatch (stored: 0x%08" PRIX32
+                    ", calculated: 0x%08" PRIX32 ")\n", i, err->inum,
+                    err->blk, err->stored, err->calc);
+        }
+        if (grp->ino_bad + grp->ext_bad > grp->err_cnt)
+            tsk_fprintf(hFile, "Group %" PRI_EXT2GRP ": %" PRIu64
+                " more inode and extent block errors not listed\n", i,
+                (uint64_t) grp->ino_bad + grp->ext_bad - grp->err_cnt);
+
+        if (grp->failed) {
+            failed++;
+            tsk_fprintf(hFile, "Group %" PRI_EXT2GRP
+                ": Not fully checked: %s\n", i, grp->errstr);
+        }
+
+        ino_cnt += grp->ino_cnt;
+        ino_bad += grp->ino_bad;
+        ext_cnt += grp->ext_cnt;
+        ext_bad += grp->ext_bad;
+    }
+
+    tsk_fprintf(hFile, "\nSUMMARY\n");
+    tsk_fprintf(hFile, "--------------------------------------------\n");
+    tsk_fprintf(hFile, "Groups: %" PRI_EXT2GRP " (%" PRIu64
+        " not fully checked)\n", ext2fs->groups_count, failed);
+    tsk_fprintf(hFile, "Group Descriptors: %" PRI_EXT2GRP
+        " checked, %" PRIu64 " mismatched\n", ext2fs->groups_count,
+        gd_bad);
+    if (chk.metadata_csum) {
+        tsk_fprintf(hFile, "Block Bitmaps: %" PRIu64 " checked, %" PRIu64
+            " mismatched, %" PRIu64 " uninitialized\n", bmap_cnt,
+            bmap_bad, bmap_uninit);
+        tsk_fprintf(hFile, "Inode Bitmaps: %" PRIu64 " checked, %" PRIu64
+            " mismatched, %" PRIu64 " uninitialized\n", imap_cnt,
+            imap_bad, imap_uninit);
+        if (chk.check_inodes) {
+            tsk_fprintf(hFile, "Inodes: %" PRIu64 " checked, %" PRIu64
+                " mismatched\n", ino_cnt, ino_bad);
+            tsk_fprintf(hFile, "Extent Blocks: %" PRIu64 " checked, %"
+                PRIu64 " mismatched\n", ext_cnt, ext_bad);
+        }
     }
+    total = sb_bad + gd_bad + bmap_bad + imap_bad + ino_bad + ext_bad;
+    tsk_fprintf(hFile, "Checksum Errors: %" PRIu64 "\n", total);
 
+    free(chk.grps);
     return 0;
 }
 
@@ -2611,7 +4040,9 @@ ext2fs_istat(TSK_FS_INFO * fs, FILE * hFile, TSK_INUM_T inum,
     tsk_fprintf(hFile, "%sAllocated\n",
         (fs_meta->flags & TSK_FS_META_FLAG_ALLOC) ? "" : "Not ");
 
-    tsk_fprintf(hFile, "Group: %" PRIuGID "\n", ext2fs->grp_num);
+    tsk_fprintf(hFile, "Group: %" PRI_EXT2GRP "\n",
+        (EXT2_GRPNUM_T) ((inum - fs->first_inum) /
+            tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group)));
 
     // Note that if this is a "virtual file", then ext2fs->dino_buf may not be set.
     tsk_fprintf(hFile, "Generation Id: %" PRIu32 "\n",
@@ -2703,6 +4134,9 @@ ext2fs_istat(TSK_FS_INFO * fs, FILE * hFile, TSK_INUM_T inum,
         if (tsk_getu32(fs->endian, dino_buf->i_flags) & EXT2_IN_EOFBLOCKS)
             tsk_fprintf(hFile, "Blocks Allocated Beyond EOF, ");
 
+        if (tsk_getu32(fs->endian, dino_buf->i_flags) & EXT2_IN_INLINE_DATA)
+            tsk_fprintf(hFile, "Inline Data, ");
+
 
         tsk_fprintf(hFile, "\n");
     }
@@ -3028,19 +4462,26 @@ ext2fs_istat(TSK_FS_INFO * fs, FILE * hFile, TSK_INUM_T inum,
     if (numblock > 0)
         fs_meta->size = numblock * fs->block_size;
 
-    tsk_fprintf(hFile, "\nDirect Blocks:\n");
-
     print.idx = 0;
     print.hFile = hFile;
 
-    if (tsk_fs_file_walk(fs_file, TSK_FS_FILE_WALK_FLAG_AONLY,
-            print_addr_act, (void *) &print)) {
-        tsk_fprintf(hFile, "\nError reading file:  ");
-        tsk_error_print(hFile);
-        tsk_error_reset();
+    /* Inline data has no blocks */
+    if (fs_meta->content_type == TSK_FS_META_CONTENT_TYPE_EXT4_INLINE) {
+        tsk_fprintf(hFile, "\nInline Data Size: %" PRIuOFF "\n",
+            fs_meta->size);
     }
-    else if (print.idx != 0) {
-        tsk_fprintf(hFile, "\n");
+    else {
+        tsk_fprintf(hFile, "\nDirect Blocks:\n");
+
+        if (tsk_fs_file_walk(fs_file, TSK_FS_FILE_WALK_FLAG_AONLY,
+                print_addr_act, (void *) &print)) {
+            tsk_fprintf(hFile, "\nError reading file:  ");
+            tsk_error_print(hFile);
+            tsk_error_reset();
+        }
+        else if (print.idx != 0) {
+            tsk_fprintf(hFile, "\n");
+        }
     }
 
     if (fs_meta->content_type == TSK_FS_META_CONTENT_TYPE_EXT4_EXTENTS) {
@@ -3104,17 +4545,11 @@ ext2fs_close(TSK_FS_INFO * fs)
     fs->tag = 0;
     free((char *) ext2fs->fs);
 
-    if (ext2fs->grp_buf != NULL)
-        free((char *) ext2fs->grp_buf);
-
-    if (ext2fs->ext4_grp_buf != NULL)
-        free((char *) ext2fs->ext4_grp_buf);
+    free(ext2fs->grp_tbl);
 
-    if (ext2fs->bmap_buf != NULL)
-        free((char *) ext2fs->bmap_buf);
-
-    if (ext2fs->imap_buf != NULL)
-        free((char *) ext2fs->imap_buf);
+    ext2fs_bitmap_cache_free(ext2fs);
+    ext2fs_extent_cache_free(ext2fs);
+    ext2fs_jclose(ext2fs);
 
     tsk_deinit_lock(&ext2fs->lock);
 
@@ -3337,6 +4772,8 @@ ext2fs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
             fprintf(stderr, "ext2fs_open: inodes per group is 0\n");
         return NULL;
     }
+    fs->inum_group_size =
+        tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group);
 
     if (tsk_getu32(fs->endian,
             ext2fs->fs->
@@ -3366,12 +4803,16 @@ ext2fs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
 
     /* Set the generic function pointers */
     fs->inode_walk = ext2fs_inode_walk;
+    // each walk keeps its own copy of the inode bitmap and table
+    fs->flags |= TSK_FS_INFO_FLAG_PAR_INODE_WALK;
     fs->block_walk = ext2fs_block_walk;
     fs->block_getflags = ext2fs_block_getflags;
+    fs->block_getflags_run = ext2fs_block_getflags_run;
 
     fs->get_default_attr_type = tsk_fs_unix_get_default_attr_type;
     //fs->load_attrs = tsk_fs_unix_make_data_run;
     fs->load_attrs = ext2fs_load_attrs;
+    fs->attr_resolve_run = ext4_attr_resolve_run;
 
     fs->file_add_meta = ext2fs_inode_lookup;
     fs->dir_open_meta = ext2fs_dir_open_meta;
@@ -3386,20 +4827,27 @@ ext2fs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
     fs->journ_inum = tsk_getu32(fs->endian, ext2fs->fs->s_journal_inum);
     fs->jblk_walk = ext2fs_jblk_walk;
     fs->jentry_walk = ext2fs_jentry_walk;
+    fs->jentry_find = ext2fs_jentry_find;
     fs->jopen = ext2fs_jopen;
 
     /* initialize the caches */
-    /* inode map */
-    ext2fs->imap_buf = NULL;
-    ext2fs->imap_grp_num = 0xffffffff;
-
-    /* block map */
-    ext2fs->bmap_buf = NULL;
-    ext2fs->bmap_grp_num = 0xffffffff;
-
-    /* group descriptor */
-    ext2fs->grp_buf = NULL;
-    ext2fs->grp_num = 0xffffffff;
+    /* block and inode maps */
+    ext2fs->map_head = NULL;
+    ext2fs->map_tail = NULL;
+    ext2fs->map_cnt = 0;
+
+    /* extent tree blocks */
+    ext2fs->ext_head = NULL;
+    ext2fs->ext_tail = NULL;
+    ext2fs->ext_cnt = 0;
+
+    /* group descriptors */
+    if (ext2fs_group_table_load(ext2fs)) {
+        fs->tag = 0;
+        free(ext2fs->fs);
+        tsk_fs_free((TSK_FS_INFO *)ext2fs);
+        return NULL;
+    }
 
 
     /*
@@ -221,6 +221,86 @@ ext2fs_dent_parse_block(EXT2FS_INFO * ext2fs, TSK_FS_DIR * a_fs_dir,
 }
 
 
+/**
+ * \internal
+ * Process a directory that has inline data.  The data is in the resident
+ * attribute that was loaded from the inode.  The "." and ".." entries are
+ * not stored, so they are made from the directory and parent addresses.
+ *
+ * @param a_is_del Set to 1 if the directory is deleted.
+ */
+static TSK_RETVAL_ENUM
+ext2fs_dent_parse_inline(EXT2FS_INFO * ext2fs, TSK_FS_DIR * a_fs_dir,
+    uint8_t a_is_del)
+{
+    TSK_FS_INFO *fs = &(ext2fs->fs_info);
+    const TSK_FS_ATTR *fs_attr;
+    TSK_FS_NAME *fs_name;
+    TSK_INUM_T par_addr;
+    TSK_RETVAL_ENUM retval_tmp;
+    TSK_RETVAL_ENUM retval_final = TSK_OK;
+    char *buf;
+    size_t len;
+
+    fs_attr = tsk_fs_file_attr_get(a_fs_dir->fs_file);
+    if ((fs_attr == NULL) || ((fs_attr->flags & TSK_FS_ATTR_RES) == 0)
+        || (fs_attr->size < EXT4_INLINE_DOTDOT_SIZE)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("ext2fs_dent_parse_inline: Invalid inline data in directory %"
+            PRIuINUM, a_fs_dir->addr);
+        return TSK_COR;
+    }
+    buf = (char *) fs_attr->rd.buf;
+    len = (size_t) fs_attr->size;
+
+    if ((fs_name = tsk_fs_name_alloc(EXT2FS_MAXNAMLEN + 1, 0)) == NULL)
+        return TSK_ERR;
+
+    fs_name->type = TSK_FS_NAME_TYPE_DIR;
+    fs_name->flags =
+        a_is_del ? TSK_FS_NAME_FLAG_UNALLOC : TSK_FS_NAME_FLAG_ALLOC;
+
+    strcpy(fs_name->name, ".");
+    fs_name->meta_addr = a_fs_dir->addr;
+    if (tsk_fs_dir_add(a_fs_dir, fs_name)) {
+        tsk_fs_name_free(fs_name);
+        return TSK_ERR;
+    }
+
+    par_addr = tsk_getu32(fs->endian, buf);
+    if ((par_addr >= fs->first_inum) && (par_addr <= fs->last_inum)) {
+        strcpy(fs_name->name, "..");
+        fs_name->meta_addr = par_addr;
+        if (tsk_fs_dir_add(a_fs_dir, fs_name)) {
+            tsk_fs_name_free(fs_name);
+            return TSK_ERR;
+        }
+    }
+    tsk_fs_name_free(fs_name);
+
+    /* The entries in i_block and the ones in the extended attribute
+     * are parsed separately because their lengths end at the border */
+    retval_tmp = ext2fs_dent_parse_block(ext2fs, a_fs_dir, a_is_del, NULL,
+        &buf[EXT4_INLINE_DOTDOT_SIZE],
+        (int) ((len < EXT4_MIN_INLINE_DATA_SIZE ? len :
+                EXT4_MIN_INLINE_DATA_SIZE) - EXT4_INLINE_DOTDOT_SIZE));
+    if (retval_tmp != TSK_OK)
+        retval_final = retval_tmp;
+
+    if ((retval_tmp != TSK_ERR) && (len > EXT4_MIN_INLINE_DATA_SIZE)) {
+        retval_tmp = ext2fs_dent_parse_block(ext2fs, a_fs_dir, a_is_del,
+            NULL, &buf[EXT4_MIN_INLINE_DATA_SIZE],
+            (int) (len - EXT4_MIN_INLINE_DATA_SIZE));
+        if (retval_tmp != TSK_OK)
+            retval_final = retval_tmp;
+    }
+
+    return retval_final;
+}
+
+
 /** \internal
 * Process a directory and load up FS_DIR with the entries. If a pointer to
 * an already allocated FS_DIR struture is given, it will be cleared.  If no existing
@@ -313,58 +393,69 @@ ext2fs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
         return TSK_COR;
     }
 
-    size = roundup(fs_dir->fs_file->meta->size, a_fs->block_size);
-    if ((dirbuf = tsk_malloc((size_t) size)) == NULL) {
-        return TSK_ERR;
-    }
-
-    /* make a copy of the directory contents that we can process */
-    load_file.left = load_file.total = (size_t) size;
-    load_file.base = load_file.cur = dirbuf;
-
-    if (tsk_fs_file_walk(fs_dir->fs_file,
-            TSK_FS_FILE_WALK_FLAG_SLACK,
-            tsk_fs_load_file_action, (void *) &load_file)) {
-        tsk_error_reset();
-        tsk_error_errstr2_concat("- ext2fs_dir_open_meta");
-        free(dirbuf);
-        return TSK_COR;
-    }
-
-    /* Not all of the directory was copied, so we exit */
-    if (load_file.left > 0) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_FWALK);
-        tsk_error_set_errstr
-            ("ext2fs_dir_open_meta: Error reading directory contents: %"
-            PRIuINUM "\n", a_addr);
-        free(dirbuf);
-        return TSK_COR;
+    /* Inline directories are not stored in blocks */
+    if (fs_dir->fs_file->meta->content_type ==
+        TSK_FS_META_CONTENT_TYPE_EXT4_INLINE) {
+        retval_final = ext2fs_dent_parse_inline(ext2fs, fs_dir,
+            (fs_dir->fs_file->meta->
+                flags & TSK_FS_META_FLAG_UNALLOC) ? 1 : 0);
+        if (retval_final == TSK_ERR)
+            return TSK_ERR;
     }
-    dirptr = dirbuf;
+    else {
+        size = roundup(fs_dir->fs_file->meta->size, a_fs->block_size);
+        if ((dirbuf = tsk_malloc((size_t) size)) == NULL) {
+            return TSK_ERR;
+        }
 
-    while ((int64_t) size > 0) {
-        int len =
-            (a_fs->block_size < size) ? a_fs->block_size : (int) size;
+        /* make a copy of the directory contents that we can process */
+        load_file.left = load_file.total = (size_t) size;
+        load_file.base = load_file.cur = dirbuf;
 
-        retval_tmp =
-            ext2fs_dent_parse_block(ext2fs, fs_dir,
-            (fs_dir->fs_file->meta->
-                flags & TSK_FS_META_FLAG_UNALLOC) ? 1 : 0, &list_seen,
-            dirptr, len);
+        if (tsk_fs_file_walk(fs_dir->fs_file,
+                TSK_FS_FILE_WALK_FLAG_SLACK,
+                tsk_fs_load_file_action, (void *) &load_file)) {
+            tsk_error_reset();
+            tsk_error_errstr2_concat("- ext2fs_dir_open_meta");
+            free(dirbuf);
+            return TSK_COR;
+        }
 
-        if (retval_tmp == TSK_ERR) {
-            retval_final = TSK_ERR;
-            break;
+        /* Not all of the directory was copied, so we exit */
+        if (load_file.left > 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_FWALK);
+            tsk_error_set_errstr
+                ("ext2fs_dir_open_meta: Error reading directory contents: %"
+                PRIuINUM "\n", a_addr);
+            free(dirbuf);
+            return TSK_COR;
         }
-        else if (retval_tmp == TSK_COR) {
-            retval_final = TSK_COR;
+        dirptr = dirbuf;
+
+        while ((int64_t) size > 0) {
+            int len =
+                (a_fs->block_size < size) ? a_fs->block_size : (int) size;
+
+            retval_tmp =
+                ext2fs_dent_parse_block(ext2fs, fs_dir,
+                (fs_dir->fs_file->meta->
+                    flags & TSK_FS_META_FLAG_UNALLOC) ? 1 : 0, &list_seen,
+                dirptr, len);
+
+            if (retval_tmp == TSK_ERR) {
+                retval_final = TSK_ERR;
+                break;
+            }
+            else if (retval_tmp == TSK_COR) {
+                retval_final = TSK_COR;
+            }
+
+            size -= len;
+            dirptr = (char *) ((uintptr_t) dirptr + len);
         }
-
-        size -= len;
-        dirptr = (char *) ((uintptr_t) dirptr + len);
+        free(dirbuf);
     }
-    free(dirbuf);
 
 
     // if we are listing the root directory, add the Orphan directory entry
@@ -387,3 +478,493 @@ ext2fs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
 
     return retval_final;
 }
+
+
+
+/*
+ * Directory hash functions for hash-indexed directories.  These have
+ * to produce exactly the same values as the ones in the kernel.
+ */
+
+#define EXT2_DX_TEA_DELTA 0x9E3779B9
+
+static void
+ext2fs_dx_tea_transform(uint32_t buf[4], const uint32_t in[4])
+{
+    uint32_t sum = 0;
+    uint32_t b0 = buf[0], b1 = buf[1];
+    uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+    int n = 16;
+
+    do {
+        sum += EXT2_DX_TEA_DELTA;
+        b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+        b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+    } while (--n);
+
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+#define EXT2_DX_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define EXT2_DX_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define EXT2_DX_H(x, y, z) ((x) ^ (y) ^ (z))
+#define EXT2_DX_ROUND(f, a, b, c, d, x, s) \
+    (a += f(b, c, d) + (x), a = (a << (s)) | (a >> (32 - (s))))
+#define EXT2_DX_K2 013240474631UL
+#define EXT2_DX_K3 015666365641UL
+
+static void
+ext2fs_dx_half_md4_transform(uint32_t buf[4], const uint32_t in[8])
+{
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+    EXT2_DX_ROUND(EXT2_DX_F, a, b, c, d, in[0], 3);
+    EXT2_DX_ROUND(EXT2_DX_F, d, a, b, c, in[1], 7);
+    EXT2_DX_ROUND(EXT2_DX_F, c, d, a, b, in[2], 11);
+    EXT2_DX_ROUND(EXT2_DX_F, b, c, d, a, in[3], 19);
+    EXT2_DX_ROUND(EXT2_DX_F, a, b, c, d, in[4], 3);
+    EXT2_DX_ROUND(EXT2_DX_F, d, a, b, c, in[5], 7);
+    EXT2_DX_ROUND(EXT2_DX_F, c, d, a, b, in[6], 11);
+    EXT2_DX_ROUND(EXT2_DX_F, b, c, d, a, in[7], 19);
+
+    EXT2_DX_ROUND(EXT2_DX_G, a, b, c, d, in[1] + EXT2_DX_K2, 3);
+    EXT2_DX_ROUND(EXT2_DX_G, d, a, b, c, in[3] + EXT2_DX_K2, 5);
+    EXT2_DX_ROUND(EXT2_DX_G, c, d, a, b, in[5] + EXT2_DX_K2, 9);
+    EXT2_DX_ROUND(EXT2_DX_G, b, c, d, a, in[7] + EXT2_DX_K2, 13);
+    EXT2_DX_ROUND(EXT2_DX_G, a, b, c, d, in[0] + EXT2_DX_K2, 3);
+    EXT2_DX_ROUND(EXT2_DX_G, d, a, b, c, in[2] + EXT2_DX_K2, 5);
+    EXT2_DX_ROUND(EXT2_DX_G, c, d, a, b, in[4] + EXT2_DX_K2, 9);
+    EXT2_DX_ROUND(EXT2_DX_G, b, c, d, a, in[6] + EXT2_DX_K2, 13);
+
+    EXT2_DX_ROUND(EXT2_DX_H, a, b, c, d, in[3] + EXT2_DX_K3, 3);
+    EXT2_DX_ROUND(EXT2_DX_H, d, a, b, c, in[7] + EXT2_DX_K3, 9);
+    EXT2_DX_ROUND(EXT2_DX_H, c, d, a, b, in[2] + EXT2_DX_K3, 11);
+    EXT2_DX_ROUND(EXT2_DX_H, b, c, d, a, in[6] + EXT2_DX_K3, 15);
+    EXT2_DX_ROUND(EXT2_DX_H, a, b, c, d, in[1] + EXT2_DX_K3, 3);
+    EXT2_DX_ROUND(EXT2_DX_H, d, a, b, c, in[5] + EXT2_DX_K3, 9);
+    EXT2_DX_ROUND(EXT2_DX_H, c, d, a, b, in[0] + EXT2_DX_K3, 11);
+    EXT2_DX_ROUND(EXT2_DX_H, b, c, d, a, in[4] + EXT2_DX_K3, 15);
+
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+/* Get the character value that the hash uses.  The kernel used to hash
+ * 'char' so the result depends on the signedness of the platform that
+ * created the file system, which is recorded in the superblock. */
+static int
+ext2fs_dx_char(const char *a_str, size_t a_idx, uint8_t a_unsigned)
+{
+    if (a_unsigned)
+        return (int) ((const unsigned char *) a_str)[a_idx];
+    else
+        return (int) ((const signed char *) a_str)[a_idx];
+}
+
+static uint32_t
+ext2fs_dx_hash_legacy(const char *a_name, size_t a_len, uint8_t a_unsigned)
+{
+    uint32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+    size_t i;
+
+    for (i = 0; i < a_len; i++) {
+        hash = hash1 + (hash0 ^ (uint32_t) (ext2fs_dx_char(a_name, i,
+                    a_unsigned) * 7152373));
+        if (hash & 0x80000000)
+            hash -= 0x7fffffff;
+        hash1 = hash0;
+        hash0 = hash;
+    }
+    return hash0 << 1;
+}
+
+static void
+ext2fs_dx_str2hashbuf(const char *a_str, size_t a_len, uint32_t * a_buf,
+    int a_num, uint8_t a_unsigned)
+{
+    uint32_t pad, val;
+    size_t i;
+
+    pad = (uint32_t) a_len | ((uint32_t) a_len << 8);
+    pad |= pad << 16;
+
+    val = pad;
+    if (a_len > (size_t) a_num * 4)
+        a_len = a_num * 4;
+    for (i = 0; i < a_len; i++) {
+        val = ext2fs_dx_char(a_str, i, a_unsigned) + (val << 8);
+        if ((i % 4) == 3) {
+            *a_buf++ = val;
+            val = pad;
+            a_num--;
+        }
+    }
+    if (--a_num >= 0)
+        *a_buf++ = val;
+    while (--a_num >= 0)
+        *a_buf++ = pad;
+}
+
+/**
+ * \internal
+ * Calculate the hash of a name in a hash-indexed directory.
+ *
+ * @param a_version Hash version (already adjusted for unsigned chars)
+ * @param a_seed Hash seed from the superblock
+ * @param a_name Name to hash
+ * @param a_len Length of name
+ * @param [out] a_hash Hash of the name (with the collision bit cleared)
+ * @returns 1 if the hash version is not supported and 0 on success
+ */
+static uint8_t
+ext2fs_dx_hash(uint8_t a_version, const uint32_t a_seed[4],
+    const char *a_name, size_t a_len, uint32_t * a_hash)
+{
+    uint32_t buf[4], in[8];
+    uint8_t is_unsigned = 0;
+    int i;
+
+    buf[0] = 0x67452301;
+    buf[1] = 0xefcdab89;
+    buf[2] = 0x98badcfe;
+    buf[3] = 0x10325476;
+
+    // an all zero seed means use the default
+    for (i = 0; i < 4; i++) {
+        if (a_seed[i]) {
+            memcpy(buf, a_seed, sizeof(buf));
+            break;
+        }
+    }
+
+    switch (a_version) {
+    case EXT2_HASH_LEGACY_UNSIGNED:
+        is_unsigned = 1;
+        // fall through
+    case EXT2_HASH_LEGACY:
+        *a_hash = ext2fs_dx_hash_legacy(a_name, a_len, is_unsigned);
+        break;
+
+    case EXT2_HASH_HALF_MD4_UNSIGNED:
+        is_unsigned = 1;
+        // fall through
+    case EXT2_HASH_HALF_MD4:
+        while (a_len > 0) {
+            ext2fs_dx_str2hashbuf(a_name, a_len, in, 8, is_unsigned);
+            ext2fs_dx_half_md4_transform(buf, in);
+            if (a_len <= 32)
+                break;
+            a_len -= 32;
+            a_name += 32;
+        }
+        *a_hash = buf[1];
+        break;
+
+    case EXT2_HASH_TEA_UNSIGNED:
+        is_unsigned = 1;
+        // fall through
+    case EXT2_HASH_TEA:
+        while (a_len > 0) {
+            ext2fs_dx_str2hashbuf(a_name, a_len, in, 4, is_unsigned);
+            ext2fs_dx_tea_transform(buf, in);
+            if (a_len <= 16)
+                break;
+            a_len -= 16;
+            a_name += 16;
+        }
+        *a_hash = buf[0];
+        break;
+
+    default:
+        return 1;
+    }
+
+    *a_hash &= ~1;
+    return 0;
+}
+
+
+/* A node of the hash index on the path to a leaf block */
+typedef struct {
+    ext2fs_dx_entry *entries;
+    ext2fs_dx_entry *at;
+    uint16_t count;
+} EXT2FS_DX_FRAME;
+
+/**
+ * \internal
+ * Read a block of a directory.
+ * @returns 1 if the block could not be read and 0 on success
+ */
+static uint8_t
+ext2fs_dx_block_read(TSK_FS_FILE * a_fs_file, uint32_t a_blk, char *a_buf)
+{
+    TSK_FS_INFO *fs = a_fs_file->fs_info;
+
+    if ((TSK_OFF_T) a_blk >= a_fs_file->meta->size / fs->block_size)
+        return 1;
+
+    if (tsk_fs_file_read(a_fs_file, (TSK_OFF_T) a_blk * fs->block_size,
+            a_buf, fs->block_size, TSK_FS_FILE_READ_FLAG_NONE) !=
+        (ssize_t) fs->block_size) {
+        tsk_error_reset();
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * \internal
+ * Set up a frame for the index entries in a node.
+ * @returns 1 if the node is corrupt and 0 on success
+ */
+static uint8_t
+ext2fs_dx_frame_init(TSK_FS_INFO * a_fs, char *a_buf, size_t a_off,
+    EXT2FS_DX_FRAME * a_frame)
+{
+    ext2fs_dx_countlimit *countlimit;
+    uint16_t limit;
+
+    if (a_off + sizeof(ext2fs_dx_entry) > a_fs->block_size)
+        return 1;
+
+    countlimit = (ext2fs_dx_countlimit *) & a_buf[a_off];
+    limit = tsk_getu16(a_fs->endian, countlimit->limit);
+    a_frame->count = tsk_getu16(a_fs->endian, countlimit->count);
+    if ((a_frame->count == 0) || (a_frame->count > limit)
+        || (a_off + (size_t) limit * sizeof(ext2fs_dx_entry) >
+            a_fs->block_size))
+        return 1;
+
+    a_frame->entries = (ext2fs_dx_entry *) & a_buf[a_off];
+    a_frame->at = a_frame->entries;
+    return 0;
+}
+
+/**
+ * \internal
+ * Find the index entry whose hash range contains a hash.  The hash of
+ * the first entry is implicitly 0.
+ */
+static void
+ext2fs_dx_frame_search(TSK_FS_INFO * a_fs, EXT2FS_DX_FRAME * a_frame,
+    uint32_t a_hash)
+{
+    uint16_t lo = 1, hi = a_frame->count;
+
+    while (lo < hi) {
+        uint16_t mid = lo + (hi - lo) / 2;
+        if (tsk_getu32(a_fs->endian, a_frame->entries[mid].hash) > a_hash)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    a_frame->at = &a_frame->entries[lo - 1];
+}
+
+/** \internal
+ * Find a name in a directory by using its hash index (htree).  Only the
+ * index blocks on the path to the name and the leaf blocks that the name
+ * hashes to are read.  The leaf blocks are parsed with the same code as
+ * ext2fs_dir_open_meta().
+ *
+ * This only finds allocated names.  In all other cases (deleted names,
+ * directories without an index, unsupported hashes, corrupt indexes,
+ * etc.) 1 is returned and the caller should fall back to
+ * ext2fs_dir_open_meta().
+ *
+ * @param a_fs File system to analyze
+ * @param a_dir_addr Metadata address of the directory
+ * @param a_name Name to find
+ * @param [out] a_result Metadata address of the name
+ * @param [out] a_fs_name Copy of the name details (or NULL if not wanted)
+ * @returns -1 on (system) error, 0 if found, and 1 if not found
+ */
+int8_t
+ext2fs_dir_lookup(TSK_FS_INFO * a_fs, TSK_INUM_T a_dir_addr,
+    const char *a_name, TSK_INUM_T * a_result, TSK_FS_NAME * a_fs_name)
+{
+    EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) a_fs;
+    TSK_FS_FILE *fs_file = NULL;
+    TSK_FS_DIR *fs_dir = NULL;
+    ext2fs_inode *dino_buf = NULL;
+    ext2fs_dx_root_info *root_info;
+    EXT2FS_DX_FRAME frames[EXT2_DX_MAX_LEVELS];
+    char *node_buf = NULL;
+    char *leaf_buf;
+    size_t name_len, i;
+    uint32_t seed[4], hash, flags;
+    uint8_t hash_version;
+    int levels, level;
+    int8_t retval = 1;
+
+    *a_result = 0;
+
+    if ((EXT2FS_HAS_COMPAT_FEATURE(a_fs, ext2fs->fs,
+                EXT2FS_FEATURE_COMPAT_DIR_INDEX) == 0)
+        || (ext2fs->deentry_type != EXT2_DE_V2))
+        return 1;
+
+    // the "." and ".." entries are not in the index
+    name_len = strlen(a_name);
+    if ((name_len == 0) || (name_len > EXT2FS_MAXNAMLEN)
+        || (strcmp(a_name, ".") == 0) || (strcmp(a_name, "..") == 0))
+        return 1;
+
+    // use last_inum-1 to skip the virtual orphan directory
+    if ((a_dir_addr < a_fs->first_inum)
+        || (a_dir_addr > a_fs->last_inum - 1))
+        return 1;
+
+    if ((dino_buf = (ext2fs_inode *) tsk_malloc(ext2fs->inode_size >
+                sizeof(ext2fs_inode) ? ext2fs->inode_size :
+                sizeof(ext2fs_inode))) == NULL)
+        return -1;
+    if (ext2fs_dinode_load(ext2fs, a_dir_addr, dino_buf)) {
+        tsk_error_reset();
+        free(dino_buf);
+        return 1;
+    }
+    flags = tsk_getu32(a_fs->endian, dino_buf->i_flags);
+    free(dino_buf);
+
+    // encrypted and casefolded names are hashed differently
+    if (((flags & EXT2_IN_INDEX) == 0)
+        || (flags & (EXT2_IN_ENCRYPT | EXT2_IN_CASEFOLD)))
+        return 1;
+
+    if ((fs_file = tsk_fs_file_open_meta(a_fs, NULL, a_dir_addr)) == NULL) {
+        tsk_error_reset();
+        return 1;
+    }
+
+    // deleted directories have only deleted names
+    if ((fs_file->meta->type != TSK_FS_META_TYPE_DIR)
+        || ((fs_file->meta->flags & TSK_FS_META_FLAG_ALLOC) == 0))
+        goto done;
+
+    /* One buffer for each level of the index and one for the leaf */
+    if ((node_buf = (char *) tsk_malloc((EXT2_DX_MAX_LEVELS + 1) *
+                a_fs->block_size)) == NULL) {
+        retval = -1;
+        goto done;
+    }
+    leaf_buf = &node_buf[EXT2_DX_MAX_LEVELS * a_fs->block_size];
+
+    if (ext2fs_dx_block_read(fs_file, 0, node_buf))
+        goto done;
+
+    root_info = (ext2fs_dx_root_info *) & node_buf[EXT2_DX_ROOT_INFO_OFF];
+    levels = root_info->indirect_levels + 1;
+    if ((tsk_getu32(a_fs->endian, root_info->reserved_zero) != 0)
+        || (root_info->info_length < sizeof(ext2fs_dx_root_info))
+        || (levels > EXT2_DX_MAX_LEVELS)
+        || ((levels > 2) && (EXT2FS_HAS_INCOMPAT_FEATURE(a_fs, ext2fs->fs,
+                    EXT4FS_FEATURE_INCOMPAT_LARGEDIR) == 0))
+        || (ext2fs_dx_frame_init(a_fs, node_buf,
+                EXT2_DX_ROOT_INFO_OFF + root_info->info_length,
+                &frames[0])))
+        goto done;
+
+    hash_version = root_info->hash_version;
+    if ((hash_version <= EXT2_HASH_TEA)
+        && (tsk_getu32(a_fs->endian,
+                ext2fs->fs->s_flags) & EXT2_FLAGS_UNSIGNED_HASH))
+        hash_version += EXT2_HASH_LEGACY_UNSIGNED;
+
+    for (i = 0; i < 4; i++)
+        seed[i] = tsk_getu32(a_fs->endian, &ext2fs->fs->s_hash_seed[i * 4]);
+
+    if (ext2fs_dx_hash(hash_version, seed, a_name, name_len, &hash))
+        goto done;
+
+    // descend to the leaf that the hash is in
+    for (level = 0; level < levels; level++) {
+        ext2fs_dx_frame_search(a_fs, &frames[level], hash);
+        if (level + 1 == levels)
+            break;
+
+        if ((ext2fs_dx_block_read(fs_file, tsk_getu32(a_fs->endian,
+                        frames[level].at->block) & EXT2_DX_BLOCK_MASK,
+                    &node_buf[(level + 1) * a_fs->block_size]))
+            || (ext2fs_dx_frame_init(a_fs,
+                    &node_buf[(level + 1) * a_fs->block_size],
+                    EXT2_DX_NODE_OFF, &frames[level + 1])))
+            goto done;
+    }
+
+    if ((fs_dir = tsk_fs_dir_alloc(a_fs, a_dir_addr, 64)) == NULL) {
+        retval = -1;
+        goto done;
+    }
+
+    while (1) {
+        TSK_RETVAL_ENUM retval_tmp;
+
+        if (ext2fs_dx_block_read(fs_file, tsk_getu32(a_fs->endian,
+                    frames[levels - 1].at->block) & EXT2_DX_BLOCK_MASK,
+                leaf_buf))
+            goto done;
+
+        tsk_fs_dir_reset(fs_dir);
+        fs_dir->addr = a_dir_addr;
+        retval_tmp = ext2fs_dent_parse_block(ext2fs, fs_dir, 0, NULL,
+            leaf_buf, a_fs->block_size);
+        if (retval_tmp == TSK_ERR) {
+            retval = -1;
+            goto done;
+        }
+
+        for (i = 0; i < fs_dir->names_used; i++) {
+            TSK_FS_NAME *fs_name = &fs_dir->names[i];
+
+            if ((fs_name->flags & TSK_FS_NAME_FLAG_ALLOC)
+                && (a_fs->name_cmp(a_fs, fs_name->name, a_name) == 0)) {
+                if ((a_fs_name) && (tsk_fs_name_copy(a_fs_name, fs_name))) {
+                    retval = -1;
+                    goto done;
+                }
+                *a_result = fs_name->meta_addr;
+                retval = 0;
+                goto done;
+            }
+        }
+
+        /* Names with the same hash can continue in the next leaf, which
+         * is marked by its first hash being equal to ours. Find the next
+         * entry at the lowest level that has one. */
+        for (level = levels - 1; level >= 0; level--) {
+            if (frames[level].at + 1 <
+                frames[level].entries + frames[level].count)
+                break;
+        }
+        if (level < 0)
+            goto done;
+
+        frames[level].at++;
+        if ((tsk_getu32(a_fs->endian,
+                    frames[level].at->hash) & ~1) != hash)
+            goto done;
+
+        // go back down the left edge of the new sub-tree
+        for (; level + 1 < levels; level++) {
+            if ((ext2fs_dx_block_read(fs_file, tsk_getu32(a_fs->endian,
+                            frames[level].at->block) & EXT2_DX_BLOCK_MASK,
+                        &node_buf[(level + 1) * a_fs->block_size]))
+                || (ext2fs_dx_frame_init(a_fs,
+                        &node_buf[(level + 1) * a_fs->block_size],
+                        EXT2_DX_NODE_OFF, &frames[level + 1])))
+                goto done;
+        }
+    }
+
+  done:
+    if (fs_dir)
+        tsk_fs_dir_close(fs_dir);
+    free(node_buf);
+    tsk_fs_file_close(fs_file);
+    return retval;
+}
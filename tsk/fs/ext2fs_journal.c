@@ -69,9 +69,107 @@ load_sb_action(TSK_FS_FILE * fs_file, TSK_OFF_T a_off, TSK_DADDR_T addr,
     jinfo->start_blk = big_tsk_getu32(sb->start_blk);
     jinfo->start_seq = big_tsk_getu32(sb->start_seq);
 
+    /* The feature fields are only valid in v2 super blocks */
+    if (big_tsk_getu32(sb->entrytype) == EXT2_J_ETYPE_SB2) {
+        jinfo->feature_compat = big_tsk_getu32(sb->feature_compat);
+        jinfo->feature_incompat = big_tsk_getu32(sb->feature_incompat);
+    }
+
     return TSK_WALK_STOP;
 }
 
+
+/*
+ * State for walking the tags of a descriptor block.  The size and
+ * layout of the tags depend on the 64BIT and CSUM features.
+ */
+typedef struct {
+    const uint8_t *desc;        /* descriptor block */
+    size_t off;                 /* offset of the next tag */
+    size_t end;                 /* end of the tag area */
+    size_t tag_size;            /* size of a tag without the UUID */
+    uint8_t is_64;              /* tags have the high 32 bits of the address */
+    uint8_t is_csum3;           /* tags have 32-bit flags */
+    uint8_t done;               /* the last tag was returned */
+} EXT2FS_JTAG_ITER;
+
+static void
+ext2fs_jtag_init(EXT2FS_JINFO * jinfo, EXT2FS_JTAG_ITER * a_iter,
+    const char *a_desc)
+{
+    a_iter->desc = (const uint8_t *) a_desc;
+    a_iter->off = sizeof(ext2fs_journ_head);
+    a_iter->end = jinfo->bsize;
+    a_iter->is_64 =
+        (jinfo->feature_incompat & JBD2_FEATURE_INCOMPAT_64BIT) ? 1 : 0;
+    a_iter->is_csum3 =
+        (jinfo->feature_incompat & JBD2_FEATURE_INCOMPAT_CSUM_V3) ? 1 : 0;
+    a_iter->done = 0;
+
+    if (a_iter->is_csum3) {
+        a_iter->tag_size = sizeof(ext2fs_journ_dentry3);
+    }
+    else {
+        /* block, checksum, flags, block_high */
+        a_iter->tag_size = 12;
+        if (jinfo->feature_incompat & JBD2_FEATURE_INCOMPAT_CSUM_V2)
+            a_iter->tag_size += 2;
+        if (a_iter->is_64 == 0)
+            a_iter->tag_size -= 4;
+    }
+
+    if (jinfo->feature_incompat & (JBD2_FEATURE_INCOMPAT_CSUM_V2 |
+            JBD2_FEATURE_INCOMPAT_CSUM_V3))
+        a_iter->end -= EXT2_J_DESC_TAIL_SIZE;
+}
+
+/*
+ * Get the next tag of a descriptor block.
+ *
+ * Return 1 if a tag was returned and 0 if there are no more tags
+ */
+static uint8_t
+ext2fs_jtag_next(EXT2FS_JTAG_ITER * a_iter, TSK_DADDR_T * a_fsblk,
+    uint32_t * a_flags)
+{
+    const uint8_t *tag;
+
+    if ((a_iter->done) || (a_iter->off + a_iter->tag_size > a_iter->end))
+        return 0;
+
+    tag = &a_iter->desc[a_iter->off];
+    *a_fsblk = big_tsk_getu32(tag);
+    if (a_iter->is_64)
+        *a_fsblk |= (TSK_DADDR_T) big_tsk_getu32(&tag[8]) << 32;
+
+    /* Without CSUM_V3, the upper 16 bits are the tag checksum */
+    *a_flags = big_tsk_getu32(&tag[4]);
+    if (a_iter->is_csum3 == 0)
+        *a_flags &= 0xffff;
+
+    /* If the SAMEID value is set, then we advance by the size of the
+     * entry, otherwise add 16 for the ID */
+    a_iter->off += a_iter->tag_size;
+    if ((*a_flags & EXT2_J_DENTRY_SAMEID) == 0)
+        a_iter->off += 16;
+
+    if (*a_flags & EXT2_J_DENTRY_LAST)
+        a_iter->done = 1;
+
+    return 1;
+}
+
+/*
+ * Return 1 if a journal entry in the descriptor at a_desc_blk with
+ * sequence a_seq is from a transaction that was already checkpointed.
+ */
+static uint8_t
+ext2fs_jentry_is_unalloc(EXT2FS_JINFO * jinfo, TSK_DADDR_T a_desc_blk,
+    uint32_t a_seq)
+{
+    return ((a_desc_blk < jinfo->start_blk) || (a_seq < jinfo->start_seq));
+}
+
 /* Place journal data in *fs
  *
  * Return 0 on success and 1 on error 
@@ -92,6 +190,8 @@ ext2fs_jopen(TSK_FS_INFO * fs, TSK_INUM_T inum)
         return 1;
     }
 
+    ext2fs_jclose(ext2fs);
+
     ext2fs->jinfo = jinfo =
         (EXT2FS_JINFO *) tsk_malloc(sizeof(EXT2FS_JINFO));
     if (jinfo == NULL) {
@@ -102,6 +202,7 @@ ext2fs_jopen(TSK_FS_INFO * fs, TSK_INUM_T inum)
     jinfo->fs_file = tsk_fs_file_open_meta(fs, NULL, inum);
     if (!jinfo->fs_file) {
         free(jinfo);
+        ext2fs->jinfo = NULL;
         return 1;
 //      error("error finding journal inode %" PRIu32, inum);
     }
@@ -112,6 +213,7 @@ ext2fs_jopen(TSK_FS_INFO * fs, TSK_INUM_T inum)
         tsk_error_set_errstr("Error loading ext3 journal");
         tsk_fs_file_close(jinfo->fs_file);
         free(jinfo);
+        ext2fs->jinfo = NULL;
         return 1;
     }
 
@@ -125,7 +227,365 @@ ext2fs_jopen(TSK_FS_INFO * fs, TSK_INUM_T inum)
 }
 
 
-/* Limitations: does not use the action or any flags 
+/** \internal
+ * Free the journal that was opened with ext2fs_jopen() and its index.
+ *
+ * @param ext2fs File system to free the journal of
+ */
+void
+ext2fs_jclose(EXT2FS_INFO * ext2fs)
+{
+    EXT2FS_JINFO *jinfo = ext2fs->jinfo;
+
+    if (jinfo == NULL)
+        return;
+
+    tsk_fs_file_close(jinfo->fs_file);
+    free(jinfo->jindex);
+    free(jinfo->jesc);
+    free(jinfo);
+    ext2fs->jinfo = NULL;
+}
+
+
+/* Check that the journal is open and that its size is consistent
+ * with its super block.
+ *
+ * Return 0 on success and 1 on error
+ */
+static uint8_t
+ext2fs_jcheck(EXT2FS_JINFO * jinfo, const char *a_func)
+{
+    if ((jinfo == NULL) || (jinfo->fs_file == NULL)
+        || (jinfo->fs_file->meta == NULL)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("%s: journal is not open", a_func);
+        return 1;
+    }
+
+    if (jinfo->fs_file->meta->size !=
+        (TSK_OFF_T) ((jinfo->last_block + 1) * jinfo->bsize)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("%s: journal file size is different from \nsize reported in journal super block",
+            a_func);
+        return 1;
+    }
+    return 0;
+}
+
+
+/* Add a copy of an FS block to the journal index.
+ *
+ * Return 0 on success and 1 on error
+ */
+static uint8_t
+ext2fs_jindex_add(EXT2FS_JINFO * jinfo, size_t * a_alloc,
+    TSK_DADDR_T a_fsblk, TSK_DADDR_T a_jblk, uint32_t a_seq,
+    uint8_t a_unalloc)
+{
+    EXT2FS_JINDEX_ENTRY *ent;
+
+    if (jinfo->jindex_cnt == *a_alloc) {
+        size_t new_alloc = (*a_alloc) ? (*a_alloc) * 2 : 256;
+        EXT2FS_JINDEX_ENTRY *tmp;
+
+        if ((tmp = (EXT2FS_JINDEX_ENTRY *) tsk_realloc(jinfo->jindex,
+                    new_alloc * sizeof(EXT2FS_JINDEX_ENTRY))) == NULL)
+            return 1;
+        jinfo->jindex = tmp;
+        *a_alloc = new_alloc;
+    }
+
+    ent = &jinfo->jindex[jinfo->jindex_cnt++];
+    ent->fsblk = a_fsblk;
+    ent->jblk = a_jblk;
+    ent->seq = a_seq;
+    ent->unalloc = a_unalloc;
+    return 0;
+}
+
+static int
+ext2fs_jindex_cmp(const void *a, const void *b)
+{
+    const EXT2FS_JINDEX_ENTRY *e1 = (const EXT2FS_JINDEX_ENTRY *) a;
+    const EXT2FS_JINDEX_ENTRY *e2 = (const EXT2FS_JINDEX_ENTRY *) b;
+
+    if (e1->fsblk != e2->fsblk)
+        return (e1->fsblk < e2->fsblk) ? -1 : 1;
+    if (e1->seq != e2->seq)
+        return (e1->seq < e2->seq) ? -1 : 1;
+    if (e1->jblk != e2->jblk)
+        return (e1->jblk < e2->jblk) ? -1 : 1;
+    return 0;
+}
+
+/* Number of bytes to read from the journal at a time when indexing it */
+#define EXT2FS_JINDEX_READ_SIZE (1024 * 1024)
+
+/*
+ * Build the index of the FS blocks that are in the journal.  The journal
+ * is read once, in order, and each data block is assigned to the tag of
+ * the descriptor before it (using the same rules as ext2fs_jentry_walk()).
+ * The tags of a descriptor at the end of the journal continue at its
+ * first block.  The index also records which journal blocks had their
+ * magic value escaped.
+ *
+ * Return 0 on success and 1 on error
+ */
+static uint8_t
+ext2fs_jindex_build(TSK_FS_INFO * fs)
+{
+    EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) fs;
+    EXT2FS_JINFO *jinfo = ext2fs->jinfo;
+    char *buf = NULL;
+    char *desc = NULL;
+    TSK_DADDR_T buf_start = 0, buf_cnt = 0;
+    TSK_DADDR_T chunk;
+    TSK_DADDR_T nblks, pos;
+    TSK_DADDR_T desc_blk = 0;
+    uint32_t desc_seq = 0;
+    uint8_t have_desc = 0;
+    EXT2FS_JTAG_ITER iter;
+    size_t alloc = 0;
+
+    if (jinfo->jindex_built)
+        return 0;
+
+    if (ext2fs_jcheck(jinfo, "ext2fs_jindex_build"))
+        return 1;
+
+    if ((jinfo->bsize == 0) || (jinfo->first_block > jinfo->last_block)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("ext2fs_jindex_build: invalid journal super block");
+        return 1;
+    }
+
+    chunk = EXT2FS_JINDEX_READ_SIZE / jinfo->bsize;
+    if (chunk == 0)
+        chunk = 1;
+
+    if (((buf = (char *) tsk_malloc((size_t) (chunk * jinfo->bsize))) ==
+            NULL)
+        || ((desc = (char *) tsk_malloc(jinfo->bsize)) == NULL)
+        || ((jinfo->jesc =
+                (uint8_t *) tsk_malloc((size_t) (jinfo->last_block / 8 +
+                        1))) == NULL)) {
+        free(buf);
+        free(desc);
+        return 1;
+    }
+    jinfo->jindex_cnt = 0;
+
+    nblks = jinfo->last_block - jinfo->first_block + 1;
+
+    for (pos = 0;; pos++) {
+        TSK_DADDR_T jblk;
+        ext2fs_journ_head *head;
+        uint8_t is_magic;
+
+        /* After the end of the journal, only follow the descriptor
+         * that wrapped around */
+        if (pos < nblks) {
+            jblk = jinfo->first_block + pos;
+        }
+        else {
+            if ((have_desc == 0) || (pos >= 2 * nblks))
+                break;
+            jblk = jinfo->first_block + (pos - nblks);
+        }
+
+        if ((jblk < buf_start) || (jblk >= buf_start + buf_cnt)) {
+            ssize_t cnt;
+
+            buf_start = jblk;
+            buf_cnt = jinfo->last_block + 1 - jblk;
+            if (buf_cnt > chunk)
+                buf_cnt = chunk;
+
+            cnt = tsk_fs_file_read(jinfo->fs_file,
+                (TSK_OFF_T) (buf_start * jinfo->bsize), buf,
+                (size_t) (buf_cnt * jinfo->bsize), TSK_FS_FILE_READ_FLAG_NONE);
+            if (cnt != (ssize_t) (buf_cnt * jinfo->bsize)) {
+                if (cnt >= 0) {
+                    tsk_error_reset();
+                    tsk_error_set_errno(TSK_ERR_FS_READ);
+                }
+                tsk_error_set_errstr2
+                    ("ext2fs_jindex_build: journal block %" PRIuDADDR,
+                    buf_start);
+                goto on_error;
+            }
+        }
+
+        head =
+            (ext2fs_journ_head *) & buf[(jblk - buf_start) * jinfo->bsize];
+        is_magic = (big_tsk_getu32(head->magic) == EXT2_JMAGIC);
+
+        /* Assign the block to the next tag of the current descriptor,
+         * unless it is a journal data structure of a later transaction */
+        if (have_desc) {
+            TSK_DADDR_T fsblk;
+            uint32_t tflags;
+
+            if ((is_magic)
+                && (big_tsk_getu32(head->entry_seq) >= desc_seq)) {
+                have_desc = 0;
+            }
+            else if (ext2fs_jtag_next(&iter, &fsblk, &tflags) == 0) {
+                have_desc = 0;
+            }
+            else {
+                if (ext2fs_jindex_add(jinfo, &alloc, fsblk, jblk,
+                        desc_seq, ext2fs_jentry_is_unalloc(jinfo,
+                            desc_blk, desc_seq)))
+                    goto on_error;
+
+                if (tflags & EXT2_J_DENTRY_ESC)
+                    setbit(jinfo->jesc, jblk);
+
+                if (iter.done)
+                    have_desc = 0;
+                continue;
+            }
+        }
+
+        if (pos >= nblks)
+            break;
+
+        if ((is_magic)
+            && (big_tsk_getu32(head->entry_type) == EXT2_J_ETYPE_DESC)) {
+            /* keep a copy, the tags may continue past the read buffer */
+            memcpy(desc, head, jinfo->bsize);
+            ext2fs_jtag_init(jinfo, &iter, desc);
+            desc_blk = jblk;
+            desc_seq = big_tsk_getu32(head->entry_seq);
+            have_desc = 1;
+        }
+    }
+
+    qsort(jinfo->jindex, jinfo->jindex_cnt, sizeof(EXT2FS_JINDEX_ENTRY),
+        ext2fs_jindex_cmp);
+    jinfo->jindex_built = 1;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "ext2fs_jindex_build: %" PRIuSIZE
+            " FS block copies in the journal\n", jinfo->jindex_cnt);
+
+    free(buf);
+    free(desc);
+    return 0;
+
+  on_error:
+    free(buf);
+    free(desc);
+    free(jinfo->jindex);
+    jinfo->jindex = NULL;
+    jinfo->jindex_cnt = 0;
+    free(jinfo->jesc);
+    jinfo->jesc = NULL;
+    return 1;
+}
+
+
+/* Call the action for the index entries from a_first to a_last (exclusive).
+ *
+ * Return 0 on success and 1 on error
+ */
+static uint8_t
+ext2fs_jindex_walk(TSK_FS_INFO * fs, size_t a_first, size_t a_last,
+    TSK_FS_JENTRY_WALK_CB a_action, void *a_ptr)
+{
+    EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) fs;
+    EXT2FS_JINFO *jinfo = ext2fs->jinfo;
+    size_t i;
+
+    for (i = a_first; i < a_last; i++) {
+        EXT2FS_JINDEX_ENTRY *ent = &jinfo->jindex[i];
+        TSK_FS_JENTRY jentry;
+        TSK_WALK_RET_ENUM retval;
+
+        jentry.jblk = ent->jblk;
+        jentry.fsblk = ent->fsblk;
+        jentry.seq = ent->seq;
+        jentry.meta_addr = 0;
+        jentry.flags = (ent->unalloc) ? TSK_FS_JENTRY_FLAG_UNALLOC :
+            TSK_FS_JENTRY_FLAG_ALLOC;
+
+        retval = a_action(fs, &jentry, 0, a_ptr);
+        if (retval == TSK_WALK_STOP)
+            break;
+        else if (retval == TSK_WALK_ERROR)
+            return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * \internal
+ * Call the action for each copy of an FS block that is in the journal,
+ * ordered by transaction sequence.  The journal is indexed on the first
+ * call, so later lookups do not need to read it again.
+ *
+ * @param fs File system with an open journal
+ * @param a_fsblk FS block to find the copies of
+ * @param a_action Callback to call with each copy
+ * @param a_ptr Pointer to pass to the callback
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+ext2fs_jentry_find(TSK_FS_INFO * fs, TSK_DADDR_T a_fsblk,
+    TSK_FS_JENTRY_WALK_CB a_action, void *a_ptr)
+{
+    EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) fs;
+    EXT2FS_JINFO *jinfo = ext2fs->jinfo;
+    size_t lo, hi, end;
+
+    // clean up any error messages that are lying around
+    tsk_error_reset();
+
+    if (ext2fs_jcheck(jinfo, "ext2fs_jentry_find"))
+        return 1;
+
+    if (a_action == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ext2fs_jentry_find: action is NULL");
+        return 1;
+    }
+
+    if (ext2fs_jindex_build(fs))
+        return 1;
+
+    /* find the first entry for the block */
+    lo = 0;
+    hi = jinfo->jindex_cnt;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (jinfo->jindex[mid].fsblk < a_fsblk)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (end = lo; end < jinfo->jindex_cnt; end++) {
+        if (jinfo->jindex[end].fsblk != a_fsblk)
+            break;
+    }
+
+    return ext2fs_jindex_walk(fs, lo, end, a_action, a_ptr);
+}
+
+
+/* If action is NULL, the journal is printed block by block.  Otherwise
+ * action is called for each FS block copy in the journal index, ordered
+ * by FS block and then by sequence.  Flags are not used.
  *
  * return 0 on success and 1 on error
  * */
@@ -145,22 +605,13 @@ ext2fs_jentry_walk(TSK_FS_INFO * fs, int flags,
     // clean up any error messages that are lying around
     tsk_error_reset();
 
-
-    if ((jinfo == NULL) || (jinfo->fs_file == NULL)
-        || (jinfo->fs_file->meta == NULL)) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_ARG);
-        tsk_error_set_errstr("ext2fs_jentry_walk: journal is not open");
+    if (ext2fs_jcheck(jinfo, "ext2fs_jentry_walk"))
         return 1;
-    }
 
-    if (jinfo->fs_file->meta->size !=
-        (jinfo->last_block + 1) * jinfo->bsize) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_ARG);
-        tsk_error_set_errstr
-            ("ext2fs_jentry_walk: journal file size is different from \nsize reported in journal super block");
-        return 1;
+    if (action) {
+        if (ext2fs_jindex_build(fs))
+            return 1;
+        return ext2fs_jindex_walk(fs, 0, jinfo->jindex_cnt, action, ptr);
     }
 
     /* Load the journal into a buffer */
@@ -355,23 +806,20 @@ ext2fs_jentry_walk(TSK_FS_INFO * fs, int flags,
         /* Revoke Block */
         else if (big_tsk_getu32(head->entry_type) == EXT2_J_ETYPE_REV) {
             tsk_printf("%" PRIuDADDR ":\t%sRevoke Block (seq: %" PRIu32
-                ")\n", i, ((i < jinfo->start_blk)
-                    || (big_tsk_getu32(head->entry_seq) <
-                        jinfo->start_seq)) ? "Unallocated " : "Allocated ",
-                big_tsk_getu32(head->entry_seq));
+                ")\n", i, ext2fs_jentry_is_unalloc(jinfo, i,
+                    big_tsk_getu32(head->entry_seq)) ? "Unallocated " :
+                "Allocated ", big_tsk_getu32(head->entry_seq));
         }
 
         /* The commit is the end of the entries */
         else if (big_tsk_getu32(head->entry_type) == EXT2_J_ETYPE_COM) {
             tsk_printf("%" PRIuDADDR ":\t%sCommit Block (seq: %" PRIu32, i,
-                ((i < jinfo->start_blk)
-                    || (big_tsk_getu32(head->entry_seq) <
-                        jinfo->start_seq)) ? "Unallocated " : "Allocated ",
-                big_tsk_getu32(head->entry_seq));
+                ext2fs_jentry_is_unalloc(jinfo, i,
+                    big_tsk_getu32(head->entry_seq)) ? "Unallocated " :
+                "Allocated ", big_tsk_getu32(head->entry_seq));
             commit_head = (ext4fs_journ_commit_head *)head;
             //tsk_printf("commit seq %" PRIu32 "\n", big_tsk_getu32(commit_head->c_header.entry_seq));
-            if (big_tsk_getu32(journ_sb->
-                    feature_compat) & JBD2_FEATURE_COMPAT_CHECKSUM) {
+            if (jinfo->feature_compat & JBD2_FEATURE_COMPAT_CHECKSUM) {
                 int chksum_type = commit_head->chksum_type;
                 if (chksum_type) {
                     tsk_printf(", checksum_type: %d",
@@ -405,31 +853,28 @@ ext2fs_jentry_walk(TSK_FS_INFO * fs, int flags,
 
         /* The descriptor describes the FS blocks that follow it */
         else if (big_tsk_getu32(head->entry_type) == EXT2_J_ETYPE_DESC) {
-            ext2fs_journ_dentry *dentry;
+            EXT2FS_JTAG_ITER iter;
             ext2fs_journ_head *head2;
+            TSK_DADDR_T fsblk;
+            uint32_t tflags;
             int unalloc = 0;
 
             b_desc_seen = 1;
 
 
             /* Is this an unallocated journ block or sequence */
-            if ((i < jinfo->start_blk) ||
-                (big_tsk_getu32(head->entry_seq) < jinfo->start_seq))
+            if (ext2fs_jentry_is_unalloc(jinfo, i,
+                    big_tsk_getu32(head->entry_seq)))
                 unalloc = 1;
 
             tsk_printf("%" PRIuDADDR ":\t%sDescriptor Block (seq: %" PRIu32
                 ")\n", i, (unalloc) ? "Unallocated " : "Allocated ",
                 big_tsk_getu32(head->entry_seq));
 
-            dentry =
-                (ext2fs_journ_dentry *) ((uintptr_t) head +
-                sizeof(ext2fs_journ_head));;
+            ext2fs_jtag_init(jinfo, &iter, (char *) head);
 
             /* Cycle through the descriptor entries to account for the journal blocks */
-            while ((uintptr_t) dentry <=
-                ((uintptr_t) head + jinfo->bsize -
-                    sizeof(ext2fs_journ_head))) {
-
+            while (ext2fs_jtag_next(&iter, &fsblk, &tflags)) {
 
                 /* Our counter is over the end of the journ */
                 if (++i > jinfo->last_block)
@@ -447,25 +892,8 @@ ext2fs_jentry_walk(TSK_FS_INFO * fs, int flags,
 
                 /* If it doesn't have the magic, then it is a
                  * journal entry and we print the FS info */
-                tsk_printf("%" PRIuDADDR ":\t%sFS Block %" PRIu32 "\n", i,
-                    (unalloc) ? "Unallocated " : "Allocated ",
-                    big_tsk_getu32(dentry->fs_blk));
-
-                /* Increment to the next */
-                if (big_tsk_getu32(dentry->flag) & EXT2_J_DENTRY_LAST)
-                    break;
-
-                /* If the SAMEID value is set, then we advance by the size of the entry, otherwise add 16 for the ID */
-                else if (big_tsk_getu32(dentry->flag) &
-                    EXT2_J_DENTRY_SAMEID)
-                    dentry =
-                        (ext2fs_journ_dentry *) ((uintptr_t) dentry +
-                        sizeof(ext2fs_journ_dentry));
-
-                else
-                    dentry =
-                        (ext2fs_journ_dentry *) ((uintptr_t) dentry +
-                        sizeof(ext2fs_journ_dentry) + 16);
+                tsk_printf("%" PRIuDADDR ":\t%sFS Block %" PRIuDADDR "\n",
+                    i, (unalloc) ? "Unallocated " : "Allocated ", fsblk);
             }
         }
     }
@@ -481,6 +909,9 @@ ext2fs_jentry_walk(TSK_FS_INFO * fs, int flags,
 /* 
  * Limitations for 1st version: start must equal end and action is ignored
  *
+ * The block is written to stdout.  If its descriptor tag has the escape
+ * flag set, the magic value is restored first.
+ *
  * Return 0 on success and 1 on error
  */
 uint8_t
@@ -490,9 +921,7 @@ ext2fs_jblk_walk(TSK_FS_INFO * fs, TSK_DADDR_T start, TSK_DADDR_T end,
     EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) fs;
     EXT2FS_JINFO *jinfo = ext2fs->jinfo;
     char *journ;
-    TSK_FS_LOAD_FILE buf1;
-    TSK_DADDR_T i;
-    ext2fs_journ_head *head;
+    ssize_t cnt;
 
     // clean up any error messages that are lying around
     tsk_error_reset();
@@ -521,7 +950,7 @@ ext2fs_jblk_walk(TSK_FS_INFO * fs, TSK_DADDR_T start, TSK_DADDR_T end,
     }
 
     if (jinfo->fs_file->meta->size !=
-        (jinfo->last_block + 1) * jinfo->bsize) {
+        (TSK_OFF_T) ((jinfo->last_block + 1) * jinfo->bsize)) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_UNSUPFUNC);
         tsk_error_set_errstr
@@ -529,102 +958,36 @@ ext2fs_jblk_walk(TSK_FS_INFO * fs, TSK_DADDR_T start, TSK_DADDR_T end,
         return 1;
     }
 
-
-    /* Load into buffer and then process it 
-     * Only get the minimum needed
-     */
-    buf1.left = buf1.total = (size_t) ((end + 1) * jinfo->bsize);
-    journ = buf1.cur = buf1.base = tsk_malloc(buf1.left);
-    if (journ == NULL) {
+    /* The index knows which blocks were escaped */
+    if (ext2fs_jindex_build(fs))
         return 1;
-    }
 
-    if (tsk_fs_file_walk(jinfo->fs_file, 0, tsk_fs_load_file_action,
-            (void *) &buf1)) {
-        free(journ);
+    if ((journ = tsk_malloc(jinfo->bsize)) == NULL) {
         return 1;
     }
 
-    if (buf1.left > 0) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_FWALK);
-        tsk_error_set_errstr("ext2fs_jblk_walk: Buffer not fully copied");
+    cnt = tsk_fs_file_read(jinfo->fs_file,
+        (TSK_OFF_T) (end * jinfo->bsize), journ, jinfo->bsize,
+        TSK_FS_FILE_READ_FLAG_NONE);
+    if (cnt != (ssize_t) jinfo->bsize) {
+        if (cnt >= 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_READ);
+        }
+        tsk_error_set_errstr2("ext2fs_jblk_walk: journal block %"
+            PRIuDADDR, end);
         free(journ);
         return 1;
     }
 
-    head = (ext2fs_journ_head *) & journ[end * jinfo->bsize];
-
-
-    /* Check if our target block is a journal data structure.
-     * 
-     * If not, 
-     * we need to look for its descriptor to see if it has been
-     * escaped
-     */
-    if (big_tsk_getu32(head->magic) != EXT2_JMAGIC) {
-
-        /* cycle backwards until we find a desc block */
-        for (i = end - 1; i >= 0; i--) {
-            ext2fs_journ_dentry *dentry;
-            TSK_DADDR_T diff;
-
-            head = (ext2fs_journ_head *) & journ[i * jinfo->bsize];
-
-            if (big_tsk_getu32(head->magic) != EXT2_JMAGIC)
-                continue;
-
-            /* If we get a commit, then any desc we find will not
-             * be for our block, so forget about it */
-            if (big_tsk_getu32(head->entry_type) == EXT2_J_ETYPE_COM)
-                break;
-
-            /* Skip any other data structure types */
-            if (big_tsk_getu32(head->entry_type) != EXT2_J_ETYPE_DESC)
-                continue;
-
-            /* We now have the previous descriptor 
-             *
-             * NOTE: We have no clue if this is the correct 
-             * descriptor if it is not the current 'run' of 
-             * transactions, but this is the best we can do
-             */
-            diff = end - i;
-
-            dentry =
-                (ext2fs_journ_dentry *) (&journ[i * jinfo->bsize] +
-                sizeof(ext2fs_journ_head));
-
-            while ((uintptr_t) dentry <=
-                ((uintptr_t) & journ[(i + 1) * jinfo->bsize] -
-                    sizeof(ext2fs_journ_head))) {
-
-                if (--diff == 0) {
-                    if (big_tsk_getu32(dentry->flag) & EXT2_J_DENTRY_ESC) {
-                        journ[end * jinfo->bsize] = 0xC0;
-                        journ[end * jinfo->bsize + 1] = 0x3B;
-                        journ[end * jinfo->bsize + 2] = 0x39;
-                        journ[end * jinfo->bsize + 3] = 0x98;
-                    }
-                    break;
-                }
-
-                /* If the SAMEID value is set, then we advance by the size of the entry, otherwise add 16 for the ID */
-                if (big_tsk_getu32(dentry->flag) & EXT2_J_DENTRY_SAMEID)
-                    dentry =
-                        (ext2fs_journ_dentry *) ((uintptr_t) dentry +
-                        sizeof(ext2fs_journ_dentry));
-                else
-                    dentry =
-                        (ext2fs_journ_dentry *) ((uintptr_t) dentry +
-                        sizeof(ext2fs_journ_dentry) + 16);
-
-            }
-            break;
-        }
+    if (isset(jinfo->jesc, end)) {
+        journ[0] = (char) 0xC0;
+        journ[1] = (char) 0x3B;
+        journ[2] = (char) 0x39;
+        journ[3] = (char) 0x98;
     }
 
-    if (fwrite(&journ[end * jinfo->bsize], jinfo->bsize, 1, stdout) != 1) {
+    if (fwrite(journ, jinfo->bsize, 1, stdout) != 1) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_WRITE);
         tsk_error_set_errstr
@@ -19,6 +19,10 @@
 #include "tsk_fatxxfs.h"
 #include "tsk_exfatfs.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+
 /**
  * \internal
  * Open part of a disk image as a FAT file system. 
@@ -130,86 +134,213 @@ fatfs_open(TSK_IMG_INFO *a_img_info, TSK_OFF_T a_offset, TSK_FS_TYPE_ENUM a_ftyp
     }
 }
 
-/* TTL is 0 if the entry has not been used.  TTL of 1 means it was the
- * most recently used, and TTL of FATFS_FAT_CACHE_N means it was the least 
- * recently used.  This function has a LRU replacement algo
+/*
+ * Read the chunk of the FAT that has the entries for the clusters
+ * starting at a_idx * FATFS_FAT_CHUNK_N and decode it into the
+ * in-memory FAT table.
  *
  * Note: This routine assumes &fatfs->cache_lock is locked by the caller.
+ *
+ * Return 1 on error and 0 on success
  */
-// return -1 on error, or cache index on success (0 to FATFS_FAT_CACHE_N)
-
-static int
-getFATCacheIdx(FATFS_INFO * fatfs, TSK_DADDR_T sect)
+static uint8_t
+fatfs_fat_chunk_load(FATFS_INFO * fatfs, TSK_DADDR_T a_idx)
 {
-    int i, cidx;
-    ssize_t cnt;
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & fatfs->fs_info;
+    TSK_DADDR_T first = a_idx * FATFS_FAT_CHUNK_N;
+    size_t cnt, len, i;
+    TSK_OFF_T off;
+    uint32_t *tbl;
+    uint8_t *buf;
+    ssize_t rd;
+
+    cnt = FATFS_FAT_CHUNK_N;
+    if (first + cnt > fatfs->lastclust + 1)
+        cnt = (size_t) (fatfs->lastclust + 1 - first);
+
+    /* byte range of the entries in the FAT */
+    switch (fatfs->fs_info.ftype) {
+    case TSK_FS_TYPE_FAT12:
+        off = first + (first >> 1);
+        len = cnt + (cnt >> 1) + 1;
+        break;
+    case TSK_FS_TYPE_FAT16:
+        off = first << 1;
+        len = cnt << 1;
+        break;
+    case TSK_FS_TYPE_FAT32:
+    case TSK_FS_TYPE_EXFAT:
+        off = first << 2;
+        len = cnt << 2;
+        break;
+    default:
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("fatfs_fat_chunk_load: Unknown FAT type: %d",
+            fatfs->fs_info.ftype);
+        return 1;
+    }
+
+    if ((tbl = (uint32_t *) tsk_malloc(cnt * sizeof(uint32_t))) == NULL)
+        return 1;
 
-    // see if we already have it in the cache
-    for (i = 0; i < FATFS_FAT_CACHE_N; i++) {
-        if ((fatfs->fatc_ttl[i] > 0) &&
-            (sect >= fatfs->fatc_addr[i]) &&
-            (sect < (fatfs->fatc_addr[i] + (FATFS_FAT_CACHE_B >> fatfs->ssize_sh)))) {
-            int a;
+    /* FAT32 entries are decoded in place */
+    if (len == cnt * sizeof(uint32_t))
+        buf = (uint8_t *) tbl;
+    else if ((buf = (uint8_t *) tsk_malloc(len)) == NULL) {
+        free(tbl);
+        return 1;
+    }
 
-            // update the TTLs to push i to the front
-            for (a = 0; a < FATFS_FAT_CACHE_N; a++) {
-                if (fatfs->fatc_ttl[a] == 0)
-                    continue;
+    rd = tsk_fs_read(fs, (fatfs->firstfatsect << fatfs->ssize_sh) + off,
+        (char *) buf, len);
+    if (rd == -1) {
+        tsk_error_set_errstr2("fatfs_fat_chunk_load: FAT: %" PRIuDADDR,
+            fatfs->firstfatsect + (off >> fatfs->ssize_sh));
+        if (buf != (uint8_t *) tbl)
+            free(buf);
+        free(tbl);
+        return 1;
+    }
+    /* entries past the end of a truncated image are treated as free */
+    if ((size_t) rd < len) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "fatfs_fat_chunk_load: Short read of FAT at cluster %"
+                PRIuDADDR "\n", first);
+        memset(buf + rd, 0, len - rd);
+    }
 
-                if (fatfs->fatc_ttl[a] < fatfs->fatc_ttl[i])
-                    fatfs->fatc_ttl[a]++;
-            }
-            fatfs->fatc_ttl[i] = 1;
-//          fprintf(stdout, "FAT Hit: %d\n", sect);
-//          fflush(stdout);
-            return i;
+    switch (fatfs->fs_info.ftype) {
+    case TSK_FS_TYPE_FAT12:
+        for (i = 0; i < cnt; i++) {
+            uint16_t tmp16 = tsk_getu16(fs->endian, buf + i + (i >> 1));
+            /* slide it over if it is one of the odd clusters */
+            if (i & 1)
+                tmp16 >>= 4;
+            tbl[i] = tmp16 & FATFS_12_MASK;
         }
+        break;
+    case TSK_FS_TYPE_FAT16:
+        for (i = 0; i < cnt; i++)
+            tbl[i] = tsk_getu16(fs->endian, buf + (i << 1)) & FATFS_16_MASK;
+        break;
+    default:
+        for (i = 0; i < cnt; i++)
+            tbl[i] = tsk_getu32(fs->endian, buf + (i << 2)) & FATFS_32_MASK;
+        break;
     }
 
-//    fprintf(stdout, "FAT Miss: %d\n", (int)sect);
-//    fflush(stdout);
+    if (buf != (uint8_t *) tbl)
+        free(buf);
+    fatfs->fat_chunks[a_idx] = tbl;
+    return 0;
+}
+
+/*
+ * Return the chunk of the in-memory FAT table that has the entry for
+ * the given cluster, loading it from the image if needed.  The entries
+ * are masked but have not been sanity checked.  The chunk stays valid
+ * until the file system is closed and can be read without any lock.
+ *
+ * a_first is set to the cluster of the first entry and a_cnt to the
+ * number of entries in the chunk.
+ *
+ * Return NULL on error
+ */
+static const uint32_t *
+fatfs_fat_chunk(FATFS_INFO * fatfs, TSK_DADDR_T a_clust,
+    TSK_DADDR_T * a_first, size_t * a_cnt)
+{
+    TSK_DADDR_T idx = a_clust / FATFS_FAT_CHUNK_N;
+    const uint32_t *tbl;
+
+    tsk_take_lock(&fatfs->cache_lock);
 
-    // Look for an unused entry or an entry with a TTL of FATFS_FAT_CACHE_N
-    cidx = 0;
-    for (i = 0; i < FATFS_FAT_CACHE_N; i++) {
-        if ((fatfs->fatc_ttl[i] == 0) ||
-            (fatfs->fatc_ttl[i] >= FATFS_FAT_CACHE_N)) {
-            cidx = i;
+    if (fatfs->fat_chunks == NULL) {
+        fatfs->fat_chunk_cnt = fatfs->lastclust / FATFS_FAT_CHUNK_N + 1;
+        if ((fatfs->fat_chunks =
+                (uint32_t **) tsk_malloc((size_t) fatfs->fat_chunk_cnt *
+                    sizeof(uint32_t *))) == NULL) {
+            tsk_release_lock(&fatfs->cache_lock);
+            return NULL;
         }
     }
-//    fprintf(stdout, "FAT Removing: %d\n", (int)fatfs->fatc_addr[cidx]);
-    //   fflush(stdout);
-
-    // read the data
-    cnt =
-        tsk_fs_read(fs, sect * fs->block_size, fatfs->fatc_buf[cidx],
-        FATFS_FAT_CACHE_B);
-    if (cnt != FATFS_FAT_CACHE_B) {
-        if (cnt >= 0) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_READ);
-        }
-        tsk_error_set_errstr2("getFATCacheIdx: FAT: %" PRIuDADDR, sect);
-        return -1;
+
+    if ((fatfs->fat_chunks[idx] == NULL)
+        && (fatfs_fat_chunk_load(fatfs, idx))) {
+        tsk_release_lock(&fatfs->cache_lock);
+        return NULL;
     }
+    tbl = fatfs->fat_chunks[idx];
 
-    // update the TTLs
-    if (fatfs->fatc_ttl[cidx] == 0)     // special case for unused entry
-        fatfs->fatc_ttl[cidx] = FATFS_FAT_CACHE_N + 1;
+    tsk_release_lock(&fatfs->cache_lock);
 
-    for (i = 0; i < FATFS_FAT_CACHE_N; i++) {
-        if (fatfs->fatc_ttl[i] == 0)
-            continue;
+    *a_first = idx * FATFS_FAT_CHUNK_N;
+    *a_cnt = FATFS_FAT_CHUNK_N;
+    if (*a_first + *a_cnt > fatfs->lastclust + 1)
+        *a_cnt = (size_t) (fatfs->lastclust + 1 - *a_first);
+    return tbl;
+}
 
-        if (fatfs->fatc_ttl[i] < fatfs->fatc_ttl[cidx])
-            fatfs->fatc_ttl[i]++;
-    }
+/*
+ * Free the in-memory FAT table.
+ */
+void
+fatfs_fat_chunks_free(FATFS_INFO * fatfs)
+{
+    TSK_DADDR_T i;
 
-    fatfs->fatc_ttl[cidx] = 1;
-    fatfs->fatc_addr[cidx] = sect;
+    if (fatfs->fat_chunks == NULL)
+        return;
 
-    return cidx;
+    for (i = 0; i < fatfs->fat_chunk_cnt; i++)
+        free(fatfs->fat_chunks[i]);
+    free(fatfs->fat_chunks);
+    fatfs->fat_chunks = NULL;
+    fatfs->fat_chunk_cnt = 0;
+}
+
+/*
+ * Count the number of leading entries in a_tbl that link to the cluster
+ * after their own, i.e. a_tbl[i] == a_next + i.  This is the inner loop
+ * of following a contiguous cluster chain.
+ */
+static size_t
+fatfs_fat_contig(const uint32_t * a_tbl, size_t a_cnt, uint32_t a_next)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    {
+        const __m128i step = _mm_set1_epi32(4);
+        __m128i want = _mm_setr_epi32((int) a_next, (int) (a_next + 1),
+            (int) (a_next + 2), (int) (a_next + 3));
+
+        for (; i + 4 <= a_cnt; i += 4) {
+            __m128i have = _mm_loadu_si128((const __m128i *) (a_tbl + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(have, want)) != 0xffff)
+                break;
+            want = _mm_add_epi32(want, step);
+        }
+    }
+#else
+    /* no early exit within a group of eight so that the compiler
+     * can vectorize the comparisons */
+    for (; i + 8 <= a_cnt; i += 8) {
+        uint32_t diff = 0;
+        int k;
+
+        for (k = 0; k < 8; k++)
+            diff |= a_tbl[i + k] ^ (uint32_t) (a_next + i + k);
+        if (diff)
+            break;
+    }
+#endif
+
+    while ((i < a_cnt) && (a_tbl[i] == (uint32_t) (a_next + i)))
+        i++;
+    return i;
 }
 
 /*
@@ -227,12 +358,10 @@ getFATCacheIdx(FATFS_INFO * fatfs, TSK_DADDR_T sect)
 uint8_t
 fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
 {
-    uint8_t *a_ptr;
-    uint16_t tmp16;
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & fatfs->fs_info;
-    TSK_DADDR_T sect, offs;
-    ssize_t cnt;
-    int cidx;
+    const uint32_t *tbl;
+    TSK_DADDR_T first;
+    size_t cnt;
 
     /* Sanity Check */
     if (clust > fatfs->lastclust) {
@@ -264,61 +393,9 @@ fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
             return 1;
         }
 
-        /* id the sector in the FAT */
-        sect = fatfs->firstfatsect +
-            ((clust + (clust >> 1)) >> fatfs->ssize_sh);
-
-        tsk_take_lock(&fatfs->cache_lock);
-
-        /* Load the FAT if we don't have it */
-        // see if it is in the cache
-        if (-1 == (cidx = getFATCacheIdx(fatfs, sect))) {
-            tsk_release_lock(&fatfs->cache_lock);
+        if ((tbl = fatfs_fat_chunk(fatfs, clust, &first, &cnt)) == NULL)
             return 1;
-        }
-
-        /* get the offset into the cache */
-        offs = ((sect - fatfs->fatc_addr[cidx]) << fatfs->ssize_sh) +
-            (clust + (clust >> 1)) % fatfs->ssize;
-
-        /* special case when the 12-bit value goes across the cache
-         * we load the cache to start at this sect.  The cache
-         * size must therefore be at least 2 sectors large 
-         */
-        if (offs == (FATFS_FAT_CACHE_B - 1)) {
-
-            // read the data -- TTLs will already have been updated
-            cnt =
-                tsk_fs_read(fs, sect * fs->block_size,
-                fatfs->fatc_buf[cidx], FATFS_FAT_CACHE_B);
-            if (cnt != FATFS_FAT_CACHE_B) {
-                tsk_release_lock(&fatfs->cache_lock);
-                if (cnt >= 0) {
-                    tsk_error_reset();
-                    tsk_error_set_errno(TSK_ERR_FS_READ);
-                }
-                tsk_error_set_errstr2
-                    ("fatfs_getFAT: TSK_FS_TYPE_FAT12 FAT overlap: %"
-                    PRIuDADDR, sect);
-                return 1;
-            }
-            fatfs->fatc_addr[cidx] = sect;
-
-            offs = (clust + (clust >> 1)) % fatfs->ssize;
-        }
-
-        /* get pointer to entry in current buffer */
-        a_ptr = (uint8_t *) fatfs->fatc_buf[cidx] + offs;
-
-        tmp16 = tsk_getu16(fs->endian, a_ptr);
-
-        tsk_release_lock(&fatfs->cache_lock);
-
-        /* slide it over if it is one of the odd clusters */
-        if (clust & 1)
-            tmp16 >>= 4;
-
-        *value = tmp16 & FATFS_12_MASK;
+        *value = tbl[clust - first];
 
         /* sanity check */
         if ((*value > (fatfs->lastclust)) &&
@@ -333,25 +410,9 @@ fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
         return 0;
 
     case TSK_FS_TYPE_FAT16:
-        /* Get sector in FAT for cluster and load it if needed */
-        sect = fatfs->firstfatsect + ((clust << 1) >> fatfs->ssize_sh);
-
-        tsk_take_lock(&fatfs->cache_lock);
-
-        if (-1 == (cidx = getFATCacheIdx(fatfs, sect))) {
-            tsk_release_lock(&fatfs->cache_lock);
+        if ((tbl = fatfs_fat_chunk(fatfs, clust, &first, &cnt)) == NULL)
             return 1;
-        }
-
-
-        /* get pointer to entry in the cache buffer */
-        a_ptr = (uint8_t *) fatfs->fatc_buf[cidx] +
-            ((sect - fatfs->fatc_addr[cidx]) << fatfs->ssize_sh) +
-            ((clust << 1) % fatfs->ssize);
-
-        *value = tsk_getu16(fs->endian, a_ptr) & FATFS_16_MASK;
-
-        tsk_release_lock(&fatfs->cache_lock);
+        *value = tbl[clust - first];
 
         /* sanity check */
         if ((*value > (fatfs->lastclust)) &&
@@ -366,24 +427,9 @@ fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
 
     case TSK_FS_TYPE_FAT32:
     case TSK_FS_TYPE_EXFAT:
-        /* Get sector in FAT for cluster and load if needed */
-        sect = fatfs->firstfatsect + ((clust << 2) >> fatfs->ssize_sh);
-
-        tsk_take_lock(&fatfs->cache_lock);
-
-        if (-1 == (cidx = getFATCacheIdx(fatfs, sect))) {
-            tsk_release_lock(&fatfs->cache_lock);
+        if ((tbl = fatfs_fat_chunk(fatfs, clust, &first, &cnt)) == NULL)
             return 1;
-        }
-
-        /* get pointer to entry in current buffer */
-        a_ptr = (uint8_t *) fatfs->fatc_buf[cidx] +
-            ((sect - fatfs->fatc_addr[cidx]) << fatfs->ssize_sh) +
-            (clust << 2) % fatfs->ssize;
-
-        *value = tsk_getu32(fs->endian, a_ptr) & FATFS_32_MASK;
-
-        tsk_release_lock(&fatfs->cache_lock);
+        *value = tbl[clust - first];
 
         /* sanity check */
         if ((*value > fatfs->lastclust) &&
@@ -406,6 +452,55 @@ fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
     }
 }
 
+/*
+ * Follow the cluster chain that starts at the given cluster for as long
+ * as each cluster links to the one after it, and at most until the run
+ * is a_max clusters long.  *a_next is set to the FAT entry of the last
+ * cluster in the run, as fatfs_getFAT() would return it.
+ *
+ * The links are read straight from the in-memory FAT table, so a
+ * contiguous file costs one lock per FATFS_FAT_CHUNK_N clusters instead
+ * of one per cluster.
+ *
+ * Return the number of clusters in the run or 0 on error
+ */
+TSK_DADDR_T
+fatfs_getFAT_run(FATFS_INFO * fatfs, TSK_DADDR_T a_clust, TSK_DADDR_T a_max,
+    TSK_DADDR_T * a_next)
+{
+    TSK_DADDR_T clust = a_clust;
+    TSK_DADDR_T len = 1;
+    size_t avail, n;
+
+    if ((a_clust >= 2) && (a_clust < fatfs->lastclust) && (a_max > 1)) {
+        do {
+            const uint32_t *tbl;
+            TSK_DADDR_T first;
+            size_t cnt;
+
+            if ((tbl = fatfs_fat_chunk(fatfs, clust, &first, &cnt)) == NULL)
+                return 0;
+
+            /* the number of links that we can follow in this chunk.
+             * The last cluster can not link to the one after it. */
+            avail = cnt - (size_t) (clust - first);
+            if (avail > fatfs->lastclust - clust)
+                avail = (size_t) (fatfs->lastclust - clust);
+            if (avail > a_max - len)
+                avail = (size_t) (a_max - len);
+
+            n = fatfs_fat_contig(tbl + (clust - first), avail,
+                (uint32_t) (clust + 1));
+            clust += n;
+            len += n;
+        } while ((n == avail) && (avail > 0));
+    }
+
+    if (fatfs_getFAT(fatfs, clust, a_next))
+        return 0;
+    return len;
+}
+
 /**************************************************************************
  *
  * BLOCK WALKING
@@ -716,6 +811,65 @@ fatfs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
     return (TSK_FS_BLOCK_FLAG_ENUM)flags;
 }
 
+/*
+ * Get the flags of a sector and the number of sectors that follow it
+ * (up to a_end) with the same flags.  In the data area, the run is
+ * extended a cluster at a time while the clusters have the same
+ * allocation status.
+ *
+ * Return the number of sectors in the run or 0 on error
+ */
+TSK_DADDR_T
+fatfs_block_getflags_run(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr,
+    TSK_DADDR_T a_end, TSK_FS_BLOCK_FLAG_ENUM * a_flags)
+{
+    FATFS_INFO *fatfs = (FATFS_INFO *) a_fs;
+    TSK_DADDR_T last;
+    TSK_DADDR_T data_end =
+        fatfs->firstclustsect + fatfs->csize * fatfs->clustcnt;
+    int flags;
+
+    // FATs and boot sector
+    if (a_addr < fatfs->firstdatasect) {
+        flags = TSK_FS_BLOCK_FLAG_META | TSK_FS_BLOCK_FLAG_ALLOC;
+        last = fatfs->firstdatasect - 1;
+    }
+    // root directory for FAT12/16
+    else if (a_addr < fatfs->firstclustsect) {
+        flags = TSK_FS_BLOCK_FLAG_CONT | TSK_FS_BLOCK_FLAG_ALLOC;
+        last = fatfs->firstclustsect - 1;
+    }
+    // sectors after the last cluster
+    else if (a_addr >= data_end) {
+        flags = TSK_FS_BLOCK_FLAG_CONT | TSK_FS_BLOCK_FLAG_UNALLOC;
+        last = a_end;
+    }
+    else {
+        int8_t alloc;
+
+        if ((alloc = fatfs_is_sectalloc(fatfs, a_addr)) == -1)
+            return 0;
+        flags = TSK_FS_BLOCK_FLAG_CONT;
+        flags |= (alloc) ? TSK_FS_BLOCK_FLAG_ALLOC :
+            TSK_FS_BLOCK_FLAG_UNALLOC;
+
+        // last sector of the cluster and then of the following
+        // clusters with the same status
+        last = FATFS_CLUST_2_SECT(fatfs,
+            FATFS_SECT_2_CLUST(fatfs, a_addr)) + fatfs->csize - 1;
+        while ((last < a_end) && (last + 1 < data_end)) {
+            if (fatfs_is_sectalloc(fatfs, last + 1) != alloc)
+                break;
+            last += fatfs->csize;
+        }
+    }
+
+    *a_flags = (TSK_FS_BLOCK_FLAG_ENUM) flags;
+    if (last > a_end)
+        last = a_end;
+    return last - a_addr + 1;
+}
+
 /* 
  * Identifies if a sector is allocated
  *
@@ -812,11 +966,15 @@ fatfs_close(TSK_FS_INFO *fs)
     FATFS_INFO *fatfs = (FATFS_INFO *) fs;
  
     fatfs_dir_buf_free(fatfs);
+    free(fatfs->dir_sectors);
+    fatfs->dir_sectors = NULL;
 
     fs->tag = 0;
 	memset(fatfs->boot_sector_buffer, 0, FATFS_MASTER_BOOT_RECORD_SIZE);
+    fatfs_fat_chunks_free(fatfs);
     tsk_deinit_lock(&fatfs->cache_lock);
     tsk_deinit_lock(&fatfs->dir_lock);
+    tsk_deinit_lock(&fatfs->dir_sectors_lock);
 	
     tsk_fs_free(fs);
 }
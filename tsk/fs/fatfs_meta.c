@@ -381,6 +381,27 @@ fatfs_inode_lookup(TSK_FS_INFO *a_fs, TSK_FS_FILE *a_fs_file,
     }
 }
 
+/*
+ * Return the lowest cluster in the range a_lo to a_hi that is in the
+ * list or a_hi + 1 if none of them are.
+ */
+static TSK_DADDR_T
+fatfs_list_find_first(TSK_LIST * a_list, TSK_DADDR_T a_lo, TSK_DADDR_T a_hi)
+{
+    TSK_DADDR_T first = a_hi + 1;
+    TSK_LIST *tmp;
+
+    // the list is in reverse sorted order and each entry covers
+    // key - len + 1 to key
+    for (tmp = a_list; tmp != NULL && tmp->key >= a_lo; tmp = tmp->next) {
+        TSK_DADDR_T lo = tmp->key + 1 - tmp->len;
+
+        if (lo <= a_hi)
+            first = (lo > a_lo) ? lo : a_lo;
+    }
+    return first;
+}
+
 /** \internal
  * Make data runs out of the clusters allocated to a file represented by a 
  * TSK_FS_FILE structure. Each data run will have a starting sector and a 
@@ -733,7 +754,9 @@ fatfs_make_data_runs(TSK_FS_FILE * a_fs_file)
         TSK_FS_ATTR_RUN *data_run = NULL;
         TSK_FS_ATTR_RUN *data_run_head = NULL;
         TSK_OFF_T full_len_s = 0;
-        TSK_DADDR_T sbase;
+        TSK_OFF_T clust_size;
+        TSK_DADDR_T sbase, run_len, nxt;
+        uint8_t loop_found;
         /* Do normal cluster chain walking for a file or directory, including
          * FAT32 and exFAT root directories. */
 
@@ -786,21 +809,63 @@ fatfs_make_data_runs(TSK_FS_FILE * a_fs_file)
                 data_run->addr = sbase;
             }
 
-            data_run->len += fatfs->csize;
-            full_len_s += fatfs->csize;
-            size_remain -= (fatfs->csize * fs->block_size);
+            /* Follow the chain for as long as it is contiguous, but
+             * not past the end of the file */
+            clust_size = (TSK_OFF_T) fatfs->csize * fs->block_size;
+            nxt = 0;
+            run_len = fatfs_getFAT_run(fatfs, clust,
+                (size_remain + clust_size - 1) / clust_size, &nxt);
+            if (run_len == 0) {
+                tsk_error_set_errstr2("%s: Inode: %" PRIuINUM
+                    "  cluster: %" PRIuDADDR, func_name, fs_meta->addr, clust);
+                fs_meta->attr_state = TSK_FS_META_ATTR_ERROR;
+                tsk_fs_attr_run_free(data_run_head);
+                tsk_list_free(list_seen);
+                list_seen = NULL;
+                return 1;
+            }
 
-            if ((int64_t) size_remain > 0) {
-                TSK_DADDR_T nxt;
-                if (fatfs_getFAT(fatfs, clust, &nxt)) {
-                    tsk_error_set_errstr2("%s: Inode: %" PRIuINUM
-                        "  cluster: %" PRIuDADDR, func_name, fs_meta->addr, clust);
-                    fs_meta->attr_state = TSK_FS_META_ATTR_ERROR;
-                    tsk_fs_attr_run_free(data_run_head);
-                    tsk_list_free(list_seen);
-                    list_seen = NULL;
-                    return 1;
+            /* stop before a cluster that is past the end of the file
+             * system, the next pass will report it */
+            if (FATFS_CLUST_2_SECT(fatfs, clust + run_len - 1) +
+                fatfs->csize - 1 > fs->last_block) {
+                run_len = (fs->last_block + 1 - sbase) / fatfs->csize;
+                nxt = clust + run_len;
+            }
+
+            /* Make sure we do not get into an infinite loop */
+            loop_found = 0;
+            if (run_len > 1) {
+                TSK_DADDR_T seen = fatfs_list_find_first(list_seen,
+                    clust + 1, clust + run_len - 1);
+                TSK_DADDR_T i;
+
+                if (seen < clust + run_len) {
+                    run_len = seen - clust;
+                    loop_found = 1;
                 }
+                for (i = 1; i < run_len; i++) {
+                    if (tsk_list_add(&list_seen, clust + i)) {
+                        fs_meta->attr_state = TSK_FS_META_ATTR_ERROR;
+                        tsk_list_free(list_seen);
+                        list_seen = NULL;
+                        return 1;
+                    }
+                }
+            }
+
+            data_run->len += fatfs->csize * run_len;
+            full_len_s += fatfs->csize * run_len;
+            size_remain -= clust_size * run_len;
+
+            if (loop_found) {
+                if (tsk_verbose)
+                    tsk_fprintf(stderr,
+                        "Loop found while processing file\n");
+                break;
+            }
+
+            if ((int64_t) size_remain > 0) {
                 clust = nxt;
 
                 /* Make sure we do not get into an infinite loop */
@@ -1035,6 +1100,88 @@ inode_walk_dent_act(TSK_FS_FILE * fs_file, const char *a_path, void *a_ptr)
     return TSK_WALK_CONT;
 }
 
+/**
+ * \internal
+ * Returns the bitmap of sectors that are allocated to directories.  It is
+ * made by walking the directory tree the first time that it is needed and
+ * is then kept until the file system is closed, so that inode walks over
+ * parts of the file system (such as those of tsk_fs_meta_walk_parallel())
+ * do not each walk the tree again.
+ *
+ * @param [in] a_fatfs Generic FAT file system info structure.
+ * @return Bitmap that is owned by a_fatfs or NULL on error.
+ */
+static uint8_t *
+fatfs_dir_sectors_load(FATFS_INFO *a_fatfs)
+{
+    TSK_FS_INFO *fs = &a_fatfs->fs_info;
+    TSK_FS_FILE *fs_file = NULL;
+    uint8_t *bitmap = NULL;
+
+    tsk_take_lock(&a_fatfs->dir_sectors_lock);
+    bitmap = a_fatfs->dir_sectors;
+    tsk_release_lock(&a_fatfs->dir_sectors_lock);
+    if (bitmap != NULL)
+        return bitmap;
+
+    /* The bitmap is built without the lock so that other threads are not
+     * blocked for the whole directory walk.  If two threads build it at
+     * the same time, the first one to finish is kept. */
+    if (tsk_verbose) {
+        tsk_fprintf(stderr,
+            "fatfs_dir_sectors_load: Walking directories to collect sector info\n");
+    }
+
+    if ((bitmap = (uint8_t*)tsk_malloc((size_t) ((fs->block_count +
+                        7) / 8))) == NULL) {
+        return NULL;
+    }
+
+    /* Manufacture an inode for the root directory. */
+    if (((fs_file = tsk_fs_file_alloc(fs)) == NULL) ||
+        ((fs_file->meta =
+                tsk_fs_meta_alloc(FATFS_FILE_CONTENT_LEN)) == NULL) ||
+        (fatfs_make_root(a_fatfs, fs_file->meta))) {
+        tsk_fs_file_close(fs_file);
+        free(bitmap);
+        return NULL;
+    }
+
+    /* Do a file_walk on the root directory to set the bits in the 
+     * directory sectors bitmap for each sector allocated to the root
+     * directory. */
+    if (tsk_fs_file_walk(fs_file,
+            (TSK_FS_FILE_WALK_FLAG_ENUM)(TSK_FS_FILE_WALK_FLAG_SLACK | TSK_FS_FILE_WALK_FLAG_AONLY),
+            inode_walk_file_act, (void*)bitmap)) {
+        tsk_fs_file_close(fs_file);
+        free(bitmap);
+        return NULL;
+    }
+    tsk_fs_file_close(fs_file);
+
+    /* Now walk recursively through the entire directory tree to set the 
+     * bits in the directory sectors bitmap for each sector allocated to 
+     * the children of the root directory. */
+    if (tsk_fs_dir_walk(fs, fs->root_inum,
+            (TSK_FS_DIR_WALK_FLAG_ENUM)(TSK_FS_DIR_WALK_FLAG_ALLOC | TSK_FS_DIR_WALK_FLAG_RECURSE |
+            TSK_FS_DIR_WALK_FLAG_NOORPHAN), inode_walk_dent_act,
+            (void *) bitmap)) {
+        free(bitmap);
+        return NULL;
+    }
+
+    tsk_take_lock(&a_fatfs->dir_sectors_lock);
+    if (a_fatfs->dir_sectors == NULL) {
+        a_fatfs->dir_sectors = bitmap;
+    }
+    else {
+        free(bitmap);
+        bitmap = a_fatfs->dir_sectors;
+    }
+    tsk_release_lock(&a_fatfs->dir_sectors_lock);
+    return bitmap;
+}
+
 /**
  * Walk the inodes in a specified range and do a TSK_FS_META_WALK_CB callback
  * for each inode that satisfies criteria specified by a set of 
@@ -1068,6 +1215,7 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
     FATFS_DENTRY *dep = NULL;
     unsigned int dentry_idx = 0;
     uint8_t *dir_sectors_bitmap = NULL;
+    uint8_t *dir_sectors_empty = NULL;
     ssize_t cnt = 0;
     uint8_t done = 0;
 
@@ -1173,56 +1321,26 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
         }
     }
 
-    /* Allocate a bitmap to keep track of which sectors are allocated to
-     * directories. */
-    if ((dir_sectors_bitmap =
-            (uint8_t*)tsk_malloc((size_t) ((a_fs->block_count +
-                        7) / 8))) == NULL) {
-        tsk_fs_file_close(fs_file);
-        return 1;
-    }
-
-    /* If not doing an orphan files search, populate the directory sectors 
+    /* If not doing an orphan files search, get the directory sectors 
      * bitmap. The bitmap will be used to make sure that no sector marked as
      * allocated to a directory is skipped when searching for directory 
-     * entries to map to inodes. */
+     * entries to map to inodes.  Orphan searches use an empty one. */
     if ((flags & TSK_FS_META_FLAG_ORPHAN) == 0) {
-        if (tsk_verbose) {
-            tsk_fprintf(stderr,
-                "fatfs_inode_walk: Walking directories to collect sector info\n");
-        }
-
-        /* Manufacture an inode for the root directory. */
-        if (fatfs_make_root(fatfs, fs_file->meta)) {
-            tsk_fs_file_close(fs_file);
-            free(dir_sectors_bitmap);
-            return 1;
-        }
-
-        /* Do a file_walk on the root directory to set the bits in the 
-         * directory sectors bitmap for each sector allocated to the root
-         * directory. */
-        if (tsk_fs_file_walk(fs_file,
-                (TSK_FS_FILE_WALK_FLAG_ENUM)(TSK_FS_FILE_WALK_FLAG_SLACK | TSK_FS_FILE_WALK_FLAG_AONLY),
-                inode_walk_file_act, (void*)dir_sectors_bitmap)) {
+        if ((dir_sectors_bitmap = fatfs_dir_sectors_load(fatfs)) == NULL) {
+            tsk_error_errstr2_concat
+                ("- fatfs_inode_walk: mapping directories");
             tsk_fs_file_close(fs_file);
-            free(dir_sectors_bitmap);
             return 1;
         }
-
-        /* Now walk recursively through the entire directory tree to set the 
-         * bits in the directory sectors bitmap for each sector allocated to 
-         * the children of the root directory. */
-        if (tsk_fs_dir_walk(a_fs, a_fs->root_inum,
-                (TSK_FS_DIR_WALK_FLAG_ENUM)(TSK_FS_DIR_WALK_FLAG_ALLOC | TSK_FS_DIR_WALK_FLAG_RECURSE |
-                TSK_FS_DIR_WALK_FLAG_NOORPHAN), inode_walk_dent_act,
-                (void *) dir_sectors_bitmap)) {
-            tsk_error_errstr2_concat
-                ("- fatfs_inode_walk: mapping directories");
+    }
+    else {
+        if ((dir_sectors_empty =
+                (uint8_t*)tsk_malloc((size_t) ((a_fs->block_count +
+                            7) / 8))) == NULL) {
             tsk_fs_file_close(fs_file);
-            free(dir_sectors_bitmap);
             return 1;
         }
+        dir_sectors_bitmap = dir_sectors_empty;
     }
 
     /* If the end inode is the one of the virtual virtual FAT files or the 
@@ -1245,7 +1363,7 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
             ("%s: Begin inode in sector too big for image: %"
             PRIuDADDR, func_name, ssect);
         tsk_fs_file_close(fs_file);
-        free(dir_sectors_bitmap);
+        free(dir_sectors_empty);
         return 1;
     }
 
@@ -1257,7 +1375,7 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
             ("%s: End inode in sector too big for image: %"
             PRIuDADDR, func_name, lsect);
         tsk_fs_file_close(fs_file);
-        free(dir_sectors_bitmap);
+        free(dir_sectors_empty);
         return 1;
     }
 
@@ -1265,7 +1383,7 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
     if ((dino_buf = (char*)tsk_malloc(fatfs->csize << fatfs->ssize_sh)) ==
         NULL) {
         tsk_fs_file_close(fs_file);
-        free(dir_sectors_bitmap);
+        free(dir_sectors_empty);
         return 1;
     }
 
@@ -1305,7 +1423,7 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
                     ("%s (root dir): sector: %" PRIuDADDR,
                     func_name, sect);
                 tsk_fs_file_close(fs_file);
-                free(dir_sectors_bitmap);
+                free(dir_sectors_empty);
                 free(dino_buf);
                 return 1;
             }
@@ -1332,7 +1450,7 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
             }
             else if (cluster_is_alloc == -1) {
                 tsk_fs_file_close(fs_file);
-                free(dir_sectors_bitmap);
+                free(dir_sectors_empty);
                 free(dino_buf);
                 return 1;
             }
@@ -1365,7 +1483,7 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
                 tsk_error_set_errstr2("%s: sector: %"
                     PRIuDADDR, func_name, sect);
                 tsk_fs_file_close(fs_file);
-                free(dir_sectors_bitmap);
+                free(dir_sectors_empty);
                 free(dino_buf);
                 return 1;
             }
@@ -1451,7 +1569,7 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
                     }
                     else {
                         tsk_fs_file_close(fs_file);
-                        free(dir_sectors_bitmap);
+                        free(dir_sectors_empty);
                         free(dino_buf);
                         return 1;
                     }
@@ -1468,13 +1586,13 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
                 retval = a_action(fs_file, a_ptr);
                 if (retval == TSK_WALK_STOP) {
                     tsk_fs_file_close(fs_file);
-                    free(dir_sectors_bitmap);
+                    free(dir_sectors_empty);
                     free(dino_buf);
                     return 0;
                 }
                 else if (retval == TSK_WALK_ERROR) {
                     tsk_fs_file_close(fs_file);
-                    free(dir_sectors_bitmap);
+                    free(dir_sectors_empty);
                     free(dino_buf);
                     return 1;
                 }
@@ -1489,7 +1607,7 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
         }
     }
 
-    free(dir_sectors_bitmap);
+    free(dir_sectors_empty);
     free(dino_buf);
 
     // handle the virtual orphans folder and FAT files if they asked for them
@@ -438,7 +438,6 @@ fatxxfs_open(FATFS_INFO *fatfs)
     const char *func_name = "fatxxfs_open";
 	TSK_FS_INFO *fs = &(fatfs->fs_info);
 	FATXXFS_SB *fatsb = (FATXXFS_SB*)(&fatfs->boot_sector_buffer);
-	int i = 0;
 	ssize_t cnt = 0;
     TSK_DADDR_T sectors = 0;
 	TSK_FS_DIR * test_dir1; // Directories used to try opening the root directory
@@ -727,10 +726,7 @@ fatxxfs_open(FATFS_INFO *fatfs)
     else
         fatfs->rootsect = fatfs->firstdatasect;
 
-    for (i = 0; i < FATFS_FAT_CACHE_N; i++) {
-        fatfs->fatc_addr[i] = 0;
-        fatfs->fatc_ttl[i] = 0;
-    }
+    fatfs_fat_chunks_free(fatfs);
 
     /*
      * block calculations : although there are no blocks in fat, we will
@@ -789,8 +785,11 @@ fatxxfs_open(FATFS_INFO *fatfs)
 
     fs->block_walk = fatfs_block_walk;
     fs->block_getflags = fatfs_block_getflags;
+    fs->block_getflags_run = fatfs_block_getflags_run;
 
     fs->inode_walk = fatfs_inode_walk;
+    // the FAT and directory sector caches are locked
+    fs->flags |= TSK_FS_INFO_FLAG_PAR_INODE_WALK;
     fs->istat = fatfs_istat;
     fs->file_add_meta = fatfs_inode_lookup;
 
@@ -821,6 +820,8 @@ fatxxfs_open(FATFS_INFO *fatfs)
     tsk_init_lock(&fatfs->cache_lock);
     tsk_init_lock(&fatfs->dir_lock);
     fatfs->inum2par = NULL;
+    tsk_init_lock(&fatfs->dir_sectors_lock);
+    fatfs->dir_sectors = NULL;
 
 	// Test to see if this is the odd Android case where the FAT entries have no short name
 	//
@@ -32,17 +32,52 @@
 
 
 
+/* Maximum number of cylinder groups in FFS_INFO.grp_head */
+#define FFS_GRP_CACHE_MAX 64
+
+/* Unlink a cylinder group from the cache list.  Must hold lock. */
+static void
+ffs_group_unlink(FFS_INFO * ffs, FFS_GRP_ENTRY * entry)
+{
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        ffs->grp_head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        ffs->grp_tail = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+/* Add a cylinder group to the front of the cache list.  Must hold lock. */
+static void
+ffs_group_push(FFS_INFO * ffs, FFS_GRP_ENTRY * entry)
+{
+    entry->prev = NULL;
+    entry->next = ffs->grp_head;
+    if (ffs->grp_head)
+        ffs->grp_head->prev = entry;
+    else
+        ffs->grp_tail = entry;
+    ffs->grp_head = entry;
+}
+
 /* ffs_group_load - load cylinder group descriptor info into cache
  *
  * Note: This routine assumes &ffs->lock is locked by the caller.
+ * The returned descriptor is valid until the lock is released.
  *
- * return 1 on error and 0 on success
+ * return the descriptor (ffsbsize_b bytes) or NULL on error
  * */
-static uint8_t
+static ffs_cgd *
 ffs_group_load(FFS_INFO * ffs, FFS_GRPNUM_T grp_num)
 {
     TSK_DADDR_T addr;
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & ffs->fs_info;
+    FFS_GRP_ENTRY *entry;
+    ffs_cgd *cg;
+    ssize_t cnt;
 
     /*
      * Sanity check
@@ -53,7 +88,17 @@ ffs_group_load(FFS_INFO * ffs, FFS_GRPNUM_T grp_num)
         tsk_error_set_errstr
             ("ffs_group_load: invalid cylinder group number: %" PRI_FFSGRP
             "", grp_num);
-        return 1;
+        return NULL;
+    }
+
+    for (entry = ffs->grp_head; entry != NULL; entry = entry->next) {
+        if (entry->grp_num == grp_num) {
+            if (entry != ffs->grp_head) {
+                ffs_group_unlink(ffs, entry);
+                ffs_group_push(ffs, entry);
+            }
+            return (ffs_cgd *) entry->buf;
+        }
     }
 
     /*
@@ -61,43 +106,62 @@ ffs_group_load(FFS_INFO * ffs, FFS_GRPNUM_T grp_num)
      * group always fits within a logical disk block (as promised in the
      * 4.4BSD <ufs/ffs/fs.h> include file).
      */
-    if (ffs->grp_buf == NULL) {
-        if ((ffs->grp_buf = tsk_malloc(ffs->ffsbsize_b)) == NULL) {
-            return 1;
-        }
+    if ((entry = (FFS_GRP_ENTRY *) tsk_malloc(sizeof(*entry) +
+                ffs->ffsbsize_b)) == NULL) {
+        return NULL;
     }
+    entry->grp_num = grp_num;
+    entry->buf = (char *) &entry[1];
 
     addr = cgtod_lcl(fs, ffs->fs.sb1, grp_num);
-    if (ffs->grp_addr != addr) {
-        ffs_cgd *cg;
-        ssize_t cnt;
-        cnt = tsk_fs_read_block(fs, addr, ffs->grp_buf, ffs->ffsbsize_b);
-        if (cnt != ffs->ffsbsize_b) {
-            if (cnt >= 0) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_READ);
-            }
-            tsk_error_set_errstr2("ffs_group_load: Group %" PRI_FFSGRP
-                " at %" PRIuDADDR, grp_num, addr);
-            return 1;
-        }
-        ffs->grp_addr = addr;
-
-        /* Perform a sanity check on the data to make sure offsets are in range */
-        cg = (ffs_cgd *) ffs->grp_buf;
-        if ((tsk_gets32(fs->endian, cg->cg_iusedoff) > ffs->ffsbsize_b)
-            || (tsk_gets32(fs->endian, cg->cg_freeoff) > ffs->ffsbsize_b)) {
+    cnt = tsk_fs_read_block(fs, addr, entry->buf, ffs->ffsbsize_b);
+    if (cnt != ffs->ffsbsize_b) {
+        if (cnt >= 0) {
             tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_CORRUPT);
-            tsk_error_set_errstr2("ffs_group_load: Group %" PRI_FFSGRP
-                " descriptor offsets too large at %" PRIuDADDR, grp_num,
-                addr);
-            return 1;
+            tsk_error_set_errno(TSK_ERR_FS_READ);
         }
+        tsk_error_set_errstr2("ffs_group_load: Group %" PRI_FFSGRP
+            " at %" PRIuDADDR, grp_num, addr);
+        free(entry);
+        return NULL;
     }
 
-    ffs->grp_num = grp_num;
-    return 0;
+    /* Perform a sanity check on the data to make sure offsets are in range */
+    cg = (ffs_cgd *) entry->buf;
+    if ((tsk_gets32(fs->endian, cg->cg_iusedoff) > ffs->ffsbsize_b)
+        || (tsk_gets32(fs->endian, cg->cg_freeoff) > ffs->ffsbsize_b)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_CORRUPT);
+        tsk_error_set_errstr2("ffs_group_load: Group %" PRI_FFSGRP
+            " descriptor offsets too large at %" PRIuDADDR, grp_num, addr);
+        free(entry);
+        return NULL;
+    }
+
+    ffs_group_push(ffs, entry);
+
+    /* remove the least recently used group if the cache is full */
+    if (++ffs->grp_cnt > FFS_GRP_CACHE_MAX) {
+        FFS_GRP_ENTRY *old = ffs->grp_tail;
+        ffs_group_unlink(ffs, old);
+        ffs->grp_cnt--;
+        free(old);
+    }
+
+    return cg;
+}
+
+/* Free all of the cylinder groups in the cache */
+static void
+ffs_group_cache_free(FFS_INFO * ffs)
+{
+    while (ffs->grp_head) {
+        FFS_GRP_ENTRY *entry = ffs->grp_head;
+        ffs->grp_head = entry->next;
+        free(entry);
+    }
+    ffs->grp_tail = NULL;
+    ffs->grp_cnt = 0;
 }
 
 
@@ -157,13 +221,11 @@ ffs_dinode_load(FFS_INFO * ffs, TSK_INUM_T inum, ffs_inode * dino_buf)
          * cached
          */
         grp_num = (FFS_GRPNUM_T) itog_lcl(fs, ffs->fs.sb1, inum);
-        if (ffs_group_load(ffs, grp_num)) {
+        if ((cg2 = (ffs_cgd2 *) ffs_group_load(ffs, grp_num)) == NULL) {
             tsk_release_lock(&ffs->lock);
             return 1;
         }
 
-        cg2 = (ffs_cgd2 *) ffs->grp_buf;
-
         /* If the inode is not init, then do not worry about it */
         if ((inum - grp_num * tsk_getu32(fs->endian,
                     ffs->fs.sb2->cg_inode_num)) >= tsk_getu32(fs->endian,
@@ -741,13 +803,11 @@ ffs_dinode_copy(FFS_INFO * ffs, TSK_FS_META * fs_meta,
     grp_num = (FFS_GRPNUM_T) itog_lcl(fs, ffs->fs.sb1, dino_inum);
 
     tsk_take_lock(&ffs->lock);
-    if (ffs_group_load(ffs, grp_num)) {
+    if ((cg = ffs_group_load(ffs, grp_num)) == NULL) {
         tsk_release_lock(&ffs->lock);
         return 1;
     }
 
-    cg = (ffs_cgd *) ffs->grp_buf;
-
     inosused = (unsigned char *) cg_inosused_lcl(fs, cg);
     ibase = grp_num * tsk_gets32(fs->endian, ffs->fs.sb1->cg_inode_num);
 
@@ -832,6 +892,10 @@ ffs_inode_lookup(TSK_FS_INFO * fs, TSK_FS_FILE * a_fs_file,
 
 
 
+/* Maximum number of bytes of an inode table that ffs_inode_walk()
+ * reads at a time */
+#define FFS_ITABLE_CHUNK (1024 * 1024)
+
 /* ffs_inode_walk - inode iterator
  *
  * flags used: TSK_FS_META_FLAG_USED, TSK_FS_META_FLAG_UNUSED,
@@ -855,6 +919,12 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     TSK_INUM_T ibase = 0;
     TSK_INUM_T end_inum_tmp;
     ffs_inode *dino_buf;
+    char *cg_buf;
+    FFS_GRPNUM_T cg_grp_num = 0;
+    TSK_INUM_T ipg, ino_init = 0;
+    char *itbl;
+    TSK_INUM_T itbl_first = 0, itbl_cnt = 0, itbl_max;
+    size_t isize;
 
     // clean up any error messages that are lying around
     tsk_error_reset();
@@ -930,28 +1000,72 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     if ((dino_buf = (ffs_inode *) tsk_malloc(sizeof(ffs_inode2))) == NULL)
         return 1;
 
+    /* Keep our own copy of the cylinder group descriptor of the current
+     * group so that the lock is not taken for each inode */
+    if ((cg_buf = (char *) tsk_malloc(ffs->ffsbsize_b)) == NULL) {
+        free(dino_buf);
+        return 1;
+    }
+
+    /* The inode table of the current group is read in chunks of up to
+     * FFS_ITABLE_CHUNK bytes and the inodes are used from there */
+    if (fs->ftype == TSK_FS_TYPE_FFS2)
+        isize = sizeof(ffs_inode2);
+    else
+        isize = sizeof(ffs_inode1);
+    ipg = tsk_gets32(fs->endian, ffs->fs.sb1->cg_inode_num);
+    itbl_max = FFS_ITABLE_CHUNK / isize;
+    if (itbl_max > end_inum_tmp - start_inum + 1)
+        itbl_max = end_inum_tmp - start_inum + 1;
+    if ((itbl = (char *) tsk_malloc((size_t) itbl_max * isize)) == NULL) {
+        free(cg_buf);
+        free(dino_buf);
+        return 1;
+    }
+
     /*
      * Iterate. This is easy because inode numbers are contiguous, unlike
      * data blocks which are interleaved with cylinder group blocks.
      */
     for (inum = start_inum; inum <= end_inum_tmp; inum++) {
         int retval;
+        TSK_INUM_T rel_inum;
 
         /*
          * Be sure to use the proper cylinder group data.
          */
         grp_num = itog_lcl(fs, ffs->fs.sb1, inum);
 
-        tsk_take_lock(&ffs->lock);
-        if (ffs_group_load(ffs, grp_num)) {
+        if ((cg == NULL) || (grp_num != cg_grp_num)) {
+            ffs_cgd *cached;
+
+            tsk_take_lock(&ffs->lock);
+            if ((cached = ffs_group_load(ffs, grp_num)) == NULL) {
+                tsk_release_lock(&ffs->lock);
+                free(itbl);
+                free(cg_buf);
+                free(dino_buf);
+                return 1;
+            }
+            memcpy(cg_buf, cached, ffs->ffsbsize_b);
             tsk_release_lock(&ffs->lock);
-            free(dino_buf);
-            return 1;
+
+            cg = (ffs_cgd *) cg_buf;
+            cg_grp_num = grp_num;
+            inosused = (unsigned char *) cg_inosused_lcl(fs, cg);
+            ibase = grp_num * ipg;
+
+            /* UFS2 does not initialize all inodes when the file system
+             * is created.  The others are zero. */
+            ino_init = ipg;
+            if (fs->ftype == TSK_FS_TYPE_FFS2) {
+                ino_init = tsk_getu32(fs->endian,
+                    ((ffs_cgd2 *) cg)->cg_initediblk);
+                if (ino_init > ipg)
+                    ino_init = ipg;
+            }
+            itbl_cnt = 0;
         }
-        cg = (ffs_cgd *) ffs->grp_buf;
-        inosused = (unsigned char *) cg_inosused_lcl(fs, cg);
-        ibase =
-            grp_num * tsk_gets32(fs->endian, ffs->fs.sb1->cg_inode_num);
 
         /*
          * Apply the allocated/unallocated restriction.
@@ -959,14 +1073,45 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         myflags = (isset(inosused, inum - ibase) ?
             TSK_FS_META_FLAG_ALLOC : TSK_FS_META_FLAG_UNALLOC);
 
-        tsk_release_lock(&ffs->lock);
-
         if ((a_flags & myflags) != myflags)
             continue;
 
+        /* Read the next chunk of the inode table if this inode is not in
+         * the buffer.  The chunk stops at the end of the initialized
+         * inodes of the group. */
+        rel_inum = inum - ibase;
+        if ((rel_inum < ino_init)
+            && ((inum < itbl_first) || (inum >= itbl_first + itbl_cnt))) {
+            TSK_INUM_T n = ino_init - rel_inum;
+            ssize_t cnt;
+
+            if (n > itbl_max)
+                n = itbl_max;
+            if (n > end_inum_tmp - inum + 1)
+                n = end_inum_tmp - inum + 1;
+            cnt = tsk_fs_read(fs,
+                (TSK_OFF_T) cgimin_lcl(fs, ffs->fs.sb1,
+                    grp_num) * fs->block_size +
+                (TSK_OFF_T) rel_inum * isize, itbl, (size_t) n * isize);
+            itbl_first = inum;
+            itbl_cnt = 0;
+            if (cnt > 0)
+                itbl_cnt = (TSK_INUM_T) cnt / isize;
+            tsk_error_reset();
+        }
 
-        if (ffs_dinode_load(ffs, inum, dino_buf)) {
+        if (rel_inum >= ino_init) {
+            memset((char *) dino_buf, 0, sizeof(ffs_inode2));
+        }
+        else if ((inum >= itbl_first) && (inum < itbl_first + itbl_cnt)) {
+            memcpy((char *) dino_buf,
+                &itbl[(size_t) (inum - itbl_first) * isize], isize);
+        }
+        // could not be read with the rest of the chunk
+        else if (ffs_dinode_load(ffs, inum, dino_buf)) {
             tsk_fs_file_close(fs_file);
+            free(itbl);
+            free(cg_buf);
             free(dino_buf);
             return 1;
         }
@@ -1013,6 +1158,8 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
          */
         if (ffs_dinode_copy(ffs, fs_file->meta, inum, dino_buf)) {
             tsk_fs_file_close(fs_file);
+            free(itbl);
+            free(cg_buf);
             free(dino_buf);
             return 1;
         }
@@ -1020,11 +1167,15 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         retval = action(fs_file, ptr);
         if (retval == TSK_WALK_STOP) {
             tsk_fs_file_close(fs_file);
+            free(itbl);
+            free(cg_buf);
             free(dino_buf);
             return 0;
         }
         else if (retval == TSK_WALK_ERROR) {
             tsk_fs_file_close(fs_file);
+            free(itbl);
+            free(cg_buf);
             free(dino_buf);
             return 1;
         }
@@ -1038,6 +1189,8 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
 
         if (tsk_fs_dir_make_orphan_dir_meta(fs, fs_file->meta)) {
             tsk_fs_file_close(fs_file);
+            free(itbl);
+            free(cg_buf);
             free(dino_buf);
             return 1;
         }
@@ -1045,11 +1198,15 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         retval = action(fs_file, ptr);
         if (retval == TSK_WALK_STOP) {
             tsk_fs_file_close(fs_file);
+            free(itbl);
+            free(cg_buf);
             free(dino_buf);
             return 0;
         }
         else if (retval == TSK_WALK_ERROR) {
             tsk_fs_file_close(fs_file);
+            free(itbl);
+            free(cg_buf);
             free(dino_buf);
             return 1;
         }
@@ -1059,6 +1216,8 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
      * Cleanup.
      */
     tsk_fs_file_close(fs_file);
+    free(itbl);
+    free(cg_buf);
     free(dino_buf);
 
     return 0;
@@ -1084,12 +1243,11 @@ ffs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
     grp_num = dtog_lcl(a_fs, ffs->fs.sb1, a_addr);
 
     tsk_take_lock(&ffs->lock);
-    if (ffs_group_load(ffs, grp_num)) {
+    if ((cg = ffs_group_load(ffs, grp_num)) == NULL) {
         tsk_release_lock(&ffs->lock);
         return 0;
     }
 
-    cg = (ffs_cgd *) ffs->grp_buf;
     freeblocks = (unsigned char *) cg_blksfree_lcl(a_fs, cg);
 
     // get the base fragment for the group
@@ -1484,11 +1642,10 @@ ffs_fsstat(TSK_FS_INFO * fs, FILE * hFile)
     for (i = 0; i < ffs->groups_count; i++) {
 
         tsk_take_lock(&ffs->lock);
-        if (ffs_group_load(ffs, i)) {
+        if ((cgd = ffs_group_load(ffs, i)) == NULL) {
             tsk_release_lock(&ffs->lock);
             return 1;
         }
-        cgd = (ffs_cgd *) ffs->grp_buf;
 
         tsk_fprintf(hFile, "\nGroup %d:\n", i);
         if (cgd) {
@@ -1706,9 +1863,8 @@ ffs_istat(TSK_FS_INFO * fs, FILE * hFile, TSK_INUM_T inum,
     tsk_fprintf(hFile, "%sAllocated\n",
         (fs_meta->flags & TSK_FS_META_FLAG_ALLOC) ? "" : "Not ");
 
-    tsk_take_lock(&ffs->lock);
-    tsk_fprintf(hFile, "Group: %" PRI_FFSGRP "\n", ffs->grp_num);
-    tsk_release_lock(&ffs->lock);
+    tsk_fprintf(hFile, "Group: %" PRI_FFSGRP "\n",
+        itog_lcl(fs, ffs->fs.sb1, inum));
 
     if (fs_meta->link)
         tsk_fprintf(hFile, "symbolic link to: %s\n", fs_meta->link);
@@ -1958,8 +2114,7 @@ ffs_close(TSK_FS_INFO * fs)
 
     fs->tag = 0;
 
-    if (ffs->grp_buf)
-        free(ffs->grp_buf);
+    ffs_group_cache_free(ffs);
 
     if (ffs->itbl_buf)
         free(ffs->itbl_buf);
@@ -2202,9 +2357,9 @@ ffs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset, TSK_FS_TYPE_ENUM ftype)
     fs->journ_inum = 0;
 
     // initialize caches
-    ffs->grp_buf = NULL;
-    ffs->grp_num = 0xffffffff;
-    ffs->grp_addr = 0;
+    ffs->grp_head = NULL;
+    ffs->grp_tail = NULL;
+    ffs->grp_cnt = 0;
 
     ffs->itbl_buf = NULL;
     ffs->itbl_addr = 0;
@@ -652,6 +652,136 @@ tsk_fs_attr_append_run(TSK_FS_INFO * a_fs, TSK_FS_ATTR * a_fs_attr,
     }
 }
 
+/**
+ * \internal
+ * Replace an UNRESOLVED run of an attribute with the runs that it stands
+ * for.  The file system loads them with its attr_resolve_run function.
+ *
+ * @param a_fs_attr Attribute that the run is in
+ * @param a_prev Run before a_run in the list (or NULL if a_run is the first)
+ * @param a_run Run to replace (it is freed)
+ * @param a_next [out] First of the new runs (or the run that followed
+ * a_run if it stood for no runs)
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+fs_attr_resolve_run(TSK_FS_ATTR * a_fs_attr, TSK_FS_ATTR_RUN * a_prev,
+    TSK_FS_ATTR_RUN * a_run, TSK_FS_ATTR_RUN ** a_next)
+{
+    TSK_FS_INFO *fs = a_fs_attr->fs_file->fs_info;
+    TSK_FS_ATTR_RUN *runs = NULL;
+    TSK_FS_ATTR_RUN *end;
+
+    if (fs->attr_resolve_run == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_UNSUPFUNC);
+        tsk_error_set_errstr
+            ("fs_attr_resolve_run: file system cannot load unresolved runs");
+        return 1;
+    }
+    if (fs->attr_resolve_run(a_fs_attr, a_run, &runs))
+        return 1;
+
+    // link the new runs in place of a_run
+    if (runs) {
+        for (end = runs; end->next; end = end->next) {
+        }
+        end->next = a_run->next;
+    }
+    else {
+        runs = a_run->next;
+        end = a_prev;
+    }
+
+    if (a_prev)
+        a_prev->next = runs;
+    else
+        a_fs_attr->nrd.run = runs;
+    if (a_fs_attr->nrd.run_end == a_run)
+        a_fs_attr->nrd.run_end = end;
+
+    *a_next = runs;
+    free(a_run);
+    return 0;
+}
+
+/**
+ * \internal
+ * Get the run that follows a_prev in the run list of an attribute (or
+ * the first run if a_prev is NULL).  UNRESOLVED runs that end after block
+ * offset a_min_end are replaced by the runs that they stand for and the
+ * ones that end at or before it are skipped, so an UNRESOLVED run is
+ * never returned.  The runs that are returned are never freed while the
+ * attribute exists, so the caller can keep using them (and pass them back
+ * as a_prev) without the lock even if another thread reads the same
+ * attribute and replaces the runs after them.  The list is only read and
+ * changed under attr_run_lock when the file system can have UNRESOLVED
+ * runs.
+ *
+ * @param a_fs_attr Attribute that the runs are in
+ * @param a_prev Run before the one to return (or NULL)
+ * @param a_min_end UNRESOLVED runs that end at or before this block
+ * offset are skipped
+ * @param a_run [out] The run (NULL at the end of the list)
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+fs_attr_run_next(TSK_FS_ATTR * a_fs_attr, TSK_FS_ATTR_RUN * a_prev,
+    TSK_DADDR_T a_min_end, TSK_FS_ATTR_RUN ** a_run)
+{
+    TSK_FS_INFO *fs = a_fs_attr->fs_file->fs_info;
+    TSK_FS_ATTR_RUN *run;
+
+    if (fs->attr_resolve_run == NULL) {
+        *a_run = (a_prev) ? a_prev->next : a_fs_attr->nrd.run;
+        return 0;
+    }
+
+    tsk_take_lock(&fs->attr_run_lock);
+    run = (a_prev) ? a_prev->next : a_fs_attr->nrd.run;
+    while ((run) && (run->flags & TSK_FS_ATTR_RUN_FLAG_UNRESOLVED)) {
+        if (run->offset + run->len <= a_min_end) {
+            a_prev = run;
+            run = run->next;
+        }
+        else if (fs_attr_resolve_run(a_fs_attr, a_prev, run, &run)) {
+            tsk_release_lock(&fs->attr_run_lock);
+            return 1;
+        }
+    }
+    tsk_release_lock(&fs->attr_run_lock);
+
+    *a_run = run;
+    return 0;
+}
+
+/**
+ * \ingroup fslib
+ * Load all of the runs of a non-resident attribute that the file system
+ * has not loaded yet (see TSK_FS_ATTR_RUN_FLAG_UNRESOLVED).  Reads and
+ * walks do this on their own, so this is needed only before the run
+ * list in TSK_FS_ATTR::nrd is used directly.
+ *
+ * @param a_fs_attr Attribute to process
+ * @returns 1 on error and 0 on success.
+ */
+uint8_t
+tsk_fs_attr_resolve(const TSK_FS_ATTR * a_fs_attr)
+{
+    TSK_FS_ATTR *fs_attr = (TSK_FS_ATTR *) a_fs_attr;
+    TSK_FS_ATTR_RUN *run, *prev = NULL;
+
+    if ((fs_attr == NULL) || ((fs_attr->flags & TSK_FS_ATTR_NONRES) == 0))
+        return 0;
+
+    do {
+        if (fs_attr_run_next(fs_attr, prev, 0, &run))
+            return 1;
+        prev = run;
+    } while (run);
+    return 0;
+}
+
 /** \internal
  * Processes a resident TSK_FS_ATTR structure and calls the callback with the associated
  * data. The size of the buffer in the callback will be block_size at max. 
@@ -752,7 +882,7 @@ tsk_fs_attr_walk_nonres(const TSK_FS_ATTR * fs_attr,
     char *buf = NULL;
     TSK_OFF_T tot_size;
     TSK_OFF_T off = 0;
-    TSK_FS_ATTR_RUN *fs_attr_run;
+    TSK_FS_ATTR_RUN *fs_attr_run, *fs_attr_run_prev = NULL;
     int retval;
     uint32_t skip_remain;
     TSK_FS_INFO *fs = fs_attr->fs_file->fs_info;
@@ -781,10 +911,19 @@ tsk_fs_attr_walk_nonres(const TSK_FS_ATTR * fs_attr,
 
     /* cycle through the number of runs we have */
     retval = TSK_WALK_CONT;
-    for (fs_attr_run = fs_attr->nrd.run; fs_attr_run;
-        fs_attr_run = fs_attr_run->next) {
+    for (;; fs_attr_run_prev = fs_attr_run) {
         TSK_DADDR_T addr, len_idx;
 
+        // get the next run, loading the runs that the file system has
+        // not loaded yet
+        if (fs_attr_run_next((TSK_FS_ATTR *) fs_attr, fs_attr_run_prev, 0,
+                &fs_attr_run)) {
+            free(buf);
+            return 1;
+        }
+        if (fs_attr_run == NULL)
+            break;
+
         addr = fs_attr_run->addr;
 
         /* cycle through each block in the run */
@@ -1054,7 +1193,7 @@ tsk_fs_attr_read(const TSK_FS_ATTR * a_fs_attr, TSK_OFF_T a_offset,
 
     /* For non-resident data, load the needed block and copy the data */
     else if (a_fs_attr->flags & TSK_FS_ATTR_NONRES) {
-        TSK_FS_ATTR_RUN *data_run_cur;
+        TSK_FS_ATTR_RUN *data_run_cur, *data_run_prev = NULL;
         TSK_DADDR_T blkoffset_toread;   // block offset of where we want to start reading from
         size_t byteoffset_toread;       // byte offset in blkoffset_toread of where we want to start reading from
         size_t len_remain;      // length remaining to copy
@@ -1091,8 +1230,7 @@ tsk_fs_attr_read(const TSK_FS_ATTR * a_fs_attr, TSK_OFF_T a_offset,
         len_remain = len_toread;
 
         // cycle through the run until we find where we can start to process the clusters
-        for (data_run_cur = a_fs_attr->nrd.run; data_run_cur;
-            data_run_cur = data_run_cur->next) {
+        for (;; data_run_prev = data_run_cur) {
             TSK_DADDR_T blkoffset_inrun;
             size_t len_inrun;
 
@@ -1100,6 +1238,15 @@ tsk_fs_attr_read(const TSK_FS_ATTR * a_fs_attr, TSK_OFF_T a_offset,
             if (len_remain <= 0)
                 break;
 
+            // get the next run, loading the runs that the file system
+            // has not loaded yet (only the ones that are needed for this
+            // read)
+            if (fs_attr_run_next((TSK_FS_ATTR *) a_fs_attr, data_run_prev,
+                    blkoffset_toread, &data_run_cur))
+                return -1;
+            if (data_run_cur == NULL)
+                break;
+
             // See if this run contains the starting offset they requested
             if (data_run_cur->offset + data_run_cur->len <=
                 blkoffset_toread)
@@ -14,6 +14,10 @@
 #include <errno.h>
 #include "tsk_fs_i.h"
 
+/* Largest number of bytes that are read at once by a
+ * TSK_FS_BLOCK_WALK_FLAG_RUNS block walk */
+#define TSK_FS_BLOCK_RUN_BSIZE  (1024 * 1024)
+
 /**
  * \internal
  * Allocate a TSK_FS_BLOCK structure.  
@@ -37,6 +41,7 @@ tsk_fs_block_alloc(TSK_FS_INFO * a_fs)
     fs_block->tag = TSK_FS_BLOCK_TAG;
     fs_block->addr = 0;
     fs_block->flags = 0;
+    fs_block->len = 1;
     fs_block->fs_info = a_fs;
 
     return fs_block;
@@ -122,6 +127,7 @@ tsk_fs_block_get_flag(TSK_FS_INFO * a_fs, TSK_FS_BLOCK * a_fs_block,
 
     a_fs_block->fs_info = a_fs;
     a_fs_block->addr = a_addr;
+    a_fs_block->len = 1;
     a_fs_block->flags = a_flags;
     a_fs_block->flags |= TSK_FS_BLOCK_FLAG_RAW;
     offs = (TSK_OFF_T) a_addr *a_fs->block_size;
@@ -171,17 +177,341 @@ tsk_fs_block_set(TSK_FS_INFO * a_fs, TSK_FS_BLOCK * a_fs_block,
     if ((a_flags & TSK_FS_BLOCK_FLAG_AONLY) == 0)
         memcpy(a_fs_block->buf, a_buf, a_fs->block_size);
     a_fs_block->addr = a_addr;
+    a_fs_block->len = 1;
     a_fs_block->flags = a_flags;
     return 0;
 }
 
 
+/* Number of set bits in a 64-bit word */
+static unsigned int
+tsk_fs_bitmap_popcount64(uint64_t a_val)
+{
+#if defined(__GNUC__)
+    return (unsigned int) __builtin_popcountll(a_val);
+#else
+    a_val = a_val - ((a_val >> 1) & 0x5555555555555555ULL);
+    a_val = (a_val & 0x3333333333333333ULL) +
+        ((a_val >> 2) & 0x3333333333333333ULL);
+    a_val = (a_val + (a_val >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (unsigned int) ((a_val * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+
+/**
+ * \internal
+ * Count the bits in an allocation bitmap that have the same value as
+ * a given bit.  Whole 64-bit words and bytes are skipped when they are
+ * all set or all clear, so long runs are found without testing each bit.
+ *
+ * @param a_map Bitmap to examine
+ * @param a_bit First bit of the run
+ * @param a_end Bit after the last one that can be part of the run
+ * @param a_msb 1 if bit 0 of a byte is its most significant bit (HFS) and
+ * 0 if it is the least significant bit (ext2fs, NTFS)
+ * @returns Number of bits in the run (at least 1)
+ */
+size_t
+tsk_fs_bitmap_run(const uint8_t * a_map, size_t a_bit, size_t a_end,
+    uint8_t a_msb)
+{
+    size_t bit;
+    uint8_t val, fill;
+    uint64_t fill64;
+
+#define TSK_FS_BITMAP_GET(map, b, msb) \
+    (((map)[(b) >> 3] & ((msb) ? (0x80 >> ((b) & 7)) : (1 << ((b) & 7)))) != 0)
+
+    val = TSK_FS_BITMAP_GET(a_map, a_bit, a_msb);
+    fill = val ? 0xff : 0x00;
+    fill64 = val ? ~(uint64_t) 0 : 0;
+
+    for (bit = a_bit + 1; bit < a_end;) {
+        if ((bit & 63) == 0) {
+            uint64_t word;
+            while (bit + 64 <= a_end) {
+                memcpy(&word, &a_map[bit >> 3], sizeof(word));
+                if (word != fill64)
+                    break;
+                bit += 64;
+            }
+            if (bit >= a_end)
+                break;
+        }
+        if (((bit & 7) == 0) && (bit + 8 <= a_end)
+            && (a_map[bit >> 3] == fill)) {
+            bit += 8;
+            continue;
+        }
+        if (TSK_FS_BITMAP_GET(a_map, bit, a_msb) != val)
+            break;
+        bit++;
+    }
+#undef TSK_FS_BITMAP_GET
+
+    return bit - a_bit;
+}
+
+
+/**
+ * \internal
+ * Count the set bits in a range of an allocation bitmap.  The bit order
+ * within a byte does not matter for the count.  Whole 64-bit words are
+ * counted at once.
+ *
+ * @param a_map Bitmap to examine
+ * @param a_bit First bit to count
+ * @param a_end Bit after the last one to count
+ * @returns Number of set bits in the range
+ */
+uint64_t
+tsk_fs_bitmap_count(const uint8_t * a_map, size_t a_bit, size_t a_end)
+{
+    uint64_t cnt = 0;
+    size_t bit = a_bit;
+
+    /* leading bits up to a byte boundary */
+    for (; (bit < a_end) && (bit & 7); bit++) {
+        if (a_map[bit >> 3] & (1 << (bit & 7)))
+            cnt++;
+    }
+
+    /* whole words and then whole bytes */
+    for (; bit + 64 <= a_end; bit += 64) {
+        uint64_t word;
+        memcpy(&word, &a_map[bit >> 3], sizeof(word));
+        cnt += tsk_fs_bitmap_popcount64(word);
+    }
+    for (; bit + 8 <= a_end; bit += 8)
+        cnt += tsk_fs_bitmap_popcount64(a_map[bit >> 3]);
+
+    /* trailing bits */
+    for (; bit < a_end; bit++) {
+        if (a_map[bit >> 3] & (1 << (bit & 7)))
+            cnt++;
+    }
+    return cnt;
+}
+
+
+/**
+ * \internal
+ * Get the flags of a block and the number of consecutive blocks (starting
+ * with it) that have the same flags.  Uses the file system's bitmap-based
+ * TSK_FS_INFO::block_getflags_run if it has one and otherwise tests each
+ * block with TSK_FS_INFO::block_getflags.
+ *
+ * @param a_fs File system
+ * @param a_addr First block of the run
+ * @param a_end Last block that can be part of the run
+ * @param a_flags [out] Flags of the blocks in the run
+ * @returns Number of blocks in the run or 0 on error
+ */
+TSK_DADDR_T
+tsk_fs_block_getflags_run(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr,
+    TSK_DADDR_T a_end, TSK_FS_BLOCK_FLAG_ENUM * a_flags)
+{
+    TSK_DADDR_T addr;
+
+    if (a_fs->block_getflags_run)
+        return a_fs->block_getflags_run(a_fs, a_addr, a_end, a_flags);
+
+    *a_flags = a_fs->block_getflags(a_fs, a_addr);
+    for (addr = a_addr + 1; addr <= a_end; addr++) {
+        if (a_fs->block_getflags(a_fs, addr) != *a_flags)
+            break;
+    }
+    return addr - a_addr;
+}
+
+
+/* Return 1 if a block with the given flags should be passed to a
+ * block walk callback with the given walk flags. */
+static uint8_t
+tsk_fs_block_walk_match(int a_myflags, TSK_FS_BLOCK_WALK_FLAG_ENUM a_flags)
+{
+    if ((a_myflags & TSK_FS_BLOCK_FLAG_META)
+        && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_META)))
+        return 0;
+    else if ((a_myflags & TSK_FS_BLOCK_FLAG_CONT)
+        && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_CONT)))
+        return 0;
+    else if ((a_myflags & TSK_FS_BLOCK_FLAG_ALLOC)
+        && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_ALLOC)))
+        return 0;
+    else if ((a_myflags & TSK_FS_BLOCK_FLAG_UNALLOC)
+        && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_UNALLOC)))
+        return 0;
+    return 1;
+}
+
+
+/**
+ * \internal
+ * Block walk for TSK_FS_BLOCK_WALK_FLAG_RUNS.  Finds runs of blocks with
+ * the same flags from the allocation bitmaps, skips the runs that do not
+ * match a_flags without reading them, and reads the others in chunks of
+ * up to TSK_FS_BLOCK_RUN_BSIZE bytes.
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+tsk_fs_block_walk_runs(TSK_FS_INFO * a_fs,
+    TSK_DADDR_T a_start_blk, TSK_DADDR_T a_end_blk,
+    TSK_FS_BLOCK_WALK_FLAG_ENUM a_flags, TSK_FS_BLOCK_WALK_CB a_action,
+    void *a_ptr)
+{
+    char *myname = "tsk_fs_block_walk";
+    TSK_FS_BLOCK *fs_block;
+    TSK_DADDR_T addr, max_blks;
+
+    // clean up any error messages that are lying around
+    tsk_error_reset();
+
+    if (a_start_blk < a_fs->first_block || a_start_blk > a_fs->last_block) {
+        tsk_error_set_errno(TSK_ERR_FS_WALK_RNG);
+        tsk_error_set_errstr("%s: start block: %" PRIuDADDR, myname,
+            a_start_blk);
+        return 1;
+    }
+    if (a_end_blk < a_fs->first_block || a_end_blk > a_fs->last_block
+        || a_end_blk < a_start_blk) {
+        tsk_error_set_errno(TSK_ERR_FS_WALK_RNG);
+        tsk_error_set_errstr("%s: end block: %" PRIuDADDR, myname,
+            a_end_blk);
+        return 1;
+    }
+
+    /* Sanity check on a_flags -- make sure at least one ALLOC is set */
+    if (((a_flags & TSK_FS_BLOCK_WALK_FLAG_ALLOC) == 0) &&
+        ((a_flags & TSK_FS_BLOCK_WALK_FLAG_UNALLOC) == 0)) {
+        a_flags |=
+            (TSK_FS_BLOCK_WALK_FLAG_ALLOC |
+            TSK_FS_BLOCK_WALK_FLAG_UNALLOC);
+    }
+    if (((a_flags & TSK_FS_BLOCK_WALK_FLAG_META) == 0) &&
+        ((a_flags & TSK_FS_BLOCK_WALK_FLAG_CONT) == 0)) {
+        a_flags |=
+            (TSK_FS_BLOCK_WALK_FLAG_CONT | TSK_FS_BLOCK_WALK_FLAG_META);
+    }
+
+    if ((fs_block =
+            (TSK_FS_BLOCK *) tsk_malloc(sizeof(TSK_FS_BLOCK))) == NULL)
+        return 1;
+    fs_block->tag = TSK_FS_BLOCK_TAG;
+    fs_block->fs_info = a_fs;
+
+    max_blks = TSK_FS_BLOCK_RUN_BSIZE / a_fs->block_size;
+    if (max_blks == 0)
+        max_blks = 1;
+    if ((a_flags & TSK_FS_BLOCK_WALK_FLAG_AONLY) == 0) {
+        if ((fs_block->buf =
+                (char *) tsk_malloc((size_t) max_blks *
+                    a_fs->block_size)) == NULL) {
+            tsk_fs_block_free(fs_block);
+            return 1;
+        }
+    }
+
+    for (addr = a_start_blk; addr <= a_end_blk;) {
+        TSK_FS_BLOCK_FLAG_ENUM myflags, nextflags;
+        TSK_DADDR_T run_end, len;
+
+        if ((len =
+                tsk_fs_block_getflags_run(a_fs, addr, a_end_blk,
+                    &myflags)) == 0) {
+            tsk_error_set_errstr2("%s: block %" PRIuDADDR, myname, addr);
+            tsk_fs_block_free(fs_block);
+            return 1;
+        }
+        run_end = addr + len - 1;
+
+        if (tsk_fs_block_walk_match(myflags, a_flags) == 0) {
+            addr = run_end + 1;
+            continue;
+        }
+
+        /* Runs end at bitmap block boundaries, so merge the ones that follow
+         * and have the same flags */
+        while (run_end < a_end_blk) {
+            if ((len =
+                    tsk_fs_block_getflags_run(a_fs, run_end + 1, a_end_blk,
+                        &nextflags)) == 0) {
+                tsk_error_set_errstr2("%s: block %" PRIuDADDR, myname,
+                    run_end + 1);
+                tsk_fs_block_free(fs_block);
+                return 1;
+            }
+            if (nextflags != myflags)
+                break;
+            run_end += len;
+        }
+
+        /* call back with the run, in buffer-sized pieces if we need content */
+        while (addr <= run_end) {
+            int retval;
+
+            fs_block->addr = addr;
+            fs_block->len = run_end - addr + 1;
+            fs_block->flags = myflags | TSK_FS_BLOCK_FLAG_RAW;
+
+            if (a_flags & TSK_FS_BLOCK_WALK_FLAG_AONLY) {
+                fs_block->flags |= TSK_FS_BLOCK_FLAG_AONLY;
+            }
+            else {
+                ssize_t cnt;
+
+                if (fs_block->len > max_blks)
+                    fs_block->len = max_blks;
+                // return what we have if the image is missing the end
+                if ((addr <= a_fs->last_block_act)
+                    && (addr + fs_block->len - 1 > a_fs->last_block_act))
+                    fs_block->len = a_fs->last_block_act - addr + 1;
+
+                cnt = tsk_fs_read_block(a_fs, addr, fs_block->buf,
+                    (size_t) fs_block->len * a_fs->block_size);
+                if (cnt != (ssize_t) fs_block->len * a_fs->block_size) {
+                    if (cnt >= 0) {
+                        tsk_error_reset();
+                        tsk_error_set_errno(TSK_ERR_FS_READ);
+                    }
+                    tsk_error_set_errstr2("%s: block %" PRIuDADDR,
+                        myname, addr);
+                    tsk_fs_block_free(fs_block);
+                    return 1;
+                }
+            }
+
+            retval = a_action(fs_block, a_ptr);
+            if (retval == TSK_WALK_STOP) {
+                tsk_fs_block_free(fs_block);
+                return 0;
+            }
+            else if (retval == TSK_WALK_ERROR) {
+                tsk_fs_block_free(fs_block);
+                return 1;
+            }
+            addr += fs_block->len;
+        }
+    }
+
+    tsk_fs_block_free(fs_block);
+    return 0;
+}
+
+
 /** 
  * \ingroup fslib
  *
  * Cycle through a range of file system blocks and call the callback function
  * with the contents and allocation status of each. 
  *
+ * With TSK_FS_BLOCK_WALK_FLAG_RUNS, the allocation bitmaps are used to
+ * find runs of consecutive blocks with the same flags.  Runs that do not
+ * match the flags are skipped without being read and the callback is
+ * called once per matching run (or per chunk of a long run) instead of
+ * once per block.  
+ *
  * @param a_fs File system to analyze
  * @param a_start_blk Block address to start walking from
  * @param a_end_blk Block address to walk to
@@ -203,6 +533,9 @@ tsk_fs_block_walk(TSK_FS_INFO * a_fs,
             ("tsk_fs_block_walk: FS_INFO structure is not allocated");
         return 1;
     }
+    if (a_flags & TSK_FS_BLOCK_WALK_FLAG_RUNS)
+        return tsk_fs_block_walk_runs(a_fs, a_start_blk, a_end_blk,
+            a_flags, a_action, a_ptr);
     return a_fs->block_walk(a_fs, a_start_blk, a_end_blk, a_flags,
         a_action, a_ptr);
 }
@@ -19,7 +19,135 @@
 
 
 /** \internal
-* Allocate a FS_DIR structure to load names into.
+ * Return a buffer of a_len bytes from the name arena of a directory.
+ * A new block is added to the arena if the current one is full.  The
+ * buffer is only released when the directory is reset or closed.
+ *
+ * @param a_fs_dir Directory whose arena to allocate from
+ * @param a_len Number of bytes needed
+ * @returns NULL on error
+ */
+static char *
+tsk_fs_dir_arena_alloc(TSK_FS_DIR * a_fs_dir, size_t a_len)
+{
+    TSK_FS_DIR_ARENA *blk = a_fs_dir->name_arena;
+    char *buf;
+
+    if ((blk == NULL) || (blk->size - blk->used < a_len)) {
+        size_t size = TSK_FS_DIR_ARENA_BSIZE;
+        if (size < a_len)
+            size = a_len;
+
+        if ((blk =
+                (TSK_FS_DIR_ARENA *) tsk_malloc(sizeof(TSK_FS_DIR_ARENA) +
+                    size)) == NULL)
+            return NULL;
+        blk->size = size;
+        blk->used = 0;
+        blk->next = a_fs_dir->name_arena;
+        a_fs_dir->name_arena = blk;
+    }
+
+    buf = &blk->buf[blk->used];
+    blk->used += a_len;
+    return buf;
+}
+
+/** \internal
+ * Release the name arena of a directory.  If a_keep is set, the most
+ * recent block is kept (and emptied) so that it can be reused.
+ */
+static void
+tsk_fs_dir_arena_free(TSK_FS_DIR * a_fs_dir, uint8_t a_keep)
+{
+    TSK_FS_DIR_ARENA *blk = a_fs_dir->name_arena;
+
+    if ((a_keep) && (blk)) {
+        a_fs_dir->name_arena = blk;
+        blk->used = 0;
+        blk = blk->next;
+        a_fs_dir->name_arena->next = NULL;
+    }
+    else {
+        a_fs_dir->name_arena = NULL;
+    }
+
+    while (blk) {
+        TSK_FS_DIR_ARENA *next = blk->next;
+        free(blk);
+        blk = next;
+    }
+}
+
+/** \internal
+ * Copy a string into a name buffer of a directory entry.  The existing
+ * buffer is reused if it is big enough, otherwise a new one is taken
+ * from the arena of the directory.
+ * @returns 1 on error
+ */
+static uint8_t
+tsk_fs_dir_arena_strcpy(TSK_FS_DIR * a_fs_dir, char **a_dst,
+    size_t * a_dst_size, const char *a_src)
+{
+    size_t len;
+
+    if (a_src == NULL) {
+        if (*a_dst_size > 0)
+            (*a_dst)[0] = '\0';
+        else
+            *a_dst = NULL;
+        return 0;
+    }
+
+    len = strlen(a_src) + 1;
+    if (len > *a_dst_size) {
+        if ((*a_dst = tsk_fs_dir_arena_alloc(a_fs_dir, len)) == NULL) {
+            *a_dst_size = 0;
+            return 1;
+        }
+        *a_dst_size = len;
+    }
+    memmove(*a_dst, a_src, len);
+    return 0;
+}
+
+/** \internal
+ * Copy a name into an entry of a directory.  This is the same as
+ * tsk_fs_name_copy() except that the strings are stored in the
+ * arena of the directory instead of being allocated per entry.
+ *
+ * @param a_fs_dir Directory that a_fs_name_to is an entry of
+ * @param a_fs_name_to Entry to copy into
+ * @param a_fs_name_from Name to copy
+ * @returns 1 on error
+ */
+static uint8_t
+tsk_fs_dir_name_copy(TSK_FS_DIR * a_fs_dir, TSK_FS_NAME * a_fs_name_to,
+    const TSK_FS_NAME * a_fs_name_from)
+{
+    if (tsk_fs_dir_arena_strcpy(a_fs_dir, &a_fs_name_to->name,
+            &a_fs_name_to->name_size, a_fs_name_from->name))
+        return 1;
+
+    if (tsk_fs_dir_arena_strcpy(a_fs_dir, &a_fs_name_to->shrt_name,
+            &a_fs_name_to->shrt_name_size, a_fs_name_from->shrt_name))
+        return 1;
+
+    a_fs_name_to->meta_addr = a_fs_name_from->meta_addr;
+    a_fs_name_to->meta_seq = a_fs_name_from->meta_seq;
+    a_fs_name_to->par_addr = a_fs_name_from->par_addr;
+    a_fs_name_to->par_seq = a_fs_name_from->par_seq;
+    a_fs_name_to->type = a_fs_name_from->type;
+    a_fs_name_to->flags = a_fs_name_from->flags;
+
+    return 0;
+}
+
+
+/** \internal
+* Allocate a FS_DIR structure to load names into.  The name strings
+* of the entries are stored in an arena that is owned by the FS_DIR
+* and released in bulk by tsk_fs_dir_reset() and tsk_fs_dir_close().
 *
 * @param a_addr Address of this directory.
 * @param a_cnt target number of FS_DENT entries to fit in
@@ -90,14 +218,25 @@ tsk_fs_dir_realloc(TSK_FS_DIR * a_fs_dir, size_t a_cnt)
 
 /** \internal
 * Reset the structures in a FS_DIR so that it can be reused.
+* The name strings of the previous entries are released.
 * @param a_fs_dir FS_DIR structure to re-use
 */
 void
 tsk_fs_dir_reset(TSK_FS_DIR * a_fs_dir)
 {
+    size_t i;
+
     if ((a_fs_dir == NULL) || (a_fs_dir->tag != TSK_FS_DIR_TAG))
         return;
 
+    for (i = 0; i < a_fs_dir->names_alloc; i++) {
+        a_fs_dir->names[i].name = NULL;
+        a_fs_dir->names[i].name_size = 0;
+        a_fs_dir->names[i].shrt_name = NULL;
+        a_fs_dir->names[i].shrt_name_size = 0;
+    }
+    tsk_fs_dir_arena_free(a_fs_dir, 1);
+
     if (a_fs_dir->fs_file) {
         tsk_fs_file_close(a_fs_dir->fs_file);
         a_fs_dir->fs_file = NULL;
@@ -130,7 +269,8 @@ tsk_fs_dir_copy(const TSK_FS_DIR * a_src_dir, TSK_FS_DIR * a_dst_dir)
     }
 
     for (i = 0; i < a_src_dir->names_used; i++) {
-        if (tsk_fs_name_copy(&a_dst_dir->names[i], &a_src_dir->names[i]))
+        if (tsk_fs_dir_name_copy(a_dst_dir, &a_dst_dir->names[i],
+                &a_src_dir->names[i]))
             return 1;
     }
 
@@ -207,19 +347,6 @@ tsk_fs_dir_add(TSK_FS_DIR * a_fs_dir, const TSK_FS_NAME * a_fs_name)
                 if ((a_fs_dir->names[i].flags & TSK_FS_NAME_FLAG_UNALLOC)
                     && (a_fs_name->flags & TSK_FS_NAME_FLAG_ALLOC)) {
                     fs_name_dest = &a_fs_dir->names[i];
-
-                    // free the memory - not the most effecient, but prevents
-                    // duplicate code.
-                    if (fs_name_dest->name) {
-                        free(fs_name_dest->name);
-                        fs_name_dest->name = NULL;
-                        fs_name_dest->name_size = 0;
-                    }
-                    if (fs_name_dest->shrt_name) {
-                        free(fs_name_dest->shrt_name);
-                        fs_name_dest->shrt_name = NULL;
-                        fs_name_dest->shrt_name_size = 0;
-                    }
                     break;
                 }
                 else {
@@ -239,7 +366,7 @@ tsk_fs_dir_add(TSK_FS_DIR * a_fs_dir, const TSK_FS_NAME * a_fs_name)
         fs_name_dest = &a_fs_dir->names[a_fs_dir->names_used++];
     }
 
-    if (tsk_fs_name_copy(fs_name_dest, a_fs_name))
+    if (tsk_fs_dir_name_copy(a_fs_dir, fs_name_dest, a_fs_name))
         return 1;
 
     // add the parent address
@@ -338,24 +465,13 @@ tsk_fs_dir_open(TSK_FS_INFO * a_fs, const char *a_dir)
 void
 tsk_fs_dir_close(TSK_FS_DIR * a_fs_dir)
 {
-    size_t i;
     if ((a_fs_dir == NULL) || (a_fs_dir->tag != TSK_FS_DIR_TAG)) {
         return;
     }
 
-    for (i = 0; i < a_fs_dir->names_used; i++) {
-        if (a_fs_dir->names[i].name) {
-            free(a_fs_dir->names[i].name);
-            a_fs_dir->names[i].name = NULL;
-            a_fs_dir->names[i].name_size = 0;
-        }
-        if (a_fs_dir->names[i].shrt_name) {
-            free(a_fs_dir->names[i].shrt_name);
-            a_fs_dir->names[i].shrt_name = NULL;
-            a_fs_dir->names[i].shrt_name_size = 0;
-        }
-    }
+    // the name strings all live in the arena
     free(a_fs_dir->names);
+    tsk_fs_dir_arena_free(a_fs_dir, 0);
 
     if (a_fs_dir->fs_file) {
         tsk_fs_file_close(a_fs_dir->fs_file);
@@ -451,7 +567,8 @@ tsk_fs_dir_get(const TSK_FS_DIR * a_fs_dir, size_t a_idx)
 /** \ingroup fslib
  * Return only the name for a file or subdirectory from an open directory.
  * Useful when wanting to find files of a given name and you don't need the 
- * additional metadata. 
+ * additional metadata.  The returned name is owned by a_fs_dir and is
+ * only valid until the directory is closed.
  *
  * @param a_fs_dir Directory to analyze
  * @param a_idx Index of file in directory to open (0-based)
@@ -481,6 +598,11 @@ tsk_fs_dir_get_name(const TSK_FS_DIR * a_fs_dir, size_t a_idx)
 #define MAX_DEPTH   128
 #define DIR_STRSZ   4096
 
+/* Largest bitmap of named metadata addresses, in bytes.  File systems
+ * with more addresses (HFS and YAFFS addresses are sparse) keep the
+ * named addresses in a TSK_LIST instead. */
+#define INUM_NAMED_BITMAP_MAX   (16 * 1024 * 1024)
+
 /** \internal
  * used to keep state between calls to dir_walk_lcl
  */
@@ -501,19 +623,21 @@ typedef struct {
     /* Set to one to collect inode info that can be used for orphan listing */
     uint8_t save_inum_named;
 
-    /* We keep list_inum_named inside DENT_DINFO so different threads
+    /* We keep the inum_named bitmap (or list_inum_named if the bitmap
+     * would be too large) inside DENT_DINFO so different threads
      * have their own copies.  On successful completion of the dir
      * walk we reassigned ownership of this pointer into the shared
-     * TSK_FS_INFO list_inum_named field.  We're trading off the extra
+     * TSK_FS_INFO field.  We're trading off the extra
      * work in each thread for cleaner locking code.
      */
+    uint8_t *inum_named;
     TSK_LIST *list_inum_named;
 
 } DENT_DINFO;
 
 
 /**
- * Saves the list_inum_named from DENT_DINFO to FS_INFO.
+ * Saves the inum_named bitmap or list from DENT_DINFO to FS_INFO.
  * This can be called from a couple of places, so the logic
  * is here in a single method.
  */
@@ -521,19 +645,36 @@ static void
 save_inum_named(TSK_FS_INFO *a_fs, DENT_DINFO *dinfo) {
 
     /* We finished the dir walk successfully, so reassign
-     * ownership of the dinfo's list_inum_named to the shared
-     * list_inum_named in TSK_FS_INFO, under a lock, if
+     * ownership of the dinfo's inum_named to the shared
+     * inum_named in TSK_FS_INFO, under a lock, if
      * another thread hasn't already done so.
      */
-    tsk_take_lock(&a_fs->list_inum_named_lock);
-    if (a_fs->list_inum_named == NULL) {
+    tsk_take_lock(&a_fs->inum_named_lock);
+    if (a_fs->inum_named_loaded == 0) {
+        a_fs->inum_named = dinfo->inum_named;
         a_fs->list_inum_named = dinfo->list_inum_named;
+        a_fs->inum_named_loaded = 1;
     }
     else {
+        free(dinfo->inum_named);
         tsk_list_free(dinfo->list_inum_named);
     }
+    dinfo->inum_named = NULL;
     dinfo->list_inum_named = NULL;
-    tsk_release_lock(&a_fs->list_inum_named_lock);
+    tsk_release_lock(&a_fs->inum_named_lock);
+}
+
+/**
+ * Stops collecting the inum_named bitmap or list in DENT_DINFO and frees
+ * the partial copy.  Used when the walk will not cover every name.
+ */
+static void
+discard_inum_named(DENT_DINFO *dinfo) {
+    free(dinfo->inum_named);
+    dinfo->inum_named = NULL;
+    tsk_list_free(dinfo->list_inum_named);
+    dinfo->list_inum_named = NULL;
+    dinfo->save_inum_named = 0;
 }
 
 /* dir_walk local function that is used for recursive calls.  Callers
@@ -591,13 +732,11 @@ tsk_fs_dir_walk_lcl(TSK_FS_INFO * a_fs, DENT_DINFO * a_dinfo,
                 fs_file->name = NULL;
                 tsk_fs_file_close(fs_file);
 
-                /* free the list -- fs_dir_walk has no way
+                /* free the bitmap -- fs_dir_walk has no way
                  * of knowing that we stopped early w/out error.
                  */
                 if (a_dinfo->save_inum_named) {
-                    tsk_list_free(a_dinfo->list_inum_named);
-                    a_dinfo->list_inum_named = NULL;
-                    a_dinfo->save_inum_named = 0;
+                    discard_inum_named(a_dinfo);
                 }
                 return TSK_WALK_STOP;
             }
@@ -611,15 +750,15 @@ tsk_fs_dir_walk_lcl(TSK_FS_INFO * a_fs, DENT_DINFO * a_dinfo,
 
         // save the inode info for orphan finding - if requested
         if ((a_dinfo->save_inum_named) && (fs_file->meta)
-            && (fs_file->meta->flags & TSK_FS_META_FLAG_UNALLOC)) {
-
-            if (tsk_list_add(&a_dinfo->list_inum_named,
+            && (fs_file->meta->flags & TSK_FS_META_FLAG_UNALLOC)
+            && (fs_file->meta->addr <= a_fs->last_inum)) {
+            if (a_dinfo->inum_named) {
+                setbit(a_dinfo->inum_named, fs_file->meta->addr);
+            }
+            else if (tsk_list_add(&a_dinfo->list_inum_named,
                     fs_file->meta->addr)) {
-
                 // if there is an error, then clear the list
-                tsk_list_free(a_dinfo->list_inum_named);
-                a_dinfo->list_inum_named = NULL;
-                a_dinfo->save_inum_named = 0;
+                discard_inum_named(a_dinfo);
             }
         }
 
@@ -793,12 +932,25 @@ tsk_fs_dir_walk(TSK_FS_INFO * a_fs, TSK_INUM_T a_addr,
      * for an orphan walk.  If the walk fails or stops, the code that
      * calls the action will clear this stuff.
      */
-    tsk_take_lock(&a_fs->list_inum_named_lock);
-    if ((a_fs->list_inum_named == NULL) && (a_addr == a_fs->root_inum)
+    tsk_take_lock(&a_fs->inum_named_lock);
+    if ((a_fs->inum_named_loaded == 0) && (a_addr == a_fs->root_inum)
         && (a_flags & TSK_FS_DIR_WALK_FLAG_RECURSE)) {
         dinfo.save_inum_named = 1;
     }
-    tsk_release_lock(&a_fs->list_inum_named_lock);
+    tsk_release_lock(&a_fs->inum_named_lock);
+
+    // one bit per metadata address, or a list if that would be too much
+    // memory.  If we can't get the memory, the walk still happens and
+    // the bitmap is built by a later one.
+    if ((dinfo.save_inum_named)
+        && (a_fs->last_inum / 8 + 1 <= INUM_NAMED_BITMAP_MAX)) {
+        if ((dinfo.inum_named =
+                (uint8_t *) tsk_malloc((size_t) (a_fs->last_inum / 8 +
+                        1))) == NULL) {
+            tsk_error_reset();
+            dinfo.save_inum_named = 0;
+        }
+    }
 
     retval = tsk_fs_dir_walk_lcl(a_fs, &dinfo, a_addr, a_flags,
         a_action, a_ptr);
@@ -808,10 +960,9 @@ tsk_fs_dir_walk(TSK_FS_INFO * a_fs, TSK_INUM_T a_addr,
     if (dinfo.save_inum_named == 1) {
         if (retval != TSK_WALK_CONT) {
             /* There was an error and we stopped early, so we should get
-             * rid of the partial list we were making.
+             * rid of the partial bitmap we were making.
              */
-            tsk_list_free(dinfo.list_inum_named);
-            dinfo.list_inum_named = NULL;
+            discard_inum_named(&dinfo);
         }
         else {
             save_inum_named(a_fs, &dinfo);
@@ -891,22 +1042,24 @@ tsk_fs_dir_make_orphan_dir_meta(TSK_FS_INFO * a_fs,
 }
 
 /** \internal
- * Searches the list of metadata addresses that are pointed to
- * by unallocated names.  Used to find orphan files. 
+ * Searches the bitmap (or list) of unallocated metadata addresses that are
+ * pointed to by file names.  Used to find orphan files. 
  * @param a_fs File system being analyzed.
- * @param a_inum Metadata address to lookup in list.
- * @returns 1 if metadata address is pointed to by an unallocated
+ * @param a_inum Metadata address to lookup in bitmap.
+ * @returns 1 if unallocated metadata address is pointed to by a
  * file name or 0 if not.
  */
 uint8_t
 tsk_fs_dir_find_inum_named(TSK_FS_INFO * a_fs, TSK_INUM_T a_inum)
 {
     uint8_t retval = 0;
-    tsk_take_lock(&a_fs->list_inum_named_lock);
-    // list can be null if no unallocated file names exist
-    if (a_fs->list_inum_named)
+    tsk_take_lock(&a_fs->inum_named_lock);
+    // both are null if the names have not been loaded
+    if ((a_fs->inum_named) && (a_inum <= a_fs->last_inum))
+        retval = isset(a_fs->inum_named, a_inum) ? 1 : 0;
+    else if (a_fs->list_inum_named)
         retval = tsk_list_find(a_fs->list_inum_named, a_inum);
-    tsk_release_lock(&a_fs->list_inum_named_lock);
+    tsk_release_lock(&a_fs->inum_named_lock);
     return retval;
 }
 
@@ -922,22 +1075,23 @@ load_named_dir_walk_cb(TSK_FS_FILE * a_fs_file, const char *a_path,
 
 
 /** \internal
- * Proces a file system and populate a list of the metadata structures
+ * Proces a file system and populate a bitmap of the metadata structures
  * that are reachable by file names. This is used to find orphan files.
- * Each file system has code that does the populating.
+ * The bitmap is filled in by any recursive tsk_fs_dir_walk() from the
+ * root directory, so this only walks if one has not been done yet.
  */
 TSK_RETVAL_ENUM
 tsk_fs_dir_load_inum_named(TSK_FS_INFO * a_fs)
 {
-    tsk_take_lock(&a_fs->list_inum_named_lock);
-    if (a_fs->list_inum_named != NULL) {
-        tsk_release_lock(&a_fs->list_inum_named_lock);
+    tsk_take_lock(&a_fs->inum_named_lock);
+    if (a_fs->inum_named_loaded) {
+        tsk_release_lock(&a_fs->inum_named_lock);
         if (tsk_verbose)
             fprintf(stderr,
-                "tsk_fs_dir_load_inum_named: List already populated.  Skipping walk.\n");
+                "tsk_fs_dir_load_inum_named: Bitmap already populated.  Skipping walk.\n");
         return TSK_OK;
     }
-    tsk_release_lock(&a_fs->list_inum_named_lock);
+    tsk_release_lock(&a_fs->inum_named_lock);
 
     if (tsk_verbose)
         fprintf(stderr,
@@ -957,15 +1111,42 @@ tsk_fs_dir_load_inum_named(TSK_FS_INFO * a_fs)
         return TSK_ERR;
     }
 
+    // the walk could not allocate the bitmap or list
+    tsk_take_lock(&a_fs->inum_named_lock);
+    if (a_fs->inum_named_loaded == 0) {
+        tsk_release_lock(&a_fs->inum_named_lock);
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUX_MALLOC);
+        tsk_error_set_errstr
+            ("tsk_fs_dir_load_inum_named: error allocating bitmap of named inodes");
+        return TSK_ERR;
+    }
+    tsk_release_lock(&a_fs->inum_named_lock);
+
     return TSK_OK;
 }
 
 
+/* Unnamed metadata structure that was found by the orphan meta walk */
+typedef struct {
+    TSK_INUM_T addr;            // metadata address
+    uint32_t seq;               // sequence of metadata structure
+    TSK_FS_META_TYPE_ENUM type; // type of file
+    char *name;                 // name stored in the metadata structure or NULL
+} FIND_ORPHAN_CAND;
+
 /* Used to keep state while populating the orphan directory */
 typedef struct {
     TSK_FS_NAME *fs_name;       // temp name structure used when adding entries to fs_dir
     TSK_FS_DIR *fs_dir;         // unique names are added to this.  represents contents of OrphanFiles directory
     TSK_LIST *orphan_subdir_list;       // keep track of files that can already be accessed via orphan directory
+
+    /* cand_lock protects the candidate list, which is filled in by the
+     * worker threads of the meta walk */
+    tsk_lock_t cand_lock;
+    FIND_ORPHAN_CAND *cands;    // unnamed metadata structures found by the meta walk
+    size_t cands_used;          // number of entries used in cands
+    size_t cands_alloc;         // number of entries allocated in cands
 } FIND_ORPHAN_DATA;
 
 /* Used to process orphan directories and make sure that their contents
@@ -1029,80 +1210,143 @@ load_orphan_dir_walk_cb(TSK_FS_FILE * a_fs_file, const char *a_path,
     return TSK_WALK_CONT;
 }
 
-/* used to identify the unnamed metadata structures */
+/* used to identify the unnamed metadata structures.  This is called
+ * from the threads of a parallel meta walk, so it only saves what is
+ * needed about each one and find_orphan_add() does the rest in address
+ * order. */
 static TSK_WALK_RET_ENUM
 find_orphan_meta_walk_cb(TSK_FS_FILE * a_fs_file, void *a_ptr)
 {
     FIND_ORPHAN_DATA *data = (FIND_ORPHAN_DATA *) a_ptr;
     TSK_FS_INFO *fs = a_fs_file->fs_info;
+    FIND_ORPHAN_CAND *cand;
+    char *name = NULL;
 
     /* We want only orphans, then check if this
-     * inode is in the seen list
+     * inode is in the seen bitmap
      */
-    tsk_take_lock(&fs->list_inum_named_lock);
-    if ((fs->list_inum_named)
-        && (tsk_list_find(fs->list_inum_named, a_fs_file->meta->addr))) {
-        tsk_release_lock(&fs->list_inum_named_lock);
+    if (tsk_fs_dir_find_inum_named(fs, a_fs_file->meta->addr)) {
         return TSK_WALK_CONT;
     }
-    tsk_release_lock(&fs->list_inum_named_lock);
 
+    // save their name if they have one
+    if (a_fs_file->meta->name2 != NULL &&
+        a_fs_file->meta->name2->name[0] != '\0') {
+        size_t len = strnlen(a_fs_file->meta->name2->name,
+            TSK_FS_META_NAME_LIST_NSIZE);
+        if ((name = (char *) tsk_malloc(len + 1)) == NULL)
+            return TSK_WALK_ERROR;
+        memcpy(name, a_fs_file->meta->name2->name, len);
+    }
+
+    tsk_take_lock(&data->cand_lock);
+    if (data->cands_used == data->cands_alloc) {
+        size_t alloc = data->cands_alloc ? data->cands_alloc * 2 : 128;
+        FIND_ORPHAN_CAND *cands;
+        if ((cands = (FIND_ORPHAN_CAND *) tsk_realloc(data->cands,
+                    alloc * sizeof(FIND_ORPHAN_CAND))) == NULL) {
+            tsk_release_lock(&data->cand_lock);
+            free(name);
+            return TSK_WALK_ERROR;
+        }
+        data->cands = cands;
+        data->cands_alloc = alloc;
+    }
+    cand = &data->cands[data->cands_used++];
+    cand->addr = a_fs_file->meta->addr;
+    cand->seq = a_fs_file->meta->seq;
+    cand->type = a_fs_file->meta->type;
+    cand->name = name;
+    tsk_release_lock(&data->cand_lock);
+
+    return TSK_WALK_CONT;
+}
+
+/* qsort callback to put the orphan candidates in address order */
+static int
+find_orphan_cand_compare(const void *a_cand1, const void *a_cand2)
+{
+    const FIND_ORPHAN_CAND *cand1 = (const FIND_ORPHAN_CAND *) a_cand1;
+    const FIND_ORPHAN_CAND *cand2 = (const FIND_ORPHAN_CAND *) a_cand2;
+
+    if (cand1->addr < cand2->addr)
+        return -1;
+    return cand1->addr > cand2->addr ? 1 : 0;
+}
+
+/* Adds an unnamed metadata structure to the orphan directory.
+ * @returns 1 on error */
+static uint8_t
+find_orphan_add(TSK_FS_INFO * fs, FIND_ORPHAN_DATA * data,
+    const FIND_ORPHAN_CAND * a_cand)
+{
     // check if we have already added it as an orphan (in a subdirectory)
-    if (tsk_list_find(data->orphan_subdir_list, a_fs_file->meta->addr)) {
-        return TSK_WALK_CONT;
+    if (tsk_list_find(data->orphan_subdir_list, a_cand->addr)) {
+        return 0;
     }
 
     // use their name if they have one
-    if (a_fs_file->meta->name2 != NULL &&
-        a_fs_file->meta->name2->name != NULL &&
-        strlen(a_fs_file->meta->name2->name) > 0) {
-        strncpy(data->fs_name->name, a_fs_file->meta->name2->name,
+    if (a_cand->name != NULL) {
+        strncpy(data->fs_name->name, a_cand->name,
             data->fs_name->name_size);
     }
     else {
         snprintf(data->fs_name->name, data->fs_name->name_size,
-            "OrphanFile-%" PRIuINUM, a_fs_file->meta->addr);
+            "OrphanFile-%" PRIuINUM, a_cand->addr);
     }
-    data->fs_name->meta_addr = a_fs_file->meta->addr;
+    data->fs_name->meta_addr = a_cand->addr;
     /* unalloc MFT entries have their sequence number incremented
      * when they are unallocated.  Decrement it in the file name so
      * that it matches the typical situation where the name is one
      * less. */
-    data->fs_name->meta_seq = a_fs_file->meta->seq - 1;
+    data->fs_name->meta_seq = a_cand->seq - 1;
     data->fs_name->flags = TSK_FS_NAME_FLAG_UNALLOC;
     data->fs_name->type = TSK_FS_NAME_TYPE_UNDEF;
 
     if (tsk_fs_dir_add(data->fs_dir, data->fs_name))
-        return TSK_WALK_ERROR;
+        return 1;
 
     /* FAT file systems spend a lot of time hunting for parent
      * directory addresses, so we put this code in here to save
      * the info when we have it. */
     if (TSK_FS_TYPE_ISFAT(fs->ftype)) {
         if (fatfs_dir_buf_add((FATFS_INFO *) fs,
-                TSK_FS_ORPHANDIR_INUM(fs), a_fs_file->meta->addr))
-            return TSK_WALK_ERROR;
+                TSK_FS_ORPHANDIR_INUM(fs), a_cand->addr))
+            return 1;
     }
 
     /* Go into directories to mark their contents as "seen" */
-    if (a_fs_file->meta->type == TSK_FS_META_TYPE_DIR) {
+    if (a_cand->type == TSK_FS_META_TYPE_DIR) {
 
         if (tsk_verbose)
             fprintf(stderr,
-                "find_orphan_meta_walk_cb: Going into directory %" PRIuINUM
-                " to mark contents as seen\n", a_fs_file->meta->addr);
+                "find_orphan_add: Going into directory %" PRIuINUM
+                " to mark contents as seen\n", a_cand->addr);
 
-        if (tsk_fs_dir_walk(fs, a_fs_file->meta->addr,
+        if (tsk_fs_dir_walk(fs, a_cand->addr,
                 TSK_FS_DIR_WALK_FLAG_UNALLOC | TSK_FS_DIR_WALK_FLAG_RECURSE
                 | TSK_FS_DIR_WALK_FLAG_NOORPHAN, load_orphan_dir_walk_cb,
                 data)) {
             tsk_error_errstr2_concat
-                (" - find_orphan_meta_walk_cb: identifying inodes allocated by file names");
-            return TSK_WALK_ERROR;
+                (" - find_orphan_add: identifying inodes allocated by file names");
+            return 1;
         }
     }
 
-    return TSK_WALK_CONT;
+    return 0;
+}
+
+/* Frees the candidate list of the orphan search */
+static void
+find_orphan_cands_free(FIND_ORPHAN_DATA * data)
+{
+    size_t i;
+    for (i = 0; i < data->cands_used; i++)
+        free(data->cands[i].name);
+    free(data->cands);
+    data->cands = NULL;
+    data->cands_used = 0;
+    data->cands_alloc = 0;
 }
 
 
@@ -1130,6 +1374,23 @@ tsk_fs_dir_add_orphan_dir_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR * a_fs_dir)
     return 0;
 }
 
+/**
+ * \ingroup fslib
+ * Set the number of threads that walk the unallocated metadata structures
+ * when the file system is first searched for orphan files.  By default,
+ * only the calling thread is used.  Other threads are only used if the
+ * file system supports tsk_fs_meta_walk_parallel().
+ * @param a_fs File system to set the count for
+ * @param a_threads Number of threads to use (0 to use one per processor)
+ */
+void
+tsk_fs_dir_set_orphan_threads(TSK_FS_INFO * a_fs, unsigned int a_threads)
+{
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG))
+        return;
+    a_fs->orphan_threads = a_threads;
+}
+
 /** \internal
  * Search the file system for orphan files and create the orphan file directory.
  * @param a_fs File system to search
@@ -1171,10 +1432,11 @@ tsk_fs_dir_find_orphans(TSK_FS_INFO * a_fs, TSK_FS_DIR * a_fs_dir)
         tsk_release_lock(&a_fs->orphan_dir_lock);
         return TSK_ERR;
     }
-    // note that list_inum_named could still be NULL if there are no deleted names.
 
     /* Now we walk the unallocated metadata structures and find ones that are
-     * not named.  The callback will add the names to the FS_DIR structure.
+     * not named.  The walk is split across threads and the callback only
+     * collects the unnamed ones.  They are then added to the FS_DIR
+     * structure in address order, as a single-threaded walk would.
      */
     data.fs_dir = a_fs_dir;
 
@@ -1188,13 +1450,30 @@ tsk_fs_dir_find_orphans(TSK_FS_INFO * a_fs, TSK_FS_DIR * a_fs_dir)
         fprintf(stderr,
             "tsk_fs_dir_find_orphans: Performing inode_walk to find unnamed metadata structures\n");
 
-    if (tsk_fs_meta_walk(a_fs, a_fs->first_inum, a_fs->last_inum,
+    tsk_init_lock(&data.cand_lock);
+    if (tsk_fs_meta_walk_parallel(a_fs, a_fs->first_inum, a_fs->last_inum,
             TSK_FS_META_FLAG_UNALLOC | TSK_FS_META_FLAG_USED,
-            find_orphan_meta_walk_cb, &data)) {
+            find_orphan_meta_walk_cb, &data, a_fs->orphan_threads,
+            TSK_FS_META_WALK_PAR_FLAG_NONE)) {
+        tsk_deinit_lock(&data.cand_lock);
+        find_orphan_cands_free(&data);
         tsk_fs_name_free(data.fs_name);
         tsk_release_lock(&a_fs->orphan_dir_lock);
         return TSK_ERR;
     }
+    tsk_deinit_lock(&data.cand_lock);
+
+    qsort(data.cands, data.cands_used, sizeof(FIND_ORPHAN_CAND),
+        find_orphan_cand_compare);
+    for (i = 0; i < data.cands_used; i++) {
+        if (find_orphan_add(a_fs, &data, &data.cands[i])) {
+            find_orphan_cands_free(&data);
+            tsk_fs_name_free(data.fs_name);
+            tsk_release_lock(&a_fs->orphan_dir_lock);
+            return TSK_ERR;
+        }
+    }
+    find_orphan_cands_free(&data);
 
     tsk_fs_name_free(data.fs_name);
     data.fs_name = NULL;
@@ -1212,7 +1491,7 @@ tsk_fs_dir_find_orphans(TSK_FS_INFO * a_fs, TSK_FS_DIR * a_fs_dir)
         if (tsk_list_find(data.orphan_subdir_list,
                 a_fs_dir->names[i].meta_addr)) {
             if (a_fs_dir->names_used > 1) {
-                tsk_fs_name_copy(&a_fs_dir->names[i],
+                tsk_fs_dir_name_copy(a_fs_dir, &a_fs_dir->names[i],
                     &a_fs_dir->names[a_fs_dir->names_used - 1]);
             }
             a_fs_dir->names_used--;
@@ -78,6 +78,25 @@ tsk_fs_file_close(TSK_FS_FILE * a_fs_file)
 
 
 
+/* Load the runs of all attributes of a file that the file system has
+ * not loaded yet.  Returns 1 on error. */
+static uint8_t
+fs_file_resolve_attrs(TSK_FS_FILE * a_fs_file)
+{
+    TSK_FS_ATTR *fs_attr;
+
+    if (a_fs_file->meta->attr == NULL)
+        return 0;
+
+    for (fs_attr = a_fs_file->meta->attr->head; fs_attr;
+        fs_attr = fs_attr->next) {
+        if ((fs_attr->flags & TSK_FS_ATTR_INUSE)
+            && (tsk_fs_attr_resolve(fs_attr)))
+            return 1;
+    }
+    return 0;
+}
+
 /** 
 * \ingroup fslib
 *
@@ -88,7 +107,9 @@ tsk_fs_file_close(TSK_FS_FILE * a_fs_file)
 * directory structure to find the name that points to the address.   In general,
 * if you know the metadata address of a file, this function is more effecient 
 * then tsk_fs_file_open, which first maps a file name to the metadata address 
-* and then opens the file using this function. 
+* and then opens the file using this function. If the metadata cache has been
+* enabled with tsk_fs_meta_cache_set_size(), the returned TSK_FS_META structure
+* may be shared with other open files and must not be modified.
 *
 * @param a_fs File system to analyze
 * @param a_fs_file Structure to store file data in or NULL to have one allocated. 
@@ -100,6 +121,7 @@ tsk_fs_file_open_meta(TSK_FS_INFO * a_fs,
     TSK_FS_FILE * a_fs_file, TSK_INUM_T a_addr)
 {
     TSK_FS_FILE *fs_file;
+    TSK_FS_META *meta;
 
     if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)) {
         tsk_error_set_errno(TSK_ERR_FS_ARG);
@@ -121,16 +143,46 @@ tsk_fs_file_open_meta(TSK_FS_INFO * a_fs,
             fs_file->name = NULL;
         }
 
+        /* a shared structure from the metadata cache cannot be reused */
+        if ((fs_file->meta) && (fs_file->meta->cache_entry)) {
+            tsk_fs_meta_close(fs_file->meta);
+            fs_file->meta = NULL;
+        }
+
         // reset the rest of it
         tsk_fs_file_reset(fs_file);
     }
 
+    // see if it has already been loaded
+    if ((meta = tsk_fs_meta_cache_get(a_fs, a_addr)) != NULL) {
+        if (fs_file->meta)
+            tsk_fs_meta_close(fs_file->meta);
+        fs_file->meta = meta;
+        return fs_file;
+    }
+
     if (a_fs->file_add_meta(a_fs, fs_file, a_addr)) {
         if (a_fs_file == NULL)
             free(fs_file);
         return NULL;
     }
 
+    /* Only fully loaded structures can be shared, so load the attributes
+     * (and all of their runs) now.  If that fails, the file is still
+     * returned but not cached. */
+    if ((a_fs->meta_cache) && (a_fs->meta_cache->size)) {
+        if (((fs_file->meta->attr_state == TSK_FS_META_ATTR_STUDIED)
+                || (a_fs->load_attrs(fs_file) == 0))
+            && (fs_file_resolve_attrs(fs_file) == 0)) {
+            tsk_fs_meta_cache_add(a_fs, fs_file->meta);
+        }
+        else {
+            if (tsk_verbose)
+                tsk_error_print(stderr);
+            tsk_error_reset();
+        }
+    }
+
     return fs_file;
 }
 
@@ -345,6 +397,49 @@ tsk_fs_file_attr_get_id(TSK_FS_FILE * a_fs_file, uint16_t a_id)
 }
 
 
+/* State of fs_file_attr_walk_cb() */
+typedef struct {
+    TSK_FS_FILE *fs_file;       // file that the caller walks
+    TSK_FS_FILE_WALK_CB action; // caller's callback
+    void *ptr;                  // caller's pointer
+} FS_FILE_WALK_DATA;
+
+/* Passes the caller's file to the caller's callback in place of the file
+ * that the attribute points to */
+static TSK_WALK_RET_ENUM
+fs_file_attr_walk_cb(TSK_FS_FILE * a_fs_file, TSK_OFF_T a_off,
+    TSK_DADDR_T a_addr, char *a_buf, size_t a_len,
+    TSK_FS_BLOCK_FLAG_ENUM a_flags, void *a_ptr)
+{
+    FS_FILE_WALK_DATA *data = (FS_FILE_WALK_DATA *) a_ptr;
+
+    // a_fs_file is the file that the attribute points to; the caller's
+    // file comes from a_ptr
+    (void) a_fs_file;
+    return data->action(data->fs_file, a_off, a_addr, a_buf, a_len,
+        a_flags, data->ptr);
+}
+
+/* Walk an attribute of a_fs_file.  When the metadata is shared through
+ * the metadata cache, the attribute points to a file that is owned by the
+ * cache and has no name, so the callback is given a_fs_file instead. */
+static uint8_t
+fs_file_attr_walk(TSK_FS_FILE * a_fs_file, const TSK_FS_ATTR * a_fs_attr,
+    TSK_FS_FILE_WALK_FLAG_ENUM a_flags, TSK_FS_FILE_WALK_CB a_action,
+    void *a_ptr)
+{
+    FS_FILE_WALK_DATA data;
+
+    if (a_fs_attr->fs_file == a_fs_file)
+        return tsk_fs_attr_walk(a_fs_attr, a_flags, a_action, a_ptr);
+
+    data.fs_file = a_fs_file;
+    data.action = a_action;
+    data.ptr = a_ptr;
+    return tsk_fs_attr_walk(a_fs_attr, a_flags, fs_file_attr_walk_cb,
+        &data);
+}
+
 /**
 * \ingroup fslib
  * Process a specific attribute in a file and call a callback function with the file contents. The callback will be 
@@ -399,7 +494,7 @@ tsk_fs_file_walk_type(TSK_FS_FILE * a_fs_file,
                 (a_flags & TSK_FS_FILE_WALK_FLAG_NOID) ? 0 : 1)) == NULL)
         return 1;
 
-    return tsk_fs_attr_walk(fs_attr, a_flags, a_action, a_ptr);
+    return fs_file_attr_walk(a_fs_file, fs_attr, a_flags, a_action, a_ptr);
 }
 
 /**
@@ -451,7 +546,7 @@ tsk_fs_file_walk(TSK_FS_FILE * a_fs_file,
     if ((fs_attr = tsk_fs_file_attr_get(a_fs_file)) == NULL)
         return 1;
 
-    return tsk_fs_attr_walk(fs_attr, a_flags, a_action, a_ptr);
+    return fs_file_attr_walk(a_fs_file, fs_attr, a_flags, a_action, a_ptr);
 }
 
 
@@ -97,6 +97,11 @@ tsk_fs_meta_close(TSK_FS_META * fs_meta)
     if ((!fs_meta) || (fs_meta->tag != TSK_FS_META_TAG))
         return;
 
+    // shared structures are freed only when the last user closes them
+    if ((fs_meta->cache_entry)
+        && (tsk_fs_meta_cache_release(fs_meta) == 0))
+        return;
+
     // clear the tag so we know the structure isn't alloc
     fs_meta->tag = 0;
 
@@ -198,3 +203,81 @@ tsk_fs_meta_walk(TSK_FS_INFO * a_fs, TSK_INUM_T a_start,
 
     return a_fs->inode_walk(a_fs, a_start, a_end, a_flags, a_cb, a_ptr);
 }
+
+
+/* State passed through tsk_fs_meta_walk() by tsk_fs_meta_walk_content() */
+typedef struct {
+    TSK_FS_META_CONTENT_WALK_CB cb;
+    void *ptr;
+} TSK_FS_META_CONTENT_WALK;
+
+static TSK_WALK_RET_ENUM
+tsk_fs_meta_walk_content_act(TSK_FS_FILE * a_fs_file, void *a_ptr)
+{
+    TSK_FS_META_CONTENT_WALK *walk = (TSK_FS_META_CONTENT_WALK *) a_ptr;
+    const TSK_FS_ATTR *fs_attr = NULL;
+
+    /* Only regular files have content to hand back.  The attributes
+     * were already loaded from the metadata buffer by the file system
+     * code, so this does not go back to the image. */
+    if ((a_fs_file->meta->type == TSK_FS_META_TYPE_REG)
+        && (a_fs_file->meta->size > 0)) {
+        fs_attr = tsk_fs_file_attr_get(a_fs_file);
+        if (fs_attr == NULL)
+            tsk_error_reset();
+    }
+
+    if ((fs_attr) && (fs_attr->flags & TSK_FS_ATTR_RES)
+        && ((fs_attr->flags & TSK_FS_ATTR_COMP) == 0)
+        && (fs_attr->rd.buf) && (fs_attr->size >= 0)
+        && ((size_t) fs_attr->size <= fs_attr->rd.buf_size)) {
+        return walk->cb(a_fs_file, fs_attr, (const char *) fs_attr->rd.buf,
+            (size_t) fs_attr->size, walk->ptr);
+    }
+
+    return walk->cb(a_fs_file, fs_attr, NULL, 0, walk->ptr);
+}
+
+/**
+ * \ingroup fslib
+ * Walk a range of metadata structures like tsk_fs_meta_walk() does, but
+ * also pass the content of files whose default data attribute is resident
+ * (i.e. stored in the metadata structure itself, such as small NTFS
+ * files).  This allows the content of many small files to be processed
+ * from a single pass over the metadata without opening or reading each
+ * file.
+ *
+ * The callback gets the default attribute of regular files (NULL for
+ * other types or if it could not be loaded).  If the content is resident,
+ * a_buf points to its a_len bytes; otherwise a_buf is NULL and the caller
+ * should read the attribute as usual.  The buffer is only valid for the
+ * duration of the callback.
+ *
+ * @param a_fs File system to process
+ * @param a_start Metadata address to start walking from
+ * @param a_end Metadata address to walk to
+ * @param a_flags Flags that specify the desired metadata features
+ * @param a_cb Callback function to call
+ * @param a_ptr Pointer to pass to the callback
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_meta_walk_content(TSK_FS_INFO * a_fs, TSK_INUM_T a_start,
+    TSK_INUM_T a_end, TSK_FS_META_FLAG_ENUM a_flags,
+    TSK_FS_META_CONTENT_WALK_CB a_cb, void *a_ptr)
+{
+    TSK_FS_META_CONTENT_WALK walk;
+
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG) || (a_cb == NULL)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("tsk_fs_meta_walk_content: called with NULL or unallocated structures");
+        return 1;
+    }
+
+    walk.cb = a_cb;
+    walk.ptr = a_ptr;
+    return a_fs->inode_walk(a_fs, a_start, a_end, a_flags,
+        tsk_fs_meta_walk_content_act, &walk);
+}
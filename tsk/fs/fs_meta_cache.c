@@ -0,0 +1,448 @@
+/*
+ * The Sleuth Kit
+ *
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2011 Brian Carrier.  All Rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file fs_meta_cache.c
+ * Contains the functions that maintain the per-file system LRU cache of
+ * TSK_FS_META structures that tsk_fs_file_open_meta() uses to avoid
+ * re-loading and re-parsing the same metadata structures.
+ *
+ * Cached structures are shared by every TSK_FS_FILE that opens the same
+ * address and are reference counted.  They are fully loaded (attr_state
+ * is TSK_FS_META_ATTR_STUDIED) before they are shared, so they are not
+ * modified while they are in use.  Each entry has its own TSK_FS_FILE that
+ * the attributes point to so that they stay valid no matter which of the
+ * files that share them is closed first.
+ */
+
+#include "tsk_fs_i.h"
+
+/* Returns the hash bucket for a metadata address */
+static size_t
+meta_cache_bucket(const TSK_FS_META_CACHE * a_cache, TSK_INUM_T a_addr)
+{
+    uint64_t h = (uint64_t) a_addr * 0x9E3779B97F4A7C15ULL;
+    return (size_t) (h >> 32) & (a_cache->bucket_cnt - 1);
+}
+
+/* Returns the entry for a_addr or NULL.  Must hold the cache lock. */
+static TSK_FS_META_CACHE_ENTRY *
+meta_cache_find(const TSK_FS_META_CACHE * a_cache, TSK_INUM_T a_addr)
+{
+    TSK_FS_META_CACHE_ENTRY *entry;
+
+    if (a_cache->bucket_cnt == 0)
+        return NULL;
+
+    for (entry = a_cache->buckets[meta_cache_bucket(a_cache, a_addr)];
+        entry != NULL; entry = entry->hnext) {
+        if (entry->fs_file.meta->addr == a_addr)
+            return entry;
+    }
+    return NULL;
+}
+
+/* Unlink an entry from the LRU list.  Must hold the cache lock. */
+static void
+meta_cache_lru_unlink(TSK_FS_META_CACHE * a_cache,
+    TSK_FS_META_CACHE_ENTRY * a_entry)
+{
+    if (a_entry->lru_prev)
+        a_entry->lru_prev->lru_next = a_entry->lru_next;
+    else
+        a_cache->lru_head = a_entry->lru_next;
+    if (a_entry->lru_next)
+        a_entry->lru_next->lru_prev = a_entry->lru_prev;
+    else
+        a_cache->lru_tail = a_entry->lru_prev;
+    a_entry->lru_prev = a_entry->lru_next = NULL;
+}
+
+/* Add an entry to the front (most recently used) of the LRU list. Must
+ * hold the cache lock. */
+static void
+meta_cache_lru_push(TSK_FS_META_CACHE * a_cache,
+    TSK_FS_META_CACHE_ENTRY * a_entry)
+{
+    a_entry->lru_prev = NULL;
+    a_entry->lru_next = a_cache->lru_head;
+    if (a_cache->lru_head)
+        a_cache->lru_head->lru_prev = a_entry;
+    else
+        a_cache->lru_tail = a_entry;
+    a_cache->lru_head = a_entry;
+}
+
+/* Remove an entry from the cache.  Returns the meta structure if no file
+ * is using it (the caller must close it once the lock is released) or
+ * NULL if files still have it open.  In that case the entry is detached
+ * and it is freed when the last file closes it.  Must hold the cache lock. */
+static TSK_FS_META *
+meta_cache_remove(TSK_FS_META_CACHE * a_cache,
+    TSK_FS_META_CACHE_ENTRY * a_entry)
+{
+    TSK_FS_META_CACHE_ENTRY **prev;
+    TSK_FS_META *fs_meta = a_entry->fs_file.meta;
+
+    prev =
+        &a_cache->buckets[meta_cache_bucket(a_cache, fs_meta->addr)];
+    while (*prev != a_entry)
+        prev = &(*prev)->hnext;
+    *prev = a_entry->hnext;
+    a_entry->hnext = NULL;
+
+    meta_cache_lru_unlink(a_cache, a_entry);
+    a_entry->in_cache = 0;
+    a_cache->used--;
+
+    if (a_entry->refs) {
+        a_cache->detached++;
+        return NULL;
+    }
+
+    fs_meta->cache_entry = NULL;
+    free(a_entry);
+    return fs_meta;
+}
+
+/* Remove all entries from the cache and close the ones that are not in
+ * use.  Must hold the cache lock when called and it is released before
+ * the structures are closed. */
+static void
+meta_cache_clear_and_unlock(TSK_FS_META_CACHE * a_cache)
+{
+    TSK_FS_META *free_list = NULL;
+    TSK_FS_META *fs_meta;
+
+    // chain the structures to close through their (now unused)
+    // cache_entry field so that no memory is needed while holding the lock
+    while (a_cache->lru_head) {
+        fs_meta = meta_cache_remove(a_cache, a_cache->lru_head);
+        if (fs_meta) {
+            fs_meta->cache_entry = (TSK_FS_META_CACHE_ENTRY *) free_list;
+            free_list = fs_meta;
+        }
+    }
+    tsk_release_lock(&a_cache->lock);
+
+    while (free_list) {
+        fs_meta = free_list;
+        free_list = (TSK_FS_META *) fs_meta->cache_entry;
+        fs_meta->cache_entry = NULL;
+        tsk_fs_meta_close(fs_meta);
+    }
+}
+
+/* Free the cache structure itself */
+static void
+meta_cache_destroy(TSK_FS_META_CACHE * a_cache)
+{
+    free(a_cache->buckets);
+    tsk_deinit_lock(&a_cache->lock);
+    free(a_cache);
+}
+
+/**
+ * \internal
+ * Allocate an empty (disabled) metadata cache.
+ * @returns NULL on error
+ */
+TSK_FS_META_CACHE *
+tsk_fs_meta_cache_alloc()
+{
+    TSK_FS_META_CACHE *cache;
+
+    if ((cache =
+            (TSK_FS_META_CACHE *) tsk_malloc(sizeof(TSK_FS_META_CACHE)))
+        == NULL)
+        return NULL;
+
+    tsk_init_lock(&cache->lock);
+    return cache;
+}
+
+/**
+ * \internal
+ * Called when the file system is closed.  Closes the cached structures
+ * that are not in use.  Structures that files still have open are freed
+ * when they are closed and the cache is freed with the last of them.
+ *
+ * @param a_cache Cache to free
+ */
+void
+tsk_fs_meta_cache_free(TSK_FS_META_CACHE * a_cache)
+{
+    uint8_t done;
+
+    if (a_cache == NULL)
+        return;
+
+    tsk_take_lock(&a_cache->lock);
+    a_cache->closed = 1;
+    a_cache->size = 0;
+    done = (a_cache->detached == 0) && (a_cache->used == 0);
+    if (a_cache->used) {
+        meta_cache_clear_and_unlock(a_cache);
+        tsk_take_lock(&a_cache->lock);
+        done = (a_cache->detached == 0);
+    }
+    tsk_release_lock(&a_cache->lock);
+
+    if (done)
+        meta_cache_destroy(a_cache);
+}
+
+/**
+ * \internal
+ * Look up a metadata address in the cache.  On a hit, the returned
+ * structure is shared with the caller and must be released with
+ * tsk_fs_meta_close().
+ *
+ * @param a_fs File system to look in
+ * @param a_addr Metadata address to find
+ * @returns Shared structure or NULL if the address is not cached
+ */
+TSK_FS_META *
+tsk_fs_meta_cache_get(TSK_FS_INFO * a_fs, TSK_INUM_T a_addr)
+{
+    TSK_FS_META_CACHE *cache = a_fs->meta_cache;
+    TSK_FS_META_CACHE_ENTRY *entry;
+    TSK_FS_META *fs_meta = NULL;
+
+    if (cache == NULL)
+        return NULL;
+
+    tsk_take_lock(&cache->lock);
+    if (cache->size == 0) {
+        tsk_release_lock(&cache->lock);
+        return NULL;
+    }
+    if ((entry = meta_cache_find(cache, a_addr)) != NULL) {
+        entry->refs++;
+        if (cache->lru_head != entry) {
+            meta_cache_lru_unlink(cache, entry);
+            meta_cache_lru_push(cache, entry);
+        }
+        fs_meta = entry->fs_file.meta;
+        cache->hits++;
+    }
+    else {
+        cache->misses++;
+    }
+    tsk_release_lock(&cache->lock);
+
+    return fs_meta;
+}
+
+/**
+ * \internal
+ * Add a fully loaded metadata structure to the cache.  If it is added,
+ * it becomes shared and the caller's use of it is counted so that it must
+ * still be released with tsk_fs_meta_close().  If the address is already
+ * cached or every entry is in use, the structure remains private to the
+ * caller.
+ *
+ * @param a_fs File system that the structure is from
+ * @param a_fs_meta Structure to add (its attributes must be loaded)
+ */
+void
+tsk_fs_meta_cache_add(TSK_FS_INFO * a_fs, TSK_FS_META * a_fs_meta)
+{
+    TSK_FS_META_CACHE *cache = a_fs->meta_cache;
+    TSK_FS_META_CACHE_ENTRY *entry, *cur;
+    TSK_FS_META *evicted = NULL;
+    TSK_FS_ATTR *fs_attr;
+    size_t bucket;
+
+    if ((cache == NULL) || (a_fs_meta->cache_entry)
+        || (a_fs_meta->attr_state != TSK_FS_META_ATTR_STUDIED)
+        || (a_fs_meta->attr == NULL))
+        return;
+
+    tsk_take_lock(&cache->lock);
+
+    // another thread may have beaten us to it
+    if ((cache->size == 0)
+        || (meta_cache_find(cache, a_fs_meta->addr) != NULL)) {
+        tsk_release_lock(&cache->lock);
+        return;
+    }
+
+    if ((entry =
+            (TSK_FS_META_CACHE_ENTRY *)
+            tsk_malloc(sizeof(TSK_FS_META_CACHE_ENTRY))) == NULL) {
+        tsk_release_lock(&cache->lock);
+        tsk_error_reset();
+        return;
+    }
+
+    // evict the least recently used entry that no file has open
+    if (cache->used >= cache->size) {
+        for (cur = cache->lru_tail; cur != NULL; cur = cur->lru_prev) {
+            if (cur->refs == 0)
+                break;
+        }
+        if (cur == NULL) {
+            tsk_release_lock(&cache->lock);
+            free(entry);
+            return;
+        }
+        evicted = meta_cache_remove(cache, cur);
+        cache->evictions++;
+    }
+
+    entry->fs_file.tag = TSK_FS_FILE_TAG;
+    entry->fs_file.fs_info = a_fs;
+    entry->fs_file.meta = a_fs_meta;
+    entry->cache = cache;
+    entry->refs = 1;
+    entry->in_cache = 1;
+
+    // the attributes must not point to the caller's file, which can be
+    // closed before the other users of the structure are done with it
+    for (fs_attr = a_fs_meta->attr->head; fs_attr; fs_attr = fs_attr->next)
+        fs_attr->fs_file = &entry->fs_file;
+    a_fs_meta->cache_entry = entry;
+
+    bucket = meta_cache_bucket(cache, a_fs_meta->addr);
+    entry->hnext = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    meta_cache_lru_push(cache, entry);
+    cache->used++;
+
+    tsk_release_lock(&cache->lock);
+
+    if (evicted)
+        tsk_fs_meta_close(evicted);
+}
+
+/**
+ * \internal
+ * Release a file's use of a shared metadata structure.  This is called
+ * by tsk_fs_meta_close() for structures that came from the cache.
+ *
+ * @param a_fs_meta Structure to release
+ * @returns 1 if the caller should now free the structure and 0 if it
+ * is still in use or cached.
+ */
+uint8_t
+tsk_fs_meta_cache_release(TSK_FS_META * a_fs_meta)
+{
+    TSK_FS_META_CACHE_ENTRY *entry = a_fs_meta->cache_entry;
+    TSK_FS_META_CACHE *cache = entry->cache;
+    uint8_t free_meta = 0;
+    uint8_t free_cache = 0;
+
+    tsk_take_lock(&cache->lock);
+    entry->refs--;
+    if ((entry->refs == 0) && (entry->in_cache == 0)) {
+        // it was evicted or the file system was closed while it was open
+        a_fs_meta->cache_entry = NULL;
+        free(entry);
+        free_meta = 1;
+        cache->detached--;
+        free_cache = (cache->closed) && (cache->detached == 0);
+    }
+    tsk_release_lock(&cache->lock);
+
+    if (free_cache)
+        meta_cache_destroy(cache);
+    return free_meta;
+}
+
+/**
+ * \ingroup fslib
+ * Set the number of metadata structures that tsk_fs_file_open_meta() keeps
+ * in memory for a file system.  When enabled, files that are opened again
+ * by address share the already loaded TSK_FS_META structure and its
+ * attributes instead of loading them from disk again.  Shared structures
+ * must be treated as read-only and the TSK_FS_ATTR::fs_file pointers of
+ * their attributes refer to a file handle that is owned by the cache.
+ * The cache is disabled by default and it is freed when the file system
+ * is closed.  Changing the size empties the cache.
+ *
+ * @param a_fs File system to configure
+ * @param a_count Maximum number of structures to keep (0 to disable)
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_meta_cache_set_size(TSK_FS_INFO * a_fs, size_t a_count)
+{
+    TSK_FS_META_CACHE *cache;
+    TSK_FS_META_CACHE_ENTRY **buckets = NULL;
+    size_t bucket_cnt = 0;
+
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)
+        || (a_fs->meta_cache == NULL)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("tsk_fs_meta_cache_set_size: called with NULL or unallocated structures");
+        return 1;
+    }
+    cache = a_fs->meta_cache;
+
+    if (a_count) {
+        for (bucket_cnt = 16; bucket_cnt < a_count; bucket_cnt <<= 1);
+
+        if ((buckets =
+                (TSK_FS_META_CACHE_ENTRY **) tsk_malloc(bucket_cnt *
+                    sizeof(TSK_FS_META_CACHE_ENTRY *))) == NULL)
+            return 1;
+    }
+
+    // disable the cache while it is emptied so that nothing new is added
+    tsk_take_lock(&cache->lock);
+    cache->size = 0;
+    meta_cache_clear_and_unlock(cache);
+
+    tsk_take_lock(&cache->lock);
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_cnt = bucket_cnt;
+    cache->size = a_count;
+    tsk_release_lock(&cache->lock);
+
+    return 0;
+}
+
+/**
+ * \ingroup fslib
+ * Get the usage statistics of the metadata cache of a file system.
+ * See tsk_fs_meta_cache_set_size().
+ *
+ * @param a_fs File system to query
+ * @param a_stats Structure to store the statistics in
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_meta_cache_get_stats(TSK_FS_INFO * a_fs,
+    TSK_FS_META_CACHE_STATS * a_stats)
+{
+    TSK_FS_META_CACHE *cache;
+
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)
+        || (a_fs->meta_cache == NULL) || (a_stats == NULL)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("tsk_fs_meta_cache_get_stats: called with NULL or unallocated structures");
+        return 1;
+    }
+    cache = a_fs->meta_cache;
+
+    tsk_take_lock(&cache->lock);
+    a_stats->size = cache->size;
+    a_stats->used = cache->used;
+    a_stats->hits = cache->hits;
+    a_stats->misses = cache->misses;
+    a_stats->evictions = cache->evictions;
+    tsk_release_lock(&cache->lock);
+    return 0;
+}
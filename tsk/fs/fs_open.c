@@ -293,10 +293,21 @@ tsk_fs_malloc(size_t a_len)
     TSK_FS_INFO *fs_info;
     if ((fs_info = (TSK_FS_INFO *) tsk_malloc(a_len)) == NULL)
         return NULL;
-    tsk_init_lock(&fs_info->list_inum_named_lock);
+    tsk_init_lock(&fs_info->inum_named_lock);
     tsk_init_lock(&fs_info->orphan_dir_lock);
+    tsk_init_lock(&fs_info->attr_run_lock);
 
+    fs_info->inum_named = NULL;
     fs_info->list_inum_named = NULL;
+    fs_info->orphan_threads = 1;
+
+    if ((fs_info->meta_cache = tsk_fs_meta_cache_alloc()) == NULL) {
+        tsk_deinit_lock(&fs_info->inum_named_lock);
+        tsk_deinit_lock(&fs_info->orphan_dir_lock);
+        tsk_deinit_lock(&fs_info->attr_run_lock);
+        free(fs_info);
+        return NULL;
+    }
 
     return fs_info;
 }
@@ -307,6 +318,10 @@ tsk_fs_malloc(size_t a_len)
 void
 tsk_fs_free(TSK_FS_INFO * a_fs_info)
 {
+    if (a_fs_info->inum_named) {
+        free(a_fs_info->inum_named);
+        a_fs_info->inum_named = NULL;
+    }
     if (a_fs_info->list_inum_named) {
         tsk_list_free(a_fs_info->list_inum_named);
         a_fs_info->list_inum_named = NULL;
@@ -321,9 +336,12 @@ tsk_fs_free(TSK_FS_INFO * a_fs_info)
         a_fs_info->orphan_dir = NULL;
     }
 
+    tsk_fs_meta_cache_free(a_fs_info->meta_cache);
+    a_fs_info->meta_cache = NULL;
 
-    tsk_deinit_lock(&a_fs_info->list_inum_named_lock);
+    tsk_deinit_lock(&a_fs_info->inum_named_lock);
     tsk_deinit_lock(&a_fs_info->orphan_dir_lock);
+    tsk_deinit_lock(&a_fs_info->attr_run_lock);
 
     free(a_fs_info);
 }
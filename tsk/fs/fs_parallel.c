@@ -0,0 +1,845 @@
+/*
+ * The Sleuth Kit
+ *
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2011 Brian Carrier.  All Rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file fs_parallel.c
+ * Contains the functions that walk the metadata structures of a file system
+ * with several worker threads.  The requested range of addresses is split
+ * into chunks and each worker runs the file system's own inode_walk on the
+ * chunks that it claims, so every worker has its own TSK_FS_FILE and
+ * buffers.  This is only done for file systems that set
+ * TSK_FS_INFO_FLAG_PAR_INODE_WALK; the others are walked serially.
+ * tsk_fs_par_for() and the tsk_fs_par_pool_* functions are simpler helpers
+ * that run a callback on a range of indices with worker threads.
+ */
+
+#include "tsk_fs_i.h"
+
+#ifdef TSK_MULTITHREAD_LIB
+#ifdef TSK_WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#endif
+
+/* Number of metadata addresses in each chunk of work, unless the file
+ * system has a natural grouping (TSK_FS_INFO.inum_group_size) */
+#define TSK_FS_PAR_CHUNK_SIZE 4096
+
+/* Largest chunk when the results are delivered in order.  Each queued
+ * result holds an open TSK_FS_FILE, so this bounds the memory use. */
+#define TSK_FS_PAR_ORDERED_CHUNK_SIZE 1024
+
+/* Upper limit on the number of worker threads */
+#define TSK_FS_PAR_MAX_THREADS 64
+
+
+#ifdef TSK_MULTITHREAD_LIB
+
+#ifdef TSK_WIN32
+typedef HANDLE tsk_par_thread_t;
+typedef CONDITION_VARIABLE tsk_par_cond_t;
+typedef unsigned (__stdcall * tsk_par_thread_main_t) (void *);
+#else
+typedef pthread_t tsk_par_thread_t;
+typedef pthread_cond_t tsk_par_cond_t;
+typedef void *(*tsk_par_thread_main_t) (void *);
+#endif
+
+/* Results of one chunk in an ordered walk */
+typedef struct {
+    TSK_FS_FILE **files;        // files that matched, in address order
+    size_t cnt;                 // number of entries in files
+    size_t alloc;               // number of entries allocated in files
+    uint8_t done;               // set when the worker has finished the chunk
+} TSK_FS_PAR_SLOT;
+
+/* State that is shared by the caller and the worker threads */
+typedef struct {
+    TSK_FS_INFO *fs;
+    TSK_FS_META_FLAG_ENUM flags;
+    TSK_FS_META_WALK_CB action;
+    void *ptr;
+    uint8_t ordered;
+
+    TSK_INUM_T start;           // first address to walk
+    TSK_INUM_T end;             // last address to walk
+    TSK_INUM_T chunk_size;      // addresses in each aligned chunk
+    size_t chunk_first;         // index of the chunk that contains start
+    size_t chunk_cnt;           // number of chunks to walk
+
+    tsk_lock_t lock;            // protects the fields below
+    tsk_par_cond_t cond;        // signalled when a field below changes
+    size_t next_chunk;          // next chunk (relative to chunk_first) to claim
+    size_t delivered;           // ordered: chunks that were given to the caller
+    size_t window;              // ordered: max chunks claimed beyond delivered
+    TSK_FS_PAR_SLOT *slots;     // ordered: results, indexed by chunk % window
+    uint8_t stop;               // set to end the walk early
+    uint8_t failed;             // set if a worker had an error
+
+    uint32_t err_no;            // error of the first worker that failed
+    char errstr[TSK_ERROR_STRING_MAX_LENGTH + 1];
+    char errstr2[TSK_ERROR_STRING_MAX_LENGTH + 1];
+} TSK_FS_PAR_WALK;
+
+/* Per worker data that is passed to the inode_walk callback */
+typedef struct {
+    TSK_FS_PAR_WALK *walk;
+    TSK_FS_PAR_SLOT *slot;
+} TSK_FS_PAR_WORKER;
+
+/* Worker threads that stay around to run several tsk_fs_par_pool_run()
+ * jobs.  Everything below lock is protected by it. */
+struct TSK_FS_PAR_POOL {
+    tsk_par_thread_t threads[TSK_FS_PAR_MAX_THREADS];
+    unsigned int thread_cnt;    // number of threads that were started
+    tsk_lock_t lock;
+    tsk_par_cond_t cond;        // signaled when a job is posted or finished
+    TSK_FS_PAR_FOR_CB func;     // function of the current job
+    void *ptr;
+    size_t cnt;                 // number of indexes in the current job
+    size_t next;                // next index to claim
+    unsigned int busy;          // number of indexes being processed
+    uint8_t quit;               // set when the threads should exit
+};
+
+
+static void
+par_cond_init(tsk_par_cond_t * a_cond)
+{
+#ifdef TSK_WIN32
+    InitializeConditionVariable(a_cond);
+#else
+    pthread_cond_init(a_cond, NULL);
+#endif
+}
+
+static void
+par_cond_deinit(tsk_par_cond_t * a_cond)
+{
+#ifndef TSK_WIN32
+    pthread_cond_destroy(a_cond);
+#endif
+}
+
+/* Must hold a_lock */
+static void
+par_cond_wait(tsk_par_cond_t * a_cond, tsk_lock_t * a_lock)
+{
+#ifdef TSK_WIN32
+    SleepConditionVariableCS(a_cond, &a_lock->critical_section, INFINITE);
+#else
+    pthread_cond_wait(a_cond, &a_lock->mutex);
+#endif
+}
+
+static void
+par_cond_broadcast(tsk_par_cond_t * a_cond)
+{
+#ifdef TSK_WIN32
+    WakeAllConditionVariable(a_cond);
+#else
+    pthread_cond_broadcast(a_cond);
+#endif
+}
+
+/* Returns the number of processors or 1 if it is not known */
+static unsigned int
+par_cpu_count()
+{
+#ifdef TSK_WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long cnt = sysconf(_SC_NPROCESSORS_ONLN);
+    return cnt > 0 ? (unsigned int) cnt : 1;
+#else
+    return 1;
+#endif
+}
+
+/* Records the error of the current thread in the shared state and stops
+ * the walk.  Only the first error is kept.  Must hold the walk lock. */
+static void
+par_save_error(TSK_FS_PAR_WALK * a_walk)
+{
+    a_walk->stop = 1;
+    if (a_walk->failed)
+        return;
+    a_walk->failed = 1;
+    a_walk->err_no = tsk_error_get_errno();
+    strncpy(a_walk->errstr, tsk_error_get_errstr(),
+        TSK_ERROR_STRING_MAX_LENGTH);
+    strncpy(a_walk->errstr2, tsk_error_get_errstr2(),
+        TSK_ERROR_STRING_MAX_LENGTH);
+}
+
+/* Marks the walk as failed because of the current thread's error */
+static void
+par_fail(TSK_FS_PAR_WALK * a_walk)
+{
+    tsk_take_lock(&a_walk->lock);
+    par_save_error(a_walk);
+    par_cond_broadcast(&a_walk->cond);
+    tsk_release_lock(&a_walk->lock);
+}
+
+/* Marks the walk as stopped, such as when the callback returns STOP */
+static void
+par_stop(TSK_FS_PAR_WALK * a_walk)
+{
+    tsk_take_lock(&a_walk->lock);
+    a_walk->stop = 1;
+    par_cond_broadcast(&a_walk->cond);
+    tsk_release_lock(&a_walk->lock);
+}
+
+/* Returns 1 if the walk has been stopped */
+static uint8_t
+par_stopped(TSK_FS_PAR_WALK * a_walk)
+{
+    uint8_t stop;
+
+    tsk_take_lock(&a_walk->lock);
+    stop = a_walk->stop;
+    tsk_release_lock(&a_walk->lock);
+    return stop;
+}
+
+/* inode_walk callback of the workers when the results are not ordered.
+ * Passes the file straight to the caller's callback. */
+static TSK_WALK_RET_ENUM
+par_walk_cb(TSK_FS_FILE * a_fs_file, void *a_ptr)
+{
+    TSK_FS_PAR_WORKER *worker = (TSK_FS_PAR_WORKER *) a_ptr;
+    TSK_FS_PAR_WALK *walk = worker->walk;
+    TSK_WALK_RET_ENUM retval;
+
+    if (par_stopped(walk))
+        return TSK_WALK_STOP;
+
+    retval = walk->action(a_fs_file, walk->ptr);
+    if (retval == TSK_WALK_STOP)
+        par_stop(walk);
+    return retval;
+}
+
+/* Move the metadata that inode_walk loaded into a_fs_file to a new
+ * TSK_FS_FILE and give a_fs_file an empty structure to load the next entry
+ * into.  Returns NULL on error. */
+static TSK_FS_FILE *
+par_file_take(TSK_FS_FILE * a_fs_file)
+{
+    TSK_FS_FILE *fs_file;
+    TSK_FS_META *fs_meta;
+    TSK_FS_ATTR *fs_attr;
+
+    if ((fs_file = tsk_fs_file_alloc(a_fs_file->fs_info)) == NULL)
+        return NULL;
+    if ((fs_meta = tsk_fs_meta_alloc(a_fs_file->meta->content_len)) == NULL) {
+        tsk_fs_file_close(fs_file);
+        return NULL;
+    }
+    fs_file->meta = a_fs_file->meta;
+    a_fs_file->meta = fs_meta;
+
+    // attributes that were already loaded point back to their file
+    if (fs_file->meta->attr) {
+        for (fs_attr = fs_file->meta->attr->head; fs_attr;
+            fs_attr = fs_attr->next)
+            fs_attr->fs_file = fs_file;
+    }
+    return fs_file;
+}
+
+/* inode_walk callback of the workers when the results are ordered.  The
+ * file passed in is reused by inode_walk, so keep what it loaded in a file
+ * that stays valid until the caller's thread gets to it. */
+static TSK_WALK_RET_ENUM
+par_walk_ordered_cb(TSK_FS_FILE * a_fs_file, void *a_ptr)
+{
+    TSK_FS_PAR_WORKER *worker = (TSK_FS_PAR_WORKER *) a_ptr;
+    TSK_FS_PAR_SLOT *slot = worker->slot;
+    TSK_FS_FILE *fs_file;
+
+    if (par_stopped(worker->walk))
+        return TSK_WALK_STOP;
+
+    if (slot->cnt == slot->alloc) {
+        size_t alloc = slot->alloc ? slot->alloc * 2 : 64;
+        TSK_FS_FILE **files;
+        if ((files = (TSK_FS_FILE **) tsk_realloc(slot->files,
+                    alloc * sizeof(TSK_FS_FILE *))) == NULL)
+            return TSK_WALK_ERROR;
+        slot->files = files;
+        slot->alloc = alloc;
+    }
+
+    if ((fs_file = par_file_take(a_fs_file)) == NULL)
+        return TSK_WALK_ERROR;
+
+    slot->files[slot->cnt++] = fs_file;
+    return TSK_WALK_CONT;
+}
+
+/* Main loop of each worker thread.  Claims chunks until there are none
+ * left or the walk is stopped. */
+static void
+par_worker(TSK_FS_PAR_WALK * a_walk)
+{
+    TSK_FS_PAR_WORKER worker;
+
+    worker.walk = a_walk;
+    worker.slot = NULL;
+
+    while (1) {
+        size_t chunk;
+        TSK_INUM_T cstart, cend;
+
+        tsk_take_lock(&a_walk->lock);
+        // in ordered mode, do not get too far ahead of the caller
+        while (a_walk->ordered && !a_walk->stop
+            && a_walk->next_chunk < a_walk->chunk_cnt
+            && a_walk->next_chunk >= a_walk->delivered + a_walk->window) {
+            par_cond_wait(&a_walk->cond, &a_walk->lock);
+        }
+        if (a_walk->stop || a_walk->next_chunk >= a_walk->chunk_cnt) {
+            tsk_release_lock(&a_walk->lock);
+            break;
+        }
+        chunk = a_walk->next_chunk++;
+        tsk_release_lock(&a_walk->lock);
+
+        cstart = a_walk->fs->first_inum +
+            (TSK_INUM_T) (a_walk->chunk_first + chunk) * a_walk->chunk_size;
+        cend = cstart + a_walk->chunk_size - 1;
+        if (cstart < a_walk->start)
+            cstart = a_walk->start;
+        if (cend > a_walk->end)
+            cend = a_walk->end;
+
+        if (a_walk->ordered) {
+            worker.slot = &a_walk->slots[chunk % a_walk->window];
+            if (a_walk->fs->inode_walk(a_walk->fs, cstart, cend,
+                    a_walk->flags, par_walk_ordered_cb, &worker)) {
+                par_fail(a_walk);
+            }
+            tsk_take_lock(&a_walk->lock);
+            worker.slot->done = 1;
+            par_cond_broadcast(&a_walk->cond);
+            tsk_release_lock(&a_walk->lock);
+        }
+        else if (a_walk->fs->inode_walk(a_walk->fs, cstart, cend,
+                a_walk->flags, par_walk_cb, &worker)) {
+            par_fail(a_walk);
+        }
+    }
+}
+
+#ifdef TSK_WIN32
+static unsigned __stdcall
+par_thread_main(void *a_arg)
+{
+    par_worker((TSK_FS_PAR_WALK *) a_arg);
+    return 0;
+}
+#else
+static void *
+par_thread_main(void *a_arg)
+{
+    par_worker((TSK_FS_PAR_WALK *) a_arg);
+    return NULL;
+}
+#endif
+
+/* Claims and processes indexes of the current job until there are none
+ * left.  Must hold the pool lock, which is released while a_func runs. */
+static void
+par_pool_work(TSK_FS_PAR_POOL * a_pool)
+{
+    while (a_pool->next < a_pool->cnt) {
+        size_t idx = a_pool->next++;
+
+        a_pool->busy++;
+        tsk_release_lock(&a_pool->lock);
+        a_pool->func(a_pool->ptr, idx);
+        tsk_take_lock(&a_pool->lock);
+        a_pool->busy--;
+    }
+    // wake up the thread that posted the job
+    if (a_pool->busy == 0)
+        par_cond_broadcast(&a_pool->cond);
+}
+
+/* Main loop of each pool thread.  Waits for jobs and works on them until
+ * the pool is stopped. */
+static void
+par_pool_worker(TSK_FS_PAR_POOL * a_pool)
+{
+    tsk_take_lock(&a_pool->lock);
+    while (1) {
+        while ((a_pool->quit == 0) && (a_pool->next >= a_pool->cnt))
+            par_cond_wait(&a_pool->cond, &a_pool->lock);
+        if (a_pool->quit)
+            break;
+        par_pool_work(a_pool);
+    }
+    tsk_release_lock(&a_pool->lock);
+}
+
+#ifdef TSK_WIN32
+static unsigned __stdcall
+par_pool_thread_main(void *a_arg)
+{
+    par_pool_worker((TSK_FS_PAR_POOL *) a_arg);
+    return 0;
+}
+#else
+static void *
+par_pool_thread_main(void *a_arg)
+{
+    par_pool_worker((TSK_FS_PAR_POOL *) a_arg);
+    return NULL;
+}
+#endif
+
+/* Starts a thread that runs a_main(a_arg).  Returns 1 on error. */
+static uint8_t
+par_thread_start(tsk_par_thread_t * a_thread, tsk_par_thread_main_t a_main,
+    void *a_arg)
+{
+#ifdef TSK_WIN32
+    *a_thread = (HANDLE) _beginthreadex(NULL, 0, a_main, a_arg, 0, NULL);
+    return *a_thread == 0 ? 1 : 0;
+#else
+    return pthread_create(a_thread, NULL, a_main, a_arg) ? 1 : 0;
+#endif
+}
+
+static void
+par_thread_join(tsk_par_thread_t a_thread)
+{
+#ifdef TSK_WIN32
+    WaitForSingleObject(a_thread, INFINITE);
+    CloseHandle(a_thread);
+#else
+    pthread_join(a_thread, NULL);
+#endif
+}
+
+/* Calls the caller's callback on the results of each chunk, in order, from
+ * the calling thread.  Returns 1 if the callback returned an error. */
+static uint8_t
+par_deliver(TSK_FS_PAR_WALK * a_walk)
+{
+    size_t chunk;
+    uint8_t retval = 0;
+
+    for (chunk = 0; chunk < a_walk->chunk_cnt; chunk++) {
+        TSK_FS_PAR_SLOT *slot = &a_walk->slots[chunk % a_walk->window];
+        uint8_t stop = 0;
+        size_t i;
+
+        tsk_take_lock(&a_walk->lock);
+        while (!slot->done && !a_walk->failed)
+            par_cond_wait(&a_walk->cond, &a_walk->lock);
+        if (a_walk->failed) {
+            tsk_release_lock(&a_walk->lock);
+            break;
+        }
+        tsk_release_lock(&a_walk->lock);
+
+        for (i = 0; i < slot->cnt; i++) {
+            if (stop == 0) {
+                TSK_WALK_RET_ENUM ret =
+                    a_walk->action(slot->files[i], a_walk->ptr);
+                if (ret == TSK_WALK_STOP) {
+                    stop = 1;
+                }
+                else if (ret == TSK_WALK_ERROR) {
+                    stop = 1;
+                    retval = 1;
+                }
+            }
+            tsk_fs_file_close(slot->files[i]);
+        }
+        slot->cnt = 0;
+
+        tsk_take_lock(&a_walk->lock);
+        slot->done = 0;
+        a_walk->delivered++;
+        if (stop)
+            a_walk->stop = 1;
+        par_cond_broadcast(&a_walk->cond);
+        tsk_release_lock(&a_walk->lock);
+
+        if (stop)
+            break;
+    }
+    return retval;
+}
+
+#endif                          // TSK_MULTITHREAD_LIB
+
+
+/**
+ * \ingroup fslib
+ * Walk a range of metadata structures with several threads and call a
+ * callback for each structure that matches the flags supplied.  This is
+ * the same as tsk_fs_meta_walk() except that the range is split into
+ * chunks that are loaded and processed by worker threads.
+ *
+ * Unless TSK_FS_META_WALK_PAR_FLAG_ORDERED is given, the callback is called
+ * from the worker threads at the same time and in no particular order, so
+ * it must be thread safe.  As with tsk_fs_meta_walk(), the TSK_FS_FILE that
+ * is passed to it is only valid until the callback returns.
+ *
+ * With TSK_FS_META_WALK_PAR_FLAG_ORDERED, the workers queue the structures
+ * that they find and the callback is called only from the calling thread and
+ * in increasing address order, so it sees the same sequence that
+ * tsk_fs_meta_walk() would give.  This costs extra memory because the
+ * loaded structures are kept until they are delivered.
+ *
+ * If the library was built without thread support, only one thread is
+ * requested, or the file system's inode_walk has not been made safe to run
+ * from several threads, this calls tsk_fs_meta_walk().
+ *
+ * @param a_fs File system to analyze
+ * @param a_start Metadata address to start walking from
+ * @param a_end Metadata address to walk to
+ * @param a_flags Flags that specify the desired metadata features
+ * @param a_action Callback function to call
+ * @param a_ptr Pointer that will be passed to the callback
+ * @param a_threads Number of worker threads to use (0 to use one per processor)
+ * @param a_par_flags Flags that control how the results are delivered
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_meta_walk_parallel(TSK_FS_INFO * a_fs, TSK_INUM_T a_start,
+    TSK_INUM_T a_end, TSK_FS_META_FLAG_ENUM a_flags,
+    TSK_FS_META_WALK_CB a_action, void *a_ptr, unsigned int a_threads,
+    TSK_FS_META_WALK_PAR_FLAG_ENUM a_par_flags)
+{
+#ifdef TSK_MULTITHREAD_LIB
+    TSK_FS_PAR_WALK *walk;
+    tsk_par_thread_t *threads;
+    unsigned int started = 0;
+    unsigned int i;
+    uint8_t retval = 0;
+    size_t chunk_last;
+#endif
+
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)
+        || (a_action == NULL)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("tsk_fs_meta_walk_parallel: called with NULL or unallocated structures");
+        return 1;
+    }
+
+#ifndef TSK_MULTITHREAD_LIB
+    return tsk_fs_meta_walk(a_fs, a_start, a_end, a_flags, a_action,
+        a_ptr);
+#else
+
+    if (a_start < a_fs->first_inum || a_start > a_fs->last_inum) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_WALK_RNG);
+        tsk_error_set_errstr("tsk_fs_meta_walk_parallel: start inode: %"
+            PRIuINUM "", a_start);
+        return 1;
+    }
+    if (a_end < a_fs->first_inum || a_end > a_fs->last_inum
+        || a_end < a_start) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_WALK_RNG);
+        tsk_error_set_errstr("tsk_fs_meta_walk_parallel: end inode: %"
+            PRIuINUM "", a_end);
+        return 1;
+    }
+
+    // walk serially unless inode_walk is known to be safe to run from
+    // several threads
+    if ((a_fs->flags & TSK_FS_INFO_FLAG_PAR_INODE_WALK) == 0)
+        return tsk_fs_meta_walk(a_fs, a_start, a_end, a_flags, a_action,
+            a_ptr);
+
+    if (a_threads == 0)
+        a_threads = par_cpu_count();
+    if (a_threads > TSK_FS_PAR_MAX_THREADS)
+        a_threads = TSK_FS_PAR_MAX_THREADS;
+
+    if ((walk = (TSK_FS_PAR_WALK *) tsk_malloc(sizeof(TSK_FS_PAR_WALK)))
+        == NULL)
+        return 1;
+    walk->fs = a_fs;
+    walk->flags = a_flags;
+    walk->action = a_action;
+    walk->ptr = a_ptr;
+    walk->ordered = (a_par_flags & TSK_FS_META_WALK_PAR_FLAG_ORDERED) ? 1 : 0;
+    walk->start = a_start;
+    walk->end = a_end;
+
+    // give each worker whole groups if the file system has them (such as
+    // the inode bitmap and table of each ExtX group)
+    walk->chunk_size = TSK_FS_PAR_CHUNK_SIZE;
+    if (a_fs->inum_group_size > 0)
+        walk->chunk_size = a_fs->inum_group_size;
+    if (walk->ordered && walk->chunk_size > TSK_FS_PAR_ORDERED_CHUNK_SIZE)
+        walk->chunk_size = TSK_FS_PAR_ORDERED_CHUNK_SIZE;
+
+    walk->chunk_first =
+        (size_t) ((a_start - a_fs->first_inum) / walk->chunk_size);
+    chunk_last = (size_t) ((a_end - a_fs->first_inum) / walk->chunk_size);
+    walk->chunk_cnt = chunk_last - walk->chunk_first + 1;
+
+    if (a_threads > walk->chunk_cnt)
+        a_threads = (unsigned int) walk->chunk_cnt;
+
+    // nothing to gain from threads
+    if (a_threads <= 1) {
+        free(walk);
+        return tsk_fs_meta_walk(a_fs, a_start, a_end, a_flags, a_action,
+            a_ptr);
+    }
+
+    // Build the list of named metadata addresses before the workers
+    // start so that they do not all wait on the same directory walk.
+    if (a_flags & TSK_FS_META_FLAG_ORPHAN) {
+        if (tsk_fs_dir_load_inum_named(a_fs) != TSK_OK) {
+            tsk_error_errstr2_concat
+                ("- tsk_fs_meta_walk_parallel: identifying inodes allocated by file names");
+            free(walk);
+            return 1;
+        }
+    }
+
+    if (walk->ordered) {
+        walk->window = 2 * a_threads;
+        if ((walk->slots = (TSK_FS_PAR_SLOT *)
+                tsk_malloc(walk->window * sizeof(TSK_FS_PAR_SLOT))) ==
+            NULL) {
+            free(walk);
+            return 1;
+        }
+    }
+    if ((threads = (tsk_par_thread_t *)
+            tsk_malloc(a_threads * sizeof(tsk_par_thread_t))) == NULL) {
+        free(walk->slots);
+        free(walk);
+        return 1;
+    }
+
+    tsk_init_lock(&walk->lock);
+    par_cond_init(&walk->cond);
+
+    for (started = 0; started < a_threads; started++) {
+        if (par_thread_start(&threads[started], par_thread_main, walk)) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr
+                ("tsk_fs_meta_walk_parallel: error starting worker thread");
+            par_fail(walk);
+            break;
+        }
+    }
+
+    if (walk->ordered && started > 0)
+        retval = par_deliver(walk);
+
+    // make sure that workers waiting on the window wake up and exit
+    if (retval)
+        par_stop(walk);
+
+    for (i = 0; i < started; i++)
+        par_thread_join(threads[i]);
+
+    if (walk->failed) {
+        tsk_error_reset();
+        tsk_error_set_errno(walk->err_no);
+        tsk_error_set_errstr("%s", walk->errstr);
+        if (walk->errstr2[0] != '\0')
+            tsk_error_set_errstr2("%s", walk->errstr2);
+        retval = 1;
+    }
+
+    // free results that were not delivered because the walk stopped early
+    if (walk->ordered) {
+        for (i = 0; i < walk->window; i++) {
+            size_t j;
+            for (j = 0; j < walk->slots[i].cnt; j++)
+                tsk_fs_file_close(walk->slots[i].files[j]);
+            free(walk->slots[i].files);
+        }
+        free(walk->slots);
+    }
+
+    par_cond_deinit(&walk->cond);
+    tsk_deinit_lock(&walk->lock);
+    free(threads);
+    free(walk);
+    return retval;
+#endif
+}
+
+
+/** \internal
+ * Start worker threads that can run several tsk_fs_par_pool_run() jobs
+ * without being created again for each one.  The threads wait for work
+ * until tsk_fs_par_pool_stop() is called.
+ *
+ * @param a_threads Maximum number of threads to use, including the thread
+ * that calls tsk_fs_par_pool_run() (0 to use one per processor)
+ * @returns The pool or NULL if no extra threads could be started, in which
+ * case tsk_fs_par_pool_run() does the work in the calling thread.
+ */
+TSK_FS_PAR_POOL *
+tsk_fs_par_pool_start(unsigned int a_threads)
+{
+#ifdef TSK_MULTITHREAD_LIB
+    TSK_FS_PAR_POOL *pool;
+
+    if (a_threads == 0)
+        a_threads = par_cpu_count();
+    if (a_threads > TSK_FS_PAR_MAX_THREADS)
+        a_threads = TSK_FS_PAR_MAX_THREADS;
+    if (a_threads < 2)
+        return NULL;
+
+    if ((pool = (TSK_FS_PAR_POOL *) tsk_malloc(sizeof(TSK_FS_PAR_POOL)))
+        == NULL) {
+        tsk_error_reset();
+        return NULL;
+    }
+    tsk_init_lock(&pool->lock);
+    par_cond_init(&pool->cond);
+
+    // the calling thread of each job is one of the workers.  If a thread
+    // cannot be started, the ones that did start do its share.
+    for (pool->thread_cnt = 0; pool->thread_cnt < a_threads - 1;
+        pool->thread_cnt++) {
+        if (par_thread_start(&pool->threads[pool->thread_cnt],
+                par_pool_thread_main, pool))
+            break;
+    }
+    if (pool->thread_cnt == 0) {
+        par_cond_deinit(&pool->cond);
+        tsk_deinit_lock(&pool->lock);
+        free(pool);
+        return NULL;
+    }
+    return pool;
+#else
+    return NULL;
+#endif
+}
+
+/** \internal
+ * Call a function for each index from 0 to a_cnt - 1 using the threads of
+ * a pool.  The calling thread also does work and the function returns once
+ * every index has been processed.  a_func is called from different threads
+ * at the same time and must be thread safe.  It has to keep track of its
+ * own errors because tsk errors are per thread.  Only one thread may run a
+ * job on a given pool at a time.
+ *
+ * @param a_pool Pool from tsk_fs_par_pool_start() or NULL to process the
+ * indexes in order in the calling thread
+ * @param a_cnt Number of indexes to process
+ * @param a_func Function to call for each index
+ * @param a_ptr Pointer that is passed to a_func
+ */
+void
+tsk_fs_par_pool_run(TSK_FS_PAR_POOL * a_pool, size_t a_cnt,
+    TSK_FS_PAR_FOR_CB a_func, void *a_ptr)
+{
+#ifdef TSK_MULTITHREAD_LIB
+    if ((a_pool != NULL) && (a_cnt > 1)) {
+        tsk_take_lock(&a_pool->lock);
+        a_pool->func = a_func;
+        a_pool->ptr = a_ptr;
+        a_pool->cnt = a_cnt;
+        a_pool->next = 0;
+        par_cond_broadcast(&a_pool->cond);
+
+        par_pool_work(a_pool);
+        while (a_pool->busy > 0)
+            par_cond_wait(&a_pool->cond, &a_pool->lock);
+        tsk_release_lock(&a_pool->lock);
+        return;
+    }
+#endif
+    {
+        size_t idx;
+        for (idx = 0; idx < a_cnt; idx++)
+            a_func(a_ptr, idx);
+    }
+}
+
+/** \internal
+ * Stop the threads of a pool and free it.
+ *
+ * @param a_pool Pool from tsk_fs_par_pool_start() (can be NULL)
+ */
+void
+tsk_fs_par_pool_stop(TSK_FS_PAR_POOL * a_pool)
+{
+#ifdef TSK_MULTITHREAD_LIB
+    unsigned int i;
+
+    if (a_pool == NULL)
+        return;
+
+    tsk_take_lock(&a_pool->lock);
+    a_pool->quit = 1;
+    par_cond_broadcast(&a_pool->cond);
+    tsk_release_lock(&a_pool->lock);
+
+    for (i = 0; i < a_pool->thread_cnt; i++)
+        par_thread_join(a_pool->threads[i]);
+    par_cond_deinit(&a_pool->cond);
+    tsk_deinit_lock(&a_pool->lock);
+    free(a_pool);
+#endif
+}
+
+/** \internal
+ * Call a function for each index from 0 to a_cnt - 1 using several
+ * threads that are started for this call only.  See
+ * tsk_fs_par_pool_run() for the rules that a_func has to follow.  Use a
+ * pool from tsk_fs_par_pool_start() instead when there are several batches
+ * of work.
+ *
+ * If the library was built without thread support, the indexes are
+ * processed in order by the calling thread.
+ *
+ * @param a_threads Maximum number of threads to use (0 to use one per processor)
+ * @param a_cnt Number of indexes to process
+ * @param a_func Function to call for each index
+ * @param a_ptr Pointer that is passed to a_func
+ */
+void
+tsk_fs_par_for(unsigned int a_threads, size_t a_cnt,
+    TSK_FS_PAR_FOR_CB a_func, void *a_ptr)
+{
+    TSK_FS_PAR_POOL *pool = NULL;
+
+#ifdef TSK_MULTITHREAD_LIB
+    if (a_threads == 0)
+        a_threads = par_cpu_count();
+#endif
+    if (a_threads > a_cnt)
+        a_threads = (unsigned int) a_cnt;
+    if (a_threads > 1)
+        pool = tsk_fs_par_pool_start(a_threads);
+    tsk_fs_par_pool_run(pool, a_cnt, a_func, a_ptr);
+    tsk_fs_par_pool_stop(pool);
+}
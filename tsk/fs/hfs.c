@@ -4798,6 +4798,39 @@ hfs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
 }
 
 
+/** \internal
+* Get the allocation status of a block and the number of blocks that
+* follow it (up to a_end) with the same status.  The run ends at the
+* end of the part of the allocation file that is cached.
+*
+* @returns Number of blocks in the run or 0 on error
+*/
+static TSK_DADDR_T
+hfs_block_getflags_run(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr,
+    TSK_DADDR_T a_end, TSK_FS_BLOCK_FLAG_ENUM * a_flags)
+{
+    HFS_INFO *hfs = (HFS_INFO *) a_fs;
+    TSK_DADDR_T first, end;
+    int8_t retval;
+
+    /* this loads the needed part of the bitmap into the cache */
+    retval = hfs_block_is_alloc(hfs, a_addr);
+    if (retval == -1)
+        return 0;
+    *a_flags =
+        (retval == 1) ? TSK_FS_BLOCK_FLAG_ALLOC : TSK_FS_BLOCK_FLAG_UNALLOC;
+
+    // bit offsets into the cache
+    first = (TSK_DADDR_T) hfs->blockmap_cache_start * 8;
+    end = first + (TSK_DADDR_T) hfs->blockmap_cache_len * 8;
+    if (a_end + 1 < end)
+        end = a_end + 1;
+
+    return tsk_fs_bitmap_run((uint8_t *) hfs->blockmap_cache,
+        (size_t) (a_addr - first), (size_t) (end - first), 1);
+}
+
+
 static uint8_t
 hfs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T start_blk,
     TSK_DADDR_T end_blk, TSK_FS_BLOCK_WALK_FLAG_ENUM flags,
@@ -6201,6 +6234,7 @@ hfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
     fs->inode_walk = hfs_inode_walk;
     fs->block_walk = hfs_block_walk;
     fs->block_getflags = hfs_block_getflags;
+    fs->block_getflags_run = hfs_block_getflags_run;
     fs->load_attrs = hfs_load_attrs;
     fs->get_default_attr_type = hfs_get_default_attr_type;
 
@@ -27,6 +27,8 @@
 
 #include "tsk_fs_i.h"
 #include "tsk_hfs.h"
+#include "tsk_ntfs.h"
+#include "tsk_ext2fs.h"
 
 
 /*******************************************************************************
@@ -233,6 +235,72 @@ tsk_fs_path2inum(TSK_FS_INFO * a_fs, const char *a_path,
 
         TSK_FS_DIR *fs_dir = NULL;
 
+        /* NTFS directories are B+trees and large ExtX directories are
+         * hash indexed, so first try to find the name without loading
+         * the entire directory.  The full directory is still loaded if
+         * it is not found because it could be a deleted or orphan name. */
+        if ((TSK_FS_TYPE_ISNTFS(a_fs->ftype) && (cur_attr == NULL))
+            || (TSK_FS_TYPE_ISEXT(a_fs->ftype))) {
+            TSK_INUM_T inum_idx;
+            TSK_FS_NAME *fs_name_idx = NULL;
+            int8_t retval;
+
+            // a_fs_name is only updated for the last name in the path
+            if ((a_fs_name) && ((fs_name_idx =
+                        tsk_fs_name_alloc(TSK_FS_TYPE_ISNTFS(a_fs->ftype) ?
+                            NTFS_MAXNAMLEN_UTF8 : EXT2FS_MAXNAMLEN + 1,
+                            16)) == NULL)) {
+                free(cpath);
+                return -1;
+            }
+
+            if (TSK_FS_TYPE_ISNTFS(a_fs->ftype))
+                retval = ntfs_dir_lookup(a_fs, next_meta, cur_dir,
+                    &inum_idx, fs_name_idx);
+            else
+                retval = ext2fs_dir_lookup(a_fs, next_meta, cur_dir,
+                    &inum_idx, fs_name_idx);
+            if (retval == -1) {
+                tsk_fs_name_free(fs_name_idx);
+                free(cpath);
+                return -1;
+            }
+            else if (retval == 0) {
+                if (tsk_verbose)
+                    tsk_fprintf(stderr, "Found it in index (%s)\n",
+                        cur_dir);
+
+                // advance to the next name
+                cur_dir = (char *) strtok_r(NULL, "/", &(strtok_last));
+
+                /* That was the last name in the path -- we found the file! */
+                if (cur_dir == NULL) {
+                    *a_result = inum_idx;
+                    if ((fs_name_idx)
+                        && (tsk_fs_name_copy(a_fs_name, fs_name_idx))) {
+                        tsk_fs_name_free(fs_name_idx);
+                        free(cpath);
+                        return -1;
+                    }
+                    tsk_fs_name_free(fs_name_idx);
+                    free(cpath);
+                    return 0;
+                }
+                tsk_fs_name_free(fs_name_idx);
+
+                // update the attribute field, if needed
+                if (TSK_FS_TYPE_ISNTFS(a_fs->ftype)
+                    && ((cur_attr = strchr(cur_dir, ':')) != NULL)) {
+                    *(cur_attr) = '\0';
+                    cur_attr++;
+                }
+
+                next_meta = inum_idx;
+                continue;
+            }
+            tsk_fs_name_free(fs_name_idx);
+        }
+
         // open the next directory in the recursion
         if ((fs_dir = tsk_fs_dir_open_meta(a_fs, next_meta)) == NULL) {
             free(cpath);
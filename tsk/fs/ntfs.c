@@ -117,6 +117,184 @@ nt2nano(uint64_t ntdate)
 
 
 
+/**
+ * Verify and remove the update sequence values in a raw MFT entry.
+ *
+ * @param a_ntfs File system the entry came from
+ * @param a_buf Raw entry of size NTFS_INFO.mft_rsize_b (updated in place)
+ *
+ * @returns TSK_OK, or TSK_COR if the entry is corrupt
+ */
+static TSK_RETVAL_ENUM
+ntfs_mft_fixup(NTFS_INFO * a_ntfs, char *a_buf)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & a_ntfs->fs_info;
+    ntfs_upd *upd;
+    uint16_t sig_seq;
+    ntfs_mft *mft;
+    int i;
+
+    /* The MFT entries have error and integrity checks in them
+     * called update sequences.  They must be checked and removed
+     * so that later functions can process the data as normal.
+     * They are located in the last 2 bytes of each 512-bytes of data.
+     *
+     * We first verify that the the 2-byte value is a give value and
+     * then replace it with what should be there
+     */
+    /* sanity check so we don't run over in the next loop */
+    mft = (ntfs_mft *) a_buf;
+    if ((tsk_getu16(fs->endian, mft->upd_cnt) > 0) &&
+        (((uint32_t) (tsk_getu16(fs->endian,
+                        mft->upd_cnt) - 1) * NTFS_UPDATE_SEQ_STRIDE) >
+            a_ntfs->mft_rsize_b)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("dinode_lookup: More Update Sequence Entries than MFT size");
+        return TSK_COR;
+    }
+    if (tsk_getu16(fs->endian, mft->upd_off) > a_ntfs->mft_rsize_b) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("dinode_lookup: Update sequence offset larger than MFT size");
+        return TSK_COR;
+    }
+
+    /* Apply the update sequence structure template */
+    upd =
+        (ntfs_upd *) ((uintptr_t) a_buf + tsk_getu16(fs->endian,
+            mft->upd_off));
+    /* Get the sequence value that each 16-bit value should be */
+    sig_seq = tsk_getu16(fs->endian, upd->upd_val);
+    /* cycle through each sector */
+    for (i = 1; i < tsk_getu16(fs->endian, mft->upd_cnt); i++) {
+        uint8_t *new_val, *old_val;
+        /* The offset into the buffer of the value to analyze */
+        size_t offset = i * NTFS_UPDATE_SEQ_STRIDE - 2;
+        /* get the current sequence value */
+        uint16_t cur_seq =
+            tsk_getu16(fs->endian, (uintptr_t) a_buf + offset);
+        if (cur_seq != sig_seq) {
+            /* get the replacement value */
+            uint16_t cur_repl =
+                tsk_getu16(fs->endian, &upd->upd_seq + (i - 1) * 2);
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+
+            tsk_error_set_errstr
+                ("Incorrect update sequence value in MFT entry\nSignature Value: 0x%"
+                PRIx16 " Actual Value: 0x%" PRIx16
+                " Replacement Value: 0x%" PRIx16
+                "\nThis is typically because of a corrupted entry",
+                sig_seq, cur_seq, cur_repl);
+            return TSK_COR;
+        }
+
+        new_val = &upd->upd_seq + (i - 1) * 2;
+        old_val = (uint8_t *) ((uintptr_t) a_buf + offset);
+        /*
+           if (tsk_verbose)
+           tsk_fprintf(stderr,
+           "ntfs_dinode_lookup: upd_seq %i   Replacing: %.4"
+           PRIx16 "   With: %.4" PRIx16 "\n", i,
+           tsk_getu16(fs->endian, old_val), tsk_getu16(fs->endian,
+           new_val));
+         */
+        *old_val++ = *new_val++;
+        *old_val = *new_val;
+    }
+
+    return TSK_OK;
+}
+
+
+/**
+ * Build the index of the $MFT $Data runs so that entry addresses can be
+ * found with a binary search instead of walking the run list.  This must
+ * be called after the $MFT has been loaded.  The index is not changed
+ * afterwards and can be used without locking.
+ *
+ * @param a_ntfs File system with mft_data set
+ * @returns 1 on error
+ */
+static uint8_t
+ntfs_load_mft_runs(NTFS_INFO * a_ntfs)
+{
+    TSK_FS_ATTR_RUN *data_run;
+    TSK_OFF_T offset = 0;
+    size_t cnt = 0;
+
+    for (data_run = a_ntfs->mft_data->nrd.run; data_run != NULL;
+        data_run = data_run->next) {
+        if (data_run->len)
+            cnt++;
+    }
+
+    if ((a_ntfs->mft_runs =
+            (NTFS_MFT_RUN *) tsk_malloc((cnt ? cnt : 1) *
+                sizeof(NTFS_MFT_RUN))) == NULL)
+        return 1;
+
+    for (data_run = a_ntfs->mft_data->nrd.run; data_run != NULL;
+        data_run = data_run->next) {
+        NTFS_MFT_RUN *run;
+        TSK_OFF_T end, last_entry;
+
+        if (data_run->len == 0)
+            continue;
+
+        run = &a_ntfs->mft_runs[a_ntfs->mft_runs_cnt++];
+        run->off = offset;
+        run->len = (TSK_OFF_T) data_run->len * a_ntfs->csize_b;
+        run->addr = (TSK_OFF_T) data_run->addr * a_ntfs->csize_b;
+        run->flags = data_run->flags;
+
+        /* does the last entry in the run continue in the next run?
+         * (only happens when the cluster size is less than the
+         * entry size) */
+        end = offset + run->len;
+        last_entry = (end - 1) / a_ntfs->mft_rsize_b * a_ntfs->mft_rsize_b;
+        if (last_entry + a_ntfs->mft_rsize_b > end)
+            run->cross_len = (uint32_t) (end - last_entry);
+        else
+            run->cross_len = 0;
+
+        offset = end;
+    }
+    return 0;
+}
+
+/**
+ * Find the $MFT run that contains a byte offset of the $MFT.
+ *
+ * @param a_ntfs File system with mft_runs loaded
+ * @param a_off Byte offset in the $MFT
+ * @returns Index into mft_runs or -1 if the offset is not in a run
+ */
+static ssize_t
+ntfs_mft_run_find(NTFS_INFO * a_ntfs, TSK_OFF_T a_off)
+{
+    size_t lo = 0, hi = a_ntfs->mft_runs_cnt;
+
+    /* find the first run that starts after the offset */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a_ntfs->mft_runs[mid].off <= a_off)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if ((lo == 0)
+        || (a_off >= a_ntfs->mft_runs[lo - 1].off +
+            a_ntfs->mft_runs[lo - 1].len))
+        return -1;
+    return (ssize_t) (lo - 1);
+}
+
+
 /**
  * Read an MFT entry and save it in raw form in the given buffer.
  * NOTE: This will remove the update sequence integrity checks in the
@@ -133,12 +311,8 @@ ntfs_dinode_lookup(NTFS_INFO * a_ntfs, char *a_buf, TSK_INUM_T a_mftnum)
 {
     TSK_OFF_T mftaddr_b, mftaddr2_b, offset;
     size_t mftaddr_len = 0;
-    int i;
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & a_ntfs->fs_info;
     TSK_FS_ATTR_RUN *data_run;
-    ntfs_upd *upd;
-    uint16_t sig_seq;
-    ntfs_mft *mft;
 
 
     /* sanity checks */
@@ -197,6 +371,38 @@ ntfs_dinode_lookup(NTFS_INFO * a_ntfs, char *a_buf, TSK_INUM_T a_mftnum)
         mftaddr_b = a_ntfs->root_mft_addr + a_mftnum * a_ntfs->mft_rsize_b;
         mftaddr2_b = 0;
     }
+    else if (a_ntfs->mft_runs) {
+        /* Use the index of the runs that was built when the
+         * file system was opened */
+        const NTFS_MFT_RUN *run;
+        ssize_t idx;
+
+        offset = a_mftnum * a_ntfs->mft_rsize_b;
+        if ((idx = ntfs_mft_run_find(a_ntfs, offset)) == -1) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_INODE_NUM);
+            tsk_error_set_errstr("mft_lookup: Error finding MFT entry %"
+                PRIuINUM " in $MFT", a_mftnum);
+            return TSK_ERR;
+        }
+        run = &a_ntfs->mft_runs[idx];
+
+        mftaddr_b = run->addr + (offset - run->off);
+        mftaddr2_b = 0;
+
+        /* special case where the MFT entry crosses a run */
+        if (run->off + run->len < offset + a_ntfs->mft_rsize_b) {
+            if ((size_t) idx + 1 == a_ntfs->mft_runs_cnt) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+                tsk_error_set_errstr
+                    ("mft_lookup: MFT entry crosses a cluster and there are no more clusters!");
+                return TSK_COR;
+            }
+            mftaddr2_b = a_ntfs->mft_runs[idx + 1].addr;
+            mftaddr_len = run->cross_len;
+        }
+    }
     else {
         /* The MFT may not be in consecutive clusters, so we need to use its
          * data attribute run list to find out what address to read
@@ -346,82 +552,365 @@ ntfs_dinode_lookup(NTFS_INFO * a_ntfs, char *a_buf, TSK_INUM_T a_mftnum)
         return 1;
     }
 #endif
-    /* The MFT entries have error and integrity checks in them
-     * called update sequences.  They must be checked and removed
-     * so that later functions can process the data as normal.
-     * They are located in the last 2 bytes of each 512-bytes of data.
-     *
-     * We first verify that the the 2-byte value is a give value and
-     * then replace it with what should be there
-     */
-    /* sanity check so we don't run over in the next loop */
-    mft = (ntfs_mft *) a_buf;
-    if ((tsk_getu16(fs->endian, mft->upd_cnt) > 0) &&
-        (((uint32_t) (tsk_getu16(fs->endian,
-                        mft->upd_cnt) - 1) * NTFS_UPDATE_SEQ_STRIDE) >
-            a_ntfs->mft_rsize_b)) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-        tsk_error_set_errstr
-            ("dinode_lookup: More Update Sequence Entries than MFT size");
-        return TSK_COR;
+
+    return ntfs_mft_fixup(a_ntfs, a_buf);
+}
+
+
+
+/* Number of bytes of $MFT that ntfs_mft_scan_entry() reads at a time */
+#define NTFS_MFT_SCAN_SIZE  (4 * 1024 * 1024)
+
+/** \internal
+ * State for reading consecutive MFT entries.  Instead of translating
+ * each entry address with ntfs_dinode_lookup(), the runs in
+ * NTFS_INFO.mft_runs are followed and large chunks of entries are read
+ * at a time.
+ */
+typedef struct {
+    NTFS_INFO *ntfs;
+    char *buf;                  ///< Chunk of raw entries
+    size_t buf_max;             ///< Number of entries that buf can hold
+    TSK_INUM_T buf_start;       ///< First entry in buf
+    size_t buf_cnt;             ///< Number of entries in buf
+    TSK_INUM_T slow_end;        ///< Entries before this are read one at a time
+    char *entry;                ///< Buffer for entries that are read one at a time
+} NTFS_MFT_SCAN;
+
+/**
+ * Setup a scan of the entries from a_start to a_end.
+ *
+ * @returns 1 on error
+ */
+static uint8_t
+ntfs_mft_scan_init(NTFS_MFT_SCAN * a_scan, NTFS_INFO * a_ntfs,
+    TSK_INUM_T a_start, TSK_INUM_T a_end)
+{
+    TSK_INUM_T cnt = a_end - a_start + 1;
+
+    memset(a_scan, 0, sizeof(NTFS_MFT_SCAN));
+    a_scan->ntfs = a_ntfs;
+    a_scan->buf_max = NTFS_MFT_SCAN_SIZE / a_ntfs->mft_rsize_b;
+    if (cnt < a_scan->buf_max)
+        a_scan->buf_max = (size_t) cnt;
+    if (a_scan->buf_max == 0)
+        a_scan->buf_max = 1;
+
+    if ((a_scan->buf =
+            (char *) tsk_malloc(a_scan->buf_max * a_ntfs->mft_rsize_b)) ==
+        NULL)
+        return 1;
+    if ((a_scan->entry = (char *) tsk_malloc(a_ntfs->mft_rsize_b)) == NULL) {
+        free(a_scan->buf);
+        a_scan->buf = NULL;
+        return 1;
     }
-    if (tsk_getu16(fs->endian, mft->upd_off) > a_ntfs->mft_rsize_b) {
+    return 0;
+}
+
+static void
+ntfs_mft_scan_free(NTFS_MFT_SCAN * a_scan)
+{
+    free(a_scan->buf);
+    free(a_scan->entry);
+    a_scan->buf = NULL;
+    a_scan->entry = NULL;
+}
+
+/**
+ * Read the chunk of entries that starts at a_mftnum into the scan
+ * buffer.  Only entries that are fully covered by the $Data runs
+ * are counted in buf_cnt.
+ *
+ * @returns 1 if the chunk could not be read
+ */
+static uint8_t
+ntfs_mft_scan_load(NTFS_MFT_SCAN * a_scan, TSK_INUM_T a_mftnum,
+    TSK_INUM_T a_end)
+{
+    NTFS_INFO *ntfs = a_scan->ntfs;
+    TSK_FS_INFO *fs = &ntfs->fs_info;
+    TSK_OFF_T offset;
+    size_t len, pos;
+    ssize_t idx;
+
+    a_scan->buf_start = a_mftnum;
+    a_scan->buf_cnt = 0;
+    if (a_end - a_mftnum + 1 < a_scan->buf_max)
+        len = (size_t) (a_end - a_mftnum + 1) * ntfs->mft_rsize_b;
+    else
+        len = a_scan->buf_max * ntfs->mft_rsize_b;
+    offset = (TSK_OFF_T) a_mftnum *ntfs->mft_rsize_b;
+
+    if ((idx = ntfs_mft_run_find(ntfs, offset)) == -1)
+        return 0;
+
+    for (pos = 0; ((size_t) idx < ntfs->mft_runs_cnt) && (pos < len);
+        idx++) {
+        const NTFS_MFT_RUN *run = &ntfs->mft_runs[idx];
+        TSK_OFF_T in_run = offset + pos - run->off;
+        size_t cnt_b;
+
+        if (run->len - in_run < (TSK_OFF_T) (len - pos))
+            cnt_b = (size_t) (run->len - in_run);
+        else
+            cnt_b = len - pos;
+
+        if (run->flags & (TSK_FS_ATTR_RUN_FLAG_SPARSE |
+                TSK_FS_ATTR_RUN_FLAG_FILLER)) {
+            memset(&a_scan->buf[pos], 0, cnt_b);
+        }
+        else {
+            ssize_t cnt;
+            cnt = tsk_fs_read(fs, run->addr + in_run, &a_scan->buf[pos],
+                cnt_b);
+            if (cnt != (ssize_t) cnt_b) {
+                tsk_error_reset();
+                return 1;
+            }
+        }
+        pos += cnt_b;
+    }
+
+    a_scan->buf_cnt = pos / ntfs->mft_rsize_b;
+    return 0;
+}
+
+/**
+ * Get the next entry of a scan.  Entries must be requested in
+ * increasing order.  The update sequence values are removed from the
+ * returned entry, which is valid until the next call.  Entries that
+ * cannot be read as part of a chunk are loaded with ntfs_dinode_lookup()
+ * so that their errors are reported the same way.
+ *
+ * @param a_scan Scan state
+ * @param a_mftnum Entry to get
+ * @param a_end Last entry of the scan
+ * @param a_mft [out] Pointer to the entry
+ *
+ * @returns Error value
+ */
+static TSK_RETVAL_ENUM
+ntfs_mft_scan_entry(NTFS_MFT_SCAN * a_scan, TSK_INUM_T a_mftnum,
+    TSK_INUM_T a_end, char **a_mft)
+{
+    NTFS_INFO *ntfs = a_scan->ntfs;
+
+    if ((a_mftnum >= a_scan->slow_end) && ((a_mftnum < a_scan->buf_start)
+            || (a_mftnum >= a_scan->buf_start + a_scan->buf_cnt))) {
+
+        if ((ntfs->mft_runs == NULL)
+            || (ntfs_mft_scan_load(a_scan, a_mftnum, a_end))) {
+            /* read the rest of this chunk one entry at a time */
+            a_scan->slow_end = a_mftnum + a_scan->buf_max;
+            a_scan->buf_cnt = 0;
+        }
+        else if (a_scan->buf_cnt == 0) {
+            /* the entry is not fully in the runs */
+            a_scan->slow_end = a_mftnum + 1;
+        }
+    }
+
+    if (a_mftnum < a_scan->slow_end) {
+        *a_mft = a_scan->entry;
+        return ntfs_dinode_lookup(ntfs, a_scan->entry, a_mftnum);
+    }
+
+    *a_mft = &a_scan->buf[(size_t) (a_mftnum - a_scan->buf_start) *
+        ntfs->mft_rsize_b];
+    return ntfs_mft_fixup(ntfs, *a_mft);
+}
+
+
+
+/* Number of $Bitmap clusters that are kept in one buffer and read
+ * together when any of them is first needed */
+#define NTFS_BMAP_CHUNK 16
+
+/*
+ * Get the file system address of a cluster of the $Bitmap file.
+ * Returns 0 if the cluster is not part of the bitmap runs.
+ */
+static TSK_DADDR_T
+ntfs_bmap_fsaddr(NTFS_INFO * ntfs, TSK_DADDR_T a_clust)
+{
+    TSK_FS_ATTR_RUN *run;
+
+    for (run = ntfs->bmap; run; run = run->next) {
+        if (run->len <= a_clust)
+            a_clust -= run->len;
+        else
+            return run->addr + a_clust;
+    }
+    return 0;
+}
+
+/*
+ * Read the clusters of a $Bitmap chunk that have not been loaded yet.
+ * Clusters that are contiguous on disk are read with one call.  Errors
+ * are not reported here; clusters that could not be read stay unloaded
+ * and ntfs_bmap_get() retries them one at a time.
+ * Must be called with ntfs->lock held.
+ */
+static void
+ntfs_bmap_load_chunk(NTFS_INFO * ntfs, size_t a_chunk)
+{
+    TSK_FS_INFO *fs = &ntfs->fs_info;
+    TSK_DADDR_T first, last, c;
+    uint8_t *buf = ntfs->bmap_chunks[a_chunk];
+
+    first = (TSK_DADDR_T) a_chunk * NTFS_BMAP_CHUNK;
+    last = first + NTFS_BMAP_CHUNK;
+    if (last > ntfs->bmap_clust_cnt)
+        last = ntfs->bmap_clust_cnt;
+
+    for (c = first; c < last;) {
+        TSK_DADDR_T fsaddr, n;
+        ssize_t cnt;
+
+        if (ntfs->bmap_loaded[c]) {
+            c++;
+            continue;
+        }
+        fsaddr = ntfs_bmap_fsaddr(ntfs, c);
+        if ((fsaddr == 0) || (fsaddr > fs->last_block)) {
+            c++;
+            continue;
+        }
+
+        /* extend the span while the clusters follow each other on disk */
+        for (n = 1; c + n < last; n++) {
+            if ((ntfs->bmap_loaded[c + n])
+                || (ntfs_bmap_fsaddr(ntfs, c + n) != fsaddr + n)
+                || (fsaddr + n > fs->last_block))
+                break;
+        }
+
+        cnt = tsk_fs_read_block(fs, fsaddr,
+            (char *) &buf[(c - first) * fs->block_size],
+            (size_t) n * fs->block_size);
+        if (cnt > 0) {
+            TSK_DADDR_T i;
+            for (i = 0; i < (TSK_DADDR_T) cnt / fs->block_size; i++)
+                ntfs->bmap_loaded[c + i] = 1;
+        }
+        c += n;
+    }
+    tsk_error_reset();
+}
+
+/*
+ * Get the in-memory copy of a cluster of the $Bitmap file, reading it
+ * (and its neighbors) from the image the first time it is needed.
+ *
+ * Returns a pointer to the cluster's bytes or NULL on error.  Loaded
+ * clusters are never changed or freed until the file system is closed,
+ * so the pointer can be used without holding the lock.
+ */
+static const uint8_t *
+ntfs_bmap_get(NTFS_INFO * ntfs, TSK_DADDR_T a_clust)
+{
+    TSK_FS_INFO *fs = &ntfs->fs_info;
+    size_t chunk;
+    uint8_t *buf;
+    TSK_DADDR_T fsaddr;
+    ssize_t cnt;
+
+    if (a_clust >= ntfs->bmap_clust_cnt) {
         tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
         tsk_error_set_errstr
-            ("dinode_lookup: Update sequence offset larger than MFT size");
-        return TSK_COR;
+            ("is_clustalloc: cluster not found in bitmap: %" PRIuDADDR
+            "", a_clust);
+        return NULL;
     }
+    chunk = (size_t) (a_clust / NTFS_BMAP_CHUNK);
 
-    /* Apply the update sequence structure template */
-    upd =
-        (ntfs_upd *) ((uintptr_t) a_buf + tsk_getu16(fs->endian,
-            mft->upd_off));
-    /* Get the sequence value that each 16-bit value should be */
-    sig_seq = tsk_getu16(fs->endian, upd->upd_val);
-    /* cycle through each sector */
-    for (i = 1; i < tsk_getu16(fs->endian, mft->upd_cnt); i++) {
-        uint8_t *new_val, *old_val;
-        /* The offset into the buffer of the value to analyze */
-        size_t offset = i * NTFS_UPDATE_SEQ_STRIDE - 2;
-        /* get the current sequence value */
-        uint16_t cur_seq =
-            tsk_getu16(fs->endian, (uintptr_t) a_buf + offset);
-        if (cur_seq != sig_seq) {
-            /* get the replacement value */
-            uint16_t cur_repl =
-                tsk_getu16(fs->endian, &upd->upd_seq + (i - 1) * 2);
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_GENFS);
-
-            tsk_error_set_errstr
-                ("Incorrect update sequence value in MFT entry\nSignature Value: 0x%"
-                PRIx16 " Actual Value: 0x%" PRIx16
-                " Replacement Value: 0x%" PRIx16
-                "\nThis is typically because of a corrupted entry",
-                sig_seq, cur_seq, cur_repl);
-            return TSK_COR;
+    tsk_take_lock(&ntfs->lock);
+    if (ntfs->bmap_chunks[chunk] == NULL) {
+        ntfs->bmap_chunks[chunk] =
+            (uint8_t *) tsk_malloc(NTFS_BMAP_CHUNK * fs->block_size);
+        if (ntfs->bmap_chunks[chunk] == NULL) {
+            tsk_release_lock(&ntfs->lock);
+            return NULL;
         }
+    }
+    buf = &ntfs->bmap_chunks[chunk][(a_clust % NTFS_BMAP_CHUNK) *
+        fs->block_size];
+    if (ntfs->bmap_loaded[a_clust]) {
+        tsk_release_lock(&ntfs->lock);
+        return buf;
+    }
 
-        new_val = &upd->upd_seq + (i - 1) * 2;
-        old_val = (uint8_t *) ((uintptr_t) a_buf + offset);
-        /*
-           if (tsk_verbose)
-           tsk_fprintf(stderr,
-           "ntfs_dinode_lookup: upd_seq %i   Replacing: %.4"
-           PRIx16 "   With: %.4" PRIx16 "\n", i,
-           tsk_getu16(fs->endian, old_val), tsk_getu16(fs->endian,
-           new_val));
-         */
-        *old_val++ = *new_val++;
-        *old_val = *new_val;
+    ntfs_bmap_load_chunk(ntfs, chunk);
+    if (ntfs->bmap_loaded[a_clust]) {
+        tsk_release_lock(&ntfs->lock);
+        return buf;
+    }
+
+    /* the span read failed, so read just this cluster to report why */
+    fsaddr = ntfs_bmap_fsaddr(ntfs, a_clust);
+    if (fsaddr == 0) {
+        tsk_release_lock(&ntfs->lock);
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
+        tsk_error_set_errstr
+            ("is_clustalloc: cluster not found in bitmap: %" PRIuDADDR
+            "", a_clust);
+        return NULL;
+    }
+    if (fsaddr > fs->last_block) {
+        tsk_release_lock(&ntfs->lock);
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
+        tsk_error_set_errstr
+            ("is_clustalloc: Cluster in bitmap too large for image: %"
+            PRIuDADDR, fsaddr);
+        return NULL;
+    }
+    cnt = tsk_fs_read_block(fs, fsaddr, (char *) buf, fs->block_size);
+    if (cnt != fs->block_size) {
+        tsk_release_lock(&ntfs->lock);
+        if (cnt >= 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_READ);
+        }
+        tsk_error_set_errstr2
+            ("is_clustalloc: Error reading bitmap at %" PRIuDADDR, fsaddr);
+        return NULL;
     }
-
-    return TSK_OK;
+    ntfs->bmap_loaded[a_clust] = 1;
+    tsk_release_lock(&ntfs->lock);
+    return buf;
 }
 
+/*
+ * Count the allocated clusters in the file system using the $Bitmap.
+ * Returns 1 on error and 0 on success.
+ */
+static uint8_t
+ntfs_bmap_count_alloc(NTFS_INFO * ntfs, TSK_DADDR_T * a_alloc)
+{
+    TSK_FS_INFO *fs = &ntfs->fs_info;
+    TSK_DADDR_T bits_p_clust = 8 * fs->block_size;
+    TSK_DADDR_T c;
+
+    *a_alloc = 0;
+    if (ntfs->bmap == NULL)
+        return 1;
+
+    for (c = 0; c * bits_p_clust <= fs->last_block; c++) {
+        const uint8_t *buf;
+        TSK_DADDR_T end = bits_p_clust;
 
+        if ((buf = ntfs_bmap_get(ntfs, c)) == NULL)
+            return 1;
+        if (fs->last_block - c * bits_p_clust + 1 < end)
+            end = fs->last_block - c * bits_p_clust + 1;
+        *a_alloc += tsk_fs_bitmap_count(buf, 0, (size_t) end);
+    }
+    return 0;
+}
 
 /*
  * given a cluster, return the allocation status or
@@ -430,10 +919,8 @@ ntfs_dinode_lookup(NTFS_INFO * a_ntfs, char *a_buf, TSK_INUM_T a_mftnum)
 static int
 is_clustalloc(NTFS_INFO * ntfs, TSK_DADDR_T addr)
 {
-    int bits_p_clust, b;
-    TSK_DADDR_T base;
-    int8_t ret;
-    bits_p_clust = 8 * ntfs->fs_info.block_size;
+    TSK_DADDR_T bits_p_clust;
+    const uint8_t *buf;
 
     /* While we are loading the MFT, assume that everything
      * is allocated.  This should only be needed when we are
@@ -459,70 +946,12 @@ is_clustalloc(NTFS_INFO * ntfs, TSK_DADDR_T addr)
         return -1;
     }
 
-    /* identify the base cluster in the bitmap file */
-    base = addr / bits_p_clust;
-    b = (int) (addr % bits_p_clust);
-
-    tsk_take_lock(&ntfs->lock);
-
-    /* is this the same as in the cached buffer? */
-    if (base != ntfs->bmap_buf_off) {
-        TSK_DADDR_T c = base;
-        TSK_FS_ATTR_RUN *run;
-        TSK_DADDR_T fsaddr = 0;
-        ssize_t cnt;
-
-        /* get the file system address of the bitmap cluster */
-        for (run = ntfs->bmap; run; run = run->next) {
-            if (run->len <= c) {
-                c -= run->len;
-            }
-            else {
-                fsaddr = run->addr + c;
-                break;
-            }
-        }
-
-        if (fsaddr == 0) {
-            tsk_release_lock(&ntfs->lock);
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
-            tsk_error_set_errstr
-                ("is_clustalloc: cluster not found in bitmap: %" PRIuDADDR
-                "", c);
-            return -1;
-        }
-        if (fsaddr > ntfs->fs_info.last_block) {
-            tsk_release_lock(&ntfs->lock);
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
-            tsk_error_set_errstr
-                ("is_clustalloc: Cluster in bitmap too large for image: %"
-                PRIuDADDR, fsaddr);
-            return -1;
-        }
-        ntfs->bmap_buf_off = base;
-        cnt = tsk_fs_read_block
-            (&ntfs->fs_info, fsaddr, ntfs->bmap_buf,
-            ntfs->fs_info.block_size);
-        if (cnt != ntfs->fs_info.block_size) {
-            tsk_release_lock(&ntfs->lock);
-            if (cnt >= 0) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_READ);
-            }
-            tsk_error_set_errstr2
-                ("is_clustalloc: Error reading bitmap at %" PRIuDADDR,
-                fsaddr);
-            return -1;
-        }
-    }
+    bits_p_clust = 8 * ntfs->fs_info.block_size;
+    if ((buf = ntfs_bmap_get(ntfs, addr / bits_p_clust)) == NULL)
+        return -1;
 
     /* identify if the cluster is allocated or not */
-    ret = (isset(ntfs->bmap_buf, b)) ? 1 : 0;
-
-    tsk_release_lock(&ntfs->lock);
-    return ret;
+    return (isset(buf, addr % bits_p_clust)) ? 1 : 0;
 }
 
 
@@ -768,15 +1197,15 @@ typedef struct {
 /**
  * Reset the values in the NTFS_COMP_INFO structure.  We need to
  * do this in between every compression unit that we process in the file.
+ * The buffers are not cleared because only the first comp_len and
+ * uncomp_idx bytes of them are ever used.
  *
  * @param comp Structure to reset
  */
 static void
 ntfs_uncompress_reset(NTFS_COMP_INFO * comp)
 {
-    memset(comp->uncomp_buf, 0, comp->buf_size_b);
     comp->uncomp_idx = 0;
-    memset(comp->comp_buf, 0, comp->buf_size_b);
     comp->comp_len = 0;
 }
 
@@ -900,6 +1329,17 @@ ntfs_uncompress_compunit(NTFS_COMP_INFO * comp)
                     tsk_fprintf(stderr,
                         "ntfs_uncompress_compunit: New Tag: %x\n", header);
 
+                /* Fast path for a group of 8 symbol tokens */
+                if ((header == 0) && (cl_index + 8 <= blk_end)
+                    && (comp->uncomp_idx + 8 <= comp->buf_size_b)
+                    && (tsk_verbose == 0)) {
+                    memcpy(&comp->uncomp_buf[comp->uncomp_idx],
+                        &comp->comp_buf[cl_index], 8);
+                    comp->uncomp_idx += 8;
+                    cl_index += 8;
+                    continue;
+                }
+
                 for (a = 0; a < 8 && cl_index < blk_end; a++) {
 
                     /* Determine token type and parse appropriately. *
@@ -1009,14 +1449,21 @@ ntfs_uncompress_compunit(NTFS_COMP_INFO * comp)
                             return 1;
                         }
 
-                        for (;
-                            start_position_index <= end_position_index
-                            && comp->uncomp_idx < comp->buf_size_b;
-                            start_position_index++) {
-
-                            // Copy the previous data to the current position
-                            comp->uncomp_buf[comp->uncomp_idx++]
-                                = comp->uncomp_buf[start_position_index];
+                        /* Copy the previous data to the current position.
+                         * The source and destination overlap if the
+                         * offset is smaller than the length, which
+                         * repeats the data.  Copying at most offset bytes
+                         * at a time gives the same result as a byte by
+                         * byte copy. The checks above make sure that
+                         * it all fits. */
+                        i = end_position_index - start_position_index + 1;
+                        while (i > 0) {
+                            size_t cpy = (i < offset) ? i : offset;
+                            memcpy(&comp->uncomp_buf[comp->uncomp_idx],
+                                &comp->uncomp_buf[comp->uncomp_idx -
+                                    offset], cpy);
+                            comp->uncomp_idx += cpy;
+                            i -= cpy;
                         }
                     }
                     header >>= 1;
@@ -1027,21 +1474,24 @@ ntfs_uncompress_compunit(NTFS_COMP_INFO * comp)
 
         // this block contains uncompressed data 
         else {
-            while (cl_index < blk_end && cl_index < comp->comp_len) {
-                /* This seems to happen only with corrupt data -- such as
-                 * when an unallocated file is being processed... */
-                if (comp->uncomp_idx >= comp->buf_size_b) {
-                    tsk_error_reset();
-                    tsk_error_set_errno(TSK_ERR_FS_FWALK);
-                    tsk_error_set_errstr
-                        ("ntfs_uncompress_compunit: Trying to write past end of uncompression buffer (1) -- corrupt data?)");
-                    return 1;
-                }
+            // blk_end was checked against comp_len above
+            size_t cpy = blk_end - cl_index;
 
-                // Place data in uncompression_buffer
-                comp->uncomp_buf[comp->uncomp_idx++] =
-                    comp->comp_buf[cl_index++];
+            /* This seems to happen only with corrupt data -- such as
+             * when an unallocated file is being processed... */
+            if (cpy > comp->buf_size_b - comp->uncomp_idx) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                tsk_error_set_errstr
+                    ("ntfs_uncompress_compunit: Trying to write past end of uncompression buffer (1) -- corrupt data?)");
+                return 1;
             }
+
+            // Place data in uncompression_buffer
+            memcpy(&comp->uncomp_buf[comp->uncomp_idx],
+                &comp->comp_buf[cl_index], cpy);
+            comp->uncomp_idx += cpy;
+            cl_index += cpy;
         }
     }                           // end of loop inside of compression unit
 
@@ -1162,6 +1612,423 @@ ntfs_proc_compunit(NTFS_INFO * ntfs, NTFS_COMP_INFO * comp,
 
 
 
+/* Maximum number of decompressed units in NTFS_INFO.comp_cache */
+#define NTFS_COMP_CACHE_MAX 64
+
+/* Maximum number of compression units that are processed as a batch
+ * (the units of a batch are decompressed in parallel) */
+#define NTFS_COMP_QUEUE_MAX 16
+
+
+/**
+ * Determine if a compression unit is stored compressed.  Only those
+ * units are cached because the others do not need to be decompressed.
+ *
+ * @param comp_unit List of addresses that store the unit
+ * @param comp_unit_size Number of addresses in comp_unit
+ * @returns 1 if the unit is compressed
+ */
+static uint8_t
+ntfs_compunit_iscomp(const TSK_DADDR_T * comp_unit, uint32_t comp_unit_size)
+{
+    return ((comp_unit_size > 0) && (comp_unit[0] != 0)
+        && (comp_unit[comp_unit_size - 1] == 0)) ? 1 : 0;
+}
+
+/* Unlink an entry from the cache list.  Must hold comp_cache_lock. */
+static void
+ntfs_comp_cache_unlink(NTFS_INFO * ntfs, NTFS_COMP_CACHE_ENTRY * entry)
+{
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        ntfs->comp_cache_head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        ntfs->comp_cache_tail = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+/* Add an entry to the front of the cache list.  Must hold comp_cache_lock. */
+static void
+ntfs_comp_cache_push(NTFS_INFO * ntfs, NTFS_COMP_CACHE_ENTRY * entry)
+{
+    entry->prev = NULL;
+    entry->next = ntfs->comp_cache_head;
+    if (ntfs->comp_cache_head)
+        ntfs->comp_cache_head->prev = entry;
+    else
+        ntfs->comp_cache_tail = entry;
+    ntfs->comp_cache_head = entry;
+}
+
+/**
+ * Look for a decompressed unit in the cache and copy it into comp.
+ *
+ * @param ntfs File system
+ * @param comp Compression state info (output is stored in here)
+ * @param comp_unit List of addresses that store the unit
+ * @param comp_unit_size Number of addresses in comp_unit
+ * @returns 1 if the unit was found and 0 if not
+ */
+static uint8_t
+ntfs_comp_cache_get(NTFS_INFO * ntfs, NTFS_COMP_INFO * comp,
+    const TSK_DADDR_T * comp_unit, uint32_t comp_unit_size)
+{
+    NTFS_COMP_CACHE_ENTRY *entry;
+    uint32_t compsize =
+        (uint32_t) (comp->buf_size_b / ntfs->fs_info.block_size);
+
+    tsk_take_lock(&ntfs->comp_cache_lock);
+    for (entry = ntfs->comp_cache_head; entry != NULL; entry = entry->next) {
+        if ((entry->addrs[0] == comp_unit[0])
+            && (entry->addr_cnt == comp_unit_size)
+            && (entry->compsize == compsize)
+            && (memcmp(entry->addrs, comp_unit,
+                    comp_unit_size * sizeof(TSK_DADDR_T)) == 0)) {
+            memcpy(comp->uncomp_buf, entry->data, entry->data_len);
+            comp->uncomp_idx = entry->data_len;
+            if (entry != ntfs->comp_cache_head) {
+                ntfs_comp_cache_unlink(ntfs, entry);
+                ntfs_comp_cache_push(ntfs, entry);
+            }
+            tsk_release_lock(&ntfs->comp_cache_lock);
+            return 1;
+        }
+    }
+    tsk_release_lock(&ntfs->comp_cache_lock);
+    return 0;
+}
+
+/**
+ * Add a decompressed unit to the cache.  The least recently used unit is
+ * removed if the cache is full.  Errors are ignored because the cache is
+ * only an optimization.
+ *
+ * @param ntfs File system
+ * @param comp Compression state info with the decompressed unit
+ * @param comp_unit List of addresses that store the unit
+ * @param comp_unit_size Number of addresses in comp_unit
+ */
+static void
+ntfs_comp_cache_add(NTFS_INFO * ntfs, const NTFS_COMP_INFO * comp,
+    const TSK_DADDR_T * comp_unit, uint32_t comp_unit_size)
+{
+    NTFS_COMP_CACHE_ENTRY *entry;
+
+    /* The addresses and data are stored after the entry */
+    if ((entry = (NTFS_COMP_CACHE_ENTRY *) malloc(sizeof(*entry) +
+                comp_unit_size * sizeof(TSK_DADDR_T) + comp->uncomp_idx))
+        == NULL)
+        return;
+    entry->addrs = (TSK_DADDR_T *) & entry[1];
+    entry->addr_cnt = comp_unit_size;
+    memcpy(entry->addrs, comp_unit, comp_unit_size * sizeof(TSK_DADDR_T));
+    entry->compsize =
+        (uint32_t) (comp->buf_size_b / ntfs->fs_info.block_size);
+    entry->data = (char *) &entry->addrs[comp_unit_size];
+    entry->data_len = comp->uncomp_idx;
+    memcpy(entry->data, comp->uncomp_buf, comp->uncomp_idx);
+
+    tsk_take_lock(&ntfs->comp_cache_lock);
+    ntfs_comp_cache_push(ntfs, entry);
+    if (++ntfs->comp_cache_cnt > NTFS_COMP_CACHE_MAX) {
+        NTFS_COMP_CACHE_ENTRY *old = ntfs->comp_cache_tail;
+        ntfs_comp_cache_unlink(ntfs, old);
+        ntfs->comp_cache_cnt--;
+        free(old);
+    }
+    tsk_release_lock(&ntfs->comp_cache_lock);
+}
+
+/* Free all of the decompressed units in the cache */
+static void
+ntfs_comp_cache_free(NTFS_INFO * ntfs)
+{
+    while (ntfs->comp_cache_head) {
+        NTFS_COMP_CACHE_ENTRY *entry = ntfs->comp_cache_head;
+        ntfs->comp_cache_head = entry->next;
+        free(entry);
+    }
+    ntfs->comp_cache_tail = NULL;
+    ntfs->comp_cache_cnt = 0;
+}
+
+
+/* A compression unit that is queued for processing */
+typedef struct {
+    NTFS_COMP_INFO comp;        // buffers and the decompressed data
+    TSK_DADDR_T *addrs;         // addresses that store the unit
+    uint32_t addr_cnt;          // number of addresses in addrs
+    uint8_t done;               // set when the unit does not need to be processed
+    uint8_t failed;             // set if the unit could not be processed
+    uint32_t err_no;            // error if failed is set
+    char errstr[TSK_ERROR_STRING_MAX_LENGTH + 1];
+    char errstr2[TSK_ERROR_STRING_MAX_LENGTH + 1];
+} NTFS_COMP_UNIT;
+
+/* Compression units of an attribute that are processed as a batch */
+typedef struct {
+    NTFS_INFO *ntfs;
+    NTFS_COMP_UNIT *units;
+    size_t max;                 // number of entries in units
+    size_t cnt;                 // number of units that are queued
+    TSK_FS_PAR_POOL *pool;      // threads that decompress the units
+    uint8_t pool_started;       // set once the pool has been started
+} NTFS_COMP_QUEUE;
+
+static void
+ntfs_comp_queue_free(NTFS_COMP_QUEUE * queue)
+{
+    size_t i;
+
+    tsk_fs_par_pool_stop(queue->pool);
+    queue->pool = NULL;
+    queue->pool_started = 0;
+    if (queue->units == NULL)
+        return;
+    for (i = 0; i < queue->max; i++) {
+        ntfs_uncompress_done(&queue->units[i].comp);
+        free(queue->units[i].addrs);
+    }
+    free(queue->units);
+    queue->units = NULL;
+}
+
+/**
+ * Setup the queue of compression units with buffers for a_max units.
+ *
+ * @param queue Queue to initialize
+ * @param ntfs File system
+ * @param compunit_size_c The size (in clusters) of a compression unit
+ * @param a_max Number of units that the queue can hold
+ * @return 1 on error and 0 on success
+ */
+static uint8_t
+ntfs_comp_queue_init(NTFS_COMP_QUEUE * queue, NTFS_INFO * ntfs,
+    uint32_t compunit_size_c, size_t a_max)
+{
+    size_t i;
+
+    if (a_max == 0)
+        a_max = 1;
+    else if (a_max > NTFS_COMP_QUEUE_MAX)
+        a_max = NTFS_COMP_QUEUE_MAX;
+
+    queue->ntfs = ntfs;
+    queue->cnt = 0;
+    queue->max = a_max;
+    queue->pool = NULL;
+    queue->pool_started = 0;
+    if ((queue->units =
+            (NTFS_COMP_UNIT *) tsk_malloc(a_max *
+                sizeof(NTFS_COMP_UNIT))) == NULL)
+        return 1;
+
+    for (i = 0; i < a_max; i++) {
+        if ((ntfs_uncompress_setup(&ntfs->fs_info, &queue->units[i].comp,
+                    compunit_size_c))
+            || ((queue->units[i].addrs =
+                    (TSK_DADDR_T *) tsk_malloc(compunit_size_c *
+                        sizeof(TSK_DADDR_T))) == NULL)) {
+            ntfs_comp_queue_free(queue);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* tsk_fs_par_pool_run() callback that processes one unit of the queue */
+static void
+ntfs_comp_queue_proc_unit(void *a_ptr, size_t a_idx)
+{
+    NTFS_COMP_QUEUE *queue = (NTFS_COMP_QUEUE *) a_ptr;
+    NTFS_COMP_UNIT *unit = &queue->units[a_idx];
+
+    if (unit->done)
+        return;
+
+    if (ntfs_proc_compunit(queue->ntfs, &unit->comp, unit->addrs,
+            unit->addr_cnt)) {
+        // errors are per thread, so save it for the caller
+        unit->failed = 1;
+        unit->err_no = tsk_error_get_errno();
+        strncpy(unit->errstr, tsk_error_get_errstr(),
+            TSK_ERROR_STRING_MAX_LENGTH);
+        strncpy(unit->errstr2, tsk_error_get_errstr2(),
+            TSK_ERROR_STRING_MAX_LENGTH);
+        return;
+    }
+    if (ntfs_compunit_iscomp(unit->addrs, unit->addr_cnt))
+        ntfs_comp_cache_add(queue->ntfs, &unit->comp, unit->addrs,
+            unit->addr_cnt);
+}
+
+/**
+ * Process the units in the queue and store the decompressed data in
+ * each unit.  Units that are in the cache are copied from there and
+ * the others are decompressed, in parallel if there is more than one.
+ * The threads are started the first time that they are needed and are
+ * reused for the later batches of the queue.
+ *
+ * @param queue Queue of units to process
+ * @returns Number of units (from the start of the queue) that were
+ * processed.  If this is less than the number of queued units, the
+ * error of the next unit is set.
+ */
+static size_t
+ntfs_comp_queue_proc(NTFS_COMP_QUEUE * queue)
+{
+    size_t i, todo = 0;
+
+    for (i = 0; i < queue->cnt; i++) {
+        NTFS_COMP_UNIT *unit = &queue->units[i];
+
+        unit->failed = 0;
+        unit->done = 0;
+        if ((ntfs_compunit_iscomp(unit->addrs, unit->addr_cnt))
+            && (ntfs_comp_cache_get(queue->ntfs, &unit->comp, unit->addrs,
+                    unit->addr_cnt)))
+            unit->done = 1;
+        else if (ntfs_compunit_iscomp(unit->addrs, unit->addr_cnt))
+            todo++;
+    }
+
+    // only compressed units are worth giving to other threads
+    if (todo > 1) {
+        if (queue->pool_started == 0) {
+            queue->pool = tsk_fs_par_pool_start(0);
+            queue->pool_started = 1;
+        }
+        tsk_fs_par_pool_run(queue->pool, queue->cnt,
+            ntfs_comp_queue_proc_unit, queue);
+    }
+    else {
+        for (i = 0; i < queue->cnt; i++) {
+            ntfs_comp_queue_proc_unit(queue, i);
+            if (queue->units[i].failed)
+                break;
+        }
+    }
+
+    for (i = 0; i < queue->cnt; i++) {
+        NTFS_COMP_UNIT *unit = &queue->units[i];
+        if (unit->failed) {
+            tsk_error_reset();
+            tsk_error_set_errno(unit->err_no);
+            tsk_error_set_errstr("%s", unit->errstr);
+            if (unit->errstr2[0] != '\0')
+                tsk_error_set_errstr2("%s", unit->errstr2);
+            return i;
+        }
+    }
+    return queue->cnt;
+}
+
+
+/**
+ * Process the compression units that are queued by ntfs_attr_walk_special()
+ * and call the callback for each of their clusters.
+ *
+ * @param fs_attr Attribute being walked
+ * @param queue Queue of units (empty when this returns)
+ * @param a_off [in,out] Offset in the attribute of the first unit
+ * @param a_retval [out] Last value returned by the callback
+ * @param a_stop [out] Set to 1 if the walk should stop
+ * @param a_action Callback
+ * @param ptr Pointer to pass to the callback
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+ntfs_attr_walk_special_units(const TSK_FS_ATTR * fs_attr,
+    NTFS_COMP_QUEUE * queue, TSK_OFF_T * a_off, int *a_retval,
+    uint8_t * a_stop, TSK_FS_FILE_WALK_CB a_action, void *ptr)
+{
+    TSK_FS_INFO *fs = fs_attr->fs_file->fs_info;
+    NTFS_INFO *ntfs = (NTFS_INFO *) fs;
+    size_t unit_cnt, u;
+
+    unit_cnt = ntfs_comp_queue_proc(queue);
+
+    for (u = 0; u <= unit_cnt && u < queue->cnt; u++) {
+        NTFS_COMP_UNIT *unit = &queue->units[u];
+        size_t i;
+
+        // decompression of this unit failed
+        if (u == unit_cnt) {
+            tsk_error_set_errstr2("%" PRIuINUM " - type: %"
+                PRIu32 "  id: %d Status: %s",
+                fs_attr->fs_file->meta->addr, fs_attr->type,
+                fs_attr->id,
+                (fs_attr->fs_file->meta->
+                    flags & TSK_FS_META_FLAG_ALLOC) ?
+                "Allocated" : "Deleted");
+            queue->cnt = 0;
+            return 1;
+        }
+
+        // now call the callback with the uncompressed data
+        for (i = 0; i < unit->addr_cnt; i++) {
+            int myflags;
+            size_t read_len;
+            int retval;
+
+            myflags = TSK_FS_BLOCK_FLAG_CONT | TSK_FS_BLOCK_FLAG_COMP;
+            retval = is_clustalloc(ntfs, unit->addrs[i]);
+            if (retval == -1) {
+                if (fs_attr->fs_file->meta->flags & TSK_FS_META_FLAG_UNALLOC)
+                    tsk_error_set_errno(TSK_ERR_FS_RECOVER);
+                queue->cnt = 0;
+                return 1;
+            }
+            else if (retval == 1) {
+                myflags |= TSK_FS_BLOCK_FLAG_ALLOC;
+            }
+            else if (retval == 0) {
+                myflags |= TSK_FS_BLOCK_FLAG_UNALLOC;
+            }
+
+            if (fs_attr->size - *a_off > fs->block_size)
+                read_len = fs->block_size;
+            else
+                read_len = (size_t) (fs_attr->size - *a_off);
+
+            if (i * fs->block_size + read_len > unit->comp.uncomp_idx) {
+                tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                tsk_error_set_errstr
+                    ("ntfs_attrwalk_special: Trying to read past end of uncompressed buffer: %"
+                    PRIuSIZE " %" PRIuSIZE " Meta: %" PRIuINUM
+                    " Status: %s",
+                    i * fs->block_size + read_len,
+                    unit->comp.uncomp_idx,
+                    fs_attr->fs_file->meta->addr,
+                    (fs_attr->fs_file->meta->
+                        flags & TSK_FS_META_FLAG_ALLOC) ?
+                    "Allocated" : "Deleted");
+                queue->cnt = 0;
+                return 1;
+            }
+
+            // call the callback
+            *a_retval =
+                a_action(fs_attr->fs_file, *a_off, unit->addrs[i],
+                &unit->comp.uncomp_buf[i * fs->block_size], read_len,
+                myflags, ptr);
+
+            *a_off += read_len;
+
+            if ((*a_off >= fs_attr->size) || (*a_retval != TSK_WALK_CONT)) {
+                *a_stop = 1;
+                queue->cnt = 0;
+                return 0;
+            }
+        }
+    }
+    queue->cnt = 0;
+    return 0;
+}
+
 /**
  * Currently ignores the SPARSE flag
  */
@@ -1200,9 +2067,8 @@ ntfs_attr_walk_special(const TSK_FS_ATTR * fs_attr,
     if (fs_attr->flags & TSK_FS_ATTR_COMP) {
         TSK_DADDR_T addr;
         TSK_FS_ATTR_RUN *fs_attr_run;
-        TSK_DADDR_T *comp_unit;
-        uint32_t comp_unit_idx = 0;
-        NTFS_COMP_INFO comp;
+        NTFS_COMP_QUEUE queue;
+        NTFS_COMP_UNIT *unit;
         TSK_OFF_T off = 0;
         int retval;
         uint8_t stop_loop = 0;
@@ -1215,18 +2081,16 @@ ntfs_attr_walk_special(const TSK_FS_ATTR * fs_attr,
             return 1;
         }
 
-        /* Allocate the buffers and state structure */
-        if (ntfs_uncompress_setup(fs, &comp, fs_attr->nrd.compsize)) {
-            return 1;
-        }
-
-        comp_unit =
-            (TSK_DADDR_T *) tsk_malloc(fs_attr->nrd.compsize *
-            sizeof(TSK_DADDR_T));
-        if (comp_unit == NULL) {
-            ntfs_uncompress_done(&comp);
+        /* Allocate the buffers and state structure.  Units are queued
+         * and processed in batches so that they can be decompressed
+         * in parallel. */
+        if (ntfs_comp_queue_init(&queue, ntfs, fs_attr->nrd.compsize,
+                (size_t) (fs_attr->nrd.allocsize / fs->block_size /
+                    fs_attr->nrd.compsize))) {
             return 1;
         }
+        unit = &queue.units[0];
+        unit->addr_cnt = 0;
         retval = TSK_WALK_CONT;
 
         /* cycle through the number of runs we have */
@@ -1256,11 +2120,30 @@ ntfs_attr_walk_special(const TSK_FS_ATTR * fs_attr,
                         (fs_attr->fs_file->meta->
                             flags & TSK_FS_META_FLAG_ALLOC) ? "Allocated" :
                         "Deleted");
-                    free(comp_unit);
-                    ntfs_uncompress_done(&comp);
+                    ntfs_comp_queue_free(&queue);
                     return 1;
                 }
                 else {
+                    // the full units that are queued come before this run
+                    if (queue.cnt) {
+                        size_t addr_cnt = unit->addr_cnt;
+
+                        if (ntfs_attr_walk_special_units(fs_attr, &queue,
+                                &off, &retval, &stop_loop, a_action,
+                                ptr)) {
+                            ntfs_comp_queue_free(&queue);
+                            return 1;
+                        }
+                        if (stop_loop)
+                            break;
+
+                        // keep the partial unit at the front of the queue
+                        memmove(queue.units[0].addrs, unit->addrs,
+                            addr_cnt * sizeof(TSK_DADDR_T));
+                        unit = &queue.units[0];
+                        unit->addr_cnt = addr_cnt;
+                    }
+
                     off += (fs_attr_run->len * fs->block_size);
                     continue;
                 }
@@ -1287,100 +2170,32 @@ ntfs_attr_walk_special(const TSK_FS_ATTR * fs_attr,
                             flags & TSK_FS_META_FLAG_ALLOC) ? "Allocated" :
                         "Deleted");
 
-                    free(comp_unit);
-                    ntfs_uncompress_done(&comp);
+                    ntfs_comp_queue_free(&queue);
                     return 1;
                 }
 
                 // queue up the addresses until we get a full unit
-                comp_unit[comp_unit_idx++] = addr;
+                unit->addrs[unit->addr_cnt++] = addr;
 
-                // time to decompress (if queue is full or this is the last block)
-                if ((comp_unit_idx == fs_attr->nrd.compsize)
+                // time to queue the unit (if it is full or this is the last block)
+                if ((unit->addr_cnt == fs_attr->nrd.compsize)
                     || ((len_idx == fs_attr_run->len - 1)
                         && (fs_attr_run->next == NULL))) {
-                    size_t i;
-
-                    // decompress the unit
-                    if (ntfs_proc_compunit(ntfs, &comp, comp_unit,
-                            comp_unit_idx)) {
-                        tsk_error_set_errstr2("%" PRIuINUM " - type: %"
-                            PRIu32 "  id: %d Status: %s",
-                            fs_attr->fs_file->meta->addr, fs_attr->type,
-                            fs_attr->id,
-                            (fs_attr->fs_file->meta->
-                                flags & TSK_FS_META_FLAG_ALLOC) ?
-                            "Allocated" : "Deleted");
-                        free(comp_unit);
-                        ntfs_uncompress_done(&comp);
-                        return 1;
-                    }
-
-                    // now call the callback with the uncompressed data
-                    for (i = 0; i < comp_unit_idx; i++) {
-                        int myflags;
-                        size_t read_len;
-
-                        myflags =
-                            TSK_FS_BLOCK_FLAG_CONT |
-                            TSK_FS_BLOCK_FLAG_COMP;
-                        retval = is_clustalloc(ntfs, comp_unit[i]);
-                        if (retval == -1) {
-                            if (fs_attr->fs_file->meta->
-                                flags & TSK_FS_META_FLAG_UNALLOC)
-                                tsk_error_set_errno(TSK_ERR_FS_RECOVER);
-                            free(comp_unit);
-                            ntfs_uncompress_done(&comp);
-                            return 1;
-                        }
-                        else if (retval == 1) {
-                            myflags |= TSK_FS_BLOCK_FLAG_ALLOC;
-                        }
-                        else if (retval == 0) {
-                            myflags |= TSK_FS_BLOCK_FLAG_UNALLOC;
-                        }
 
-                        if (fs_attr->size - off > fs->block_size)
-                            read_len = fs->block_size;
-                        else
-                            read_len = (size_t) (fs_attr->size - off);
-
-                        if (i * fs->block_size + read_len >
-                            comp.uncomp_idx) {
-                            tsk_error_set_errno(TSK_ERR_FS_FWALK);
-                            tsk_error_set_errstr
-                                ("ntfs_attrwalk_special: Trying to read past end of uncompressed buffer: %"
-                                PRIuSIZE " %" PRIuSIZE " Meta: %" PRIuINUM
-                                " Status: %s",
-                                i * fs->block_size + read_len,
-                                comp.uncomp_idx,
-                                fs_attr->fs_file->meta->addr,
-                                (fs_attr->fs_file->meta->
-                                    flags & TSK_FS_META_FLAG_ALLOC) ?
-                                "Allocated" : "Deleted");
-                            free(comp_unit);
-                            ntfs_uncompress_done(&comp);
+                    // decompress the queued units if the queue is full
+                    // or there are no more
+                    if ((++queue.cnt == queue.max)
+                        || ((len_idx == fs_attr_run->len - 1)
+                            && (fs_attr_run->next == NULL))) {
+                        if (ntfs_attr_walk_special_units(fs_attr, &queue,
+                                &off, &retval, &stop_loop, a_action,
+                                ptr)) {
+                            ntfs_comp_queue_free(&queue);
                             return 1;
                         }
-
-                        // call the callback
-                        retval =
-                            a_action(fs_attr->fs_file, off, comp_unit[i],
-                            &comp.uncomp_buf[i * fs->block_size], read_len,
-                            myflags, ptr);
-
-                        off += read_len;
-
-                        if (off >= fs_attr->size) {
-                            stop_loop = 1;
-                            break;
-                        }
-                        if (retval != TSK_WALK_CONT) {
-                            stop_loop = 1;
-                            break;
-                        }
                     }
-                    comp_unit_idx = 0;
+                    unit = &queue.units[queue.cnt];
+                    unit->addr_cnt = 0;
                 }
 
                 if (stop_loop)
@@ -1399,8 +2214,15 @@ ntfs_attr_walk_special(const TSK_FS_ATTR * fs_attr,
                 break;
         }
 
-        ntfs_uncompress_done(&comp);
-        free(comp_unit);
+        // process any full units that are still queued
+        if ((stop_loop == 0) && (queue.cnt)
+            && (ntfs_attr_walk_special_units(fs_attr, &queue, &off,
+                    &retval, &stop_loop, a_action, ptr))) {
+            ntfs_comp_queue_free(&queue);
+            return 1;
+        }
+
+        ntfs_comp_queue_free(&queue);
 
         if (retval == TSK_WALK_ERROR)
             return 1;
@@ -1417,6 +2239,75 @@ ntfs_attr_walk_special(const TSK_FS_ATTR * fs_attr,
 }
 
 
+/**
+ * Process the compression units that are queued by ntfs_file_read_special()
+ * and copy their data to the output buffer.
+ *
+ * @param a_fs_attr Attribute being read
+ * @param queue Queue of units (empty when this returns)
+ * @param a_offset Offset in the attribute that the read started at
+ * @param a_buf Output buffer
+ * @param a_len Length of a_buf
+ * @param a_buf_idx [in,out] Number of bytes in a_buf that have been copied
+ * @param a_byteoffset [in,out] Offset in the first unit to start copying at
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+ntfs_file_read_special_units(const TSK_FS_ATTR * a_fs_attr,
+    NTFS_COMP_QUEUE * queue, TSK_OFF_T a_offset, char *a_buf,
+    size_t a_len, size_t * a_buf_idx, size_t * a_byteoffset)
+{
+    size_t unit_cnt, u;
+
+    unit_cnt = ntfs_comp_queue_proc(queue);
+
+    for (u = 0; u < queue->cnt && *a_buf_idx < a_len; u++) {
+        NTFS_COMP_UNIT *unit = &queue->units[u];
+        size_t cpylen;
+
+        // decompression of this unit failed
+        if (u == unit_cnt) {
+            tsk_error_set_errstr2("%" PRIuINUM " - type: %"
+                PRIu32 "  id: %d  Status: %s",
+                a_fs_attr->fs_file->meta->addr,
+                a_fs_attr->type, a_fs_attr->id,
+                (a_fs_attr->fs_file->meta->
+                    flags & TSK_FS_META_FLAG_ALLOC) ?
+                "Allocated" : "Deleted");
+            queue->cnt = 0;
+            return 1;
+        }
+
+        // copy uncompressed data to the output buffer
+        if (unit->comp.uncomp_idx < *a_byteoffset) {
+
+            // @@ ERROR
+            queue->cnt = 0;
+            return 1;
+        }
+        else if (unit->comp.uncomp_idx - *a_byteoffset <
+            a_len - *a_buf_idx) {
+            cpylen = unit->comp.uncomp_idx - *a_byteoffset;
+        }
+        else {
+            cpylen = a_len - *a_buf_idx;
+        }
+        // Make sure not to return more bytes than are in the file
+        if (cpylen > (a_fs_attr->size - (a_offset + *a_buf_idx)))
+            cpylen =
+                (size_t) (a_fs_attr->size - (a_offset + *a_buf_idx));
+
+        memcpy(&a_buf[*a_buf_idx], &unit->comp.uncomp_buf[*a_byteoffset],
+            cpylen);
+
+        // reset this in case we need to also read from the next unit
+        *a_byteoffset = 0;
+        *a_buf_idx += cpylen;
+    }
+    queue->cnt = 0;
+    return 0;
+}
+
 /** \internal
  *
  * @returns number of bytes read or -1 on error (incl if offset is past EOF)
@@ -1444,9 +2335,10 @@ ntfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
         TSK_FS_ATTR_RUN *data_run_cur;
         TSK_OFF_T cu_blkoffset; // block offset of starting compression unit to start reading from
         size_t byteoffset;      // byte offset in compression unit of where we want to start reading from
-        TSK_DADDR_T *comp_unit;
-        uint32_t comp_unit_idx = 0;
-        NTFS_COMP_INFO comp;
+        NTFS_COMP_QUEUE queue;
+        NTFS_COMP_UNIT *unit;
+        size_t unit_b;          // size of a compression unit in bytes
+        size_t pending;         // most bytes that the queued units can add to buf
         size_t buf_idx = 0;
 
         if (a_fs_attr->nrd.compsize <= 0) {
@@ -1482,19 +2374,6 @@ ntfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
             return len;
         }
 
-        /* Allocate the buffers and state structure */
-        if (ntfs_uncompress_setup(fs, &comp, a_fs_attr->nrd.compsize)) {
-            return -1;
-        }
-
-        comp_unit =
-            (TSK_DADDR_T *) tsk_malloc(a_fs_attr->nrd.compsize *
-            sizeof(TSK_DADDR_T));
-        if (comp_unit == NULL) {
-            ntfs_uncompress_done(&comp);
-            return -1;
-        }
-
         // figure out the needed offsets
         cu_blkoffset = a_offset / fs->block_size;
         if (cu_blkoffset) {
@@ -1504,9 +2383,20 @@ ntfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
 
         byteoffset = (size_t) (a_offset - cu_blkoffset * fs->block_size);
 
+        /* Allocate the buffers and state structure.  The queue only
+         * needs to hold the units that cover the requested range. */
+        unit_b = a_fs_attr->nrd.compsize * fs->block_size;
+        if (ntfs_comp_queue_init(&queue, ntfs, a_fs_attr->nrd.compsize,
+                (byteoffset + a_len + unit_b - 1) / unit_b)) {
+            return -1;
+        }
+        unit = &queue.units[0];
+        unit->addr_cnt = 0;
+        pending = 0;
+
         // cycle through the run until we find where we can start to process the clusters
         for (data_run_cur = a_fs_attr->nrd.run;
-            (data_run_cur) && (buf_idx < a_len);
+            (data_run_cur) && (buf_idx + pending < a_len);
             data_run_cur = data_run_cur->next) {
 
             TSK_DADDR_T addr;
@@ -1530,60 +2420,36 @@ ntfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
                 addr += a;
 
             /* cycle through the relevant in the run */
-            for (; a < data_run_cur->len && buf_idx < a_len; a++) {
+            for (; a < data_run_cur->len && buf_idx + pending < a_len; a++) {
 
                 // queue up the addresses until we get a full unit
-                comp_unit[comp_unit_idx++] = addr;
+                unit->addrs[unit->addr_cnt++] = addr;
 
-                // time to decompress (if queue is full or this is the last block)
-                if ((comp_unit_idx == a_fs_attr->nrd.compsize)
+                // time to queue the unit (if it is full or this is the last block)
+                if ((unit->addr_cnt == a_fs_attr->nrd.compsize)
                     || ((a == data_run_cur->len - 1)
                         && (data_run_cur->next == NULL))) {
-                    size_t cpylen;
-
-                    // decompress the unit
-                    if (ntfs_proc_compunit(ntfs, &comp, comp_unit,
-                            comp_unit_idx)) {
-                        tsk_error_set_errstr2("%" PRIuINUM " - type: %"
-                            PRIu32 "  id: %d  Status: %s",
-                            a_fs_attr->fs_file->meta->addr,
-                            a_fs_attr->type, a_fs_attr->id,
-                            (a_fs_attr->fs_file->meta->
-                                flags & TSK_FS_META_FLAG_ALLOC) ?
-                            "Allocated" : "Deleted");
-                        free(comp_unit);
-                        ntfs_uncompress_done(&comp);
-                        return -1;
-                    }
 
-                    // copy uncompressed data to the output buffer
-                    if (comp.uncomp_idx < byteoffset) {
-
-                        // @@ ERROR
-                        free(comp_unit);
-                        ntfs_uncompress_done(&comp);
-                        return -1;
-                    }
-                    else if (comp.uncomp_idx - byteoffset <
-                        a_len - buf_idx) {
-                        cpylen = comp.uncomp_idx - byteoffset;
-                    }
-                    else {
-                        cpylen = a_len - buf_idx;
+                    // byteoffset is only set until the first unit is copied
+                    pending += (queue.cnt == 0) ? unit_b - byteoffset : unit_b;
+
+                    // decompress the queued units if the queue is full,
+                    // they cover the rest of the request, or there are
+                    // no more
+                    if ((++queue.cnt == queue.max)
+                        || (buf_idx + pending >= a_len)
+                        || ((a == data_run_cur->len - 1)
+                            && (data_run_cur->next == NULL))) {
+                        if (ntfs_file_read_special_units(a_fs_attr, &queue,
+                                a_offset, a_buf, a_len, &buf_idx,
+                                &byteoffset)) {
+                            ntfs_comp_queue_free(&queue);
+                            return -1;
+                        }
+                        pending = 0;
                     }
-                    // Make sure not to return more bytes than are in the file
-                    if (cpylen > (a_fs_attr->size - (a_offset + buf_idx)))
-                        cpylen =
-                            (size_t) (a_fs_attr->size - (a_offset +
-                                buf_idx));
-
-                    memcpy(&a_buf[buf_idx], &comp.uncomp_buf[byteoffset],
-                        cpylen);
-
-                    // reset this in case we need to also read from the next run
-                    byteoffset = 0;
-                    buf_idx += cpylen;
-                    comp_unit_idx = 0;
+                    unit = &queue.units[queue.cnt];
+                    unit->addr_cnt = 0;
                 }
                 /* If it is a sparse run, don't increment the addr so that
                  * it remains 0 */
@@ -1595,8 +2461,15 @@ ntfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
             }
         }
 
-        free(comp_unit);
-        ntfs_uncompress_done(&comp);
+        // process any full units that are still queued
+        if ((queue.cnt)
+            && (ntfs_file_read_special_units(a_fs_attr, &queue, a_offset,
+                    a_buf, a_len, &buf_idx, &byteoffset))) {
+            ntfs_comp_queue_free(&queue);
+            return -1;
+        }
+
+        ntfs_comp_queue_free(&queue);
         return (ssize_t) buf_idx;
     }
     else {
@@ -1631,6 +2504,89 @@ typedef struct {
     uint32_t newId[256];
 } NTFS_ATTRLIST_MAP;
 
+/* Number of entries that ntfs_proc_attrlist() reads at a time.  Entries
+ * that are this close together in $MFT are read with one read. */
+#define NTFS_ATTRLIST_SPAN  16
+
+/* Scratch buffers for ntfs_proc_attrlist().  These are kept in a pool
+ * in NTFS_INFO so that files with attribute lists do not need new
+ * buffers each time they are loaded. */
+struct NTFS_ATTRLIST_SCRATCH {
+    NTFS_ATTRLIST_SCRATCH *next;        ///< Next unused scratch in the pool
+    NTFS_ATTRLIST_MAP map;
+    TSK_INUM_T todo[256];       ///< Extension entries to process (in list order)
+    uint16_t sorted[256];       ///< Indices into todo, sorted by entry address
+    uint8_t loaded[256];        ///< 1 if the entry was read into mft
+    char *mft;                  ///< Raw entries for todo
+    size_t mft_max;             ///< Number of entries that mft can hold
+    char *span;                 ///< Buffer for NTFS_ATTRLIST_SPAN entries
+    char *list;                 ///< Content of the attribute list
+    size_t list_size;           ///< Size of the list buffer
+};
+
+/**
+ * Get a scratch buffer from the pool (or allocate a new one).
+ *
+ * @param ntfs File system
+ * @returns NULL on error
+ */
+static NTFS_ATTRLIST_SCRATCH *
+ntfs_attrlist_scratch_get(NTFS_INFO * ntfs)
+{
+    NTFS_ATTRLIST_SCRATCH *scratch;
+
+    tsk_take_lock(&ntfs->attrlist_pool_lock);
+    scratch = ntfs->attrlist_pool;
+    if (scratch)
+        ntfs->attrlist_pool = scratch->next;
+    tsk_release_lock(&ntfs->attrlist_pool_lock);
+
+    if (scratch == NULL) {
+        if ((scratch =
+                (NTFS_ATTRLIST_SCRATCH *)
+                tsk_malloc(sizeof(NTFS_ATTRLIST_SCRATCH))) == NULL)
+            return NULL;
+        if ((scratch->span =
+                (char *) tsk_malloc(NTFS_ATTRLIST_SPAN *
+                    ntfs->mft_rsize_b)) == NULL) {
+            free(scratch);
+            return NULL;
+        }
+    }
+    scratch->next = NULL;
+    scratch->map.num_used = 0;
+    return scratch;
+}
+
+/**
+ * Return a scratch buffer to the pool.
+ */
+static void
+ntfs_attrlist_scratch_put(NTFS_INFO * ntfs,
+    NTFS_ATTRLIST_SCRATCH * scratch)
+{
+    tsk_take_lock(&ntfs->attrlist_pool_lock);
+    scratch->next = ntfs->attrlist_pool;
+    ntfs->attrlist_pool = scratch;
+    tsk_release_lock(&ntfs->attrlist_pool_lock);
+}
+
+/**
+ * Free the scratch buffers in the pool.
+ */
+static void
+ntfs_attrlist_pool_free(NTFS_INFO * ntfs)
+{
+    while (ntfs->attrlist_pool) {
+        NTFS_ATTRLIST_SCRATCH *scratch = ntfs->attrlist_pool;
+        ntfs->attrlist_pool = scratch->next;
+        free(scratch->mft);
+        free(scratch->span);
+        free(scratch->list);
+        free(scratch);
+    }
+}
+
 /*
  * Process an NTFS attribute sequence and load the data into data
  * structures.
@@ -2258,6 +3214,90 @@ ntfs_proc_attrseq(NTFS_INFO * ntfs,
 
 
 
+/**
+ * Read the extension entries of an attribute list into the scratch
+ * buffer.  The entries are sorted and entries that are close together
+ * in $MFT are read with one read.  This is only an optimization:
+ * entries that cannot be read this way are not marked as loaded and
+ * are read later with ntfs_dinode_lookup() so that their errors are
+ * reported the same way as before.
+ *
+ * @param ntfs File system
+ * @param scratch Scratch buffer with todo filled in
+ * @param a_cnt Number of entries in todo
+ */
+static void
+ntfs_attrlist_load(NTFS_INFO * ntfs, NTFS_ATTRLIST_SCRATCH * scratch,
+    uint16_t a_cnt)
+{
+    NTFS_MFT_SCAN scan;
+    uint16_t i, j, k;
+
+    memset(scratch->loaded, 0, a_cnt);
+
+    /* the runs of $MFT are not indexed until it is loaded */
+    if ((ntfs->mft_runs == NULL) || (a_cnt == 0))
+        return;
+
+    if (scratch->mft_max < a_cnt) {
+        char *mft;
+        if ((mft = (char *) tsk_realloc(scratch->mft,
+                    (size_t) a_cnt * ntfs->mft_rsize_b)) == NULL) {
+            tsk_error_reset();
+            return;
+        }
+        scratch->mft = mft;
+        scratch->mft_max = a_cnt;
+    }
+
+    /* sort the indices by address (there are at most 256 and they
+     * are usually already close to sorted) */
+    for (i = 0; i < a_cnt; i++) {
+        TSK_INUM_T addr = scratch->todo[i];
+        for (j = i; (j > 0) && (scratch->todo[scratch->sorted[j - 1]] >
+                addr); j--)
+            scratch->sorted[j] = scratch->sorted[j - 1];
+        scratch->sorted[j] = i;
+    }
+
+    memset(&scan, 0, sizeof(scan));
+    scan.ntfs = ntfs;
+    scan.buf = scratch->span;
+    scan.buf_max = NTFS_ATTRLIST_SPAN;
+
+    for (i = 0; i < a_cnt; i = j) {
+        TSK_INUM_T first = scratch->todo[scratch->sorted[i]];
+
+        /* find the entries that can be read with the first one */
+        for (j = i + 1; (j < a_cnt)
+            && (scratch->todo[scratch->sorted[j]] - first <
+                NTFS_ATTRLIST_SPAN); j++);
+
+        if (ntfs_mft_scan_load(&scan, first,
+                scratch->todo[scratch->sorted[j - 1]]))
+            continue;
+
+        for (k = i; k < j; k++) {
+            uint16_t idx = scratch->sorted[k];
+            size_t off = (size_t) (scratch->todo[idx] - first);
+            char *mft = &scratch->mft[(size_t) idx * ntfs->mft_rsize_b];
+
+            if (off >= scan.buf_cnt)
+                break;
+            // leave the entries that ntfs_dinode_lookup() rejects to it
+            if ((scratch->todo[idx] == 0)
+                || (scratch->todo[idx] > ntfs->fs_info.last_inum - 1))
+                continue;
+            memcpy(mft, &scan.buf[off * ntfs->mft_rsize_b],
+                ntfs->mft_rsize_b);
+            if (ntfs_mft_fixup(ntfs, mft) == TSK_OK)
+                scratch->loaded[idx] = 1;
+            else
+                tsk_error_reset();
+        }
+    }
+}
+
 /*
  * Attribute lists are used when all of the attribute  headers can not
  * fit into one MFT entry.  This contains an entry for every attribute
@@ -2281,8 +3321,9 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & ntfs->fs_info;
     ntfs_mft *mft;
     TSK_FS_LOAD_FILE load_file;
-    TSK_INUM_T mftToDo[256];
+    TSK_INUM_T *mftToDo;
     uint16_t mftToDoCnt = 0;
+    NTFS_ATTRLIST_SCRATCH *scratch;
     NTFS_ATTRLIST_MAP *map;
     uint16_t nextid = 0;
     int a;
@@ -2292,35 +3333,29 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
             "ntfs_proc_attrlist: Processing entry %"
             PRIuINUM "\n", fs_file->meta->addr);
 
-    if ((mft = (ntfs_mft *) tsk_malloc(ntfs->mft_rsize_b)) == NULL) {
-        return TSK_ERR;
-    }
-
-    if ((map =
-            (NTFS_ATTRLIST_MAP *) tsk_malloc(sizeof(NTFS_ATTRLIST_MAP))) ==
-        NULL) {
-        free(mft);
+    if ((scratch = ntfs_attrlist_scratch_get(ntfs)) == NULL) {
         return TSK_ERR;
     }
-
-    /* Clear the contents of the todo buffer */
-    memset(mftToDo, 0, sizeof(mftToDo));
+    map = &scratch->map;
+    mftToDo = scratch->todo;
 
     /* Get a copy of the attribute list stream using the above action */
-    load_file.left = load_file.total = (size_t) fs_attr_attrlist->size;
-    load_file.base = load_file.cur = buf =
-        tsk_malloc((size_t) fs_attr_attrlist->size);
-    if (buf == NULL) {
-        free(mft);
-        free(map);
-        return TSK_ERR;
+    if (scratch->list_size < (size_t) fs_attr_attrlist->size) {
+        if ((buf = (char *) tsk_realloc(scratch->list,
+                    (size_t) fs_attr_attrlist->size)) == NULL) {
+            ntfs_attrlist_scratch_put(ntfs, scratch);
+            return TSK_ERR;
+        }
+        scratch->list = buf;
+        scratch->list_size = (size_t) fs_attr_attrlist->size;
     }
+    load_file.left = load_file.total = (size_t) fs_attr_attrlist->size;
+    load_file.base = load_file.cur = buf = scratch->list;
     endaddr = (uintptr_t) buf + (uintptr_t) fs_attr_attrlist->size;
     if (tsk_fs_attr_walk(fs_attr_attrlist, 0, tsk_fs_load_file_action,
             (void *) &load_file)) {
         tsk_error_errstr2_concat("- processing attrlist");
-        free(mft);
-        free(map);
+        ntfs_attrlist_scratch_put(ntfs, scratch);
         return TSK_ERR;
     }
 
@@ -2332,9 +3367,7 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
         tsk_error_set_errno(TSK_ERR_FS_FWALK);
         tsk_error_set_errstr2("processing attrlist of entry %" PRIuINUM,
             fs_file->meta->addr);
-        free(mft);
-        free(buf);
-        free(map);
+        ntfs_attrlist_scratch_put(ntfs, scratch);
         return TSK_ERR;
     }
 
@@ -2382,11 +3415,13 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
             }
         }
 
-        // add it to the list
+        // add it to the list (the name slot may have been used before)
         if (found == 0) {
             map->extMft[map->num_used] = mftnum;
             map->type[map->num_used] = type;
             map->extId[map->num_used] = id;
+            memset(map->name[map->num_used], 0,
+                sizeof(map->name[map->num_used]));
             memcpy(map->name[map->num_used], &list->name, list->nlen * 2);
             if (map->num_used < 255)
                 map->num_used++;
@@ -2417,6 +3452,9 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
         map->newId[a] = ++nextid;
     }
 
+    /* Read the entries in address order before processing them in
+     * list order */
+    ntfs_attrlist_load(ntfs, scratch, mftToDoCnt);
 
     /* Process the ToDo list & and call ntfs_proc_attr */
     for (a = 0; a < mftToDoCnt; a++) {
@@ -2440,22 +3478,27 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
             continue;
         }
 
-        if ((retval =
-                ntfs_dinode_lookup(ntfs, (char *) mft,
-                    mftToDo[a])) != TSK_OK) {
-            // if the entry is corrupt, then continue
-            if (retval == TSK_COR) {
-                if (tsk_verbose)
-                    tsk_error_print(stderr);
-                tsk_error_reset();
-                continue;
-            }
+        if (scratch->loaded[a]) {
+            mft = (ntfs_mft *) & scratch->mft[(size_t) a *
+                ntfs->mft_rsize_b];
+        }
+        else {
+            mft = (ntfs_mft *) scratch->span;
+            if ((retval =
+                    ntfs_dinode_lookup(ntfs, (char *) mft,
+                        mftToDo[a])) != TSK_OK) {
+                // if the entry is corrupt, then continue
+                if (retval == TSK_COR) {
+                    if (tsk_verbose)
+                        tsk_error_print(stderr);
+                    tsk_error_reset();
+                    continue;
+                }
 
-            free(mft);
-            free(map);
-            free(buf);
-            tsk_error_errstr2_concat(" - proc_attrlist");
-            return TSK_ERR;
+                ntfs_attrlist_scratch_put(ntfs, scratch);
+                tsk_error_errstr2_concat(" - proc_attrlist");
+                return TSK_ERR;
+            }
         }
 
         /* verify that this entry refers to the original one */
@@ -2480,9 +3523,7 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
                     mftToDo[a], 
                     fs_file->meta->addr,
                     tsk_getu48(fs->endian, mft->base_ref));
-                free(mft);
-                free(map);
-                free(buf);
+                ntfs_attrlist_scratch_put(ntfs, scratch);
                 return TSK_COR;
             }
         }
@@ -2510,16 +3551,12 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
                 continue;
             }
             tsk_error_errstr2_concat("- proc_attrlist");
-            free(mft);
-            free(map);
-            free(buf);
+            ntfs_attrlist_scratch_put(ntfs, scratch);
             return TSK_ERR;
         }
     }
 
-    free(mft);
-    free(map);
-    free(buf);
+    ntfs_attrlist_scratch_put(ntfs, scratch);
     return TSK_OK;
 }
 
@@ -2901,18 +3938,19 @@ ntfs_attrname_lookup(TSK_FS_INFO * fs, uint16_t type, char *name, int len)
 }
 
 
-/* Load the block bitmap $Data run  and allocate a buffer for a cache
+/* Load the block bitmap $Data run and set up the in-memory copy of it
  *
  * return 1 on error and 0 on success
  * */
 static uint8_t
 ntfs_load_bmap(NTFS_INFO * ntfs)
 {
-    ssize_t cnt = 0;
     ntfs_attr *attr = NULL;
     ntfs_attr *data_attr = NULL;
     TSK_FS_INFO *fs = NULL;
     ntfs_mft *mft = NULL;
+    TSK_FS_ATTR_RUN *run;
+    TSK_DADDR_T bits_p_clust, run_len;
 
     if (ntfs == NULL) {
         goto on_error;
@@ -2968,14 +4006,6 @@ ntfs_load_bmap(NTFS_INFO * ntfs)
                 NULL, NTFS_MFT_BMAP)) != TSK_OK) {
         goto on_error;
     }
-    ntfs->bmap_buf = (char *) tsk_malloc(fs->block_size);
-    if (ntfs->bmap_buf == NULL) {
-        goto on_error;
-    }
-
-    /* Load the first cluster so that we have something there */
-    ntfs->bmap_buf_off = 0;
-
     // Check ntfs->bmap before it is accessed.
     if (ntfs->bmap == NULL) {
         goto on_error;
@@ -2988,14 +4018,32 @@ ntfs_load_bmap(NTFS_INFO * ntfs)
             "", ntfs->bmap->addr);
         goto on_error;
     }
-    cnt =
-        tsk_fs_read_block(fs,
-        ntfs->bmap->addr, ntfs->bmap_buf, fs->block_size);
-    if (cnt != fs->block_size) {
-        if (cnt >= 0) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_READ);
-        }
+
+    /* The in-memory copy covers the clusters of $Bitmap that describe
+     * the file system, but no more than its runs contain. */
+    bits_p_clust = 8 * fs->block_size;
+    ntfs->bmap_clust_cnt = fs->last_block / bits_p_clust + 1;
+    for (run = ntfs->bmap, run_len = 0; run; run = run->next) {
+        run_len += run->len;
+        if (run_len >= ntfs->bmap_clust_cnt)
+            break;
+    }
+    if (run_len < ntfs->bmap_clust_cnt)
+        ntfs->bmap_clust_cnt = run_len;
+
+    ntfs->bmap_chunk_cnt = (size_t) ((ntfs->bmap_clust_cnt +
+            NTFS_BMAP_CHUNK - 1) / NTFS_BMAP_CHUNK);
+    if ((ntfs->bmap_chunks = (uint8_t **) tsk_malloc(ntfs->bmap_chunk_cnt *
+                sizeof(uint8_t *))) == NULL) {
+        goto on_error;
+    }
+    if ((ntfs->bmap_loaded =
+            (uint8_t *) tsk_malloc((size_t) ntfs->bmap_clust_cnt)) == NULL) {
+        goto on_error;
+    }
+
+    /* Load the first chunk so that we have something there */
+    if (ntfs_bmap_get(ntfs, 0) == NULL) {
         tsk_error_set_errstr2("ntfs_load_bmap: Error reading block at %"
             PRIuDADDR, ntfs->bmap->addr);
         goto on_error;
@@ -3170,6 +4218,39 @@ ntfs_sds_to_str(TSK_FS_INFO * a_fs, const ntfs_attr_sds * a_sds,
 
 
 
+/* Hash of a security id for NTFS_INFO.sid_map */
+static size_t
+ntfs_sid_map_hash(uint32_t secid)
+{
+    return (size_t) (secid * 2654435761U);
+}
+
+/** \internal
+ * Find the entry for a security id in NTFS_INFO.sid_map.
+ *
+ * Note: This routine assumes &ntfs->sid_lock is locked by the caller.
+ *
+ * @param ntfs File system
+ * @param secid Security Id to find
+ * @returns NULL if the id is not in $SII
+ */
+static NTFS_SID_ENTRY *
+ntfs_sid_map_find(NTFS_INFO * ntfs, uint32_t secid)
+{
+    size_t mask, i;
+
+    if ((ntfs->sid_map == NULL) || (secid == 0))
+        return NULL;
+
+    mask = ntfs->sid_map_size - 1;
+    for (i = ntfs_sid_map_hash(secid) & mask;; i = (i + 1) & mask) {
+        if (ntfs->sid_map[i].sec_id == secid)
+            return &ntfs->sid_map[i];
+        else if (ntfs->sid_map[i].sec_id == 0)
+            return NULL;
+    }
+}
+
 /** \internal
  * Maps a security id value from a file to its SDS structure
  *
@@ -3182,8 +4263,8 @@ ntfs_sds_to_str(TSK_FS_INFO * a_fs, const ntfs_attr_sds * a_sds,
 static const ntfs_attr_sds *
 ntfs_get_sds(TSK_FS_INFO * fs, uint32_t secid)
 {
-    uint32_t i = 0;
     NTFS_INFO *ntfs = (NTFS_INFO *) fs;
+    NTFS_SID_ENTRY *entry;
     ntfs_attr_sii *sii = NULL;
     ntfs_attr_sds *sds = NULL;
     uint32_t sii_secid = 0;
@@ -3204,21 +4285,10 @@ ntfs_get_sds(TSK_FS_INFO * fs, uint32_t secid)
     }
 
 
-    // Loop through all the SII entries looking for the security id matching that found in the file.
-    // This lookup is obviously O(n^2) for all n files. However, since so many files have the exact
-    // same security identifier, it is not really that bad. In reality, 100,000 files may only map to
-    // 10,000 security identifiers. Since SII entries are 0x28 bytes each and security identifiers
-    // increase incrementally, we could go directly to the entry in question ((secid * 0x28) + 256).
-    // SII entries started at 256 on Vista; however, I did not look at the starting secid for other
-    // versions of NTFS.
-    for (i = 0; i < ntfs->sii_data.used; i++) {
-        if (tsk_getu32(fs->endian,
-                ((ntfs_attr_sii *) (ntfs->sii_data.buffer))[i].
-                key_sec_id) == secid) {
-            sii = &((ntfs_attr_sii *) (ntfs->sii_data.buffer))[i];
-            break;
-        }
-    }
+    // Find the SII entry for the security id in the hash table that
+    // was built when $Secure was loaded.
+    if ((entry = ntfs_sid_map_find(ntfs, secid)) != NULL)
+        sii = &((ntfs_attr_sii *) (ntfs->sii_data.buffer))[entry->sii_idx];
 
     if (sii == NULL) {
         tsk_error_reset();
@@ -3310,6 +4380,8 @@ ntfs_file_get_sidstr(TSK_FS_FILE * a_fs_file, char **sid_str)
     ntfs_attr_si *si;
     const ntfs_attr_sds *sds;
     NTFS_INFO *ntfs = (NTFS_INFO *) a_fs_file->fs_info;
+    NTFS_SID_ENTRY *entry;
+    uint32_t secid;
 
     *sid_str = NULL;
 
@@ -3337,11 +4409,24 @@ ntfs_file_get_sidstr(TSK_FS_FILE * a_fs_file, char **sid_str)
         return 1;
     }
 
+    secid = tsk_getu32(a_fs_file->fs_info->endian, si->sec_id);
+
     tsk_take_lock(&ntfs->sid_lock);
+    // see if we already made the string for this security id
+    entry = ntfs_sid_map_find(ntfs, secid);
+    if ((entry) && (entry->sid_str)) {
+        if ((*sid_str =
+                (char *) tsk_malloc(strlen(entry->sid_str) + 1)) == NULL) {
+            tsk_release_lock(&ntfs->sid_lock);
+            return 1;
+        }
+        strcpy(*sid_str, entry->sid_str);
+        tsk_release_lock(&ntfs->sid_lock);
+        return 0;
+    }
+
     // sds points inside ntfs->sds_data, which we've just locked
-    sds =
-        ntfs_get_sds(a_fs_file->fs_info,
-        tsk_getu32(a_fs_file->fs_info->endian, si->sec_id));
+    sds = ntfs_get_sds(a_fs_file->fs_info, secid);
     if (!sds) {
         tsk_release_lock(&ntfs->sid_lock);
         tsk_error_set_errstr2("- ntfs_file_get_sidstr:SI attribute");
@@ -3352,6 +4437,13 @@ ntfs_file_get_sidstr(TSK_FS_FILE * a_fs_file, char **sid_str)
         tsk_error_set_errstr2("- ntfs_file_get_sidstr:SI attribute");
         return 1;
     }
+
+    // save a copy for the other files with this id (it is only a cache,
+    // so ignore allocation errors)
+    if ((entry)
+        && ((entry->sid_str =
+                (char *) malloc(strlen(*sid_str) + 1)) != NULL))
+        strcpy(entry->sid_str, *sid_str);
     tsk_release_lock(&ntfs->sid_lock);
     return 0;
 #else
@@ -3460,6 +4552,71 @@ ntfs_proc_sii(TSK_FS_INFO * fs, NTFS_SXX_BUFFER * sii_buffer)
 }
 
 
+/** \internal
+ * Build the hash table that maps security ids to their entries in
+ * ntfs->sii_data.  The SID strings are created later as they are needed.
+ *
+ * Note: This routine is called only from ntfs_load_secure and therefore
+ * does not need to lock ntfs->sid_lock.
+ *
+ * @param ntfs File system with the $SII entries loaded
+ * @returns 1 on error
+ */
+static uint8_t
+ntfs_sid_map_load(NTFS_INFO * ntfs)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ntfs->fs_info;
+    size_t size, mask, i;
+
+    if (ntfs->sii_data.used == 0)
+        return 0;
+
+    // keep the table at most half full
+    for (size = 16; size < ntfs->sii_data.used * 2; size *= 2);
+
+    if ((ntfs->sid_map =
+            (NTFS_SID_ENTRY *) tsk_malloc(size *
+                sizeof(NTFS_SID_ENTRY))) == NULL)
+        return 1;
+    ntfs->sid_map_size = size;
+    mask = size - 1;
+
+    for (i = 0; i < ntfs->sii_data.used; i++) {
+        uint32_t secid = tsk_getu32(fs->endian,
+            ((ntfs_attr_sii *) (ntfs->sii_data.buffer))[i].key_sec_id);
+        size_t h;
+
+        if (secid == 0)
+            continue;
+
+        // the first entry for an id is the one that is used
+        for (h = ntfs_sid_map_hash(secid) & mask;
+            (ntfs->sid_map[h].sec_id != 0)
+            && (ntfs->sid_map[h].sec_id != secid); h = (h + 1) & mask);
+        if (ntfs->sid_map[h].sec_id == 0) {
+            ntfs->sid_map[h].sec_id = secid;
+            ntfs->sid_map[h].sii_idx = (uint32_t) i;
+        }
+    }
+    return 0;
+}
+
+/* Free the hash table of security ids and their SID strings */
+static void
+ntfs_sid_map_free(NTFS_INFO * ntfs)
+{
+    size_t i;
+
+    if (ntfs->sid_map == NULL)
+        return;
+    for (i = 0; i < ntfs->sid_map_size; i++)
+        free(ntfs->sid_map[i].sid_str);
+    free(ntfs->sid_map);
+    ntfs->sid_map = NULL;
+    ntfs->sid_map_size = 0;
+}
+
+
 /*
  * Load the $Secure attributes so that we can identify the user.
  *
@@ -3485,6 +4642,8 @@ ntfs_load_secure(NTFS_INFO * ntfs)
     ntfs->sds_data.buffer = NULL;
     ntfs->sds_data.size = 0;
     ntfs->sds_data.used = 0;
+    ntfs->sid_map = NULL;
+    ntfs->sid_map_size = 0;
 
 
     // Open $Secure. The $SDS stream contains all the security descriptors
@@ -3641,7 +4800,7 @@ ntfs_load_secure(NTFS_INFO * ntfs)
     }
 
     tsk_fs_file_close(secure);
-    return 0;
+    return ntfs_sid_map_load(ntfs);
 }
 
 #endif
@@ -3671,6 +4830,62 @@ ntfs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
 }
 
 
+/*
+ * Get the flags of a cluster and the number of clusters that follow
+ * it (up to a_end) with the same allocation status.
+ *
+ * Returns the number of clusters in the run or 0 on error
+ */
+static TSK_DADDR_T
+ntfs_block_getflags_run(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr,
+    TSK_DADDR_T a_end, TSK_FS_BLOCK_FLAG_ENUM * a_flags)
+{
+    NTFS_INFO *ntfs = (NTFS_INFO *) a_fs;
+    TSK_DADDR_T bits_p_clust = 8 * a_fs->block_size;
+    TSK_DADDR_T base, b, end, len = 0;
+    int retval;
+
+    /* this also loads the needed part of the bitmap */
+    retval = is_clustalloc(ntfs, a_addr);
+    if (retval == -1)
+        return 0;
+    *a_flags =
+        (retval == 1) ? TSK_FS_BLOCK_FLAG_ALLOC : TSK_FS_BLOCK_FLAG_UNALLOC;
+
+    if (ntfs->loading_the_MFT == 1)
+        return 1;
+
+    base = a_addr / bits_p_clust;
+    b = a_addr % bits_p_clust;
+
+    /* the run can continue into the following $Bitmap clusters */
+    while (a_addr + len <= a_end) {
+        const uint8_t *buf;
+        TSK_DADDR_T n;
+
+        if ((buf = ntfs_bmap_get(ntfs, base)) == NULL) {
+            tsk_error_reset();
+            break;
+        }
+        if ((len > 0) && ((isset(buf, b) ? 1 : 0) != retval))
+            break;
+
+        end = bits_p_clust;
+        if (a_end - (a_addr + len) + 1 < end - b)
+            end = b + (a_end - (a_addr + len) + 1);
+
+        n = tsk_fs_bitmap_run(buf, (size_t) b, (size_t) end, 0);
+        len += n;
+        if (b + n < bits_p_clust)
+            break;
+        base++;
+        b = 0;
+    }
+
+    return len;
+}
+
+
 
 /*
  * flags: TSK_FS_BLOCK_FLAG_ALLOC and FS_FLAG_UNALLOC
@@ -3804,6 +5019,7 @@ ntfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     TSK_FS_FILE *fs_file;
     TSK_INUM_T end_inum_tmp;
     ntfs_mft *mft;
+    NTFS_MFT_SCAN scan;
     /*
      * Sanity checks.
      */
@@ -3886,10 +5102,6 @@ ntfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         return 1;
     }
 
-    if ((mft = (ntfs_mft *) tsk_malloc(ntfs->mft_rsize_b)) == NULL) {
-        tsk_fs_file_close(fs_file);
-        return 1;
-    }
     // we need to handle fs->last_inum specially because it is for the
     // virtual ORPHANS directory.  Handle it outside of the loop.
     if (end_inum == TSK_FS_ORPHANDIR_INUM(fs))
@@ -3897,15 +5109,21 @@ ntfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     else
         end_inum_tmp = end_inum;
 
+    /* The entries are read from $MFT in large chunks */
+    if (ntfs_mft_scan_init(&scan, ntfs, start_inum, end_inum_tmp)) {
+        tsk_fs_file_close(fs_file);
+        return 1;
+    }
+
 
     for (mftnum = start_inum; mftnum <= end_inum_tmp; mftnum++) {
         int retval;
         TSK_RETVAL_ENUM retval2;
 
-        /* read MFT entry in to NTFS_INFO */
+        /* get the next MFT entry from the scan */
         if ((retval2 =
-                ntfs_dinode_lookup(ntfs, (char *) mft,
-                    mftnum)) != TSK_OK) {
+                ntfs_mft_scan_entry(&scan, mftnum, end_inum_tmp,
+                    (char **) &mft)) != TSK_OK) {
             // if the entry is corrupt, then skip to the next one
             if (retval2 == TSK_COR) {
                 if (tsk_verbose)
@@ -3914,7 +5132,7 @@ ntfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
                 continue;
             }
             tsk_fs_file_close(fs_file);
-            free(mft);
+            ntfs_mft_scan_free(&scan);
             return 1;
         }
 
@@ -3954,7 +5172,7 @@ ntfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
                 continue;
             }
             tsk_fs_file_close(fs_file);
-            free(mft);
+            ntfs_mft_scan_free(&scan);
             return 1;
         }
 
@@ -3968,12 +5186,12 @@ ntfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         retval = a_action(fs_file, ptr);
         if (retval == TSK_WALK_STOP) {
             tsk_fs_file_close(fs_file);
-            free(mft);
+            ntfs_mft_scan_free(&scan);
             return 0;
         }
         else if (retval == TSK_WALK_ERROR) {
             tsk_fs_file_close(fs_file);
-            free(mft);
+            ntfs_mft_scan_free(&scan);
             return 1;
         }
     }
@@ -3986,25 +5204,25 @@ ntfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
 
         if (tsk_fs_dir_make_orphan_dir_meta(fs, fs_file->meta)) {
             tsk_fs_file_close(fs_file);
-            free(mft);
+            ntfs_mft_scan_free(&scan);
             return 1;
         }
         /* call action */
         retval = a_action(fs_file, ptr);
         if (retval == TSK_WALK_STOP) {
             tsk_fs_file_close(fs_file);
-            free(mft);
+            ntfs_mft_scan_free(&scan);
             return 0;
         }
         else if (retval == TSK_WALK_ERROR) {
             tsk_fs_file_close(fs_file);
-            free(mft);
+            ntfs_mft_scan_free(&scan);
             return 1;
         }
     }
 
     tsk_fs_file_close(fs_file);
-    free((char *) mft);
+    ntfs_mft_scan_free(&scan);
     return 0;
 }
 
@@ -4036,6 +5254,7 @@ ntfs_fsstat(TSK_FS_INFO * fs, FILE * hFile)
     const TSK_FS_ATTR *fs_attr;
     char asc[512];
     ntfs_attrdef *attrdeftmp;
+    TSK_DADDR_T alloc_clust;
 
     tsk_fprintf(hFile, "FILE SYSTEM INFORMATION\n");
     tsk_fprintf(hFile, "--------------------------------------------\n");
@@ -4138,6 +5357,14 @@ ntfs_fsstat(TSK_FS_INFO * fs, FILE * hFile)
     tsk_fprintf(hFile,
         "Total Sector Range: 0 - %" PRIu64
         "\n", tsk_getu64(fs->endian, ntfs->fs->vol_size_s) - 1);
+
+    if (ntfs_bmap_count_alloc(ntfs, &alloc_clust) == 0) {
+        tsk_fprintf(hFile, "Free Clusters: %" PRIuDADDR "\n",
+            fs->block_count - alloc_clust);
+    }
+    else {
+        tsk_error_reset();
+    }
     /*
      * Attrdef Info
      */
@@ -4711,39 +5938,6 @@ ntfs_istat(TSK_FS_INFO * fs, FILE * hFile,
 
 
 
-/* JOURNAL CODE - MOVE TO NEW FILE AT SOME POINT */
-
-static uint8_t
-ntfs_jopen(TSK_FS_INFO * fs, TSK_INUM_T inum)
-{
-    tsk_error_reset();
-    tsk_error_set_errno(TSK_ERR_FS_UNSUPFUNC);
-    tsk_error_set_errstr("NTFS Journal is not yet supported\n");
-    return 1;
-}
-
-static uint8_t
-ntfs_jentry_walk(TSK_FS_INFO * fs, int flags,
-    TSK_FS_JENTRY_WALK_CB a_action, void *ptr)
-{
-    tsk_error_reset();
-    tsk_error_set_errno(TSK_ERR_FS_UNSUPFUNC);
-    tsk_error_set_errstr("NTFS Journal is not yet supported\n");
-    return 1;
-}
-
-
-static uint8_t
-ntfs_jblk_walk(TSK_FS_INFO * fs, TSK_DADDR_T start,
-    TSK_DADDR_T end, int flags, TSK_FS_JBLK_WALK_CB a_action, void *ptr)
-{
-    tsk_error_reset();
-    tsk_error_set_errno(TSK_ERR_FS_UNSUPFUNC);
-    tsk_error_set_errstr("NTFS Journal is not yet supported\n");
-    return 1;
-}
-
-
 static TSK_FS_ATTR_TYPE_ENUM
 ntfs_get_default_attr_type(const TSK_FS_FILE * a_file)
 {
@@ -4776,19 +5970,33 @@ ntfs_close(TSK_FS_INFO * fs)
         free(ntfs->sds_data.buffer);
     ntfs->sds_data.buffer = NULL;
 
+    ntfs_sid_map_free(ntfs);
+
 #endif
 
     fs->tag = 0;
     free((char *) ntfs->fs);
     tsk_fs_attr_run_free(ntfs->bmap);
-    free(ntfs->bmap_buf);
+    if (ntfs->bmap_chunks) {
+        size_t i;
+        for (i = 0; i < ntfs->bmap_chunk_cnt; i++)
+            free(ntfs->bmap_chunks[i]);
+        free(ntfs->bmap_chunks);
+    }
+    free(ntfs->bmap_loaded);
     tsk_fs_file_close(ntfs->mft_file);
+    free(ntfs->mft_runs);
+    ntfs_comp_cache_free(ntfs);
+    ntfs_attrlist_pool_free(ntfs);
+    ntfs_jclose(ntfs);
 
     if (ntfs->orphan_map)
         ntfs_orphan_map_free(ntfs);
 
     tsk_deinit_lock(&ntfs->lock);
     tsk_deinit_lock(&ntfs->orphan_map_lock);
+    tsk_deinit_lock(&ntfs->comp_cache_lock);
+    tsk_deinit_lock(&ntfs->attrlist_pool_lock);
 #if TSK_USE_SID
     tsk_deinit_lock(&ntfs->sid_lock);
 #endif
@@ -4841,7 +6049,8 @@ ntfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
 
     ntfs->loading_the_MFT = 0;
     ntfs->bmap = NULL;
-    ntfs->bmap_buf = NULL;
+    ntfs->bmap_chunks = NULL;
+    ntfs->bmap_loaded = NULL;
 
     /* Read the boot sector */
     len = roundup(sizeof(ntfs_sb), img_info->sector_size);
@@ -4984,8 +6193,11 @@ ntfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
      * Set the function pointers (before we start calling internal functions)
      */
     fs->inode_walk = ntfs_inode_walk;
+    // each walk reads $MFT into its own buffer and the shared caches are locked
+    fs->flags |= TSK_FS_INFO_FLAG_PAR_INODE_WALK;
     fs->block_walk = ntfs_block_walk;
     fs->block_getflags = ntfs_block_getflags;
+    fs->block_getflags_run = ntfs_block_getflags_run;
 
     fs->get_default_attr_type = ntfs_get_default_attr_type;
     fs->load_attrs = ntfs_load_attrs;
@@ -5009,6 +6221,8 @@ ntfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
     // set up locks
     tsk_init_lock(&ntfs->lock);
     tsk_init_lock(&ntfs->orphan_map_lock);
+    tsk_init_lock(&ntfs->comp_cache_lock);
+    tsk_init_lock(&ntfs->attrlist_pool_lock);
 #if TSK_USE_SID
     tsk_init_lock(&ntfs->sid_lock);
 #endif
@@ -5056,6 +6270,12 @@ ntfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
     /* reset the flag that we are no longer loading $MFT */
     ntfs->loading_the_MFT = 0;
 
+    /* index the runs of $MFT for entry lookups */
+    if (ntfs_load_mft_runs(ntfs)) {
+        tsk_fs_file_close(ntfs->mft_file);
+        goto on_error;
+    }
+
     /* Volume ID */
     for (fs->fs_id_used = 0; fs->fs_id_used < 8; fs->fs_id_used++) {
         fs->fs_id[fs->fs_id_used] = ntfs->fs->serial[fs->fs_id_used];
@@ -5126,7 +6346,8 @@ ntfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
         if( ntfs->fs != NULL ) {
             free( ntfs->fs );
         }
-        free( ntfs );
+        free( ntfs->mft_runs );
+        tsk_fs_free( fs );
     }
     return NULL;
 }
@@ -25,8 +25,8 @@
  * NTFS file name processing internal functions.
  */
 
-#include <map>
 #include <vector>
+#include <algorithm>
 
 /** 
  * Class to hold the pair of MFT entry and sequence. 
@@ -42,11 +42,11 @@ class NTFS_META_ADDR {
         seq = a_seq;
     }
 
-    uint64_t getAddr() {
+    uint64_t getAddr() const {
         return addr;
     }
 
-    uint32_t getSeq() {
+    uint32_t getSeq() const {
         return seq;
     }
 };
@@ -58,42 +58,142 @@ class NTFS_META_ADDR {
  * shown in Windows (when mounted).  They must have been found via the MFT entry, so 
  * we now load all parent to child relationships into the map. 
  * 
- * One of these classes is created per parent folder */
+ * One of these classes is created per file system.  The pairs are collected
+ * while the MFT is walked and then sorted so that the children of each
+ * parent folder (at a given sequence) are next to each other in one array.
+ * A hash table that is keyed by the parent address and sequence points to
+ * the start of each folder's children. */
 class NTFS_PAR_MAP  {
 private:
-        // maps sequence number to list of inums for the folder at that seq.
-        std::map <uint32_t, std::vector <NTFS_META_ADDR> > seq2addrs;
+        // parent to child pair that was found during the MFT walk
+        struct PAIR {
+            TSK_INUM_T par;
+            uint32_t parSeq;
+            uint32_t seq;
+            TSK_INUM_T inum;
+
+            bool operator< (const PAIR &other) const {
+                if (par != other.par)
+                    return par < other.par;
+                if (parSeq != other.parSeq)
+                    return parSeq < other.parSeq;
+                if (inum != other.inum)
+                    return inum < other.inum;
+                return seq < other.seq;
+            }
+        };
+
+        // hash table entry for a parent folder at a given sequence
+        struct SLOT {
+            TSK_INUM_T par;
+            uint32_t parSeq;
+            uint32_t cnt;       // number of children (0 if slot is empty)
+            size_t start;       // index of first child in children
+        };
+
+        std::vector <PAIR> pairs;       // pairs that still need to be indexed
+        std::vector <NTFS_META_ADDR> children;
+        std::vector <SLOT> slots;       // size is a power of 2
+
+        static size_t hash(TSK_INUM_T par, uint32_t parSeq) {
+            uint64_t h = ((uint64_t) par) ^ (((uint64_t) parSeq) << 48);
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            return (size_t) h;
+        }
+
+        const SLOT *find(TSK_INUM_T par, uint32_t parSeq) const {
+            if (slots.empty())
+                return NULL;
+            size_t mask = slots.size() - 1;
+            for (size_t i = hash(par, parSeq) & mask; ; i = (i + 1) & mask) {
+                const SLOT &slot = slots[i];
+                if (slot.cnt == 0)
+                    return NULL;
+                if ((slot.par == par) && (slot.parSeq == parSeq))
+                    return &slot;
+            }
+        }
+
 public:
         /**
-         * Add a child to this parent.
-         * @param seq Sequence of the parent that this child belonged to
+         * Add a child to this map.  index() must be called before the
+         * child can be found.
+         * @param par Address of the parent folder
+         * @param parSeq Sequence of the parent that this child belonged to
          * @param inum Address of child in the folder.
          * @param seq Sequence of child in the folder
          */
-        void add (uint32_t parSeq, TSK_INUM_T inum, uint32_t seq) {
-            NTFS_META_ADDR addr(inum, seq);
-            seq2addrs[parSeq].push_back(addr);
+        void add (TSK_INUM_T par, uint32_t parSeq, TSK_INUM_T inum, uint32_t seq) {
+            PAIR pair;
+            pair.par = par;
+            pair.parSeq = parSeq;
+            pair.seq = seq;
+            pair.inum = inum;
+            pairs.push_back(pair);
         }
 
         /**
-         * Test if there are any children for this directory at a given sequence.
-         * @param seq Sequence to test.
-         * @returns true if children exist
+         * Build the child array and hash table from the added pairs.
+         * The children of each folder are sorted by address, which is the
+         * order that a single-threaded MFT walk finds them in.
          */
-        bool exists (uint32_t seq) {
-            if (seq2addrs.count(seq) > 0) 
-                return true;
-            else
-                return false;
+        void index () {
+            std::sort(pairs.begin(), pairs.end());
+
+            size_t groups = 0;
+            for (size_t i = 0; i < pairs.size(); i++) {
+                if ((i == 0) || (pairs[i].par != pairs[i - 1].par)
+                    || (pairs[i].parSeq != pairs[i - 1].parSeq))
+                    groups++;
+            }
+
+            // keep the table at most half full
+            size_t size = 16;
+            while (size < groups * 2)
+                size *= 2;
+            slots.assign(size, SLOT());
+            children.clear();
+            children.reserve(pairs.size());
+
+            SLOT *cur = NULL;
+            for (size_t i = 0; i < pairs.size(); i++) {
+                const PAIR &pair = pairs[i];
+                if ((cur == NULL) || (cur->par != pair.par)
+                    || (cur->parSeq != pair.parSeq)) {
+                    size_t mask = slots.size() - 1;
+                    size_t s = hash(pair.par, pair.parSeq) & mask;
+                    while (slots[s].cnt != 0)
+                        s = (s + 1) & mask;
+                    cur = &slots[s];
+                    cur->par = pair.par;
+                    cur->parSeq = pair.parSeq;
+                    cur->start = children.size();
+                }
+                children.push_back(NTFS_META_ADDR(pair.inum, pair.seq));
+                cur->cnt++;
+            }
+
+            // free the memory of the pairs
+            std::vector <PAIR>().swap(pairs);
         }
 
-        /** 
-         * Get the children for this folder at a given sequence.  Use exists first. 
-         * @param seq Sequence number to retrieve children for.
-         * @returns list of INUMS for children.
+        /**
+         * Get the children for a folder at a given sequence.
+         * @param par Address of the folder
+         * @param parSeq Sequence of the folder to retrieve children for.
+         * @param cnt [out] Number of children
+         * @returns list of children or NULL if there are none
          */
-        std::vector <NTFS_META_ADDR> &get (uint32_t seq) {
-            return seq2addrs[seq];
+        const NTFS_META_ADDR *get (TSK_INUM_T par, uint32_t parSeq, size_t *cnt) const {
+            const SLOT *slot = find(par, parSeq);
+            if (slot == NULL) {
+                *cnt = 0;
+                return NULL;
+            }
+            *cnt = slot->cnt;
+            return &children[slot->start];
         }
  };
 
@@ -105,74 +205,63 @@ class NTFS_PAR_MAP  {
 *
 * Assumes that you already have the lock
 */
-static std::map<TSK_INUM_T, NTFS_PAR_MAP> * getParentMap(NTFS_INFO *ntfs) {
+static NTFS_PAR_MAP * getParentMap(NTFS_INFO *ntfs) {
     // allocate it if it hasn't already been 
     if (ntfs->orphan_map == NULL) {
-        ntfs->orphan_map = new std::map<TSK_INUM_T, NTFS_PAR_MAP>;
+        ntfs->orphan_map = new NTFS_PAR_MAP;
     }
-    return (std::map<TSK_INUM_T, NTFS_PAR_MAP> *)ntfs->orphan_map;
+    return (NTFS_PAR_MAP *)ntfs->orphan_map;
 }
 
 
+/* State that is shared by the threads that populate the orphan_map */
+typedef struct {
+    NTFS_INFO *ntfs;
+    NTFS_PAR_MAP *map;
+    tsk_lock_t lock;            // protects map and ntfs->alloc_file_count
+} NTFS_PAR_MAP_BUILD;
+
 
 /** \internal
- * Add a parent and child pair to the map stored in NTFS_INFO
+ * Add the parent and child pairs of a file to the map that is being built.
  *
- * Note: This routine assumes &ntfs->orhpan_map_lock is locked by the caller.
+ * Note: This routine assumes &build->lock is locked by the caller.
  *
- * @param ntfs structure to add the pair to
- * @param par Parent address
+ * @param build Map that is being built
  * @param child_meta Child to add 
  * @returns 1 on error
  */
 static uint8_t
-ntfs_parent_map_add(NTFS_INFO * ntfs, TSK_FS_META_NAME_LIST *name_list, TSK_FS_META *child_meta) 
+ntfs_parent_map_add(NTFS_PAR_MAP_BUILD * build, TSK_FS_META *child_meta) 
 {
-    std::map<TSK_INUM_T, NTFS_PAR_MAP> *tmpParentMap = getParentMap(ntfs);
-    NTFS_PAR_MAP &tmpParMap = (*tmpParentMap)[name_list->par_inode];
-    tmpParMap.add(name_list->par_seq, child_meta->addr, child_meta->seq);
-    return 0;
-}
+    TSK_FS_META_NAME_LIST *fs_name_list;
 
-/** \internal
- * Returns if a parent has children or not.
- *
- * Note: This routine assumes &ntfs->orhpan_map_lock is locked by the caller.
- *
- * @param ntfs File system that has already been analyzed
- * @param par Parent inode to find child files for
- * @seq seq Sequence of parent folder 
- * @returns true if parent has children.
- */
-static bool 
-ntfs_parent_map_exists(NTFS_INFO *ntfs, TSK_INUM_T par, uint32_t seq) 
-{
-    std::map<TSK_INUM_T, NTFS_PAR_MAP> *tmpParentMap = getParentMap(ntfs);
-    if (tmpParentMap->count(par) > 0) {
-        NTFS_PAR_MAP &tmpParMap = (*tmpParentMap)[par];
-        if (tmpParMap.exists(seq))
-            return true;
+    /* go through each file name structure */
+    for (fs_name_list = child_meta->name2; fs_name_list;
+        fs_name_list = fs_name_list->next) {
+        build->map->add(fs_name_list->par_inode, fs_name_list->par_seq,
+            child_meta->addr, child_meta->seq);
     }
-    return false;
+    return 0;
 }
 
 /** \internal
- * Look up a map entry by the parent address. You should call ntfs_parent_map_exists() before this, otherwise
- * an empty entry could be created. 
+ * Look up the children of a parent folder.
  *
  * Note: This routine assumes &ntfs->orhpan_map_lock is locked by the caller.
  *
  * @param ntfs File system that has already been analyzed
  * @param par Parent inode to find child files for
  * @param seq Sequence of parent inode 
- * @returns address of children files in the parent directory
+ * @param cnt [out] Number of children
+ * @returns address of children files in the parent directory (or NULL if
+ * there are none)
  */
-static std::vector <NTFS_META_ADDR> &
-ntfs_parent_map_get(NTFS_INFO * ntfs, TSK_INUM_T par, uint32_t seq)
+static const NTFS_META_ADDR *
+ntfs_parent_map_get(NTFS_INFO * ntfs, TSK_INUM_T par, uint32_t seq, size_t *cnt)
 {
-    std::map<TSK_INUM_T, NTFS_PAR_MAP> *tmpParentMap = getParentMap(ntfs);
-    NTFS_PAR_MAP &tmpParMap = (*tmpParentMap)[par];
-    return tmpParMap.get(seq);
+    NTFS_PAR_MAP *tmpParentMap = getParentMap(ntfs);
+    return tmpParentMap->get(par, seq, cnt);
 }
 
 
@@ -194,7 +283,7 @@ ntfs_orphan_map_free(NTFS_INFO * a_ntfs)
         tsk_release_lock(&a_ntfs->orphan_map_lock);
         return;
     }
-    std::map<TSK_INUM_T, NTFS_PAR_MAP> *tmpParentMap = getParentMap(a_ntfs);
+    NTFS_PAR_MAP *tmpParentMap = getParentMap(a_ntfs);
 
     delete tmpParentMap;
     a_ntfs->orphan_map = NULL;
@@ -203,13 +292,15 @@ ntfs_orphan_map_free(NTFS_INFO * a_ntfs)
 
 
 /* inode_walk callback that is used to populate the orphan_map
- * structure in NTFS_INFO */
+ * structure in NTFS_INFO.  This is called from several threads. */
 static TSK_WALK_RET_ENUM
 ntfs_parent_act(TSK_FS_FILE * fs_file, void *ptr)
 {
-    NTFS_INFO *ntfs = (NTFS_INFO *) fs_file->fs_info;
-    TSK_FS_META_NAME_LIST *fs_name_list;
+    NTFS_PAR_MAP_BUILD *build = (NTFS_PAR_MAP_BUILD *) ptr;
+    NTFS_INFO *ntfs = build->ntfs;
+    uint8_t failed;
 
+    tsk_take_lock(&build->lock);
     if ((fs_file->meta->flags & TSK_FS_META_FLAG_ALLOC) &&
         fs_file->meta->type == TSK_FS_META_TYPE_REG) {
             if (ntfs->alloc_file_count == -1)
@@ -218,15 +309,41 @@ ntfs_parent_act(TSK_FS_FILE * fs_file, void *ptr)
                 ntfs->alloc_file_count++;
     }
 
-    /* go through each file name structure */
-    fs_name_list = fs_file->meta->name2;
-    while (fs_name_list) {
-        if (ntfs_parent_map_add(ntfs, fs_name_list,
-                fs_file->meta))
-            return TSK_WALK_ERROR;
-        fs_name_list = fs_name_list->next;
-    }
-    return TSK_WALK_CONT;
+    failed = ntfs_parent_map_add(build, fs_file->meta);
+    tsk_release_lock(&build->lock);
+
+    return failed ? TSK_WALK_ERROR : TSK_WALK_CONT;
+}
+
+
+/** \internal
+ * Walk the MFT and load the parent to child pairs into the orphan_map
+ * structure in NTFS_INFO.  The walk is split across threads.
+ *
+ * Note: This routine assumes &ntfs->orhpan_map_lock is locked by the caller.
+ *
+ * @param ntfs File system to analyze
+ * @returns 1 on error
+ */
+static uint8_t
+ntfs_parent_map_load(NTFS_INFO * ntfs)
+{
+    TSK_FS_INFO *fs = &ntfs->fs_info;
+    NTFS_PAR_MAP_BUILD build;
+    uint8_t retval;
+
+    build.ntfs = ntfs;
+    build.map = getParentMap(ntfs);
+    tsk_init_lock(&build.lock);
+
+    retval = tsk_fs_meta_walk_parallel(fs, fs->first_inum, fs->last_inum,
+        (TSK_FS_META_FLAG_ENUM)(TSK_FS_META_FLAG_UNALLOC | TSK_FS_META_FLAG_ALLOC),
+        ntfs_parent_act, &build, 0, TSK_FS_META_WALK_PAR_FLAG_NONE);
+    tsk_deinit_lock(&build.lock);
+
+    // index what we have, even on error, so that the map can be used
+    build.map->index();
+    return retval;
 }
 
 
@@ -1220,13 +1337,10 @@ ntfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
     // load and cache the map if it has not already been done
     tsk_take_lock(&ntfs->orphan_map_lock);
     if (ntfs->orphan_map == NULL) {
-        // we do this to make it non-NULL. WE had some images that
+        // this always makes it non-NULL. WE had some images that
         // had no orphan files and it repeatedly did inode_walks
         // because orphan_map was always NULL
-        getParentMap(ntfs);
-
-        if (a_fs->inode_walk(a_fs, a_fs->first_inum, a_fs->last_inum,
-                (TSK_FS_META_FLAG_ENUM)(TSK_FS_META_FLAG_UNALLOC | TSK_FS_META_FLAG_ALLOC), ntfs_parent_act, NULL)) {
+        if (ntfs_parent_map_load(ntfs)) {
             tsk_release_lock(&ntfs->orphan_map_lock);
             return TSK_ERR;
         }
@@ -1249,10 +1363,10 @@ ntfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
             seqToSrch = 0;
     }
 
-    if (ntfs_parent_map_exists(ntfs, a_addr, seqToSrch)) {
+    size_t childCnt;
+    const NTFS_META_ADDR *childFiles = ntfs_parent_map_get(ntfs, a_addr, seqToSrch, &childCnt);
+    if (childFiles != NULL) {
         TSK_FS_NAME *fs_name;
-        
-        std::vector <NTFS_META_ADDR> &childFiles = ntfs_parent_map_get(ntfs, a_addr, seqToSrch);
 
         if ((fs_name = tsk_fs_name_alloc(256, 0)) == NULL)
             return TSK_ERR;
@@ -1261,7 +1375,7 @@ ntfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
         fs_name->par_addr = a_addr;
         fs_name->par_seq = fs_dir->fs_file->meta->seq;
 
-        for (size_t a = 0; a < childFiles.size(); a++) {
+        for (size_t a = 0; a < childCnt; a++) {
             TSK_FS_FILE *fs_file_orp = NULL;
 
             /* Check if fs_dir already has an allocated entry for this
@@ -1342,6 +1456,306 @@ ntfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
 
 
 
+/****************************************************************************
+ * INDEX LOOKUP ROUTINES
+ *
+ * These find a single name by descending the $I30 B+tree instead of
+ * loading the entire directory.  They only report names that are
+ * allocated in the tree, so callers that need deleted or orphan names
+ * must still use ntfs_dir_open_meta().
+ */
+
+/* Maximum depth of the B+tree that we will follow */
+#define NTFS_IDX_MAX_DEPTH  32
+
+/* Upper case version of a UTF-16 character for collation.  We do not
+ * load $UpCase, so only ASCII is folded.  Names with other characters
+ * may not be found and the caller then falls back to a full scan. */
+static UTF16
+ntfs_idx_upcase(UTF16 a_c)
+{
+    if ((a_c >= 'a') && (a_c <= 'z'))
+        return a_c - 'a' + 'A';
+    return a_c;
+}
+
+/* Compare the key with the name in an index entry (using the file name
+ * collation).
+ * @returns <0 if the key sorts before the entry, 0 if equal, and >0 if after */
+static int
+ntfs_idx_name_cmp(TSK_FS_INFO * a_fs, const UTF16 * a_key, size_t a_key_len,
+    const ntfs_attr_fname * a_fname)
+{
+    const uint8_t *name = (const uint8_t *) &a_fname->name;
+    size_t i;
+
+    for (i = 0; i < a_key_len && i < a_fname->nlen; i++) {
+        UTF16 k = ntfs_idx_upcase(a_key[i]);
+        UTF16 e = ntfs_idx_upcase((UTF16) tsk_getu16(a_fs->endian,
+                &name[i * 2]));
+        if (k != e)
+            return (k < e) ? -1 : 1;
+    }
+    if (a_key_len == a_fname->nlen)
+        return 0;
+    return (a_key_len < a_fname->nlen) ? -1 : 1;
+}
+
+/* Verify that an index entry fits in the node and that its $FILE_NAME
+ * is complete.  Returns 1 if it is valid. */
+static uint8_t
+ntfs_idx_entry_valid(TSK_FS_INFO * a_fs, const ntfs_idxentry * a_idxe,
+    uintptr_t a_end)
+{
+    uint16_t idxlen, str_len;
+    const ntfs_attr_fname *fname;
+
+    if ((uintptr_t) a_idxe + 16 > a_end)
+        return 0;
+    idxlen = tsk_getu16(a_fs->endian, a_idxe->idxlen);
+    if ((idxlen < 16) || ((uintptr_t) a_idxe + idxlen > a_end))
+        return 0;
+    if (a_idxe->flags & NTFS_IDX_SUB) {
+        if (idxlen < 24)
+            return 0;
+    }
+    if (a_idxe->flags & NTFS_IDX_LAST)
+        return 1;
+
+    str_len = tsk_getu16(a_fs->endian, a_idxe->strlen);
+    fname = (const ntfs_attr_fname *) &a_idxe->stream;
+    if ((str_len < 66) || (16 + (uint32_t) str_len > idxlen)
+        || (66 + 2 * (uint32_t) fname->nlen > str_len))
+        return 0;
+    return 1;
+}
+
+/** \internal
+ * Find a name in a directory by descending its $I30 B+tree.  Only the
+ * index records on the path to the name are read.
+ *
+ * This only finds a name if a scan of the full directory would return
+ * the same allocated entry for it.  In all other cases (deleted or
+ * orphan entries, DOS or POSIX names, corrupt indexes, etc.) 1 is
+ * returned and the caller should fall back to ntfs_dir_open_meta().
+ *
+ * @param a_fs File system to analyze
+ * @param a_dir_addr Metadata address of the directory
+ * @param a_name UTF-8 name to find (case insensitive)
+ * @param [out] a_result Metadata address of the name
+ * @param [out] a_fs_name Copy of the name details (or NULL if not wanted)
+ * @returns -1 on (system) error, 0 if found, and 1 if not found
+ */
+int8_t
+ntfs_dir_lookup(TSK_FS_INFO * a_fs, TSK_INUM_T a_dir_addr,
+    const char *a_name, TSK_INUM_T * a_result, TSK_FS_NAME * a_fs_name)
+{
+    NTFS_INFO *ntfs = (NTFS_INFO *) a_fs;
+    TSK_FS_FILE *fs_file;
+    const TSK_FS_ATTR *fs_attr_root;
+    const TSK_FS_ATTR *fs_attr_idx;
+    ntfs_idxroot *idxroot;
+    ntfs_idxelist *idxelist;
+    ntfs_idxentry *idxe;
+    ntfs_idxrec *idxrec = NULL;
+    TSK_FS_NAME *fs_name = NULL;
+    UTF16 key[NTFS_MAXNAMLEN + 1];
+    UTF16 *key_end = key;
+    const UTF8 *name8 = (const UTF8 *) a_name;
+    size_t key_len;
+    uintptr_t node_end, end = 0;
+    uint32_t vcn_size;
+    int depth;
+    int8_t retval = 1;
+
+    *a_result = 0;
+
+    // the "." and ".." entries are made up by ntfs_dir_open_meta()
+    if ((strcmp(a_name, ".") == 0) || (strcmp(a_name, "..") == 0))
+        return 1;
+
+    if (tsk_UTF8toUTF16(&name8, (const UTF8 *) a_name + strlen(a_name),
+            &key_end, &key[NTFS_MAXNAMLEN],
+            TSKstrictConversion) != TSKconversionOK)
+        return 1;
+    key_len = key_end - key;
+    if (key_len == 0)
+        return 1;
+
+    if ((fs_file = tsk_fs_file_open_meta(a_fs, NULL, a_dir_addr)) == NULL) {
+        tsk_error_reset();
+        return 1;
+    }
+
+    // deleted directories have only deleted names
+    if ((fs_file->meta->type != TSK_FS_META_TYPE_DIR)
+        || ((fs_file->meta->flags & TSK_FS_META_FLAG_ALLOC) == 0)
+        || (fs_file->meta->attr == NULL)) {
+        tsk_fs_file_close(fs_file);
+        return 1;
+    }
+
+    fs_attr_root = tsk_fs_attrlist_get(fs_file->meta->attr,
+        TSK_FS_ATTR_TYPE_NTFS_IDXROOT);
+    if ((fs_attr_root == NULL) || (fs_attr_root->flags & TSK_FS_ATTR_NONRES)
+        || (fs_attr_root->rd.buf_size < sizeof(ntfs_idxroot))) {
+        tsk_error_reset();
+        tsk_fs_file_close(fs_file);
+        return 1;
+    }
+    idxroot = (ntfs_idxroot *) fs_attr_root->rd.buf;
+    if (tsk_getu32(a_fs->endian, idxroot->type) != NTFS_ATYPE_FNAME) {
+        tsk_fs_file_close(fs_file);
+        return 1;
+    }
+    idxelist = &idxroot->list;
+    node_end = (uintptr_t) fs_attr_root->rd.buf + fs_attr_root->rd.buf_size;
+
+    fs_attr_idx = tsk_fs_attrlist_get(fs_file->meta->attr,
+        TSK_FS_ATTR_TYPE_NTFS_IDXALLOC);
+    tsk_error_reset();
+
+    // VCNs are in clusters unless the index records are smaller
+    if (ntfs->idx_rsize_b >= ntfs->csize_b)
+        vcn_size = ntfs->csize_b;
+    else
+        vcn_size = NTFS_UPDATE_SEQ_STRIDE;
+
+    for (depth = 0; depth < NTFS_IDX_MAX_DEPTH; depth++) {
+        TSK_OFF_T vcn;
+
+        /* Verify the offset pointers.  Only the entries before seqend
+         * are in the tree. */
+        if ((tsk_getu32(a_fs->endian, idxelist->seqend_off) <
+                tsk_getu32(a_fs->endian, idxelist->begin_off))
+            || ((uintptr_t) idxelist + tsk_getu32(a_fs->endian,
+                    idxelist->seqend_off) > node_end))
+            goto done;
+
+        idxe = (ntfs_idxentry *) ((uintptr_t) idxelist +
+            tsk_getu32(a_fs->endian, idxelist->begin_off));
+        end = (uintptr_t) idxelist + tsk_getu32(a_fs->endian,
+            idxelist->seqend_off);
+
+        // find the first entry that the key does not sort after
+        while (1) {
+            int cmp;
+
+            if (ntfs_idx_entry_valid(a_fs, idxe, end) == 0)
+                goto done;
+            if (idxe->flags & NTFS_IDX_LAST)
+                break;
+
+            cmp = ntfs_idx_name_cmp(a_fs, key, key_len,
+                (ntfs_attr_fname *) & idxe->stream);
+            if (cmp == 0)
+                goto found;
+            else if (cmp < 0)
+                break;
+
+            idxe = (ntfs_idxentry *) ((uintptr_t) idxe +
+                tsk_getu16(a_fs->endian, idxe->idxlen));
+        }
+
+        // the name would be in the sub-node of this entry
+        if (((idxe->flags & NTFS_IDX_SUB) == 0) || (fs_attr_idx == NULL)
+            || (fs_attr_idx->flags & TSK_FS_ATTR_RES))
+            goto done;
+
+        vcn = (TSK_OFF_T) tsk_getu64(a_fs->endian, (uint8_t *) idxe +
+            tsk_getu16(a_fs->endian, idxe->idxlen) - 8);
+
+        if ((idxrec == NULL) &&
+            ((idxrec = (ntfs_idxrec *) tsk_malloc(ntfs->idx_rsize_b)) == NULL)) {
+            retval = -1;
+            goto done;
+        }
+
+        if (tsk_fs_attr_read(fs_attr_idx, vcn * vcn_size, (char *) idxrec,
+                ntfs->idx_rsize_b, TSK_FS_FILE_READ_FLAG_NONE) !=
+            (ssize_t) ntfs->idx_rsize_b) {
+            tsk_error_reset();
+            goto done;
+        }
+        if ((tsk_getu32(a_fs->endian, idxrec->magic) != NTFS_IDXREC_MAGIC)
+            || ((TSK_OFF_T) tsk_getu64(a_fs->endian, idxrec->idx_vcn) != vcn)
+            || (ntfs_fix_idxrec(ntfs, idxrec, ntfs->idx_rsize_b))) {
+            tsk_error_reset();
+            goto done;
+        }
+
+        idxelist = &idxrec->list;
+        node_end = (uintptr_t) idxrec + ntfs->idx_rsize_b;
+    }
+    goto done;
+
+  found:
+    {
+        ntfs_attr_fname *fname = (ntfs_attr_fname *) & idxe->stream;
+        ntfs_idxentry *idxe_next;
+
+        /* DOS names are attached to the long name of the file and POSIX
+         * names can differ only by case, so let the caller sort them out */
+        if (((fname->nspace != NTFS_FNAME_WIN32)
+                && (fname->nspace != NTFS_FNAME_WINDOS))
+            || (tsk_getu48(a_fs->endian, idxe->file_ref) > a_fs->last_inum)
+            || (tsk_getu48(a_fs->endian, idxe->file_ref) < a_fs->first_inum)
+            || (tsk_getu48(a_fs->endian, fname->par_ref) != a_dir_addr))
+            goto done;
+
+        if ((fs_name = tsk_fs_name_alloc(NTFS_MAXNAMLEN_UTF8, 16)) == NULL) {
+            retval = -1;
+            goto done;
+        }
+        if ((ntfs_dent_copy(ntfs, idxe, fs_name))
+            || (a_fs->name_cmp(a_fs, fs_name->name, a_name) != 0))
+            goto done;
+
+        // look at the next entry for another name that collates the
+        // same and for the DOS name of this file
+        idxe_next = (ntfs_idxentry *) ((uintptr_t) idxe +
+            tsk_getu16(a_fs->endian, idxe->idxlen));
+        if ((ntfs_idx_entry_valid(a_fs, idxe_next, end))
+            && ((idxe_next->flags & NTFS_IDX_LAST) == 0)) {
+            ntfs_attr_fname *fname_next =
+                (ntfs_attr_fname *) & idxe_next->stream;
+
+            if (ntfs_idx_name_cmp(a_fs, key, key_len, fname_next) == 0)
+                goto done;
+
+            if ((fname->nspace == NTFS_FNAME_WIN32)
+                && (fname_next->nspace == NTFS_FNAME_DOS)
+                && (tsk_getu48(a_fs->endian, idxe_next->file_ref) ==
+                    fs_name->meta_addr)
+                && (tsk_getu48(a_fs->endian, fname_next->par_ref) ==
+                    a_dir_addr))
+                ntfs_dent_copy_short_only(ntfs, idxe_next, fs_name);
+        }
+
+        fs_name->flags = TSK_FS_NAME_FLAG_ALLOC;
+        if (a_dir_addr) {
+            fs_name->par_addr = a_dir_addr;
+            fs_name->par_seq = fs_file->meta->seq;
+        }
+
+        if ((a_fs_name) && (tsk_fs_name_copy(a_fs_name, fs_name))) {
+            retval = -1;
+            goto done;
+        }
+        *a_result = fs_name->meta_addr;
+        retval = 0;
+    }
+
+  done:
+    if (fs_name)
+        tsk_fs_name_free(fs_name);
+    free(idxrec);
+    tsk_fs_file_close(fs_file);
+    return retval;
+}
+
+
+
 /****************************************************************************
  * FIND_FILE ROUTINES
  *
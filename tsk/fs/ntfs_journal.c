@@ -0,0 +1,757 @@
+/*
+ * The Sleuth Kit
+ *
+ *  This software is distributed under the Common Public License 1.0
+ */
+
+/** \file ntfs_journal.c
+ * Contains the internal TSK NTFS journal code for the change journal
+ * ($Extend/$UsnJrnl:$J) and the pages of $LogFile.  The change journal is
+ * streamed: only the clusters that are allocated to $J (which is sparse
+ * up to the oldest record that is kept) are read, in large buffers, and
+ * all of the records in a buffer are decoded before the callback is
+ * called.
+ */
+
+#include "tsk_fs_i.h"
+#include "tsk_ntfs.h"
+
+/* Number of bytes of $J that are read at a time */
+#define NTFS_USN_CHUNK  (1024 * 1024)
+
+/* Maximum size of a record.  Records do not cross the 4KB pages that
+ * the journal is written in. */
+#define NTFS_USN_MAXREC 4096
+
+/* Number of bytes of $LogFile that are read at a time */
+#define NTFS_LOG_CHUNK  (1024 * 1024)
+
+/* $LogFile page signatures */
+#define NTFS_LOG_RSTR   0x52545352
+#define NTFS_LOG_RCRD   0x44524352
+#define NTFS_LOG_CHKD   0x444b4843
+
+
+/** \internal
+ * Free the journal that was opened with ntfs_jopen().
+ *
+ * @param ntfs File system to free the journal of
+ */
+void
+ntfs_jclose(NTFS_INFO * ntfs)
+{
+    if (ntfs->jinfo == NULL)
+        return;
+
+    tsk_fs_file_close(ntfs->jinfo->fs_file);
+    free(ntfs->jinfo);
+    ntfs->jinfo = NULL;
+}
+
+/** \internal
+ * Find the change journal ($Extend/$UsnJrnl).  Only the indexes are
+ * searched, so this does not need a scan of the directories.
+ *
+ * @param fs File system to search
+ * @param [out] a_inum Address of the change journal or $LogFile if the
+ * file system does not have one
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+ntfs_jfind(TSK_FS_INFO * fs, TSK_INUM_T * a_inum)
+{
+    TSK_INUM_T extend, usn;
+    int8_t ret;
+
+    *a_inum = NTFS_MFT_LOG;
+    if ((ret = ntfs_dir_lookup(fs, NTFS_ROOTINO, "$Extend", &extend,
+                NULL)) == 0)
+        ret = ntfs_dir_lookup(fs, extend, "$UsnJrnl", &usn, NULL);
+    if (ret == -1)
+        return 1;
+    if (ret == 0)
+        *a_inum = usn;
+    return 0;
+}
+
+/** \internal
+ * Open a journal.  If inum is $LogFile, its pages are walked.  Otherwise
+ * it must be the change journal, which has the records in its $J stream.
+ * TSK_FS_INFO::journ_inum is 0 for NTFS, and an inum of 0 opens the change
+ * journal if there is one and $LogFile if not.
+ *
+ * @param fs File system to open the journal in
+ * @param inum Address of the journal file (or 0)
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+ntfs_jopen(TSK_FS_INFO * fs, TSK_INUM_T inum)
+{
+    NTFS_INFO *ntfs = (NTFS_INFO *) fs;
+    NTFS_JINFO *jinfo;
+    const TSK_FS_ATTR *fs_attr;
+
+    // clean up any error messages that are lying around
+    tsk_error_reset();
+
+    ntfs_jclose(ntfs);
+
+    // 0 is $MFT, which is never a journal
+    if ((inum == 0) && (ntfs_jfind(fs, &inum)))
+        return 1;
+
+    if ((jinfo = (NTFS_JINFO *) tsk_malloc(sizeof(NTFS_JINFO))) == NULL)
+        return 1;
+    jinfo->j_inum = inum;
+    jinfo->is_usn = (inum != NTFS_MFT_LOG);
+
+    if ((jinfo->fs_file = tsk_fs_file_open_meta(fs, NULL, inum)) == NULL) {
+        free(jinfo);
+        return 1;
+    }
+
+    if (jinfo->is_usn)
+        fs_attr =
+            tsk_fs_attrlist_get_name_type(jinfo->fs_file->meta->attr,
+            NTFS_ATYPE_DATA, "$J");
+    else
+        fs_attr =
+            tsk_fs_file_attr_get_type(jinfo->fs_file, NTFS_ATYPE_DATA, 0,
+            0);
+    if (fs_attr == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_jopen: MFT entry %" PRIuINUM
+            " does not have a %s journal stream", inum,
+            jinfo->is_usn ? "$J" : "$Data");
+        tsk_fs_file_close(jinfo->fs_file);
+        free(jinfo);
+        return 1;
+    }
+    jinfo->fs_attr = fs_attr;
+    ntfs->jinfo = jinfo;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "ntfs_jopen: %s journal opened at MFT entry %" PRIuINUM
+            " size: %" PRIdOFF "\n", jinfo->is_usn ? "change" : "log",
+            inum, fs_attr->size);
+
+    return 0;
+}
+
+
+
+/***************************************************************
+ * Change journal
+ */
+
+/* State of a walk of the change journal */
+typedef struct {
+    TSK_FS_INFO *fs;
+    const TSK_FS_ATTR *fs_attr;
+    char *buf;                  // data of $J that has not been decoded yet
+    size_t buf_len;             // number of bytes in buf
+    TSK_OFF_T buf_off;          // offset in $J of buf[0]
+    NTFS_USN_ENTRY *ents;       // records decoded from buf
+    size_t ents_max;
+    char *names;                // UTF-8 names of the records in ents
+    size_t names_size;
+    NTFS_USN_WALK_CB action;
+    void *ptr;
+    TSK_WALK_RET_ENUM ret;      // return value of the last callback
+} NTFS_USN_WALK;
+
+/** \internal
+ * Decode all of the complete records in the walk buffer and pass them
+ * to the callback.  Anything that is not a valid record (the padding at
+ * the end of each page or corrupt data) is skipped 8 bytes at a time.
+ *
+ * @param a_walk Walk state (ret is set to the callback return value)
+ * @param a_final 1 if no more data will be added to the buffer
+ * @returns Number of bytes at the start of the buffer that were used
+ */
+static size_t
+ntfs_usn_decode(NTFS_USN_WALK * a_walk, uint8_t a_final)
+{
+    TSK_FS_INFO *fs = a_walk->fs;
+    size_t pos = 0;
+    size_t cnt = 0;
+    size_t name_pos = 0;
+
+    a_walk->ret = TSK_WALK_CONT;
+
+    while (pos + 8 <= a_walk->buf_len) {
+        char *rec = &a_walk->buf[pos];
+        NTFS_USN_ENTRY *ent = &a_walk->ents[cnt];
+        uint32_t len = tsk_getu32(fs->endian, rec);
+        uint16_t major = tsk_getu16(fs->endian, &rec[4]);
+        uint16_t nlen, noff;
+        UTF16 *name16;
+        UTF8 *name8;
+
+        if ((len == 0) || (len % 8) || (len > NTFS_USN_MAXREC)) {
+            pos += 8;
+            continue;
+        }
+        if (pos + len > a_walk->buf_len)
+            break;
+
+        if ((major == 2) && (len >= sizeof(ntfs_usn_rec2))) {
+            ntfs_usn_rec2 *r2 = (ntfs_usn_rec2 *) rec;
+            ent->addr = tsk_getu48(fs->endian, r2->file_ref);
+            ent->seq = tsk_getu16(fs->endian, r2->seq);
+            ent->par_addr = tsk_getu48(fs->endian, r2->par_ref);
+            ent->par_seq = tsk_getu16(fs->endian, r2->par_seq);
+            ent->usn = tsk_getu64(fs->endian, r2->usn);
+            ent->time = tsk_getu64(fs->endian, r2->time);
+            ent->reason = tsk_getu32(fs->endian, r2->reason);
+            ent->source = tsk_getu32(fs->endian, r2->source);
+            ent->sec_id = tsk_getu32(fs->endian, r2->sec_id);
+            ent->attr = tsk_getu32(fs->endian, r2->attr);
+            nlen = tsk_getu16(fs->endian, r2->nlen);
+            noff = tsk_getu16(fs->endian, r2->noff);
+        }
+        else if ((major == 3) && (len >= sizeof(ntfs_usn_rec3))) {
+            ntfs_usn_rec3 *r3 = (ntfs_usn_rec3 *) rec;
+            // NTFS uses the 64-bit reference in the low bytes of the 128-bit one
+            ent->addr = tsk_getu48(fs->endian, r3->file_ref);
+            ent->seq = tsk_getu16(fs->endian, &r3->file_ref[6]);
+            ent->par_addr = tsk_getu48(fs->endian, r3->par_ref);
+            ent->par_seq = tsk_getu16(fs->endian, &r3->par_ref[6]);
+            ent->usn = tsk_getu64(fs->endian, r3->usn);
+            ent->time = tsk_getu64(fs->endian, r3->time);
+            ent->reason = tsk_getu32(fs->endian, r3->reason);
+            ent->source = tsk_getu32(fs->endian, r3->source);
+            ent->sec_id = tsk_getu32(fs->endian, r3->sec_id);
+            ent->attr = tsk_getu32(fs->endian, r3->attr);
+            nlen = tsk_getu16(fs->endian, r3->nlen);
+            noff = tsk_getu16(fs->endian, r3->noff);
+        }
+        else if (major == 4) {
+            // range tracking records do not describe a file change
+            pos += len;
+            continue;
+        }
+        else {
+            pos += 8;
+            continue;
+        }
+
+        /* The USN is the offset of the record in $J, which makes it a
+         * good check that we are at the start of a record */
+        if ((ent->usn != a_walk->buf_off + (TSK_OFF_T) pos)
+            || (nlen % 2) || ((uint32_t) noff + nlen > len)
+            || (noff < (major == 2 ? sizeof(ntfs_usn_rec2) :
+                    sizeof(ntfs_usn_rec3)))) {
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "ntfs_usn_decode: Invalid record at offset %" PRIdOFF
+                    "\n", a_walk->buf_off + (TSK_OFF_T) pos);
+            pos += 8;
+            continue;
+        }
+        ent->major = major;
+        ent->minor = tsk_getu16(fs->endian, &rec[6]);
+
+        name16 = (UTF16 *) & rec[noff];
+        name8 = (UTF8 *) & a_walk->names[name_pos];
+        if (tsk_UTF16toUTF8(fs->endian, (const UTF16 **) &name16,
+                (UTF16 *) & rec[noff + nlen], &name8,
+                (UTF8 *) & a_walk->names[a_walk->names_size - 1],
+                TSKlenientConversion) != TSKconversionOK) {
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "ntfs_usn_decode: Error converting name of record %"
+                    PRIdOFF " to UTF8\n", ent->usn);
+        }
+        *name8 = '\0';
+        ent->name = &a_walk->names[name_pos];
+        name_pos = (char *) name8 - a_walk->names + 1;
+
+        cnt++;
+        pos += len;
+    }
+
+    if (a_final)
+        pos = a_walk->buf_len;
+
+    if (cnt > 0)
+        a_walk->ret = a_walk->action(fs, a_walk->ents, cnt, a_walk->ptr);
+
+    return pos;
+}
+
+/** \internal
+ * Add a range of $J to the walk buffer and decode it as it is read.
+ *
+ * @param a_walk Walk state
+ * @param a_off Offset of the range in $J
+ * @param a_len Length of the range
+ * @param a_addr Byte offset of the range in the file system or -1 to
+ * read it through the attribute
+ * @returns 1 on error and 0 on success (check a_walk->ret for STOP)
+ */
+static uint8_t
+ntfs_usn_add(NTFS_USN_WALK * a_walk, TSK_OFF_T a_off, TSK_OFF_T a_len,
+    TSK_OFF_T a_addr)
+{
+    // records do not span gaps in the stream
+    if (a_off != a_walk->buf_off + (TSK_OFF_T) a_walk->buf_len) {
+        a_walk->buf_len = 0;
+        a_walk->buf_off = a_off;
+    }
+
+    while (a_len > 0) {
+        size_t len = (a_len > NTFS_USN_CHUNK) ? NTFS_USN_CHUNK :
+            (size_t) a_len;
+        size_t used;
+        ssize_t cnt;
+
+        if (a_addr >= 0)
+            cnt = tsk_fs_read(a_walk->fs, a_addr,
+                &a_walk->buf[a_walk->buf_len], len);
+        else
+            cnt = tsk_fs_attr_read(a_walk->fs_attr, a_off,
+                &a_walk->buf[a_walk->buf_len], len,
+                TSK_FS_FILE_READ_FLAG_NONE);
+        if (cnt != (ssize_t) len) {
+            if (cnt >= 0) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_READ);
+            }
+            tsk_error_set_errstr2("ntfs_usn_add: Error reading $J at %"
+                PRIdOFF, a_off);
+            return 1;
+        }
+        a_walk->buf_len += len;
+        a_off += len;
+        a_len -= len;
+        if (a_addr >= 0)
+            a_addr += len;
+
+        used = ntfs_usn_decode(a_walk, 0);
+        if (a_walk->ret != TSK_WALK_CONT)
+            return (a_walk->ret == TSK_WALK_ERROR);
+
+        memmove(a_walk->buf, &a_walk->buf[used], a_walk->buf_len - used);
+        a_walk->buf_len -= used;
+        a_walk->buf_off += used;
+    }
+    return 0;
+}
+
+/**
+ * \ingroup fslib
+ * Walk the records of the change journal that was opened with
+ * ntfs_jopen().  Only the allocated runs of $J are read and each buffer
+ * of records is decoded and passed to the callback at once, so large
+ * journals can be processed without a callback per cluster.
+ *
+ * @param fs File system that the journal was opened in
+ * @param a_action Callback to call with each batch of records
+ * @param ptr Pointer to pass to the callback
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+ntfs_usn_walk(TSK_FS_INFO * fs, NTFS_USN_WALK_CB a_action, void *ptr)
+{
+    NTFS_INFO *ntfs = (NTFS_INFO *) fs;
+    NTFS_JINFO *jinfo = ntfs->jinfo;
+    const TSK_FS_ATTR *fs_attr;
+    NTFS_USN_WALK walk;
+    TSK_OFF_T init;
+    uint8_t retval = 0;
+
+    // clean up any error messages that are lying around
+    tsk_error_reset();
+
+    if ((jinfo == NULL) || (jinfo->is_usn == 0)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_usn_walk: change journal is not open");
+        return 1;
+    }
+    fs_attr = jinfo->fs_attr;
+
+    memset(&walk, 0, sizeof(walk));
+    walk.fs = fs;
+    walk.fs_attr = fs_attr;
+    walk.action = a_action;
+    walk.ptr = ptr;
+    walk.ents_max = (NTFS_USN_CHUNK + NTFS_USN_MAXREC) / 64 + 1;
+    // a UTF-16 character is at most 3 UTF-8 bytes
+    walk.names_size =
+        (NTFS_USN_CHUNK + NTFS_USN_MAXREC) / 2 * 3 + walk.ents_max;
+    if (((walk.buf = (char *) tsk_malloc(NTFS_USN_CHUNK +
+                    NTFS_USN_MAXREC)) == NULL)
+        || ((walk.ents = (NTFS_USN_ENTRY *) tsk_malloc(walk.ents_max *
+                    sizeof(NTFS_USN_ENTRY))) == NULL)
+        || ((walk.names = (char *) tsk_malloc(walk.names_size)) == NULL)) {
+        free(walk.buf);
+        free(walk.ents);
+        return 1;
+    }
+
+    if ((fs_attr->flags & TSK_FS_ATTR_NONRES)
+        && ((fs_attr->flags & (TSK_FS_ATTR_COMP | TSK_FS_ATTR_ENC)) == 0)) {
+        TSK_FS_ATTR_RUN *run;
+
+        /* Read the allocated runs directly and skip the sparse ones,
+         * which make up most of a journal that has wrapped */
+        init = fs_attr->nrd.initsize;
+        for (run = fs_attr->nrd.run; run; run = run->next) {
+            TSK_OFF_T off = run->offset * fs->block_size;
+            TSK_OFF_T len = run->len * fs->block_size;
+
+            if (off >= init)
+                break;
+            if (run->flags & (TSK_FS_ATTR_RUN_FLAG_SPARSE |
+                    TSK_FS_ATTR_RUN_FLAG_FILLER))
+                continue;
+            if (off + len > init)
+                len = init - off;
+
+            if (ntfs_usn_add(&walk, off, len,
+                    run->addr * fs->block_size)) {
+                retval = 1;
+                break;
+            }
+            if (walk.ret != TSK_WALK_CONT)
+                break;
+        }
+    }
+    else {
+        init = (fs_attr->flags & TSK_FS_ATTR_NONRES) ?
+            fs_attr->nrd.initsize : fs_attr->size;
+        retval = ntfs_usn_add(&walk, 0, init, -1);
+    }
+
+    if ((retval == 0) && (walk.ret == TSK_WALK_CONT)) {
+        ntfs_usn_decode(&walk, 1);
+        retval = (walk.ret == TSK_WALK_ERROR);
+    }
+
+    free(walk.buf);
+    free(walk.ents);
+    free(walk.names);
+    return retval;
+}
+
+
+/* Names of the NTFS_USN_REASON_ flags, for printing */
+static const struct {
+    uint32_t flag;
+    const char *name;
+} ntfs_usn_reasons[] = {
+    {NTFS_USN_REASON_DATA_OVERWRITE, "DATA_OVERWRITE"},
+    {NTFS_USN_REASON_DATA_EXTEND, "DATA_EXTEND"},
+    {NTFS_USN_REASON_DATA_TRUNCATION, "DATA_TRUNCATION"},
+    {NTFS_USN_REASON_NAMED_DATA_OVERWRITE, "NAMED_DATA_OVERWRITE"},
+    {NTFS_USN_REASON_NAMED_DATA_EXTEND, "NAMED_DATA_EXTEND"},
+    {NTFS_USN_REASON_NAMED_DATA_TRUNCATION, "NAMED_DATA_TRUNCATION"},
+    {NTFS_USN_REASON_FILE_CREATE, "FILE_CREATE"},
+    {NTFS_USN_REASON_FILE_DELETE, "FILE_DELETE"},
+    {NTFS_USN_REASON_EA_CHANGE, "EA_CHANGE"},
+    {NTFS_USN_REASON_SECURITY_CHANGE, "SECURITY_CHANGE"},
+    {NTFS_USN_REASON_RENAME_OLD_NAME, "RENAME_OLD_NAME"},
+    {NTFS_USN_REASON_RENAME_NEW_NAME, "RENAME_NEW_NAME"},
+    {NTFS_USN_REASON_INDEXABLE_CHANGE, "INDEXABLE_CHANGE"},
+    {NTFS_USN_REASON_BASIC_INFO_CHANGE, "BASIC_INFO_CHANGE"},
+    {NTFS_USN_REASON_HARD_LINK_CHANGE, "HARD_LINK_CHANGE"},
+    {NTFS_USN_REASON_COMPRESSION_CHANGE, "COMPRESSION_CHANGE"},
+    {NTFS_USN_REASON_ENCRYPTION_CHANGE, "ENCRYPTION_CHANGE"},
+    {NTFS_USN_REASON_OBJECT_ID_CHANGE, "OBJECT_ID_CHANGE"},
+    {NTFS_USN_REASON_REPARSE_POINT_CHANGE, "REPARSE_POINT_CHANGE"},
+    {NTFS_USN_REASON_STREAM_CHANGE, "STREAM_CHANGE"},
+    {NTFS_USN_REASON_TRANSACTED_CHANGE, "TRANSACTED_CHANGE"},
+    {NTFS_USN_REASON_INTEGRITY_CHANGE, "INTEGRITY_CHANGE"},
+    {NTFS_USN_REASON_CLOSE, "CLOSE"},
+    {0, NULL}
+};
+
+/* Data for ntfs_usn_jentry_act */
+typedef struct {
+    TSK_FS_JENTRY_WALK_CB action;
+    void *ptr;
+} NTFS_USN_JENTRY_DATA;
+
+/** \internal
+ * ntfs_usn_walk() callback for ntfs_jentry_walk().  Prints the records
+ * if there is no jentry callback.  Otherwise, the callback gets the
+ * journal block of each record and, in meta_addr, the MFT entry that it
+ * is about.
+ */
+static TSK_WALK_RET_ENUM
+ntfs_usn_jentry_act(TSK_FS_INFO * fs, const NTFS_USN_ENTRY * a_ents,
+    size_t a_cnt, void *ptr)
+{
+    NTFS_USN_JENTRY_DATA *data = (NTFS_USN_JENTRY_DATA *) ptr;
+    size_t i;
+
+    for (i = 0; i < a_cnt; i++) {
+        const NTFS_USN_ENTRY *ent = &a_ents[i];
+        char timeBuf[128];
+        uint32_t reason;
+        int j;
+
+        if (data->action) {
+            TSK_FS_JENTRY jentry;
+            TSK_WALK_RET_ENUM retval;
+
+            jentry.jblk = (TSK_DADDR_T) (ent->usn / fs->block_size);
+            jentry.fsblk = 0;
+            jentry.seq = (uint64_t) ent->usn;
+            jentry.flags = TSK_FS_JENTRY_FLAG_ALLOC;
+            jentry.meta_addr = ent->addr;
+            if ((retval = data->action(fs, &jentry, 0, data->ptr)) !=
+                TSK_WALK_CONT)
+                return retval;
+            continue;
+        }
+
+        tsk_printf("%" PRIdOFF "\t%" PRIuINUM "-%" PRIu16 "\t%" PRIuINUM
+            "-%" PRIu16 "\t%s\t", ent->usn, ent->addr, ent->seq,
+            ent->par_addr, ent->par_seq,
+            tsk_fs_time_to_str_subsecs(nt2unixtime(ent->time),
+                (unsigned int) (ent->time % 10000000) * 100, timeBuf));
+
+        reason = ent->reason;
+        for (j = 0; ntfs_usn_reasons[j].name; j++) {
+            if ((reason & ntfs_usn_reasons[j].flag) == 0)
+                continue;
+            reason &= ~ntfs_usn_reasons[j].flag;
+            tsk_printf("%s%s", ntfs_usn_reasons[j].name,
+                reason ? "|" : "");
+        }
+        if (reason)
+            tsk_printf("0x%" PRIx32, reason);
+
+        tsk_printf("\t%s\n", ent->name);
+    }
+    return TSK_WALK_CONT;
+}
+
+
+
+/***************************************************************
+ * $LogFile
+ */
+
+/** \internal
+ * Print the type of each page in $LogFile and the LSNs in its header.
+ *
+ * @param fs File system that the journal was opened in
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+ntfs_log_print(TSK_FS_INFO * fs)
+{
+    NTFS_INFO *ntfs = (NTFS_INFO *) fs;
+    const TSK_FS_ATTR *fs_attr = ntfs->jinfo->fs_attr;
+    uint32_t psize = 4096;
+    TSK_OFF_T off;
+    char *buf;
+
+    if ((buf = (char *) tsk_malloc(NTFS_LOG_CHUNK)) == NULL)
+        return 1;
+
+    tsk_printf("Page\tDescription\n");
+
+    for (off = 0; off < fs_attr->size; off += NTFS_LOG_CHUNK) {
+        size_t len = NTFS_LOG_CHUNK;
+        size_t i;
+        ssize_t cnt;
+
+        if (off + (TSK_OFF_T) len > fs_attr->size)
+            len = (size_t) (fs_attr->size - off);
+
+        cnt = tsk_fs_attr_read(fs_attr, off, buf, len,
+            TSK_FS_FILE_READ_FLAG_NONE);
+        if (cnt != (ssize_t) len) {
+            if (cnt >= 0) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_READ);
+            }
+            tsk_error_set_errstr2("ntfs_log_print: Error reading $LogFile at %"
+                PRIdOFF, off);
+            free(buf);
+            return 1;
+        }
+
+        /* The first restart page has the size of the log pages */
+        if ((off == 0) && (len >= 0x18)
+            && (tsk_getu32(fs->endian, buf) == NTFS_LOG_RSTR)) {
+            uint32_t p = tsk_getu32(fs->endian, &buf[0x14]);
+            if ((p >= 512) && (p <= NTFS_LOG_CHUNK) && ((p & (p - 1)) == 0))
+                psize = p;
+        }
+
+        for (i = 0; i + psize <= len; i += psize) {
+            char *page = &buf[i];
+            TSK_OFF_T pnum = (off + (TSK_OFF_T) i) / psize;
+            uint32_t magic = tsk_getu32(fs->endian, page);
+
+            if (magic == NTFS_LOG_RSTR) {
+                uint16_t roff = tsk_getu16(fs->endian, &page[0x18]);
+                tsk_printf("%" PRIdOFF ":\tRestart Page (Chkdsk LSN: %"
+                    PRIu64, pnum, tsk_getu64(fs->endian, &page[0x08]));
+                if ((uint32_t) roff + 8 <= psize)
+                    tsk_printf(", Current LSN: %" PRIu64,
+                        tsk_getu64(fs->endian, &page[roff]));
+                tsk_printf(")\n");
+            }
+            else if (magic == NTFS_LOG_RCRD) {
+                tsk_printf("%" PRIdOFF ":\tRecord Page (Last LSN: %"
+                    PRIu64 ", Last End LSN: %" PRIu64
+                    ", Next Record Offset: %" PRIu16 ")\n", pnum,
+                    tsk_getu64(fs->endian, &page[0x08]),
+                    tsk_getu64(fs->endian, &page[0x20]),
+                    tsk_getu16(fs->endian, &page[0x18]));
+            }
+            else if (magic == NTFS_LOG_CHKD) {
+                tsk_printf("%" PRIdOFF ":\tChkdsk Modified Page\n", pnum);
+            }
+            else if (magic == NTFS_MFT_MAGIC_BAAD) {
+                tsk_printf("%" PRIdOFF
+                    ":\tBad Page (Incomplete Multi-Sector Transfer)\n",
+                    pnum);
+            }
+            else {
+                tsk_printf("%" PRIdOFF ":\tUnused Page\n", pnum);
+            }
+        }
+    }
+
+    free(buf);
+    return 0;
+}
+
+
+/** \internal
+ * Walk the entries of the journal.  For the change journal, the records
+ * are printed if a_action is NULL.  For $LogFile, the pages are
+ * printed and a_action is not used.
+ *
+ * @param fs File system that the journal was opened in
+ * @param flags Not used
+ * @param a_action Callback or NULL to print the entries
+ * @param ptr Pointer to pass to the callback
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+ntfs_jentry_walk(TSK_FS_INFO * fs, int flags,
+    TSK_FS_JENTRY_WALK_CB a_action, void *ptr)
+{
+    NTFS_INFO *ntfs = (NTFS_INFO *) fs;
+    NTFS_USN_JENTRY_DATA data;
+
+    // no flags are defined for NTFS journals
+    (void) flags;
+
+    // clean up any error messages that are lying around
+    tsk_error_reset();
+
+    if (ntfs->jinfo == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_jentry_walk: journal is not open");
+        return 1;
+    }
+
+    if (ntfs->jinfo->is_usn == 0)
+        return ntfs_log_print(fs);
+
+    if (a_action == NULL)
+        tsk_printf("USN\tEntry\tParent\tTime\tReason\tName\n");
+
+    data.action = a_action;
+    data.ptr = ptr;
+    return ntfs_usn_walk(fs, ntfs_usn_jentry_act, &data);
+}
+
+
+/** \internal
+ * Walk the blocks of the journal stream from start to end (inclusive).
+ * The blocks are written to stdout if a_action is NULL.
+ *
+ * @param fs File system that the journal was opened in
+ * @param start First block of the journal stream
+ * @param end Last block of the journal stream
+ * @param flags Not used
+ * @param a_action Callback or NULL to write the blocks to stdout
+ * @param ptr Pointer to pass to the callback
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+ntfs_jblk_walk(TSK_FS_INFO * fs, TSK_DADDR_T start, TSK_DADDR_T end,
+    int flags, TSK_FS_JBLK_WALK_CB a_action, void *ptr)
+{
+    NTFS_INFO *ntfs = (NTFS_INFO *) fs;
+    const TSK_FS_ATTR *fs_attr;
+    TSK_DADDR_T last, i;
+    char *buf;
+
+    // no flags are defined for NTFS journals
+    (void) flags;
+
+    // clean up any error messages that are lying around
+    tsk_error_reset();
+
+    if (ntfs->jinfo == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_jblk_walk: journal is not open");
+        return 1;
+    }
+    fs_attr = ntfs->jinfo->fs_attr;
+
+    last = (TSK_DADDR_T) ((fs_attr->size + fs->block_size - 1) /
+        fs->block_size);
+    if ((last == 0) || (end > last - 1) || (start > end)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_WALK_RNG);
+        tsk_error_set_errstr("ntfs_jblk_walk: invalid range %" PRIuDADDR
+            " - %" PRIuDADDR, start, end);
+        return 1;
+    }
+
+    if ((buf = (char *) tsk_malloc(fs->block_size)) == NULL)
+        return 1;
+
+    for (i = start; i <= end; i++) {
+        ssize_t cnt = tsk_fs_attr_read(fs_attr,
+            (TSK_OFF_T) i * fs->block_size, buf, fs->block_size,
+            TSK_FS_FILE_READ_FLAG_NONE);
+        if (cnt < 0) {
+            tsk_error_set_errstr2("ntfs_jblk_walk: block %" PRIuDADDR, i);
+            free(buf);
+            return 1;
+        }
+        // the end of the last block is past the end of the stream
+        if ((size_t) cnt < fs->block_size)
+            memset(&buf[cnt], 0, fs->block_size - cnt);
+
+        if (a_action) {
+            TSK_WALK_RET_ENUM retval =
+                a_action(fs, buf, (int) fs->block_size, ptr);
+            if (retval == TSK_WALK_STOP)
+                break;
+            else if (retval == TSK_WALK_ERROR) {
+                free(buf);
+                return 1;
+            }
+        }
+        else if (fwrite(buf, fs->block_size, 1, stdout) != 1) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_WRITE);
+            tsk_error_set_errstr
+                ("ntfs_jblk_walk: error writing buffer block");
+            free(buf);
+            return 1;
+        }
+    }
+
+    free(buf);
+    return 0;
+}
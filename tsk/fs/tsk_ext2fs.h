@@ -166,7 +166,7 @@ extern "C" {
         uint8_t s_mmp_block[8]; /* u64 */
         uint8_t s_raid_stripe_width[4]; /* u32 */
         uint8_t s_log_groups_per_flex;  /* u8 */
-        uint8_t s_reserved_char_pad;    /* u8 */
+        uint8_t s_checksum_type;        /* u8 */
         uint8_t s_reserved_pad[2];      /* u16 */
         uint8_t s_kbytes_written[8];    /* u64 */
         uint8_t s_snapshot_inum[4];     /* u32 */
@@ -188,7 +188,14 @@ extern "C" {
         uint8_t s_usr_quota_inum[4];    /* u32 */
         uint8_t s_grp_quota_inum[4];    /* u32 */
         uint8_t s_overhead_clusters[4]; /* u32 */
-        uint8_t s_padding[109 * 4];
+        uint8_t s_backup_bgs[2 * 4];    /* u32[2] */
+        uint8_t s_encrypt_algos[4];     /* u8[4] */
+        uint8_t s_encrypt_pw_salt[16];  /* u8[16] */
+        uint8_t s_lpf_ino[4];   /* u32 */
+        uint8_t s_prj_quota_inum[4];    /* u32 */
+        uint8_t s_checksum_seed[4];     /* u32: crc32c(uuid) if CSUM_SEED */
+        uint8_t s_padding[98 * 4];
+        uint8_t s_checksum[4];  /* u32: crc32c(superblock) */
     } ext2fs_sb;
 
 /* File system State Values */
@@ -208,7 +215,7 @@ extern "C" {
 
 /* feature flags */
 #define EXT2FS_HAS_COMPAT_FEATURE(fs,sb,mask)\
-    ((tsk_getu32(fs->endian,sb->s_feature_compat) & mask) != 0)
+    ((tsk_getu32(fs->endian,sb->s_feature_compat) & (mask)) != 0)
 
 #define EXT2FS_FEATURE_COMPAT_DIR_PREALLOC	0x0001
 #define EXT2FS_FEATURE_COMPAT_IMAGIC_INODES	0x0002
@@ -218,7 +225,7 @@ extern "C" {
 #define EXT2FS_FEATURE_COMPAT_DIR_INDEX		0x0020
 
 #define EXT2FS_HAS_INCOMPAT_FEATURE(fs,sb,mask)\
-    ((tsk_getu32(fs->endian,sb->s_feature_incompat) & mask) != 0)
+    ((tsk_getu32(fs->endian,sb->s_feature_incompat) & (mask)) != 0)
 
 #define EXT2FS_FEATURE_INCOMPAT_COMPRESSION	0x0001
 #define EXT2FS_FEATURE_INCOMPAT_FILETYPE	0x0002
@@ -231,11 +238,12 @@ extern "C" {
 #define EXT2FS_FEATURE_INCOMPAT_FLEX_BG         0x0200
 #define EXT2FS_FEATURE_INCOMPAT_EA_INODE        0x0400
 #define EXT2FS_FEATURE_INCOMPAT_DIRDATA         0x1000
-#define EXT4FS_FEATURE_INCOMPAT_INLINEDATA      0x2000  /* data in inode */
+#define EXT4FS_FEATURE_INCOMPAT_INLINEDATA      0x8000  /* data in inode */
 #define EXT4FS_FEATURE_INCOMPAT_LARGEDIR        0x4000  /* >2GB or 3-lvl htree */
+#define EXT4FS_FEATURE_INCOMPAT_CSUM_SEED       0x2000  /* s_checksum_seed is used */
 
 #define EXT2FS_HAS_RO_COMPAT_FEATURE(fs,sb,mask)\
-    ((tsk_getu32(fs->endian,sb->s_feature_ro_compat) & mask) != 0)
+    ((tsk_getu32(fs->endian,sb->s_feature_ro_compat) & (mask)) != 0)
 
 #define EXT2FS_FEATURE_RO_COMPAT_SPARSE_SUPER	0x0001
 #define EXT2FS_FEATURE_RO_COMPAT_LARGE_FILE 	0x0002
@@ -248,6 +256,9 @@ extern "C" {
 #define EXT4FS_FEATURE_RO_COMPAT_BIGALLOC       0x0200
 #define EXT4FS_FEATURE_RO_COMPAT_METADATA_CSUM  0x0400
 
+/* s_checksum_type */
+#define EXT4FS_CRC32C_CHKSUM    1
+
 
 /*
  * Group Descriptor
@@ -277,7 +288,9 @@ extern "C" {
         uint8_t bg_free_inodes_count_lo[2];     /* u16 */
         uint8_t bg_used_dirs_count_lo[2];       /* u16 */
         uint8_t bg_flags[2];    /* u16 */
-        uint8_t bg_reserved[4 * 2];     /* u32 */
+        uint8_t bg_exclude_bitmap_lo[4];        /* u32 */
+        uint8_t bg_block_bitmap_csum_lo[2];     /* u16: crc32c(bitmap) */
+        uint8_t bg_inode_bitmap_csum_lo[2];     /* u16: crc32c(bitmap) */
         uint8_t bg_itable_unused_lo[2]; /* u16 */
         uint8_t bg_checksum[2]; /* u16 */
         uint8_t bg_block_bitmap_hi[4];  /* u32 */
@@ -287,7 +300,10 @@ extern "C" {
         uint8_t bg_free_inodes_count_hi[2];     /* u16 */
         uint8_t bg_used_dirs_count_hi[2];       /* u16 */
         uint8_t bg_itable_unused_hi[2]; /* u16 */
-        uint8_t bg_reserved2[4 * 3];    /* u32 */
+        uint8_t bg_exclude_bitmap_hi[4];        /* u32 */
+        uint8_t bg_block_bitmap_csum_hi[2];     /* u16 */
+        uint8_t bg_inode_bitmap_csum_hi[2];     /* u16 */
+        uint8_t bg_reserved[4]; /* u32 */
     } ext4fs_gd;
 
 
@@ -332,9 +348,10 @@ extern "C" {
         uint8_t f1[2];
         uint8_t i_uid_high[2];  /* u16 */
         uint8_t i_gid_high[2];  /* u16 */
-        uint8_t f7[4];          /* u32 */
+        uint8_t i_checksum_lo[2];       /* u16: crc32c(inode) */
+        uint8_t f7[2];          /* u16 */
         uint8_t i_extra_isize[2];       /* u16 */
-        uint8_t i_pad1[2];      /* u16 */
+        uint8_t i_checksum_hi[2];       /* u16 */
         uint8_t i_ctime_extra[4];       /* u32 */
         uint8_t i_mtime_extra[4];       /* u32 */
         uint8_t i_atime_extra[4];       /* u32 */
@@ -365,6 +382,14 @@ extern "C" {
         uint8_t eh_generation[4];       /* u32 */
     } ext2fs_extent_header;
 
+#define EXT2_EXTENT_MAGIC	0xF30A
+
+/* Extent tree blocks (not the root in the inode) end with a crc32c of
+ * the block up to the tail, which follows the eh_max entries. */
+    typedef struct ext2fs_extent_tail {
+        uint8_t et_checksum[4]; /* u32 */
+    } ext2fs_extent_tail;
+
 /* MODE */
 #define EXT2_IN_FMT  0170000
 #define EXT2_IN_SOCK 0140000
@@ -411,6 +436,9 @@ extern "C" {
 #define EXT2_IN_EXTENTS                 0x00080000      /* Inode uses extents */
 #define EXT2_IN_EA_INODE                0x00200000      /* Inode used for large EA */
 #define EXT2_IN_EOFBLOCKS               0x00400000      /* Blocks allocated beyond EOF */
+#define EXT2_IN_ENCRYPT                 0x00000800      /* Encrypted file (ext4 reuses ECOMPR) */
+#define EXT2_IN_INLINE_DATA             0x10000000      /* Data stored in the inode */
+#define EXT2_IN_CASEFOLD                0x40000000      /* Casefolded directory */
 #define EXT2_IN_RESERVED                0x80000000      /* reserved for ext4 lib */
 #define EXT2_IN_USER_VISIBLE            0x004BDFFF      /* User visible flags */
 #define EXT2_IN_USER_MODIFIABLE         0x004B80FF      /* User modifiable flags */
@@ -455,6 +483,49 @@ extern "C" {
 #define EXT2_DE_V2	2
 
 
+/*
+ * Hash-indexed (htree) directories.  The root is stored in the first
+ * block after the "." and ".." entries and the interior nodes are
+ * stored in blocks that look like a single empty directory entry.
+ */
+    typedef struct {
+        uint8_t reserved_zero[4];       /* u32 */
+        uint8_t hash_version;   /* u8 */
+        uint8_t info_length;    /* u8 */
+        uint8_t indirect_levels;        /* u8 */
+        uint8_t unused_flags;   /* u8 */
+    } ext2fs_dx_root_info;
+
+/* The first entry of each node stores the limit and count in place of
+ * its hash (the hash of the first entry is always 0) */
+    typedef struct {
+        uint8_t limit[2];       /* u16 */
+        uint8_t count[2];       /* u16 */
+    } ext2fs_dx_countlimit;
+
+    typedef struct {
+        uint8_t hash[4];        /* u32 */
+        uint8_t block[4];       /* u32 */
+    } ext2fs_dx_entry;
+
+#define EXT2_DX_ROOT_INFO_OFF   24      /* after the "." and ".." entries */
+#define EXT2_DX_NODE_OFF        8       /* after the empty directory entry */
+#define EXT2_DX_BLOCK_MASK      0x0fffffff
+#define EXT2_DX_MAX_LEVELS      3
+
+/* Directory hash versions */
+#define EXT2_HASH_LEGACY                0
+#define EXT2_HASH_HALF_MD4              1
+#define EXT2_HASH_TEA                   2
+#define EXT2_HASH_LEGACY_UNSIGNED       3
+#define EXT2_HASH_HALF_MD4_UNSIGNED     4
+#define EXT2_HASH_TEA_UNSIGNED          5
+
+/* Superblock s_flags */
+#define EXT2_FLAGS_SIGNED_HASH          0x0001
+#define EXT2_FLAGS_UNSIGNED_HASH        0x0002
+
+
 
 
 /* Extended Attributes
@@ -478,6 +549,7 @@ extern "C" {
 #define EXT2_EA_IDX_TRUSTED                4
 #define EXT2_EA_IDX_LUSTRE                 5
 #define EXT2_EA_IDX_SECURITY               6
+#define EXT2_EA_IDX_SYSTEM                 7
 
 /* Entries follow the header and are aligned to 4-byte boundaries
  * the value of the attribute is stored at the bottom of the block
@@ -495,6 +567,18 @@ extern "C" {
 #define EXT2_EA_LEN(nlen) \
 	((((nlen) + 19 ) / 4) * 4)
 
+/* Extended attributes can also be stored in the inode after the
+ * i_extra_isize bytes.  The value offsets are relative to the first
+ * entry, which directly follows the magic value. */
+#define EXT2_GOOD_OLD_INODE_SIZE	128
+
+/* Inline data (EXT4FS_FEATURE_INCOMPAT_INLINEDATA) is stored in i_block
+ * and continues in the "system.data" extended attribute in the inode.
+ * Inline directories start with the parent inode instead of "." and
+ * "..", and the entries in i_block and the attribute are separate. */
+#define EXT4_MIN_INLINE_DATA_SIZE	((EXT2FS_NDADDR + EXT2FS_NIADDR) * 4)
+#define EXT4_INLINE_DOTDOT_SIZE		4
+
 
     typedef struct {
         uint8_t ver[4];
@@ -540,6 +624,8 @@ extern "C" {
 #define JBD2_FEATURE_INCOMPAT_REVOKE        0x00000001
 #define JBD2_FEATURE_INCOMPAT_64BIT         0x00000002
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT  0x00000004
+#define JBD2_FEATURE_INCOMPAT_CSUM_V2       0x00000008
+#define JBD2_FEATURE_INCOMPAT_CSUM_V3       0x00000010
 
     typedef struct {
         uint8_t magic[4];
@@ -616,6 +702,26 @@ extern "C" {
         uint8_t flag[4];
     } ext2fs_journ_dentry;
 
+/* Descriptor table entry with the CSUM_V3 feature */
+    typedef struct {
+        uint8_t fs_blk[4];
+        uint8_t flag[4];
+        uint8_t fs_blk_hi[4];
+        uint8_t chksum[4];
+    } ext2fs_journ_dentry3;
+
+/* Size of the checksum tail at the end of descriptor blocks (CSUM_V2/V3) */
+#define EXT2_J_DESC_TAIL_SIZE	4
+
+
+/* Entry in the index of the journal: one journal copy of a FS block */
+    typedef struct {
+        TSK_DADDR_T fsblk;      /* FS block that the copy is of */
+        TSK_DADDR_T jblk;       /* journal block that holds the copy */
+        uint32_t seq;           /* transaction that wrote it */
+        uint8_t unalloc;        /* 1 if the transaction was checkpointed */
+    } EXT2FS_JINDEX_ENTRY;
+
 
 /* Journal Info */
     typedef struct {
@@ -630,10 +736,43 @@ extern "C" {
         uint32_t start_seq;
         TSK_DADDR_T start_blk;
 
+        uint32_t feature_compat;
+        uint32_t feature_incompat;
+
+        /* Index of the journal data blocks, sorted by FS block, then
+         * by sequence.  Built on first use by ext2fs_jindex_build() */
+        EXT2FS_JINDEX_ENTRY *jindex;
+        size_t jindex_cnt;
+        uint8_t jindex_built;
+        uint8_t *jesc;          /* bitmap of journal blocks that were escaped */
+
     } EXT2FS_JINFO;
 
 
 
+    /*
+     * Entry in the cache of block and inode allocation bitmaps
+     */
+    typedef struct EXT2FS_BITMAP_ENTRY EXT2FS_BITMAP_ENTRY;
+    struct EXT2FS_BITMAP_ENTRY {
+        EXT2FS_BITMAP_ENTRY *prev;      /* more recently used entry */
+        EXT2FS_BITMAP_ENTRY *next;      /* less recently used entry */
+        EXT2_GRPNUM_T grp_num;  /* group that the bitmap is for */
+        uint8_t is_imap;        /* 1 for an inode bitmap and 0 for a block bitmap */
+        uint8_t *buf;           /* bitmap (one block, stored after the entry) */
+    };
+
+    /*
+     * Entry in the cache of ext4 extent tree blocks
+     */
+    typedef struct EXT2FS_EXTENT_BLOCK EXT2FS_EXTENT_BLOCK;
+    struct EXT2FS_EXTENT_BLOCK {
+        EXT2FS_EXTENT_BLOCK *prev;      /* more recently used entry */
+        EXT2FS_EXTENT_BLOCK *next;      /* less recently used entry */
+        TSK_DADDR_T addr;       /* address of the block */
+        uint8_t *buf;           /* block content (stored after the entry) */
+    };
+
     /*
      * Structure of an ext2fs file system handle.
      */
@@ -641,20 +780,22 @@ extern "C" {
         TSK_FS_INFO fs_info;    /* super class */
         ext2fs_sb *fs;          /* super block */
 
-        /* lock protects grp_buf, grp_num, bmap_buf, bmap_grp_num, imap_buf, imap_grp_num */
+        /* lock protects map_head, map_tail, map_cnt, ext_head, ext_tail, ext_cnt */
         tsk_lock_t lock;
 
-        // one of the below will be allocated and populated by ext2fs_group_load depending on the FS type
-        ext4fs_gd *ext4_grp_buf; /* cached group descriptor for 64-bit ext4 r/w shared - lock */
-        ext2fs_gd *grp_buf;     /* cached group descriptor for ext2,ext3,32-bit ext4 r/w shared - lock */
+        // group descriptor table, read at open and accessed with ext2fs_group_get (read only after open)
+        uint8_t *grp_tbl;       /* ext4fs_gd for 64-bit ext4 (grp_64bit), ext2fs_gd for ext2,ext3,32-bit ext4 */
+        size_t grp_desc_size;   /* size of each descriptor in grp_tbl */
+        EXT2_GRPNUM_T grp_tbl_cnt;      /* number of descriptors that were read into grp_tbl */
+        uint8_t grp_64bit;      /* 1 if grp_tbl has 64-bit ext4 descriptors */
 
-        EXT2_GRPNUM_T grp_num;  /* cached group number r/w shared - lock */
+        EXT2FS_BITMAP_ENTRY *map_head;  /* most recently used allocation bitmap r/w shared - lock */
+        EXT2FS_BITMAP_ENTRY *map_tail;  /* least recently used allocation bitmap r/w shared - lock */
+        size_t map_cnt;         /* number of bitmaps in the cache r/w shared - lock */
 
-        uint8_t *bmap_buf;      /* cached block allocation bitmap r/w shared - lock */
-        EXT2_GRPNUM_T bmap_grp_num;     /* cached block bitmap nr r/w shared - lock */
-
-        uint8_t *imap_buf;      /* cached inode allocation bitmap r/w shared - lock */
-        EXT2_GRPNUM_T imap_grp_num;     /* cached inode bitmap nr r/w shared - lock */
+        EXT2FS_EXTENT_BLOCK *ext_head;  /* most recently used extent tree block r/w shared - lock */
+        EXT2FS_EXTENT_BLOCK *ext_tail;  /* least recently used extent tree block r/w shared - lock */
+        size_t ext_cnt;         /* number of extent tree blocks in the cache r/w shared - lock */
 
         TSK_OFF_T groups_offset;        /* offset to first group desc */
         EXT2_GRPNUM_T groups_count;     /* nr of descriptor group blocks */
@@ -666,14 +807,22 @@ extern "C" {
     } EXT2FS_INFO;
 
 
+    extern uint8_t ext2fs_dinode_load(EXT2FS_INFO * ext2fs,
+        TSK_INUM_T dino_inum, ext2fs_inode * dino_buf);
     extern TSK_RETVAL_ENUM
         ext2fs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
         TSK_INUM_T a_addr);
+    extern int8_t ext2fs_dir_lookup(TSK_FS_INFO * a_fs,
+        TSK_INUM_T a_dir_addr, const char *a_name, TSK_INUM_T * a_result,
+        TSK_FS_NAME * a_fs_name);
     extern uint8_t ext2fs_jentry_walk(TSK_FS_INFO *, int,
         TSK_FS_JENTRY_WALK_CB, void *);
     extern uint8_t ext2fs_jblk_walk(TSK_FS_INFO *, TSK_DADDR_T,
         TSK_DADDR_T, int, TSK_FS_JBLK_WALK_CB, void *);
     extern uint8_t ext2fs_jopen(TSK_FS_INFO *, TSK_INUM_T);
+    extern uint8_t ext2fs_jentry_find(TSK_FS_INFO *, TSK_DADDR_T,
+        TSK_FS_JENTRY_WALK_CB, void *);
+    extern void ext2fs_jclose(EXT2FS_INFO *);
 
 #ifdef __cplusplus
 }
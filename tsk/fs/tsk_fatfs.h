@@ -51,10 +51,9 @@
 #define FATFS_NUM_VIRT_FILES(fatfs) \
     (fatfs->numfat + 2)
 
-/* size of FAT to read into FATFS_INFO each time */
-/* This must be at least 1024 bytes or else fat12 will get messed up */
-#define FATFS_FAT_CACHE_N		4       // number of caches
-#define FATFS_FAT_CACHE_B		4096
+/* number of FAT entries to read into the in-memory FAT table each time */
+/* This must be even or else fat12 chunks will not start on a byte boundary */
+#define FATFS_FAT_CHUNK_N		65536
 
 #define FATFS_MASTER_BOOT_RECORD_SIZE 512
 
@@ -198,12 +197,13 @@ extern "C" {
     struct FATFS_INFO {
         TSK_FS_INFO fs_info;    /* super class */
 
-        /* FAT cache */
-        /* cache_lock protects fatc_buf, fatc_addr, fatc_ttl */
+        /* In-memory copy of the FAT, with the entries masked and in host
+         * order.  It is loaded FATFS_FAT_CHUNK_N entries at a time as they
+         * are needed.  cache_lock protects fat_chunks; a chunk does not
+         * change once it has been loaded, so it can be read without the lock. */
         tsk_lock_t cache_lock;
-        char fatc_buf[FATFS_FAT_CACHE_N][FATFS_FAT_CACHE_B];        //r/w shared - lock
-        TSK_DADDR_T fatc_addr[FATFS_FAT_CACHE_N];     // r/w shared - lock
-        uint8_t fatc_ttl[FATFS_FAT_CACHE_N];  //r/w shared - lock
+        uint32_t **fat_chunks;  //r/w shared - lock
+        TSK_DADDR_T fat_chunk_cnt;      // number of entries in fat_chunks
 
         /* First sector of FAT */
         TSK_DADDR_T firstfatsect;
@@ -244,6 +244,9 @@ extern "C" {
         tsk_lock_t dir_lock;    //< Lock that protects inum2par.
         void *inum2par;         //< Maps subfolder metadata address to parent folder metadata addresses.
 
+        tsk_lock_t dir_sectors_lock;    //< Lock that protects dir_sectors.
+        uint8_t *dir_sectors;   //< Bitmap of sectors allocated to directories, made by the first inode walk that needs it.
+
 		char boot_sector_buffer[FATFS_MASTER_BOOT_RECORD_SIZE];
         int using_backup_boot_sector;
 
@@ -312,6 +315,10 @@ extern "C" {
     extern TSK_FS_BLOCK_FLAG_ENUM
     fatfs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr);
 
+    extern TSK_DADDR_T
+    fatfs_block_getflags_run(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr,
+        TSK_DADDR_T a_end, TSK_FS_BLOCK_FLAG_ENUM * a_flags);
+
     extern TSK_FS_ATTR_TYPE_ENUM
     fatfs_get_default_attr_type(const TSK_FS_FILE * a_file);
 
@@ -320,6 +327,11 @@ extern "C" {
     extern uint8_t fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust,
         TSK_DADDR_T * value);
 
+    extern TSK_DADDR_T fatfs_getFAT_run(FATFS_INFO * fatfs,
+        TSK_DADDR_T a_clust, TSK_DADDR_T a_max, TSK_DADDR_T * a_next);
+
+    extern void fatfs_fat_chunks_free(FATFS_INFO * fatfs);
+
     extern uint8_t 
     fatfs_dir_buf_add(FATFS_INFO * fatfs, TSK_INUM_T par_inum, TSK_INUM_T dir_inum); 
 
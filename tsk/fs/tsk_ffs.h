@@ -471,6 +471,17 @@ extern "C" {
 
 
 
+/*
+ * Entry in the cache of cylinder group descriptors
+ */
+    typedef struct FFS_GRP_ENTRY FFS_GRP_ENTRY;
+    struct FFS_GRP_ENTRY {
+        FFS_GRP_ENTRY *prev;    /* more recently used entry */
+        FFS_GRP_ENTRY *next;    /* less recently used entry */
+        FFS_GRPNUM_T grp_num;   /* cylinder group that is cached */
+        char *buf;              /* cylinder group block (ffsbsize_b bytes, stored after the entry) */
+    };
+
 /*
  * Structure of a fast file system handle.
  */
@@ -481,15 +492,15 @@ extern "C" {
             ffs_sb2 *sb2;       /* super block buffer */
         } fs;
 
-        /* lock protects itbl_buf, itbl_addr, grp_buf, grp_num, grp_addr */
+        /* lock protects itbl_buf, itbl_addr, grp_head, grp_tail, grp_cnt */
         tsk_lock_t lock;
 
         char *itbl_buf;         ///< Cached inode block buffer (r/w shared - lock)
         TSK_DADDR_T itbl_addr;  ///< Address where inode block buf was read from (r/w shared - lock)
 
-        char *grp_buf;          ///< Cached cylinder group buffer (r/w shared - lock)
-        FFS_GRPNUM_T grp_num;   ///< Cyl grp num that is cached (r/w shared - lock)
-        TSK_DADDR_T grp_addr;   ///< Address where cached cyl grp data was read from (r/w shared - lock)
+        FFS_GRP_ENTRY *grp_head;        ///< Most recently used cylinder group (r/w shared - lock)
+        FFS_GRP_ENTRY *grp_tail;        ///< Least recently used cylinder group (r/w shared - lock)
+        size_t grp_cnt;         ///< Number of cylinder groups in the cache (r/w shared - lock)
 
         FFS_GRPNUM_T groups_count;      /* nr of descriptor group blocks */
 
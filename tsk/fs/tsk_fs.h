@@ -49,6 +49,8 @@ extern "C" {
 
     typedef struct TSK_FS_INFO TSK_FS_INFO;
     typedef struct TSK_FS_FILE TSK_FS_FILE;
+    typedef struct TSK_FS_META_CACHE TSK_FS_META_CACHE;
+    typedef struct TSK_FS_META_CACHE_ENTRY TSK_FS_META_CACHE_ENTRY;
 
 
 
@@ -89,7 +91,8 @@ extern "C" {
         TSK_FS_BLOCK_WALK_FLAG_UNALLOC = 0x02,  ///< Unallocated blocks
         TSK_FS_BLOCK_WALK_FLAG_CONT = 0x04,     ///< Blocks that could store file content
         TSK_FS_BLOCK_WALK_FLAG_META = 0x08,     ///< Blocks that could store file system metadata
-        TSK_FS_BLOCK_WALK_FLAG_AONLY = 0x10     ///< Do not include content in callback only address and allocation status
+        TSK_FS_BLOCK_WALK_FLAG_AONLY = 0x10,    ///< Do not include content in callback only address and allocation status
+        TSK_FS_BLOCK_WALK_FLAG_RUNS = 0x20      ///< Call the callback once per run of consecutive blocks that have the same flags (see TSK_FS_BLOCK::len)
     };
     typedef enum TSK_FS_BLOCK_WALK_FLAG_ENUM TSK_FS_BLOCK_WALK_FLAG_ENUM;
 
@@ -104,6 +107,7 @@ extern "C" {
         char *buf;              ///< Buffer with block data (of size TSK_FS_INFO::block_size)
         TSK_DADDR_T addr;       ///< Address of block
         TSK_FS_BLOCK_FLAG_ENUM flags;   /// < Flags for block (alloc or unalloc)
+        TSK_DADDR_T len;        ///< Number of consecutive blocks starting at addr that this structure describes (and that are in buf). Always 1 unless TSK_FS_BLOCK_WALK_FLAG_RUNS was given to tsk_fs_block_walk().
     } TSK_FS_BLOCK;
 
 
@@ -113,6 +117,10 @@ extern "C" {
     * @param a_block Pointer to block structure that holds block content and flags
     * @param a_ptr Pointer that was supplied by the caller who called tsk_fs_block_walk
     * @returns Value to identify if walk should continue, stop, or stop because of error
+    *
+    * With TSK_FS_BLOCK_WALK_FLAG_RUNS, a_block describes TSK_FS_BLOCK::len blocks and
+    * its buffer holds the content of all of them (unless TSK_FS_BLOCK_WALK_FLAG_AONLY
+    * was also given).  A long run can be split over several callbacks.
     */
     typedef TSK_WALK_RET_ENUM(*TSK_FS_BLOCK_WALK_CB) (const TSK_FS_BLOCK *
         a_block, void *a_ptr);
@@ -147,9 +155,18 @@ extern "C" {
     typedef enum {
         TSK_FS_ATTR_RUN_FLAG_NONE = 0x00,       ///< No Flag
         TSK_FS_ATTR_RUN_FLAG_FILLER = 0x01,     ///< Entry is a filler for a run that has not been seen yet in the processing (or has been lost)
-        TSK_FS_ATTR_RUN_FLAG_SPARSE = 0x02      ///< Entry is a sparse run where all data in the run is zeros
+        TSK_FS_ATTR_RUN_FLAG_SPARSE = 0x02,     ///< Entry is a sparse run where all data in the run is zeros
+        TSK_FS_ATTR_RUN_FLAG_UNRESOLVED = 0x04  ///< Entry stands for runs that the file system has not loaded yet (addr is file system specific).  They are loaded when the attribute is read or walked or by tsk_fs_attr_resolve().
     } TSK_FS_ATTR_RUN_FLAG_ENUM;
 
+    /*
+     * Note that reading or walking a non-resident attribute can change
+     * its run list: UNRESOLVED runs are replaced by the runs that they
+     * stand for (under TSK_FS_INFO::attr_run_lock).  Several threads can
+     * read or walk the same attribute at once, but call
+     * tsk_fs_attr_resolve() before using TSK_FS_ATTR::nrd directly.
+     */
+
 
     typedef struct TSK_FS_ATTR_RUN TSK_FS_ATTR_RUN;
 
@@ -272,7 +289,7 @@ extern "C" {
     */
     struct TSK_FS_ATTR {
         TSK_FS_ATTR *next;      ///< Pointer to next attribute in list
-        TSK_FS_FILE *fs_file;   ///< Pointer to the file that this is from
+        TSK_FS_FILE *fs_file;   ///< Pointer to the file that this is from (a file owned by the metadata cache, without a name, if the metadata is shared)
         TSK_FS_ATTR_FLAG_ENUM flags;    ///< Flags for attribute
         char *name;             ///< Name of attribute (in UTF-8).  Will be NULL if attribute doesn't have a name. 
         size_t name_size;       ///< Number of bytes allocated to name
@@ -322,6 +339,7 @@ extern "C" {
     extern uint8_t tsk_fs_attr_walk(const TSK_FS_ATTR * a_fs_attr,
         TSK_FS_FILE_WALK_FLAG_ENUM a_flags, TSK_FS_FILE_WALK_CB a_action,
         void *a_ptr);
+    extern uint8_t tsk_fs_attr_resolve(const TSK_FS_ATTR * a_fs_attr);
 
     //@}
 
@@ -424,7 +442,8 @@ extern "C" {
 
     typedef enum TSK_FS_META_CONTENT_TYPE_ENUM {
         TSK_FS_META_CONTENT_TYPE_DEFAULT = 0x0,
-        TSK_FS_META_CONTENT_TYPE_EXT4_EXTENTS = 0x1     ///< Ext4 with extents instead of individual pointers
+        TSK_FS_META_CONTENT_TYPE_EXT4_EXTENTS = 0x1,    ///< Ext4 with extents instead of individual pointers
+        TSK_FS_META_CONTENT_TYPE_EXT4_INLINE = 0x2      ///< Ext4 with data stored in the inode instead of blocks
     } TSK_FS_META_CONTENT_TYPE_ENUM;
 
 
@@ -500,6 +519,8 @@ extern "C" {
 
         TSK_FS_META_NAME_LIST *name2;   ///< Name of file stored in metadata (FATXX and NTFS Only)
         char *link;             ///< Name of target file if this is a symbolic link
+
+        TSK_FS_META_CACHE_ENTRY *cache_entry;   ///< \internal Metadata cache entry if this structure is shared between files (NULL if it belongs to a single file)
     } TSK_FS_META;
 
 
@@ -531,9 +552,60 @@ extern "C" {
         TSK_INUM_T a_end, TSK_FS_META_FLAG_ENUM a_flags,
         TSK_FS_META_WALK_CB a_cb, void *a_ptr);
 
+    /**
+    * Callback for tsk_fs_meta_walk_content().  Called for every file that
+    * meets the criteria of the walk.
+    * @param a_fs_file Pointer to the current file
+    * @param a_fs_attr Default data attribute of the file (NULL if it is not a regular file or has none)
+    * @param a_buf Resident content of the attribute or NULL if it must be read from the image
+    * @param a_len Number of bytes in a_buf
+    * @param a_ptr Pointer that was specified by caller to the walk
+    * @returns Value that tells the walk to continue or stop
+    */
+    typedef TSK_WALK_RET_ENUM(*TSK_FS_META_CONTENT_WALK_CB) (TSK_FS_FILE *
+        a_fs_file, const TSK_FS_ATTR * a_fs_attr, const char *a_buf,
+        size_t a_len, void *a_ptr);
+
+    extern uint8_t tsk_fs_meta_walk_content(TSK_FS_INFO * a_fs,
+        TSK_INUM_T a_start, TSK_INUM_T a_end,
+        TSK_FS_META_FLAG_ENUM a_flags, TSK_FS_META_CONTENT_WALK_CB a_cb,
+        void *a_ptr);
+
+    /**
+    * Flags used by tsk_fs_meta_walk_parallel() to control how the results
+    * are passed to the callback.
+    */
+    typedef enum {
+        TSK_FS_META_WALK_PAR_FLAG_NONE = 0x00,  ///< Call the callback from the worker threads as structures are found
+        TSK_FS_META_WALK_PAR_FLAG_ORDERED = 0x01,       ///< Call the callback from the calling thread in address order
+    } TSK_FS_META_WALK_PAR_FLAG_ENUM;
+
+    extern uint8_t tsk_fs_meta_walk_parallel(TSK_FS_INFO * a_fs,
+        TSK_INUM_T a_start, TSK_INUM_T a_end,
+        TSK_FS_META_FLAG_ENUM a_flags, TSK_FS_META_WALK_CB a_cb,
+        void *a_ptr, unsigned int a_threads,
+        TSK_FS_META_WALK_PAR_FLAG_ENUM a_par_flags);
+
     extern uint8_t tsk_fs_meta_make_ls(const TSK_FS_META * a_fs_meta,
         char *a_buf, size_t a_len);
 
+    /**
+    * Usage statistics for the metadata cache of a file system.
+    * See tsk_fs_meta_cache_set_size(). 
+    */
+    typedef struct {
+        size_t size;            ///< Maximum number of structures in the cache (0 if disabled)
+        size_t used;            ///< Number of structures currently in the cache
+        uint64_t hits;          ///< Number of lookups that were served from the cache
+        uint64_t misses;        ///< Number of lookups that had to load the structure from disk
+        uint64_t evictions;     ///< Number of structures removed to make room for others
+    } TSK_FS_META_CACHE_STATS;
+
+    extern uint8_t tsk_fs_meta_cache_set_size(TSK_FS_INFO * a_fs,
+        size_t a_count);
+    extern uint8_t tsk_fs_meta_cache_get_stats(TSK_FS_INFO * a_fs,
+        TSK_FS_META_CACHE_STATS * a_stats);
+
     //@}
 
     /************* NAME / DIR structures **********/
@@ -606,6 +678,10 @@ extern "C" {
     * @param a_path Path of the file
     * @param a_ptr Pointer that was originally passed by caller to tsk_fs_dir_walk.
     * @returns Value to signal if tsk_fs_dir_walk should stop or continue. 
+    *
+    * The name in a_fs_file is owned by the directory being walked and its strings
+    * are released in bulk when that directory is finished.  It must not be modified
+    * or freed and must be copied if it is needed after the callback returns.
     */
     typedef TSK_WALK_RET_ENUM(*TSK_FS_DIR_WALK_CB) (TSK_FS_FILE *
         a_fs_file, const char *a_path, void *a_ptr);
@@ -628,6 +704,8 @@ extern "C" {
         uint32_t seq;           ///< Metadata address sequence (NTFS Only)
 
         TSK_FS_INFO *fs_info;   ///< Pointer to file system the directory is located in
+
+        struct TSK_FS_DIR_ARENA *name_arena;    ///< \internal Blocks that the name strings in names are carved from
     } TSK_FS_DIR;
 
     /**
@@ -654,6 +732,8 @@ extern "C" {
     extern TSK_FS_FILE *tsk_fs_dir_get(const TSK_FS_DIR *, size_t);
     extern const TSK_FS_NAME *tsk_fs_dir_get_name(const TSK_FS_DIR * a_fs_dir, size_t a_idx);
     extern void tsk_fs_dir_close(TSK_FS_DIR *);
+    extern void tsk_fs_dir_set_orphan_threads(TSK_FS_INFO * a_fs,
+        unsigned int a_threads);
 
     extern int8_t tsk_fs_path2inum(TSK_FS_INFO * a_fs, const char *a_path,
         TSK_INUM_T * a_result, TSK_FS_NAME * a_fs_name);
@@ -741,9 +821,20 @@ extern "C" {
     /** \name Generic File System Journal Data Structures */
     //@{
 
+    /**
+    * Flags for a journal entry (TSK_FS_JENTRY.flags).
+    */
+    typedef enum {
+        TSK_FS_JENTRY_FLAG_ALLOC = 0x01,        ///< Entry is in the active part of the journal
+        TSK_FS_JENTRY_FLAG_UNALLOC = 0x02,      ///< Entry is from a transaction that has already been checkpointed
+    } TSK_FS_JENTRY_FLAG_ENUM;
+
     typedef struct {
         TSK_DADDR_T jblk;       /* journal block address */
-        TSK_DADDR_T fsblk;      /* fs block that journal entry is about */
+        TSK_DADDR_T fsblk;      /* fs block that journal entry is about (0 if it is about metadata_addr) */
+        uint64_t seq;           /* transaction (sequence) that wrote the entry */
+        TSK_FS_JENTRY_FLAG_ENUM flags;  /* allocation status of the entry */
+        TSK_INUM_T meta_addr;   /* metadata address that the entry is about (NTFS change journal), 0 if it is about fsblk */
     } TSK_FS_JENTRY;
 
     typedef TSK_WALK_RET_ENUM(*TSK_FS_JBLK_WALK_CB) (TSK_FS_INFO *, char *,
@@ -866,7 +957,8 @@ extern "C" {
     enum TSK_FS_INFO_FLAG_ENUM {
         TSK_FS_INFO_FLAG_NONE = 0x00,   ///< No Flags
         TSK_FS_INFO_FLAG_HAVE_SEQ = 0x01,       ///< File system has sequence numbers in the inode addresses.
-        TSK_FS_INFO_FLAG_HAVE_NANOSEC = 0x02    ///< Nano second field in times will be set.
+        TSK_FS_INFO_FLAG_HAVE_NANOSEC = 0x02,   ///< Nano second field in times will be set.
+        TSK_FS_INFO_FLAG_PAR_INODE_WALK = 0x04  ///< \internal inode_walk can be called from several threads at once (see tsk_fs_meta_walk_parallel())
     };
     typedef enum TSK_FS_INFO_FLAG_ENUM TSK_FS_INFO_FLAG_ENUM;
 
@@ -892,6 +984,7 @@ extern "C" {
         TSK_INUM_T root_inum;   ///< Metadata address of root directory  
         TSK_INUM_T first_inum;  ///< First valid metadata address
         TSK_INUM_T last_inum;   ///< Last valid metadata address
+        TSK_INUM_T inum_group_size;     ///< \internal Number of metadata addresses in each group that the file system stores together (ExtX inodes per group), 0 if there are no groups
 
         /* content */
         TSK_DADDR_T block_count;        ///< Number of blocks in fs
@@ -919,22 +1012,35 @@ extern "C" {
 
         TSK_ENDIAN_ENUM endian; ///< Endian order of data
 
-        /* list_inum_named_lock protects list_inum_named */
-        tsk_lock_t list_inum_named_lock;        // taken when r/w the list_inum_named list
-        TSK_LIST *list_inum_named;      /**< List of unallocated inodes that
-                                        * are pointed to by a file name -- 
-                                        * Used to find orphan files.  Is filled 
-                                        * after looking for orphans
-                                        * or afer a full name_walk is performed.
+        /* inum_named_lock protects inum_named, list_inum_named and inum_named_loaded */
+        tsk_lock_t inum_named_lock;     // taken when r/w the inum_named bitmap or list
+        uint8_t *inum_named;    /**< Bitmap (indexed by address) of unallocated
+                                        * metadata structures that are pointed to
+                                        * by a file name -- Used to find orphan files.
+                                        * Is filled after looking for orphans
+                                        * or after a full name_walk is performed and
+                                        * kept until the file system is closed.
+                                        * NULL if the file system has too many
+                                        * addresses for a bitmap.
                                         * (r/w shared - lock) */
+        TSK_LIST *list_inum_named;      ///< List of the same addresses, used instead of inum_named when the bitmap would be too large (r/w shared - lock)
+        uint8_t inum_named_loaded;      ///< Set once inum_named or list_inum_named has been filled in (r/w shared - lock)
 
         /* orphan_hunt_lock protects orphan_dir */
         tsk_lock_t orphan_dir_lock;     // taken for the duration of orphan hunting (not just when updating orphan_dir)
         TSK_FS_DIR *orphan_dir; ///< Files and dirs in the top level of the $OrphanFiles directory.  NULL if orphans have not been hunted for yet. (r/w shared - lock) 
+        unsigned int orphan_threads;    ///< \internal Number of threads used to search for orphan files (see tsk_fs_dir_set_orphan_threads())
+
+        TSK_FS_META_CACHE *meta_cache;  ///< \internal Cache of loaded metadata structures used by tsk_fs_file_open_meta() (has its own lock)
+
+        /* attr_run_lock protects the run lists of non-resident attributes
+         * while UNRESOLVED runs in them are replaced */
+        tsk_lock_t attr_run_lock;       // taken when resolving runs
 
          uint8_t(*block_walk) (TSK_FS_INFO * fs, TSK_DADDR_T start, TSK_DADDR_T end, TSK_FS_BLOCK_WALK_FLAG_ENUM flags, TSK_FS_BLOCK_WALK_CB cb, void *ptr);    ///< FS-specific function: Call tsk_fs_block_walk() instead. 
 
          TSK_FS_BLOCK_FLAG_ENUM(*block_getflags) (TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr);      ///< \internal
+         TSK_DADDR_T(*block_getflags_run) (TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr, TSK_DADDR_T a_end, TSK_FS_BLOCK_FLAG_ENUM * a_flags);        ///< \internal Optional. Get the flags of a_addr and the number of blocks up to a_end that have the same flags (0 on error)
 
          uint8_t(*inode_walk) (TSK_FS_INFO * fs, TSK_INUM_T start, TSK_INUM_T end, TSK_FS_META_FLAG_ENUM flags, TSK_FS_META_WALK_CB cb, void *ptr);     ///< FS-specific function: Call tsk_fs_meta_walk() instead. 
 
@@ -944,6 +1050,8 @@ extern "C" {
 
          uint8_t(*load_attrs) (TSK_FS_FILE *);  ///< \internal
 
+         uint8_t(*attr_resolve_run) (TSK_FS_ATTR * a_fs_attr, const TSK_FS_ATTR_RUN * a_run, TSK_FS_ATTR_RUN ** a_runs);       ///< \internal Optional. Load the runs that an UNRESOLVED run of a_fs_attr stands for into a_runs (1 on error)
+
 
         /**
         * Pointer to file system specific function that prints details on a specific file to a file handle. 
@@ -967,6 +1075,8 @@ extern "C" {
 
          uint8_t(*jentry_walk) (TSK_FS_INFO *, int, TSK_FS_JENTRY_WALK_CB, void *);     ///< \internal
 
+         uint8_t(*jentry_find) (TSK_FS_INFO *, TSK_DADDR_T, TSK_FS_JENTRY_WALK_CB, void *);     ///< \internal Calls the callback for each journal copy of a FS block.  NULL if not supported.
+
          uint8_t(*fsstat) (TSK_FS_INFO * fs, FILE * hFile);     ///< \internal
 
         int (*name_cmp) (TSK_FS_INFO *, const char *, const char *);    ///< \internal
@@ -1462,7 +1572,7 @@ class TskFsAttribute {
     * @return A run in the attribute.
     */
     const TskFsAttrRun *getRun(int a_idx) const {
-        if (m_fsAttr != NULL) {
+        if ((m_fsAttr != NULL) && (tsk_fs_attr_resolve(m_fsAttr) == 0)) {
             TSK_FS_ATTR_RUN *run = m_fsAttr->nrd.run;
             int i = 0;
             while (run != NULL) {
@@ -1479,7 +1589,7 @@ class TskFsAttribute {
      */
     int getRunCount() const {
         int size = 0;
-        if (m_fsAttr != NULL) {
+        if ((m_fsAttr != NULL) && (tsk_fs_attr_resolve(m_fsAttr) == 0)) {
             TSK_FS_ATTR_RUN *run = m_fsAttr->nrd.run;
             while (run != NULL) {
                 size++;
@@ -2255,6 +2365,18 @@ class TskFsBlock {
             return (TSK_FS_BLOCK_FLAG_ENUM) 0;
     };
 
+    /**
+        * Get number of consecutive blocks that this object describes
+    * (only larger than 1 when TSK_FS_BLOCK_WALK_FLAG_RUNS is used)
+    * @return number of blocks
+    */
+    TSK_DADDR_T getLen() const {
+        if (m_fsBlock != NULL)
+            return m_fsBlock->len;
+        else
+            return 0;
+    };
+
   private:
     /**
         * Get pointer to file system that block is from
@@ -84,6 +84,13 @@ extern "C" {
     extern TSK_FS_BLOCK *tsk_fs_block_alloc(TSK_FS_INFO * fs);
     extern int tsk_fs_block_set(TSK_FS_INFO * fs, TSK_FS_BLOCK * fs_block,
         TSK_DADDR_T a_addr, TSK_FS_BLOCK_FLAG_ENUM a_flags, char *a_buf);
+    extern TSK_DADDR_T tsk_fs_block_getflags_run(TSK_FS_INFO * a_fs,
+        TSK_DADDR_T a_addr, TSK_DADDR_T a_end,
+        TSK_FS_BLOCK_FLAG_ENUM * a_flags);
+    extern size_t tsk_fs_bitmap_run(const uint8_t * a_map, size_t a_bit,
+        size_t a_end, uint8_t a_msb);
+    extern uint64_t tsk_fs_bitmap_count(const uint8_t * a_map,
+        size_t a_bit, size_t a_end);
 
     /* FS_DATA */
     extern TSK_FS_ATTR *tsk_fs_attr_alloc(TSK_FS_ATTR_FLAG_ENUM);
@@ -129,6 +136,47 @@ extern "C" {
     extern void tsk_fs_meta_reset(TSK_FS_META *);
     extern void tsk_fs_meta_close(TSK_FS_META * fs_meta);
 
+    /* FS_META cache */
+    struct TSK_FS_META_CACHE_ENTRY {
+        TSK_FS_FILE fs_file;    // owned by the cache, the attributes of fs_file.meta point to it
+        TSK_FS_META_CACHE *cache;
+        int refs;               // number of open files using fs_file.meta (r/w shared - cache lock)
+        uint8_t in_cache;       // 0 if entry was removed from the cache while files had it open
+        TSK_FS_META_CACHE_ENTRY *hnext; // next entry in hash chain
+        TSK_FS_META_CACHE_ENTRY *lru_prev;      // more recently used entry
+        TSK_FS_META_CACHE_ENTRY *lru_next;      // less recently used entry
+    };
+
+    struct TSK_FS_META_CACHE {
+        tsk_lock_t lock;        // protects everything below and the entries
+        size_t size;            // maximum number of entries (0 if disabled)
+        size_t used;            // number of entries in the cache
+        TSK_FS_META_CACHE_ENTRY **buckets;
+        size_t bucket_cnt;      // power of 2
+        TSK_FS_META_CACHE_ENTRY *lru_head;      // most recently used
+        TSK_FS_META_CACHE_ENTRY *lru_tail;      // least recently used
+        size_t detached;        // number of entries that are open but no longer in the cache
+        uint8_t closed;         // set when the file system has been closed
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+    };
+    extern TSK_FS_META_CACHE *tsk_fs_meta_cache_alloc();
+    extern void tsk_fs_meta_cache_free(TSK_FS_META_CACHE *);
+    extern TSK_FS_META *tsk_fs_meta_cache_get(TSK_FS_INFO *, TSK_INUM_T);
+    extern void tsk_fs_meta_cache_add(TSK_FS_INFO *, TSK_FS_META *);
+    extern uint8_t tsk_fs_meta_cache_release(TSK_FS_META *);
+
+    /* Parallel loops (fs_parallel.c) */
+    typedef void (*TSK_FS_PAR_FOR_CB) (void *a_ptr, size_t a_idx);
+    extern void tsk_fs_par_for(unsigned int a_threads, size_t a_cnt,
+        TSK_FS_PAR_FOR_CB a_func, void *a_ptr);
+    typedef struct TSK_FS_PAR_POOL TSK_FS_PAR_POOL;
+    extern TSK_FS_PAR_POOL *tsk_fs_par_pool_start(unsigned int a_threads);
+    extern void tsk_fs_par_pool_run(TSK_FS_PAR_POOL * a_pool, size_t a_cnt,
+        TSK_FS_PAR_FOR_CB a_func, void *a_ptr);
+    extern void tsk_fs_par_pool_stop(TSK_FS_PAR_POOL * a_pool);
+
     /* FS_FILE */
     extern TSK_FS_FILE *tsk_fs_file_alloc(TSK_FS_INFO *);
 
@@ -166,6 +214,17 @@ extern "C" {
     extern void tsk_fs_name_print_mac_md5(FILE *, const TSK_FS_FILE *,
         const char *, const TSK_FS_ATTR * fs_attr, const char *, int32_t,
 		const unsigned char *);
+    /* Block of memory that the name strings of a TSK_FS_DIR are
+     * carved from so that they can be released in bulk. */
+    typedef struct TSK_FS_DIR_ARENA {
+        struct TSK_FS_DIR_ARENA *next;  // next (older) block in the list
+        size_t size;            // number of bytes in buf
+        size_t used;            // number of bytes in buf that have been handed out
+        char buf[1];            // start of the string data
+    } TSK_FS_DIR_ARENA;
+
+#define TSK_FS_DIR_ARENA_BSIZE  8192
+
     extern uint8_t tsk_fs_name_copy(TSK_FS_NAME * a_fs_name_to,
         const TSK_FS_NAME * a_fs_name_from);
     extern void tsk_fs_name_reset(TSK_FS_NAME * a_fs_name);
@@ -531,6 +531,16 @@ extern "C" {
         size_t used;            ///< Number of records used in the buffer (size depends on type of data stored)
     } NTFS_SXX_BUFFER;
 
+/************************************************************************
+ * Hash table entry that maps a security id to its $SII entry and the
+ * owner SID string (which is created the first time it is needed)
+ */
+    typedef struct {
+        uint32_t sec_id;        ///< Security id (0 if the entry is empty)
+        uint32_t sii_idx;       ///< Index of the entry in NTFS_INFO.sii_data
+        char *sid_str;          ///< Owner SID string or NULL if not created yet
+    } NTFS_SID_ENTRY;
+
 
 
 /************************************************************************
@@ -606,7 +616,140 @@ extern "C" {
 #endif
 
 
+/************************************************************************
+ * Change journal ($Extend/$UsnJrnl:$J) records
+ */
+
+#define NTFS_USN_REASON_DATA_OVERWRITE          0x00000001
+#define NTFS_USN_REASON_DATA_EXTEND             0x00000002
+#define NTFS_USN_REASON_DATA_TRUNCATION         0x00000004
+#define NTFS_USN_REASON_NAMED_DATA_OVERWRITE    0x00000010
+#define NTFS_USN_REASON_NAMED_DATA_EXTEND       0x00000020
+#define NTFS_USN_REASON_NAMED_DATA_TRUNCATION   0x00000040
+#define NTFS_USN_REASON_FILE_CREATE             0x00000100
+#define NTFS_USN_REASON_FILE_DELETE             0x00000200
+#define NTFS_USN_REASON_EA_CHANGE               0x00000400
+#define NTFS_USN_REASON_SECURITY_CHANGE         0x00000800
+#define NTFS_USN_REASON_RENAME_OLD_NAME         0x00001000
+#define NTFS_USN_REASON_RENAME_NEW_NAME         0x00002000
+#define NTFS_USN_REASON_INDEXABLE_CHANGE        0x00004000
+#define NTFS_USN_REASON_BASIC_INFO_CHANGE       0x00008000
+#define NTFS_USN_REASON_HARD_LINK_CHANGE        0x00010000
+#define NTFS_USN_REASON_COMPRESSION_CHANGE      0x00020000
+#define NTFS_USN_REASON_ENCRYPTION_CHANGE       0x00040000
+#define NTFS_USN_REASON_OBJECT_ID_CHANGE        0x00080000
+#define NTFS_USN_REASON_REPARSE_POINT_CHANGE    0x00100000
+#define NTFS_USN_REASON_STREAM_CHANGE           0x00200000
+#define NTFS_USN_REASON_TRANSACTED_CHANGE       0x00400000
+#define NTFS_USN_REASON_INTEGRITY_CHANGE        0x00800000
+#define NTFS_USN_REASON_CLOSE                   0x80000000
+
+/* Version 2 record */
+    typedef struct {
+        uint8_t length[4];      /* Size of the record */
+        uint8_t major[2];       /* Major version (2) */
+        uint8_t minor[2];       /* Minor version */
+        uint8_t file_ref[6];    /* File reference of the file that changed */
+        uint8_t seq[2];
+        uint8_t par_ref[6];     /* File reference of its parent directory */
+        uint8_t par_seq[2];
+        uint8_t usn[8];         /* USN (offset in $J) of the record */
+        uint8_t time[8];        /* Time of the change */
+        uint8_t reason[4];      /* NTFS_USN_REASON_ flags */
+        uint8_t source[4];      /* Source information */
+        uint8_t sec_id[4];      /* Security Id of the file */
+        uint8_t attr[4];        /* File attribute flags */
+        uint8_t nlen[2];        /* Length of the name (in bytes) */
+        uint8_t noff[2];        /* Offset of the name in the record */
+    } ntfs_usn_rec2;
+
+/* Version 3 record (128-bit file references) */
+    typedef struct {
+        uint8_t length[4];      /* Size of the record */
+        uint8_t major[2];       /* Major version (3) */
+        uint8_t minor[2];       /* Minor version */
+        uint8_t file_ref[16];   /* File reference of the file that changed */
+        uint8_t par_ref[16];    /* File reference of its parent directory */
+        uint8_t usn[8];         /* USN (offset in $J) of the record */
+        uint8_t time[8];        /* Time of the change */
+        uint8_t reason[4];      /* NTFS_USN_REASON_ flags */
+        uint8_t source[4];      /* Source information */
+        uint8_t sec_id[4];      /* Security Id of the file */
+        uint8_t attr[4];        /* File attribute flags */
+        uint8_t nlen[2];        /* Length of the name (in bytes) */
+        uint8_t noff[2];        /* Offset of the name in the record */
+    } ntfs_usn_rec3;
+
+/************************************************************************
+ * Decoded change journal record, as passed to ntfs_usn_walk() callbacks
+ */
+    typedef struct {
+        TSK_OFF_T usn;          ///< Update sequence number (offset of the record in $J)
+        uint16_t major;         ///< Major version of the record
+        uint16_t minor;         ///< Minor version of the record
+        TSK_INUM_T addr;        ///< MFT entry of the file that changed
+        uint16_t seq;           ///< Sequence number of the file
+        TSK_INUM_T par_addr;    ///< MFT entry of the parent directory
+        uint16_t par_seq;       ///< Sequence number of the parent directory
+        uint64_t time;          ///< Time of the change (NT time)
+        uint32_t reason;        ///< NTFS_USN_REASON_ flags
+        uint32_t source;        ///< Source information
+        uint32_t sec_id;        ///< Security Id of the file
+        uint32_t attr;          ///< File attribute flags
+        const char *name;       ///< UTF-8 name of the file (only valid during the callback)
+    } NTFS_USN_ENTRY;
+
+/**
+ * Callback for ntfs_usn_walk().  It is called with all of the records
+ * that were decoded from one buffer of the journal.
+ */
+    typedef TSK_WALK_RET_ENUM(*NTFS_USN_WALK_CB) (TSK_FS_INFO *,
+        const NTFS_USN_ENTRY *, size_t, void *);
+
+/************************************************************************
+ * Journal opened by ntfs_jopen()
+ */
+    typedef struct {
+        TSK_FS_FILE *fs_file;   ///< Journal file
+        const TSK_FS_ATTR *fs_attr;     ///< Attribute with the journal data ($J or the $LogFile $Data)
+        TSK_INUM_T j_inum;      ///< Address of the journal file
+        uint8_t is_usn;         ///< 1 if the journal is the change journal, 0 if it is $LogFile
+    } NTFS_JINFO;
+
+
+/************************************************************************
+ * Entry in the index of the $MFT $Data runs that is built at open time
+ */
+    typedef struct {
+        TSK_OFF_T off;          ///< Byte offset of the run in the $MFT
+        TSK_OFF_T len;          ///< Length of the run in bytes
+        TSK_OFF_T addr;         ///< Byte address of the run in the file system
+        TSK_FS_ATTR_RUN_FLAG_ENUM flags;        ///< Flags of the run
+        uint32_t cross_len;     ///< If non-zero, number of bytes of the last entry that are in this run (the rest starts the next run)
+    } NTFS_MFT_RUN;
+
+
+/************************************************************************
+ * Entry in the cache of decompressed compression units.  Units are
+ * identified by the clusters that store them.
+ */
+    typedef struct NTFS_COMP_CACHE_ENTRY NTFS_COMP_CACHE_ENTRY;
+    struct NTFS_COMP_CACHE_ENTRY {
+        NTFS_COMP_CACHE_ENTRY *prev;    ///< More recently used entry
+        NTFS_COMP_CACHE_ENTRY *next;    ///< Less recently used entry
+        TSK_DADDR_T *addrs;     ///< Cluster addresses of the unit
+        uint32_t addr_cnt;      ///< Number of addresses in addrs
+        uint32_t compsize;      ///< Size of a compression unit (in clusters) of the attribute
+        char *data;             ///< Decompressed data
+        size_t data_len;        ///< Number of bytes in data
+    };
+
+
 
+/************************************************************************
+ * Scratch buffers for processing attribute lists (defined in ntfs.c)
+ */
+    typedef struct NTFS_ATTRLIST_SCRATCH NTFS_ATTRLIST_SCRATCH;
 
 
 /************************************************************************
@@ -622,15 +765,19 @@ extern "C" {
         uint32_t mft_rsize_b;   /* number of bytes per mft record */
         uint32_t idx_rsize_b;   /* number of bytes per idx record */
         TSK_DADDR_T root_mft_addr;      /* address of first mft entry */
+        NTFS_MFT_RUN *mft_runs; /* index of the mft_data runs, sorted by offset (read only after open) */
+        size_t mft_runs_cnt;    /* number of entries in mft_runs */
 
         uint8_t loading_the_MFT;        /* set to 1 when initializing the setup */
 
         TSK_FS_ATTR_RUN *bmap;  /* Run of bitmap for clusters (linked list) */
+        TSK_DADDR_T bmap_clust_cnt;     /* number of $Bitmap clusters that cover the file system */
+        size_t bmap_chunk_cnt;  /* number of entries in bmap_chunks */
 
-        /* lock protects bmap_buf, bmap_buf_off */
+        /* lock protects bmap_chunks, bmap_loaded */
         tsk_lock_t lock;
-        char *bmap_buf;         /* buffer to hold cached copy of bitmap (r/w shared - lock)  */
-        TSK_DADDR_T bmap_buf_off;       /* offset cluster in cached bitmap  (r/w shared - lock) */
+        uint8_t **bmap_chunks;  /* in-memory copy of $Bitmap, NTFS_BMAP_CHUNK clusters per buffer, allocated as needed (r/w shared - lock) */
+        uint8_t *bmap_loaded;   /* 1 for each $Bitmap cluster that has been read into bmap_chunks (r/w shared - lock) */
 
         ntfs_attrdef *attrdef;  // buffer of attrdef file contents
         size_t attrdef_len;     // length of addrdef buffer
@@ -639,13 +786,27 @@ extern "C" {
         tsk_lock_t orphan_map_lock;
         void *orphan_map;       // map that lists par directory to its orphans. (r/w shared - lock) 
 
+        /* comp_cache_lock protects comp_cache_head, comp_cache_tail, comp_cache_cnt */
+        tsk_lock_t comp_cache_lock;
+        NTFS_COMP_CACHE_ENTRY *comp_cache_head; // most recently used decompressed unit (r/w shared - lock)
+        NTFS_COMP_CACHE_ENTRY *comp_cache_tail; // least recently used decompressed unit (r/w shared - lock)
+        size_t comp_cache_cnt;  // number of units in the cache (r/w shared - lock)
+
+        /* attrlist_pool_lock protects attrlist_pool */
+        tsk_lock_t attrlist_pool_lock;
+        NTFS_ATTRLIST_SCRATCH *attrlist_pool;   // unused scratch buffers for ntfs_proc_attrlist (r/w shared - lock)
+
 #if TSK_USE_SID
-        /* sid_lock protects sii_data, sds_data */
+        /* sid_lock protects sii_data, sds_data, sid_map */
         tsk_lock_t sid_lock;
         NTFS_SXX_BUFFER sii_data;       // (r/w shared - lock) 
         NTFS_SXX_BUFFER sds_data;       // (r/w shared - lock) 
+        NTFS_SID_ENTRY *sid_map;        // hash table of the security ids in sii_data (r/w shared - lock)
+        size_t sid_map_size;    // number of entries in sid_map (a power of 2)
 #endif
 
+        NTFS_JINFO *jinfo;      // journal opened with ntfs_jopen()
+
         uint32_t alloc_file_count;      // number of allocated regular files, will be -1
                                         // until a directory is opened.
     } NTFS_INFO;
@@ -659,8 +820,22 @@ extern "C" {
     extern TSK_RETVAL_ENUM ntfs_dir_open_meta(TSK_FS_INFO * a_fs,
         TSK_FS_DIR ** a_fs_dir, TSK_INUM_T a_addr);
 
+    extern int8_t ntfs_dir_lookup(TSK_FS_INFO * a_fs,
+        TSK_INUM_T a_dir_addr, const char *a_name, TSK_INUM_T * a_result,
+        TSK_FS_NAME * a_fs_name);
+
     extern void ntfs_orphan_map_free(NTFS_INFO * a_ntfs);
 
+    extern uint8_t ntfs_jopen(TSK_FS_INFO * fs, TSK_INUM_T inum);
+    extern uint8_t ntfs_jentry_walk(TSK_FS_INFO * fs, int flags,
+        TSK_FS_JENTRY_WALK_CB a_action, void *ptr);
+    extern uint8_t ntfs_jblk_walk(TSK_FS_INFO * fs, TSK_DADDR_T start,
+        TSK_DADDR_T end, int flags, TSK_FS_JBLK_WALK_CB a_action,
+        void *ptr);
+    extern void ntfs_jclose(NTFS_INFO * ntfs);
+    extern uint8_t ntfs_usn_walk(TSK_FS_INFO * fs,
+        NTFS_USN_WALK_CB a_action, void *ptr);
+
     extern int ntfs_name_cmp(TSK_FS_INFO *, const char *, const char *);
 
     extern uint8_t ntfs_find_file(TSK_FS_INFO * fs, TSK_INUM_T inode_toid,
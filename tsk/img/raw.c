@@ -260,6 +260,10 @@ raw_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf, size_t len)
                 len -= read_len;
 
                 while (len > 0) {
+                    /* stop at the end of the last image segment */
+                    if (i + 1 >= raw_info->img_info.num_img)
+                        break;
+
                     /* go to the next image segment */
                     i++;
 
@@ -0,0 +1,64 @@
+/*
+ * crc_test.cpp
+ *
+ * The Sleuth Kit
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+#include <libtsk.h>
+#include <cstring>
+
+// tsk/base/crc.h defines its own bool and can not be included from C++
+extern "C" {
+uint32_t tsk_crc32c(uint32_t crc, const void *buf, size_t len);
+uint32_t tsk_crc32c_sw(uint32_t crc, const void *buf, size_t len);
+}
+
+#include "crc_test.h"
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( CrcTest );
+
+void CrcTest::setUp() {}
+void CrcTest::tearDown() {}
+
+// Standard CRC32C check value.  tsk_crc32c() uses whichever of the
+// SSE 4.2, ARM or table versions the CPU supports; tsk_crc32c_sw()
+// is always the table version.
+void CrcTest::testKnownAnswer() {
+	const char *check = "123456789";
+
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 0xE3069283,
+		(uint32_t) ~tsk_crc32c(~(uint32_t) 0, check, 9));
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 0xE3069283,
+		(uint32_t) ~tsk_crc32c_sw(~(uint32_t) 0, check, 9));
+
+	// 32 bytes of zeros (RFC 3720, B.4)
+	uint8_t zeros[32];
+	memset(zeros, 0, sizeof(zeros));
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 0x8A9136AA,
+		(uint32_t) ~tsk_crc32c(~(uint32_t) 0, zeros, sizeof(zeros)));
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 0x8A9136AA,
+		(uint32_t) ~tsk_crc32c_sw(~(uint32_t) 0, zeros, sizeof(zeros)));
+}
+
+// The hardware versions process 8 and 4 bytes at a time, so compare
+// them with the table version for every length and alignment of a
+// short buffer and for a CRC that is carried over between calls.
+void CrcTest::testSoftwareMatches() {
+	uint8_t buf[80];
+	for (unsigned i = 0; i < sizeof(buf); i++)
+		buf[i] = (uint8_t) (i * 37 + 11);
+
+	for (unsigned off = 0; off < 8; off++) {
+		for (unsigned len = 0; off + len <= sizeof(buf); len++) {
+			CPPUNIT_ASSERT_EQUAL(tsk_crc32c_sw(0x12345678, buf + off, len),
+				tsk_crc32c(0x12345678, buf + off, len));
+		}
+	}
+
+	uint32_t crc = tsk_crc32c(~(uint32_t) 0, buf, 13);
+	crc = tsk_crc32c(crc, buf + 13, sizeof(buf) - 13);
+	CPPUNIT_ASSERT_EQUAL(tsk_crc32c_sw(~(uint32_t) 0, buf, sizeof(buf)), crc);
+}
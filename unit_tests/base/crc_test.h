@@ -0,0 +1,30 @@
+/*
+ * crc_test.h
+ *
+ * The Sleuth Kit
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+#ifndef CRC_TEST_H_
+#define CRC_TEST_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class CrcTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( CrcTest );
+  CPPUNIT_TEST(testKnownAnswer);
+  CPPUNIT_TEST(testSoftwareMatches);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void testKnownAnswer();
+  void testSoftwareMatches();
+};
+
+
+#endif /* CRC_TEST_H_ */